@@ -2099,14 +2099,14 @@ __kernel void cl_barrett32_76(__private uint exponent, const int96_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC32(exponent, tid, k_tab, k_base, &f);
+  calculate_FC32(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_76: exp=%d, b=%x:%x:%x:%x:%x:%x, k_base=%x:%x:%x, f=%x:%x:%x, shift=%d\n",
-        exponent, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        EXPONENT, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett32_76(exponent << (32 - shiftcount), f, tid, bb, RES
+  check_barrett32_76(EXPONENT << (32 - SHIFTCOUNT), f, tid, bb, RES
                      MODBASECASE_PAR);
 }
 
@@ -2128,14 +2128,14 @@ __kernel void cl_barrett32_77(__private uint exponent, const int96_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC32(exponent, tid, k_tab, k_base, &f);
+  calculate_FC32(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_77: exp=%d, b=%x:%x:%x:%x:%x:%x, k_base=%x:%x:%x, f=%x:%x:%x, shift=%d\n",
-        exponent, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        EXPONENT, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett32_77(exponent << (32 - shiftcount), f, tid, bb, RES
+  check_barrett32_77(EXPONENT << (32 - SHIFTCOUNT), f, tid, bb, RES
                      MODBASECASE_PAR);
 }
 
@@ -2157,14 +2157,14 @@ __kernel void cl_barrett32_79(__private uint exponent, const int96_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC32(exponent, tid, k_tab, k_base, &f);
+  calculate_FC32(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_79: exp=%d, b=%x:%x:%x:%x:%x:%x, k_base=%x:%x:%x, f=%x:%x:%x, shift=%d\n",
-        exponent, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        EXPONENT, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett32_79(exponent << (32 - shiftcount), f, tid, bb, RES
+  check_barrett32_79(EXPONENT << (32 - SHIFTCOUNT), f, tid, bb, RES
                      MODBASECASE_PAR);
 }
 
@@ -2186,14 +2186,14 @@ __kernel void cl_barrett32_87(__private uint exponent, const int96_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC32(exponent, tid, k_tab, k_base, &f);
+  calculate_FC32(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_87: exp=%d, b=%x:%x:%x:%x:%x:%x, k_base=%x:%x:%x, f=%x:%x:%x, shift=%d\n",
-        exponent, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        EXPONENT, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett32_87(exponent << (32 - shiftcount), f, tid, bb, bit_max65, RES
+  check_barrett32_87(EXPONENT << (32 - SHIFTCOUNT), f, tid, bb, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -2215,14 +2215,14 @@ __kernel void cl_barrett32_88(__private uint exponent, const int96_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC32(exponent, tid, k_tab, k_base, &f);
+  calculate_FC32(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_88: exp=%d, b=%x:%x:%x:%x:%x:%x, k_base=%x:%x:%x, f=%x:%x:%x, shift=%d\n",
-        exponent, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        EXPONENT, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett32_88(exponent << (32 - shiftcount), f, tid, bb, bit_max65, RES
+  check_barrett32_88(EXPONENT << (32 - SHIFTCOUNT), f, tid, bb, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -2244,13 +2244,13 @@ __kernel void cl_barrett32_92(__private uint exponent, const int96_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC32(exponent, tid, k_tab, k_base, &f);
+  calculate_FC32(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_92: exp=%d, b=%x:%x:%x:%x:%x:%x, k_base=%x:%x:%x, f=%x:%x:%x, shift=%d\n",
-        exponent, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        EXPONENT, bb.d5, bb.d4, bb.d3, bb.d2, bb.d1, bb.d0, k_base.d2, k_base.d1, k_base.d0, V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
-  check_barrett32_92(exponent << (32 - shiftcount), f, tid, bb, bit_max65, RES
+  check_barrett32_92(EXPONENT << (32 - SHIFTCOUNT), f, tid, bb, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -2264,7 +2264,7 @@ __kernel void cl_barrett32_92(__private uint exponent, const int96_t k_base, con
  ****************************************
  ****************************************/
 
-__kernel void cl_barrett32_76_gs(__private uint exponent, const int96_t k_base,
+__kernel void cl_barrett32_76_gs(__private uint exponent, const int96_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount,
@@ -2274,7 +2274,8 @@ __kernel void cl_barrett32_76_gs(__private uint exponent, const int96_t k_base,
                                  __private int192_t bb,
 #endif
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF)
 /*
 shiftcount is used for precomputing without mod
@@ -2285,6 +2286,9 @@ a is precomputed on host ONCE.
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int96_v  my_k_base, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int96_t  k_base = class_k_base96(k_base_in, class_delta[class_index]);
   __private uint_v   tmp_v;
 #ifdef WA_FOR_CATALYST11_10_BUG
   __private int192_t bb={b_in.s0, b_in.s1, b_in.s2, b_in.s3, b_in.s4, b_in.s5};
@@ -2297,12 +2301,17 @@ a is precomputed on host ONCE.
 tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_76_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_76_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -2310,11 +2319,11 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
 #if (TRACE_KERNEL > 3)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_76_gs: shift=%d, shifted exp=%#x\n",
-        shiftcount, initial_shifter_value);
+        SHIFTCOUNT, initial_shifter_value);
 #endif
 #ifdef INTEL
   // WA for another bug
@@ -2331,45 +2340,45 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -2383,10 +2392,10 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
     my_k_base.d1 = k_base.d1 + mul_hi(NUM_CLASSES, k_delta) - AS_UINT_V(k_base.d0 > my_k_base.d0);	/* k is limited to 2^64 -1 so there is no need for k.d2 */
 #endif
 
-    f.d0   = my_k_base.d0 * exponent;
-    tmp_v  = mul_hi(my_k_base.d0, exponent);
-    f.d1   = my_k_base.d1 * exponent + tmp_v;
-    f.d2   = mul_hi(my_k_base.d1, exponent) - AS_UINT_V(f.d1 < tmp_v);
+    f.d0   = my_k_base.d0 * EXPONENT;
+    tmp_v  = mul_hi(my_k_base.d0, EXPONENT);
+    f.d1   = my_k_base.d1 * EXPONENT + tmp_v;
+    f.d2   = mul_hi(my_k_base.d1, EXPONENT) - AS_UINT_V(f.d1 < tmp_v);
 
 #if (TRACE_KERNEL > 2)
     if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_76_gs: x: smem[%d]=%d, k_delta=%d, k=%x:%x, k*p=%x:%x:%x\n",
@@ -2409,7 +2418,7 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
   }
 }
 
-__kernel void cl_barrett32_77_gs(__private uint exponent, const int96_t k_base,
+__kernel void cl_barrett32_77_gs(__private uint exponent, const int96_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount,
@@ -2419,7 +2428,8 @@ __kernel void cl_barrett32_77_gs(__private uint exponent, const int96_t k_base,
                                  __private int192_t bb,
 #endif
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF)
 /*
 shiftcount is used for precomputing without mod
@@ -2430,6 +2440,9 @@ a is precomputed on host ONCE.
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int96_v  my_k_base, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int96_t  k_base = class_k_base96(k_base_in, class_delta[class_index]);
   __private uint_v   tmp_v;
 #ifdef WA_FOR_CATALYST11_10_BUG
   __private int192_t bb={b_in.s0, b_in.s1, b_in.s2, b_in.s3, b_in.s4, b_in.s5};
@@ -2442,12 +2455,17 @@ a is precomputed on host ONCE.
 tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_77_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_77_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -2455,11 +2473,11 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
 #if (TRACE_KERNEL > 3)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_77_gs: shift=%d, shifted exp=%#x\n",
-        shiftcount, initial_shifter_value);
+        SHIFTCOUNT, initial_shifter_value);
 #endif
 #ifdef INTEL
   // WA for another bug
@@ -2476,45 +2494,45 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -2528,10 +2546,10 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
     my_k_base.d1 = k_base.d1 + mul_hi(NUM_CLASSES, k_delta) - AS_UINT_V(k_base.d0 > my_k_base.d0);	/* k is limited to 2^64 -1 so there is no need for k.d2 */
 #endif
 
-    f.d0   = my_k_base.d0 * exponent;
-    tmp_v  = mul_hi(my_k_base.d0, exponent);
-    f.d1   = my_k_base.d1 * exponent + tmp_v;
-    f.d2   = mul_hi(my_k_base.d1, exponent) - AS_UINT_V(f.d1 < tmp_v);
+    f.d0   = my_k_base.d0 * EXPONENT;
+    tmp_v  = mul_hi(my_k_base.d0, EXPONENT);
+    f.d1   = my_k_base.d1 * EXPONENT + tmp_v;
+    f.d2   = mul_hi(my_k_base.d1, EXPONENT) - AS_UINT_V(f.d1 < tmp_v);
 
 #if (TRACE_KERNEL > 2)
     if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_77_gs: x: smem[%d]=%d, k_delta=%d, k=%x:%x, k*p=%x:%x:%x\n",
@@ -2554,7 +2572,7 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
   }
 }
 
-__kernel void cl_barrett32_79_gs(__private uint exponent, const int96_t k_base,
+__kernel void cl_barrett32_79_gs(__private uint exponent, const int96_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount,
@@ -2564,7 +2582,8 @@ __kernel void cl_barrett32_79_gs(__private uint exponent, const int96_t k_base,
                                  __private int192_t bb,
 #endif
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF)
 /*
 shiftcount is used for precomputing without mod
@@ -2575,6 +2594,9 @@ a is precomputed on host ONCE.
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int96_v  my_k_base, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int96_t  k_base = class_k_base96(k_base_in, class_delta[class_index]);
   __private uint_v   tmp_v;
 #ifdef WA_FOR_CATALYST11_10_BUG
   __private int192_t bb={b_in.s0, b_in.s1, b_in.s2, b_in.s3, b_in.s4, b_in.s5};
@@ -2587,12 +2609,17 @@ a is precomputed on host ONCE.
 tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_79_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_79_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -2600,11 +2627,11 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
 #if (TRACE_KERNEL > 3)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_79_gs: shift=%d, shifted exp=%#x\n",
-        shiftcount, initial_shifter_value);
+        SHIFTCOUNT, initial_shifter_value);
 #endif
 #ifdef INTEL
   // WA for another bug
@@ -2621,45 +2648,45 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -2673,10 +2700,10 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
     my_k_base.d1 = k_base.d1 + mul_hi(NUM_CLASSES, k_delta) - AS_UINT_V(k_base.d0 > my_k_base.d0);	/* k is limited to 2^64 -1 so there is no need for k.d2 */
 #endif
 
-    f.d0   = my_k_base.d0 * exponent;
-    tmp_v  = mul_hi(my_k_base.d0, exponent);
-    f.d1   = my_k_base.d1 * exponent + tmp_v;
-    f.d2   = mul_hi(my_k_base.d1, exponent) - AS_UINT_V(f.d1 < tmp_v);
+    f.d0   = my_k_base.d0 * EXPONENT;
+    tmp_v  = mul_hi(my_k_base.d0, EXPONENT);
+    f.d1   = my_k_base.d1 * EXPONENT + tmp_v;
+    f.d2   = mul_hi(my_k_base.d1, EXPONENT) - AS_UINT_V(f.d1 < tmp_v);
 
 #if (TRACE_KERNEL > 2)
     if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_79_gs: x: smem[%d]=%d, k_delta=%d, k=%x:%x, k*p=%x:%x:%x\n",
@@ -2699,7 +2726,7 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
   }
 }
 
-__kernel void cl_barrett32_87_gs(__private uint exponent, const int96_t k_base,
+__kernel void cl_barrett32_87_gs(__private uint exponent, const int96_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount,
@@ -2709,7 +2736,8 @@ __kernel void cl_barrett32_87_gs(__private uint exponent, const int96_t k_base,
                                  __private int192_t bb,
 #endif
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF)
 /*
 shiftcount is used for precomputing without mod
@@ -2720,6 +2748,9 @@ a is precomputed on host ONCE.
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int96_v  my_k_base, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int96_t  k_base = class_k_base96(k_base_in, class_delta[class_index]);
   __private uint_v   tmp_v;
 #ifdef WA_FOR_CATALYST11_10_BUG
   __private int192_t bb={b_in.s0, b_in.s1, b_in.s2, b_in.s3, b_in.s4, b_in.s5};
@@ -2732,12 +2763,17 @@ a is precomputed on host ONCE.
 tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_87_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_87_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -2745,11 +2781,11 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
 #if (TRACE_KERNEL > 3)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_87_gs: shift=%d, shifted exp=%#x\n",
-        shiftcount, initial_shifter_value);
+        SHIFTCOUNT, initial_shifter_value);
 #endif
 #ifdef INTEL
   // WA for another bug
@@ -2766,45 +2802,45 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -2818,10 +2854,10 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
     my_k_base.d1 = k_base.d1 + mul_hi(NUM_CLASSES, k_delta) - AS_UINT_V(k_base.d0 > my_k_base.d0);	/* k is limited to 2^64 -1 so there is no need for k.d2 */
 #endif
 
-    f.d0   = my_k_base.d0 * exponent;
-    tmp_v  = mul_hi(my_k_base.d0, exponent);
-    f.d1   = my_k_base.d1 * exponent + tmp_v;
-    f.d2   = mul_hi(my_k_base.d1, exponent) - AS_UINT_V(f.d1 < tmp_v);
+    f.d0   = my_k_base.d0 * EXPONENT;
+    tmp_v  = mul_hi(my_k_base.d0, EXPONENT);
+    f.d1   = my_k_base.d1 * EXPONENT + tmp_v;
+    f.d2   = mul_hi(my_k_base.d1, EXPONENT) - AS_UINT_V(f.d1 < tmp_v);
 
 #if (TRACE_KERNEL > 2)
     if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_87_gs: x: smem[%d]=%d, k_delta=%d, k=%x:%x, k*p=%x:%x:%x\n",
@@ -2839,12 +2875,12 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
         lid, tid, get_group_id(0), i, smem[i], V(k_delta), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett32_87(initial_shifter_value, f, tid, bb, bit_max65, RES
+    check_barrett32_87(initial_shifter_value, f, tid, bb, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
 
-__kernel void cl_barrett32_88_gs(__private uint exponent, const int96_t k_base,
+__kernel void cl_barrett32_88_gs(__private uint exponent, const int96_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount,
@@ -2854,7 +2890,8 @@ __kernel void cl_barrett32_88_gs(__private uint exponent, const int96_t k_base,
                                  __private int192_t bb,
 #endif
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF)
 /*
 shiftcount is used for precomputing without mod
@@ -2865,6 +2902,9 @@ a is precomputed on host ONCE.
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int96_v  my_k_base, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int96_t  k_base = class_k_base96(k_base_in, class_delta[class_index]);
   __private uint_v   tmp_v;
 #ifdef WA_FOR_CATALYST11_10_BUG
   __private int192_t bb={b_in.s0, b_in.s1, b_in.s2, b_in.s3, b_in.s4, b_in.s5};
@@ -2877,12 +2917,17 @@ a is precomputed on host ONCE.
 tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_88_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_88_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -2890,11 +2935,11 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
 #if (TRACE_KERNEL > 3)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_88_gs: shift=%d, shifted exp=%#x\n",
-        shiftcount, initial_shifter_value);
+        SHIFTCOUNT, initial_shifter_value);
 #endif
 #ifdef INTEL
   // WA for another bug
@@ -2911,45 +2956,45 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -2963,10 +3008,10 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
     my_k_base.d1 = k_base.d1 + mul_hi(NUM_CLASSES, k_delta) - AS_UINT_V(k_base.d0 > my_k_base.d0);	/* k is limited to 2^64 -1 so there is no need for k.d2 */
 #endif
 
-    f.d0   = my_k_base.d0 * exponent;
-    tmp_v  = mul_hi(my_k_base.d0, exponent);
-    f.d1   = my_k_base.d1 * exponent + tmp_v;
-    f.d2   = mul_hi(my_k_base.d1, exponent) - AS_UINT_V(f.d1 < tmp_v);
+    f.d0   = my_k_base.d0 * EXPONENT;
+    tmp_v  = mul_hi(my_k_base.d0, EXPONENT);
+    f.d1   = my_k_base.d1 * EXPONENT + tmp_v;
+    f.d2   = mul_hi(my_k_base.d1, EXPONENT) - AS_UINT_V(f.d1 < tmp_v);
 
 #if (TRACE_KERNEL > 2)
     if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_88_gs: x: smem[%d]=%d, k_delta=%d, k=%x:%x, k*p=%x:%x:%x\n",
@@ -2984,12 +3029,12 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
         lid, tid, get_group_id(0), i, smem[i], V(k_delta), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett32_88(initial_shifter_value, f, tid, bb, bit_max65, RES
+    check_barrett32_88(initial_shifter_value, f, tid, bb, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
 
-__kernel void cl_barrett32_92_gs(__private uint exponent, const int96_t k_base,
+__kernel void cl_barrett32_92_gs(__private uint exponent, const int96_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount,
@@ -2999,7 +3044,8 @@ __kernel void cl_barrett32_92_gs(__private uint exponent, const int96_t k_base,
                                  __private int192_t bb,
 #endif
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF)
 /*
 shiftcount is used for precomputing without mod
@@ -3010,6 +3056,9 @@ a is precomputed on host ONCE.
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int96_v  my_k_base, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int96_t  k_base = class_k_base96(k_base_in, class_delta[class_index]);
   __private uint_v   tmp_v;
 #ifdef WA_FOR_CATALYST11_10_BUG
   __private int192_t bb={b_in.s0, b_in.s1, b_in.s2, b_in.s3, b_in.s4, b_in.s5};
@@ -3022,12 +3071,17 @@ a is precomputed on host ONCE.
 tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_92_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett32_92_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -3035,11 +3089,11 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
 #if (TRACE_KERNEL > 3)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_92_gs: shift=%d, shifted exp=%#x\n",
-        shiftcount, initial_shifter_value);
+        SHIFTCOUNT, initial_shifter_value);
 #endif
 #ifdef INTEL
   // WA for another bug
@@ -3056,45 +3110,45 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -3108,10 +3162,10 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
     my_k_base.d1 = k_base.d1 + mul_hi(NUM_CLASSES, k_delta) - AS_UINT_V(k_base.d0 > my_k_base.d0);	/* k is limited to 2^64 -1 so there is no need for k.d2 */
 #endif
 
-    f.d0   = my_k_base.d0 * exponent;
-    tmp_v  = mul_hi(my_k_base.d0, exponent);
-    f.d1   = my_k_base.d1 * exponent + tmp_v;
-    f.d2   = mul_hi(my_k_base.d1, exponent) - AS_UINT_V(f.d1 < tmp_v);
+    f.d0   = my_k_base.d0 * EXPONENT;
+    tmp_v  = mul_hi(my_k_base.d0, EXPONENT);
+    f.d1   = my_k_base.d1 * EXPONENT + tmp_v;
+    f.d2   = mul_hi(my_k_base.d1, EXPONENT) - AS_UINT_V(f.d1 < tmp_v);
 
 #if (TRACE_KERNEL > 2)
     if (tid==TRACE_TID) printf((__constant char *)"cl_barrett32_92_gs: x: smem[%d]=%d, k_delta=%d, k=%x:%x, k*p=%x:%x:%x\n",
@@ -3129,7 +3183,7 @@ tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
         lid, tid, get_group_id(0), i, smem[i], V(k_delta), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett32_92(initial_shifter_value, f, tid, bb, bit_max65, RES
+    check_barrett32_92(initial_shifter_value, f, tid, bb, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
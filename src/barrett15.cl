@@ -1949,14 +1949,14 @@ __kernel void cl_barrett15_69(__private uint exponent, const int75_t k_base, con
 
 	tid = 	mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC75(exponent, tid, k_tab, k_base, &f);
+  calculate_FC75(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 1)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_69: f=%x:%x:%x:%x:%x, shift=%d\n",
-        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett15_69(exponent << (32 - shiftcount), f, tid, b_in, bit_max65, RES
+  check_barrett15_69(EXPONENT << (32 - SHIFTCOUNT), f, tid, b_in, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -1970,14 +1970,14 @@ __kernel void cl_barrett15_70(__private uint exponent, const int75_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC75(exponent, tid, k_tab, k_base, &f);
+  calculate_FC75(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 1)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_70: f=%x:%x:%x:%x:%x, shift=%d\n",
-        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett15_70(exponent << (32 - shiftcount), f, tid, b_in, bit_max65, RES
+  check_barrett15_70(EXPONENT << (32 - SHIFTCOUNT), f, tid, b_in, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -1991,14 +1991,14 @@ __kernel void cl_barrett15_71(__private uint exponent, const int75_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC75(exponent, tid, k_tab, k_base, &f);
+  calculate_FC75(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 1)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_71: f=%x:%x:%x:%x:%x, shift=%d\n",
-        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett15_71(exponent << (32 - shiftcount), f, tid, b_in, bit_max65, RES
+  check_barrett15_71(EXPONENT << (32 - SHIFTCOUNT), f, tid, b_in, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -2012,14 +2012,14 @@ __kernel void cl_barrett15_73(__private uint exponent, const int75_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC75(exponent, tid, k_tab, k_base, &f);
+  calculate_FC75(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 1)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_73: f=%x:%x:%x:%x:%x, shift=%d\n",
-        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett15_73(exponent << (32 - shiftcount), f, tid, b_in, bit_max65, RES
+  check_barrett15_73(EXPONENT << (32 - SHIFTCOUNT), f, tid, b_in, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -2032,14 +2032,14 @@ __kernel void cl_barrett15_74(__private uint exponent, const int75_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC75(exponent, tid, k_tab, k_base, &f);
+  calculate_FC75(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 1)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_74: f=%x:%x:%x:%x:%x, shift=%d\n",
-        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
 
-  check_barrett15_74(exponent << (32 - shiftcount), f, tid, b_in, bit_max65, RES
+  check_barrett15_74(EXPONENT << (32 - SHIFTCOUNT), f, tid, b_in, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -3639,13 +3639,13 @@ __kernel void cl_barrett15_82(__private uint exponent, const int75_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC90(exponent, tid, k_tab, k_base, &f);
+  calculate_FC90(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 1)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_82: tid=%d, f=%x:%x:%x:%x:%x:%x, shift=%d\n",
-        tid, V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        tid, V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
-  check_barrett15_82(exponent << (32 - shiftcount), f, tid, b_in, bit_max65, RES
+  check_barrett15_82(EXPONENT << (32 - SHIFTCOUNT), f, tid, b_in, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -3658,13 +3658,13 @@ __kernel void cl_barrett15_83(__private uint exponent, const int75_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC90(exponent, tid, k_tab, k_base, &f);
+  calculate_FC90(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 1)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_83: tid=%d, f=%x:%x:%x:%x:%x:%x, shift=%d\n",
-        tid, V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        tid, V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
-  check_barrett15_83(exponent << (32 - shiftcount), f, tid, b_in, bit_max65, RES
+  check_barrett15_83(EXPONENT << (32 - SHIFTCOUNT), f, tid, b_in, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
@@ -3677,17 +3677,81 @@ __kernel void cl_barrett15_88(__private uint exponent, const int75_t k_base, con
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;
 
-  calculate_FC90(exponent, tid, k_tab, k_base, &f);
+  calculate_FC90(EXPONENT, tid, k_tab, k_base, &f);
 
 #if (TRACE_KERNEL > 1)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_88: tid=%d, f=%x:%x:%x:%x:%x:%x, shift=%d\n",
-        tid, V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), shiftcount);
+        tid, V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0), SHIFTCOUNT);
 #endif
-  check_barrett15_88(exponent << (32 - shiftcount), f, tid, b_in, bit_max65, RES
+  check_barrett15_88(EXPONENT << (32 - SHIFTCOUNT), f, tid, b_in, BIT_MAX65, RES
                      MODBASECASE_PAR);
 }
 
 
+/****
+ * multi-grid variants of the CPU-sieve kernels above (GridsPerLaunch > 1)
+ *
+ * One launch tests the ktabs of up to 16 grids of get_global_size(0) * VECTOR_SIZE
+ * candidates each. The ktab of grid g starts at g * grid_size, its exponent, k_base and
+ * shiftcount are exponents.s<g>, k_bases.s<g> and shiftcounts.s<g>: the grids of a batch
+ * (BatchExponents > 1) belong to different exponents of the same bit range. jobs.s<g> is
+ * the index of the exponent in the batch, its factors go to the result buffer at
+ * RES + jobs.s<g> * (1 + 3 * RES_FACTORS_MAX) (0 outside a batch). b_in is
+ * 2^(exponent >> shiftcount), it is set up here for each grid. Each thread walks over
+ * the grids with a stride of grid_size, so the launch overhead is spent once per launch
+ * instead of once per grid.
+ ****/
+
+#define BARRETT15_GRIDS_KERNEL(BITS, INT_V, CALCULATE_FC)                                                             \
+__kernel void cl_barrett15_##BITS##_grids(const uint16 exponents, const ulong16 k_bases,                              \
+                              const __global uint * restrict k_tab, const uint16 shiftcounts, const uint16 jobs,      \
+                              const uint grids, __global uint * restrict RES, const int bit_max65                     \
+                              MODBASECASE_PAR_DEF)                                                                    \
+{                                                                                                                     \
+  __private INT_V f;                                                                                                  \
+  __private int75_t k_base;                                                                                           \
+  __private ulong k_grid[16];                                                                                         \
+  __private uint exp_grid[16], shift_grid[16], job_grid[16], b_grid[8];                                               \
+  __private uint tid, grid_size, g, ln2b;                                                                             \
+                                                                                                                      \
+  vstore16(k_bases, 0, k_grid);                                                                                       \
+  vstore16(exponents, 0, exp_grid);                                                                                   \
+  vstore16(shiftcounts, 0, shift_grid);                                                                               \
+  vstore16(jobs, 0, job_grid);                                                                                        \
+  tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), (uint)get_local_id(0)) * VECTOR_SIZE;                   \
+  grid_size = (uint)get_global_size(0) * VECTOR_SIZE;                                                                 \
+                                                                                                                      \
+  for (g = 0; g < grids; g++, tid += grid_size)                                                                       \
+  {                                                                                                                   \
+    k_base.d0 = (uint) k_grid[g] & 0x7FFF;                                                                            \
+    k_base.d1 = (uint)(k_grid[g] >> 15) & 0x7FFF;                                                                     \
+    k_base.d2 = (uint)(k_grid[g] >> 30) & 0x7FFF;                                                                     \
+    k_base.d3 = (uint)(k_grid[g] >> 45) & 0x7FFF;                                                                     \
+    k_base.d4 = (uint)(k_grid[g] >> 60);                                                                              \
+                                                                                                                      \
+    /* the host checks 60 <= ln2b < 180, see run_kernel15_grids() */                                                  \
+    ln2b = (exp_grid[g] >> shift_grid[g]) - 60;                                                                       \
+    vstore8((uint8)0, 0, b_grid);                                                                                     \
+    b_grid[ln2b / 15] = 1 << (ln2b % 15);                                                                             \
+                                                                                                                      \
+    CALCULATE_FC(exp_grid[g], tid, k_tab, k_base, &f);                                                                \
+                                                                                                                      \
+    check_barrett15_##BITS(exp_grid[g] << (32 - shift_grid[g]), f, tid, vload8(0, b_grid), BIT_MAX65,                 \
+                           RES + job_grid[g] * (1 + 3 * RES_FACTORS_MAX)                                              \
+                           MODBASECASE_PAR);                                                                          \
+  }                                                                                                                   \
+}
+
+BARRETT15_GRIDS_KERNEL(69, int75_v, calculate_FC75)
+BARRETT15_GRIDS_KERNEL(70, int75_v, calculate_FC75)
+BARRETT15_GRIDS_KERNEL(71, int75_v, calculate_FC75)
+BARRETT15_GRIDS_KERNEL(73, int75_v, calculate_FC75)
+BARRETT15_GRIDS_KERNEL(74, int75_v, calculate_FC75)
+BARRETT15_GRIDS_KERNEL(82, int90_v, calculate_FC90)
+BARRETT15_GRIDS_KERNEL(83, int90_v, calculate_FC90)
+BARRETT15_GRIDS_KERNEL(88, int90_v, calculate_FC90)
+
+
 #else
 /****************************************
  ****************************************
@@ -3698,29 +3762,38 @@ __kernel void cl_barrett15_88(__private uint exponent, const int75_t k_base, con
 
 
 __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
-              cl_barrett15_69_gs(const uint exponent, const int75_t k_base,
+              cl_barrett15_69_gs(const uint exponent, const int75_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount, const uint8 b_in,
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF         )
 {
   __private uint     i, initial_shifter_value, total_bit_count;
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int75_v  k, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int75_t  k_base = class_k_base75(k_base_in, class_delta[class_index]);
   __private int75_t exp75;
 
 	tid = mad24((uint)get_group_id(0), (uint)get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_69_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_69_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -3728,13 +3801,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
-  exp75.d2=exponent>>29;exp75.d1=(exponent>>14)&0x7FFF;exp75.d0=(exponent<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
+  exp75.d2=EXPONENT>>29;exp75.d1=(EXPONENT>>14)&0x7FFF;exp75.d0=(EXPONENT<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_69_gs: exp=%u, shift=%d, shifted exp=%#x, total_bit_count=%u, shared_mem_size=%u\n",
-        exponent, shiftcount, initial_shifter_value, total_bit_count, shared_mem_allocated);
+        EXPONENT, SHIFTCOUNT, initial_shifter_value, total_bit_count, shared_mem_allocated);
 #endif
 
   for (i = lid*VECTOR_SIZE; i < total_bit_count; i += 256*VECTOR_SIZE) // VECTOR_SIZE*THREADS_PER_BLOCK
@@ -3747,45 +3820,45 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -3828,35 +3901,44 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
         i, smem[i], V(k_delta), V(k.d4), V(k.d3), V(k.d2), V(k.d1), V(k.d0), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett15_69(initial_shifter_value, f, tid, b_in, bit_max65, RES
+    check_barrett15_69(initial_shifter_value, f, tid, b_in, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
 
 __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
-              cl_barrett15_70_gs(const uint exponent, const int75_t k_base,
+              cl_barrett15_70_gs(const uint exponent, const int75_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount, const uint8 b_in,
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF         )
 {
   __private uint     i, initial_shifter_value, total_bit_count;
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int75_v  k, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int75_t  k_base = class_k_base75(k_base_in, class_delta[class_index]);
   __private int75_t exp75;
 
 	tid = mad24(get_group_id(0), get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_70_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_70_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -3864,13 +3946,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
-  exp75.d2=exponent>>29;exp75.d1=(exponent>>14)&0x7FFF;exp75.d0=(exponent<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
+  exp75.d2=EXPONENT>>29;exp75.d1=(EXPONENT>>14)&0x7FFF;exp75.d0=(EXPONENT<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_70_gs: exp=%u, shift=%d, shifted exp=%#x, total_bit_count=%u, shared_mem_size=%u\n",
-        exponent, shiftcount, initial_shifter_value, total_bit_count, shared_mem_allocated);
+        EXPONENT, SHIFTCOUNT, initial_shifter_value, total_bit_count, shared_mem_allocated);
 #endif
 
   for (i = lid*VECTOR_SIZE; i < total_bit_count; i += 256*VECTOR_SIZE) // VECTOR_SIZE*THREADS_PER_BLOCK
@@ -3883,45 +3965,45 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -3964,35 +4046,44 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
         i, smem[i], V(k_delta), V(k.d4), V(k.d3), V(k.d2), V(k.d1), V(k.d0), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett15_70(initial_shifter_value, f, tid, b_in, bit_max65, RES
+    check_barrett15_70(initial_shifter_value, f, tid, b_in, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
 
 __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
-              cl_barrett15_71_gs(const uint exponent, const int75_t k_base,
+              cl_barrett15_71_gs(const uint exponent, const int75_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount, const uint8 b_in,
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF         )
 {
   __private uint     i, initial_shifter_value, total_bit_count;
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int75_v  k, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int75_t  k_base = class_k_base75(k_base_in, class_delta[class_index]);
   __private int75_t exp75;
 
 	tid = mad24(get_group_id(0), get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_71_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_71_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -4000,13 +4091,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
-  exp75.d2=exponent>>29;exp75.d1=(exponent>>14)&0x7FFF;exp75.d0=(exponent<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
+  exp75.d2=EXPONENT>>29;exp75.d1=(EXPONENT>>14)&0x7FFF;exp75.d0=(EXPONENT<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_71_gs: exp=%u, shift=%d, shifted exp=%#x, total_bit_count=%u, shared_mem_size=%u\n",
-        exponent, shiftcount, initial_shifter_value, total_bit_count, shared_mem_allocated);
+        EXPONENT, SHIFTCOUNT, initial_shifter_value, total_bit_count, shared_mem_allocated);
 #endif
 
   for (i = lid*VECTOR_SIZE; i < total_bit_count; i += 256*VECTOR_SIZE) // VECTOR_SIZE*THREADS_PER_BLOCK
@@ -4019,45 +4110,45 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -4100,35 +4191,44 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
         i, smem[i], V(k_delta), V(k.d4), V(k.d3), V(k.d2), V(k.d1), V(k.d0), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett15_71(initial_shifter_value, f, tid, b_in, bit_max65, RES
+    check_barrett15_71(initial_shifter_value, f, tid, b_in, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
 
 __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
-              cl_barrett15_73_gs(const uint exponent, const int75_t k_base,
+              cl_barrett15_73_gs(const uint exponent, const int75_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount, const uint8 b_in,
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF         )
 {
   __private uint     i, initial_shifter_value, total_bit_count;
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int75_v  k, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int75_t  k_base = class_k_base75(k_base_in, class_delta[class_index]);
   __private int75_t exp75;
 
 	tid = mad24(get_group_id(0), get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_73_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_73_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -4136,13 +4236,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
-  exp75.d2=exponent>>29;exp75.d1=(exponent>>14)&0x7FFF;exp75.d0=(exponent<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
+  exp75.d2=EXPONENT>>29;exp75.d1=(EXPONENT>>14)&0x7FFF;exp75.d0=(EXPONENT<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_73_gs: exp=%u, shift=%d, shifted exp=%#x, total_bit_count=%u, shared_mem_size=%u\n",
-        exponent, shiftcount, initial_shifter_value, total_bit_count, shared_mem_allocated);
+        EXPONENT, SHIFTCOUNT, initial_shifter_value, total_bit_count, shared_mem_allocated);
 #endif
 
   for (i = lid*VECTOR_SIZE; i < total_bit_count; i += 256*VECTOR_SIZE) // VECTOR_SIZE*THREADS_PER_BLOCK
@@ -4155,45 +4255,45 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -4236,30 +4336,39 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
         i, smem[i], V(k_delta), V(k.d4), V(k.d3), V(k.d2), V(k.d1), V(k.d0), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett15_73(initial_shifter_value, f, tid, b_in, bit_max65, RES
+    check_barrett15_73(initial_shifter_value, f, tid, b_in, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
 
 __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
-              cl_barrett15_74_gs(const uint exponent, const int75_t k_base,
+              cl_barrett15_74_gs(const uint exponent, const int75_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount, const uint8 b_in,
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF         )
 {
   __private uint     i, initial_shifter_value, total_bit_count;
   __local   ushort   bitcount[256];	// Each thread of our block puts bit-counts here
   __private int75_v  k, f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int75_t  k_base = class_k_base75(k_base_in, class_delta[class_index]);
   __private int75_t exp75;
 
 	tid = mad24(get_group_id(0), get_local_size(0), lid);
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -4267,13 +4376,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
-  exp75.d2=exponent>>29;exp75.d1=(exponent>>14)&0x7FFF;exp75.d0=(exponent<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
+  exp75.d2=EXPONENT>>29;exp75.d1=(EXPONENT>>14)&0x7FFF;exp75.d0=(EXPONENT<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_74_gs: exp=%u, shift=%d, shifted exp=%#x, total_bit_count=%u, shared_mem_size=%u\n",
-        exponent, shiftcount, initial_shifter_value, total_bit_count, shared_mem_allocated);
+        EXPONENT, SHIFTCOUNT, initial_shifter_value, total_bit_count, shared_mem_allocated);
 #endif
 
   for (i = lid*VECTOR_SIZE; i < total_bit_count; i += 256*VECTOR_SIZE) // VECTOR_SIZE*THREADS_PER_BLOCK
@@ -4286,45 +4395,45 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -4367,7 +4476,7 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
         i, smem[i], V(k_delta), V(k.d4), V(k.d3), V(k.d2), V(k.d1), V(k.d0), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett15_74(initial_shifter_value, f, tid, b_in, bit_max65, RES
+    check_barrett15_74(initial_shifter_value, f, tid, b_in, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
@@ -4381,12 +4490,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
  ****************************************/
 
 __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
-              cl_barrett15_82_gs(const uint exponent, const int75_t k_base,
+              cl_barrett15_82_gs(const uint exponent, const int75_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount, const uint8 b_in,
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF         )
 {
   __private uint     i, initial_shifter_value, total_bit_count;
@@ -4394,30 +4504,38 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
   __private int75_v  k;
   __private int90_v  f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int75_t  k_base = class_k_base75(k_base_in, class_delta[class_index]);
   __private int75_t  exp75;
 
   tid = mad24(get_group_id(0), get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (tid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_82_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (tid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_82_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
 
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
-  exp75.d2=exponent>>29;exp75.d1=(exponent>>14)&0x7FFF;exp75.d0=(exponent<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
+  exp75.d2=EXPONENT>>29;exp75.d1=(EXPONENT>>14)&0x7FFF;exp75.d0=(EXPONENT<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_82_gs: exp=%u, shift=%d, shifted exp=%#x, total_bit_count=%u, shared_mem_size=%u\n",
-        exponent, shiftcount, initial_shifter_value, total_bit_count, shared_mem_allocated);
+        EXPONENT, SHIFTCOUNT, initial_shifter_value, total_bit_count, shared_mem_allocated);
 #endif
 
   for (i = lid*VECTOR_SIZE; i < total_bit_count; i += 256*VECTOR_SIZE) // VECTOR_SIZE*THREADS_PER_BLOCK
@@ -4430,45 +4548,45 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -4514,18 +4632,19 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
         i, smem[i], V(k_delta), V(k.d4), V(k.d3), V(k.d2), V(k.d1), V(k.d0), V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett15_82(initial_shifter_value, f, tid, b_in, bit_max65, RES
+    check_barrett15_82(initial_shifter_value, f, tid, b_in, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
 
 __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
-              cl_barrett15_83_gs(const uint exponent, const int75_t k_base,
+              cl_barrett15_83_gs(const uint exponent, const int75_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount, const uint8 b_in,
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF         )
 {
   __private uint     i, initial_shifter_value, total_bit_count;
@@ -4533,17 +4652,25 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
   __private int75_v  k;
   __private int90_v  f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int75_t  k_base = class_k_base75(k_base_in, class_delta[class_index]);
   __private int75_t  exp75;
 
 	tid = mad24(get_group_id(0), get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_83_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_83_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -4551,13 +4678,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
-  exp75.d2=exponent>>29;exp75.d1=(exponent>>14)&0x7FFF;exp75.d0=(exponent<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
+  exp75.d2=EXPONENT>>29;exp75.d1=(EXPONENT>>14)&0x7FFF;exp75.d0=(EXPONENT<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_83_gs: exp=%u, shift=%d, shifted exp=%#x, total_bit_count=%u, shared_mem_size=%u\n",
-        exponent, shiftcount, initial_shifter_value, total_bit_count, shared_mem_allocated);
+        EXPONENT, SHIFTCOUNT, initial_shifter_value, total_bit_count, shared_mem_allocated);
 #endif
 
   for (i = lid*VECTOR_SIZE; i < total_bit_count; i += 256*VECTOR_SIZE) // VECTOR_SIZE*THREADS_PER_BLOCK
@@ -4570,45 +4697,45 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -4654,18 +4781,19 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
         i, smem[i], V(k_delta), V(k.d4), V(k.d3), V(k.d2), V(k.d1), V(k.d0), V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett15_83(initial_shifter_value, f, tid, b_in, bit_max65, RES
+    check_barrett15_83(initial_shifter_value, f, tid, b_in, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
 
 __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
-              cl_barrett15_88_gs(const uint exponent, const int75_t k_base,
+              cl_barrett15_88_gs(const uint exponent, const int75_t k_base_in,
                                  const __global uint * restrict bit_array,
                                  const uint bits_to_process, __local ushort *smem,
                                  const int shiftcount, const uint8 b_in,
                                  __global uint * restrict RES, const int bit_max65,
-                                 const uint shared_mem_allocated // only used to verify assumptions
+                                 const uint shared_mem_allocated, // only used to verify assumptions
+                                 const uint blocks_per_class, const __global uint * restrict class_delta
                                  MODBASECASE_PAR_DEF         )
 {
   __private uint     i, initial_shifter_value, total_bit_count;
@@ -4673,17 +4801,25 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
   __private int75_v  k;
   __private int90_v  f;
   __private uint     tid, lid=get_local_id(0);
+  __private uint     class_index = GS_CLASS_INDEX;
+  __private uint     block = get_group_id(0) - class_index * blocks_per_class;  // block within the class
+  __private int75_t  k_base = class_k_base75(k_base_in, class_delta[class_index]);
   __private int75_t  exp75;
 
 	tid = mad24(get_group_id(0), get_local_size(0), lid);
 
 #if (TRACE_SIEVE_KERNEL > 0)
-    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_88_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, bit_max65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
-        exponent, exponent, k_base.d2, k_base.d1, k_base.d0, bits_to_process, shiftcount, bit_max65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
+    if (lid==TRACE_SIEVE_TID) printf((__constant char *)"cl_barrett15_88_gs: exp=%d=%#x, k=%x:%x:%x, bits=%d, shift=%d, BIT_MAX65=%d, b_in=%x:%x:%x:%x:%x:%x:%x:%x, base addr=%#x\n",
+        EXPONENT, EXPONENT, k_base.d2, k_base.d1, k_base.d0, bits_to_process, SHIFTCOUNT, BIT_MAX65, b_in.s7, b_in.s6, b_in.s5, b_in.s4, b_in.s3, b_in.s2, b_in.s1, b_in.s0, bit_array);
 #endif
 
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted candidate list, this block tests one chunk of it (see gpusieve.cl)
+  total_bit_count = compact_chunk_count(bit_array + get_group_id(0) * GS_COMPACT_CHUNK);
+#else
   // extract the bits set in bit_array into smem and get the total count (call to gpusieve.cl)
   total_bit_count = extract_bits(bits_to_process, tid, lid, bitcount, smem, bit_array);
+#endif
 
 // Here, all warps in our block have placed their candidates in shared memory.
 // Now we can start TFing candidates.
@@ -4691,13 +4827,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Init some stuff that will be used for all k's tested  <== this makes the OpenCL compiler abort, supposed to be fixed in Cat 13.4
 // Compute factor corresponding to first sieve bit in this block.
 
-  initial_shifter_value = exponent << (32 - shiftcount);	// Initial shifter value
+  initial_shifter_value = EXPONENT << (32 - SHIFTCOUNT);	// Initial shifter value
 
-  exp75.d2=exponent>>29;exp75.d1=(exponent>>14)&0x7FFF;exp75.d0=(exponent<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
+  exp75.d2=EXPONENT>>29;exp75.d1=(EXPONENT>>14)&0x7FFF;exp75.d0=(EXPONENT<<1)&0x7FFF;	// exp75 = 2 * exponent  // PERF: exp.d1=amd_bfe(exp, 15, 14)
 
 #if (TRACE_KERNEL > 0)
   if (tid==TRACE_TID) printf((__constant char *)"cl_barrett15_88_gs: exp=%u, shift=%d, shifted exp=%#x, total_bit_count=%u, shared_mem_size=%u\n",
-        exponent, shiftcount, initial_shifter_value, total_bit_count, shared_mem_allocated);
+        EXPONENT, SHIFTCOUNT, initial_shifter_value, total_bit_count, shared_mem_allocated);
 #endif
 
   for (i = lid*VECTOR_SIZE; i < total_bit_count; i += 256*VECTOR_SIZE) // VECTOR_SIZE*THREADS_PER_BLOCK
@@ -4710,45 +4846,45 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
 // Get the (k - k_base) value to test
 
 #if (VECTOR_SIZE == 1)
-    k_delta = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
+    k_delta = GS_K_DELTA(i);
 #elif (VECTOR_SIZE == 2)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
 #elif (VECTOR_SIZE == 3)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
 #elif (VECTOR_SIZE == 4)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
 #elif (VECTOR_SIZE == 8)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
 #elif (VECTOR_SIZE == 16)
-    k_delta.s0 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i]));
-    k_delta.s1 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+1]));
-    k_delta.s2 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+2]));
-    k_delta.s3 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+3]));
-    k_delta.s4 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+4]));
-    k_delta.s5 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+5]));
-    k_delta.s6 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+6]));
-    k_delta.s7 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+7]));
-    k_delta.s8 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+8]));
-    k_delta.s9 = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+9]));
-    k_delta.sa = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+10]));
-    k_delta.sb = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+11]));
-    k_delta.sc = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+12]));
-    k_delta.sd = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+13]));
-    k_delta.se = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+14]));
-    k_delta.sf = mad24(bits_to_process, (uint)get_group_id(0), (uint)(smem[i+15]));
+    k_delta.s0 = GS_K_DELTA(i);
+    k_delta.s1 = GS_K_DELTA(i+1);
+    k_delta.s2 = GS_K_DELTA(i+2);
+    k_delta.s3 = GS_K_DELTA(i+3);
+    k_delta.s4 = GS_K_DELTA(i+4);
+    k_delta.s5 = GS_K_DELTA(i+5);
+    k_delta.s6 = GS_K_DELTA(i+6);
+    k_delta.s7 = GS_K_DELTA(i+7);
+    k_delta.s8 = GS_K_DELTA(i+8);
+    k_delta.s9 = GS_K_DELTA(i+9);
+    k_delta.sa = GS_K_DELTA(i+10);
+    k_delta.sb = GS_K_DELTA(i+11);
+    k_delta.sc = GS_K_DELTA(i+12);
+    k_delta.sd = GS_K_DELTA(i+13);
+    k_delta.se = GS_K_DELTA(i+14);
+    k_delta.sf = GS_K_DELTA(i+15);
 #endif
 
 // Compute new f.  This is computed as f = f_base + 2 * (k - k_base) * exp.
@@ -4794,7 +4930,7 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1)))
         i, smem[i], V(k_delta), V(k.d4), V(k.d3), V(k.d2), V(k.d1), V(k.d0), V(f.d5), V(f.d4), V(f.d3), V(f.d2), V(f.d1), V(f.d0));
 #endif
 
-    check_barrett15_88(initial_shifter_value, f, tid, b_in, bit_max65, RES
+    check_barrett15_88(initial_shifter_value, f, tid, b_in, BIT_MAX65, RES
                        MODBASECASE_PAR);
   }
 }
@@ -17,6 +17,7 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "crc.h"
@@ -24,16 +25,55 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "params.h"
 #include "timer.h"
 #include "my_types.h"
+#include "checkpoint.h"
 
 extern mystuff_t    mystuff;
 
+static const char hex_digits[] = "0123456789ABCDEF";
+
+/* the finished classes as one hex digit per 4 classes, the lowest class is bit 0 of the first digit */
+static void classes_to_hex(const cl_uchar classes_done[CLASS_BITMAP_BYTES], char *buffer)
+{
+  unsigned int i, len = (mystuff.num_classes + 3) / 4;
+
+  for (i = 0; i < len; i++) buffer[i] = hex_digits[(classes_done[i / 2] >> ((i & 1) * 4)) & 0xF];
+  buffer[len] = 0;
+}
+
+/* returns 1 if buffer is a valid bitmap for the current number of classes. Checkpoints of older versions
+   store the last finished class instead, all classes up to it are finished then. */
+static int hex_to_classes(const char *buffer, cl_uchar classes_done[CLASS_BITMAP_BYTES])
+{
+  unsigned int i, len = (mystuff.num_classes + 3) / 4;
+  const char *digit;
+  char *end;
+  long last_class;
+
+  memset(classes_done, 0, CLASS_BITMAP_BYTES);
+  if (strlen(buffer) != len)
+  {
+    last_class = strtol(buffer, &end, 10);
+    if (*end || last_class < 0 || last_class >= (long)mystuff.num_classes) return 0;
+    for (i = 0; i <= (unsigned int)last_class; i++) CLASS_SET(classes_done, i);
+    return 1;
+  }
+  for (i = 0; i < len; i++)
+  {
+    digit = strchr(hex_digits, buffer[i]);
+    if (digit == NULL || *digit == 0) return 0;
+    classes_done[i / 2] |= (cl_uchar)((digit - hex_digits) << ((i & 1) * 4));
+  }
+  return 1;
+}
+
+
 /*
 checkpoint_write() writes the checkpoint file.
 */
-void checkpoint_write(unsigned int exp, int bit_min, int bit_max, unsigned int cur_class, int num_factors, int96 factors[MAX_FACTORS_PER_JOB], unsigned long long int bit_level_time)
+void checkpoint_write(unsigned int exp, int bit_min, int bit_max, const cl_uchar classes_done[CLASS_BITMAP_BYTES], int num_factors, int96 factors[MAX_FACTORS_PER_JOB], unsigned long long int bit_level_time)
 {
   FILE *f;
-  char buffer[MAX_BUFFER_LENGTH], filename[32], filename_save[32], filename_write[32], factors_buffer[MAX_FACTOR_BUFFER_LENGTH];
+  char buffer[MAX_BUFFER_LENGTH], filename[32], filename_save[32], filename_write[32], factors_buffer[MAX_FACTOR_BUFFER_LENGTH], classes_buffer[MAX_CLASS_BITMAP_LENGTH];
   unsigned int i, res, factors_buffer_length;
 
   sprintf(filename, "M%u.ckp", exp);
@@ -55,7 +95,8 @@ void checkpoint_write(unsigned int exp, int bit_min, int bit_max, unsigned int c
   else {
       sprintf(factors_buffer, "0");
   }
-  
+  classes_to_hex(classes_done, classes_buffer);
+
   f=fopen(filename_write, "w");
   if(f==NULL)
   {
@@ -68,10 +109,10 @@ void checkpoint_write(unsigned int exp, int bit_min, int bit_max, unsigned int c
               unsigned long long c1, c2, c3, c4, c5;
               timer_init(&cptimer); */
 
-      sprintf(buffer, "%u %d %d %d %s: %d %d %s %llu", exp, bit_min, bit_max, mystuff.num_classes, MFAKTO_VERSION, cur_class, num_factors, strlen(factors_buffer) ? factors_buffer : "0", bit_level_time);
+      sprintf(buffer, "%u %d %d %d %s: %s %d %s %llu", exp, bit_min, bit_max, mystuff.num_classes, MFAKTO_VERSION, classes_buffer, num_factors, strlen(factors_buffer) ? factors_buffer : "0", bit_level_time);
       i = crc32_checksum(buffer, (int)strlen(buffer));
       //              c1 = timer_diff(&cptimer);
-      i = fprintf(f, "%u %d %d %d %s: %d %d %s %llu %08X\n", exp, bit_min, bit_max, mystuff.num_classes, MFAKTO_VERSION, cur_class, num_factors, strlen(factors_buffer) ? factors_buffer : "0", bit_level_time, i);
+      i = fprintf(f, "%u %d %d %d %s: %s %d %s %llu %08X\n", exp, bit_min, bit_max, mystuff.num_classes, MFAKTO_VERSION, classes_buffer, num_factors, strlen(factors_buffer) ? factors_buffer : "0", bit_level_time, i);
 //              c2 = timer_diff(&cptimer);
     res=fclose(f);
 //              c3 = timer_diff(&cptimer);
@@ -98,19 +139,21 @@ void checkpoint_write(unsigned int exp, int bit_min, int bit_max, unsigned int c
 /*
 checkpoint_read() reads the checkpoint file and compares values for exp,
 bit_min, bit_max, NUM_CLASSES read from file with current values.
-If these parameters are equal than it sets cur_class and num_factors,
-factors, and bit_level_time to the values from the checkpoint file.
+If these parameters are equal than it sets classes_done (one bit per finished
+class), num_factors, factors, and bit_level_time to the values from the
+checkpoint file.
 
 returns 1 on success (valid checkpoint file)
 returns 0 otherwise
 */
-int checkpoint_read(unsigned int exp, int bit_min, int bit_max, unsigned int *cur_class, int* num_factors, int96 factors[MAX_FACTORS_PER_JOB], unsigned long long int* bit_level_time, int verbosity)
+int checkpoint_read(unsigned int exp, int bit_min, int bit_max, cl_uchar classes_done[CLASS_BITMAP_BYTES], int* num_factors, int96 factors[MAX_FACTORS_PER_JOB], unsigned long long int* bit_level_time, int verbosity)
 {
   FILE *f;
   int ret=0,i,chksum;
   char ckp_buffer[MAX_BUFFER_LENGTH] = { 0 }, cur_buffer[MAX_BUFFER_LENGTH], *ptr, *ptr2, filename[20], filename_save[32], version[81], factors_buffer[MAX_FACTOR_BUFFER_LENGTH];
+  char classes_buffer[MAX_CLASS_BITMAP_LENGTH] = { 0 };
 
-  *cur_class=-1;
+  memset(classes_done, 0, CLASS_BITMAP_BYTES);
   *num_factors=0;
   
   sprintf(filename, "M%u.ckp", exp);
@@ -132,19 +175,19 @@ int checkpoint_read(unsigned int exp, int bit_min, int bit_max, unsigned int *cu
     {
       ptr2=&(ckp_buffer[i]);
       ptr=strstr(ptr2, ": ");
-      if (ptr > ptr2)
+      if (ptr > ptr2 && ptr - ptr2 < (int)sizeof(version))
       {
         strncpy(version, ptr2, ptr-ptr2);
         version[ptr-ptr2]='\0';
       }
       else sprintf(version, "%s", MFAKTO_VERSION);
-      (void) sscanf(ptr,": %d %d %s %llu", cur_class, num_factors, factors_buffer, bit_level_time);
-      sprintf(cur_buffer,"%u %d %d %d %s: %d %d %s %llu", exp, bit_min, bit_max, mystuff.num_classes, version, *cur_class, *num_factors, factors_buffer, *bit_level_time);
+      // field widths: MAX_CLASS_BITMAP_LENGTH - 1, MAX_FACTOR_BUFFER_LENGTH - 1
+      (void) sscanf(ptr,": %1155s %d %599s %llu", classes_buffer, num_factors, factors_buffer, bit_level_time);
+      sprintf(cur_buffer,"%u %d %d %d %s: %s %d %s %llu", exp, bit_min, bit_max, mystuff.num_classes, version, classes_buffer, *num_factors, factors_buffer, *bit_level_time);
       chksum= crc32_checksum(cur_buffer,(int)strlen(cur_buffer));
       // no trainling '\n' for the compare buffer to allow interchanging \n\r and \n files 
-      i=sprintf(cur_buffer,"%u %d %d %d %s: %d %d %s %llu %08X", exp, bit_min, bit_max, mystuff.num_classes, version, *cur_class, *num_factors, factors_buffer, *bit_level_time, chksum);
-      if(*cur_class >= 0 && \
-         *cur_class < mystuff.num_classes && \
+      i=sprintf(cur_buffer,"%u %d %d %d %s: %s %d %s %llu %08X", exp, bit_min, bit_max, mystuff.num_classes, version, classes_buffer, *num_factors, factors_buffer, *bit_level_time, chksum);
+      if(hex_to_classes(classes_buffer, classes_done) && \
          *num_factors >= 0 && \
          strncmp(ckp_buffer, cur_buffer, i) == 0 && \
          ((*num_factors == 0 && strlen(factors_buffer) == 1) || \
@@ -199,7 +242,7 @@ int checkpoint_read(unsigned int exp, int bit_min, int bit_max, unsigned int *cu
     if (rename(filename_save, filename) == 0)
     {
       if (verbosity>1) printf("Renamed backup file \"%s\" to \"%s\", trying to load it.\n", filename_save, filename);
-      return checkpoint_read(exp, bit_min, bit_max, cur_class, num_factors, factors, bit_level_time, mystuff.verbosity);
+      return checkpoint_read(exp, bit_min, bit_max, classes_done, num_factors, factors, bit_level_time, mystuff.verbosity);
     }
   }
   return ret;
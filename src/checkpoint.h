@@ -19,8 +19,13 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 
 #include "my_types.h"
 
-void checkpoint_write(unsigned int exp, int bit_min, int bit_max, unsigned int cur_class, int num_factors,
+/* bitmaps with one bit per class, CLASS_BITMAP_BYTES long */
+#define CLASS_SET(map, c)  ((map)[(c) / 8] |= (cl_uchar)(1 << ((c) % 8)))
+#define CLASS_CLR(map, c)  ((map)[(c) / 8] &= (cl_uchar)~(1 << ((c) % 8)))
+#define CLASS_TEST(map, c) (((map)[(c) / 8] >> ((c) % 8)) & 1)
+
+void checkpoint_write(unsigned int exp, int bit_min, int bit_max, const cl_uchar classes_done[CLASS_BITMAP_BYTES], int num_factors,
                       int96 factors[MAX_FACTORS_PER_JOB], unsigned long long int bit_level_time);
-int checkpoint_read(unsigned int exp, int bit_min, int bit_max, unsigned int *cur_class, int *num_factors,
+int checkpoint_read(unsigned int exp, int bit_min, int bit_max, cl_uchar classes_done[CLASS_BITMAP_BYTES], int *num_factors,
                     int96 factors[MAX_FACTORS_PER_JOB], unsigned long long int *bit_level_time, int verbosity);
 void checkpoint_delete(unsigned int exp);
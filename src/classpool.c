@@ -0,0 +1,155 @@
+/*
+This file is part of mfaktc (mfakto).
+Copyright (C) 2009 - 2014  Oliver Weihe (o.weihe@t-online.de)
+                           Bertram Franz (bertramf@gmx.net)
+
+mfaktc (mfakto) is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+mfaktc (mfakto) is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "params.h"
+#include "my_types.h"
+#include "compatibility.h"
+#include "checkpoint.h"
+#include "classpool.h"
+#include "mfakto.h"
+#include "output.h"
+
+int class_needed(unsigned int expo, unsigned long long int k_min, int c);
+
+static void count_done(class_pool_t *pool, unsigned int num_classes)
+{
+  unsigned int c;
+
+  pool->num_done = 0;
+  for (c = 0; c < num_classes; c++)
+  {
+    if (CLASS_TEST(pool->needed, c) && CLASS_TEST(pool->done, c)) pool->num_done++;
+  }
+}
+
+static void write_pool_checkpoint(class_pool_t *pool)
+{
+  checkpoint_write(pool->exponent, pool->bit_min, pool->bit_max, pool->done, pool->num_factors, pool->factors, pool->bit_level_time);
+}
+
+int classpool_init(class_pool_t *pool, mystuff_t *mystuff, unsigned long long k_min, int only_class)
+{
+  int ret = 0;
+  unsigned int c;
+
+  memset(pool, 0, sizeof(*pool));
+  pool->exponent = mystuff->exponent;
+  pool->bit_min  = mystuff->bit_min;
+  pool->bit_max  = mystuff->bit_max_stage;
+
+  if (only_class >= 0)
+  {
+    /* the known factor is in the last class, tf() checks the results of the last class (or launch) */
+    CLASS_SET(pool->needed, (unsigned int)only_class);
+    pool->num_needed = 1;
+    for (c = (unsigned int)only_class; c-- > 0 && pool->num_needed < SELFTEST_CLASSES; )
+    {
+      if (class_needed(mystuff->exponent, k_min, c))
+      {
+        CLASS_SET(pool->needed, c);
+        pool->num_needed++;
+      }
+    }
+    return 0;
+  }
+  for (c = 0; c < mystuff->num_classes; c++)
+  {
+    if (class_needed(mystuff->exponent, k_min, c))
+    {
+      CLASS_SET(pool->needed, c);
+      pool->num_needed++;
+    }
+  }
+
+  if (mystuff->mode != MODE_NORMAL) return 0;
+
+  pool->shared = (num_device_list > 1);
+  if (mystuff->checkpoints > 0 &&
+      checkpoint_read(pool->exponent, pool->bit_min, pool->bit_max, pool->done, &pool->num_factors, pool->factors,
+                      &pool->bit_level_time, mystuff->verbosity) == 1)
+  {
+    count_done(pool, mystuff->num_classes);
+    ret = 1;
+  }
+  for (c = 0; c < MAX_DEVICES; c++) pool->time_merged[c] = pool->bit_level_time;
+
+  return ret;
+}
+
+unsigned int classpool_take(class_pool_t *pool, mystuff_t *mystuff, unsigned int *classes, unsigned int max_classes)
+{
+  unsigned int c, n = 0;
+
+  if (pool->shared) lock_devices();
+  if (mystuff->stopafterfactor >= 2 && pool->num_factors > 0 && mystuff->mode == MODE_NORMAL) pool->stop = 1;
+  for (c = pool->next; c < mystuff->num_classes && n < max_classes && !pool->stop; c++)
+  {
+    if (CLASS_TEST(pool->needed, c) && !CLASS_TEST(pool->done, c)) classes[n++] = c;
+  }
+  if (n > 0) pool->next = classes[n - 1] + 1;
+  if (pool->shared) unlock_devices();
+
+  return n;
+}
+
+static int add_factors(class_pool_t *pool, mystuff_t *mystuff, const int96 *factors, int num_factors)
+{
+  int i;
+
+  for (i = 0; i < num_factors; i++)
+  {
+    if (pool->num_factors >= MAX_FACTORS_PER_JOB)
+    {
+      logprintf(mystuff, "ERROR: reached limit of %u factors for this job, try a different range\n", MAX_FACTORS_PER_JOB);
+      return RET_QUIT;
+    }
+    pool->factors[pool->num_factors++] = factors[i];
+  }
+  return 0;
+}
+
+int classpool_done(class_pool_t *pool, mystuff_t *mystuff, const unsigned int *classes, unsigned int num_classes,
+                   const int96 *factors, int num_factors, int write_checkpoint)
+{
+  cl_uint d = (cl_uint)(dev - device_list);
+  unsigned int c;
+  int ret;
+
+  if (pool->shared) lock_devices();
+  for (c = 0; c < num_classes; c++) CLASS_SET(pool->done, classes[c]);
+  pool->num_done += num_classes;
+  /* each device adds the time of its own classes */
+  pool->bit_level_time += mystuff->stats.bit_level_time - pool->time_merged[d];
+  pool->time_merged[d]  = mystuff->stats.bit_level_time;
+  ret = add_factors(pool, mystuff, factors, num_factors);
+  if (write_checkpoint && mystuff->mode == MODE_NORMAL) write_pool_checkpoint(pool);
+  if (pool->shared) unlock_devices();
+
+  return ret;
+}
+
+void classpool_stop(class_pool_t *pool)
+{
+  if (pool->shared) lock_devices();
+  pool->stop = 1;
+  if (pool->shared) unlock_devices();
+}
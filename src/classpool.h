@@ -0,0 +1,72 @@
+/*
+This file is part of mfaktc (mfakto).
+Copyright (C) 2009 - 2014  Oliver Weihe (o.weihe@t-online.de)
+                           Bertram Franz (bertramf@gmx.net)
+
+mfaktc (mfakto) is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+mfaktc (mfakto) is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CLASSPOOL_H_
+#define CLASSPOOL_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "my_types.h"
+
+/* The needed classes of one bit level are a pool of tasks. tf() takes classes from the pool and reports
+them back when they are finished, in any order. The finished classes are a bitmap, which is also what the
+checkpoint file stores.
+
+With several devices (-d x,y,...) the device threads of run_on_devices() share the pool of the current
+bit level and take classes under lock_devices(), whichever device is free gets the next ones. Fast and
+slow devices (or -d h) thus finish an assignment together. There is one checkpoint file, written from the
+pool, and device 0 reports the result. */
+
+typedef struct
+{
+  unsigned int       exponent;
+  int                bit_min, bit_max;
+  int                shared;                          /* the threads of several devices take classes */
+  int                stop;                            /* no more classes are handed out */
+  unsigned int       next;                            /* lowest class which might be free */
+  unsigned int       num_needed;                      /* classes which must be tested */
+  unsigned int       num_done;                        /* finished classes, all devices */
+  cl_uchar           needed[CLASS_BITMAP_BYTES];
+  cl_uchar           done[CLASS_BITMAP_BYTES];
+  int                num_factors;
+  int96              factors[MAX_FACTORS_PER_JOB];
+  unsigned long long bit_level_time;                  /* time of the finished classes in ms, all devices */
+  unsigned long long time_merged[MAX_DEVICES];        /* part of stats.bit_level_time of each device in bit_level_time */
+} class_pool_t;
+
+/* only_class >= 0 restricts the pool to that class and up to SELFTEST_CLASSES - 1 needed classes below it
+   (self-tests). Returns 1 if a checkpoint was loaded, 0 if the bit level starts from scratch. */
+int          classpool_init(class_pool_t *pool, mystuff_t *mystuff, unsigned long long k_min, int only_class);
+
+/* hands out up to max_classes free classes in ascending order, 0 when there are none left for us */
+unsigned int classpool_take(class_pool_t *pool, mystuff_t *mystuff, unsigned int *classes, unsigned int max_classes);
+
+/* marks classes as finished and adds their factors. The checkpoint is written if write_checkpoint is set.
+   Returns RET_QUIT if there are too many factors for one job. */
+int          classpool_done(class_pool_t *pool, mystuff_t *mystuff, const unsigned int *classes, unsigned int num_classes,
+                            const int96 *factors, int num_factors, int write_checkpoint);
+
+/* hands out no more classes, e.g. after an error on one of the devices */
+void         classpool_stop(class_pool_t *pool);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -23,6 +23,26 @@ Version 0.16.0
  Common functions and defines for various kernels
 */
 
+/* Exponent-specialized builds (SpecializeKernels=1): the host rebuilds the barrett kernel of an
+   assignment with -DTF_EXPONENT, -DTF_SHIFTCOUNT and -DTF_BIT_MAX65. The kernels then ignore these
+   arguments, and the compiler sees the exponent bits of the squaring loop and the bit_max dependent
+   shifts as constants. */
+#ifdef TF_EXPONENT
+  #define EXPONENT   TF_EXPONENT
+  #define SHIFTCOUNT TF_SHIFTCOUNT
+  #define BIT_MAX65  TF_BIT_MAX65
+#else
+  #define EXPONENT   exponent
+  #define SHIFTCOUNT shiftcount
+  #define BIT_MAX65  bit_max65
+#endif
+
+/* factors a result buffer holds, the host passes RES_FACTORS_MAX of params.h. The default is for
+   CompileOptions which replace the host's build options. */
+#ifndef RES_FACTORS_MAX
+  #define RES_FACTORS_MAX 64
+#endif
+
 // prototypes
 
 void check_big_factor96(const int96_v f, const int96_v a, __global uint * const RES);
@@ -215,7 +235,7 @@ inline uint_v generic_bitalign(const uint_v high, const uint_v low, const int sh
   if((a.d2.comp|a.d1.comp)==0 && a.d0.comp==1) \
   { \
       int index = ATOMIC_INC(RES[0]); \
-      if (index < 10) \
+      if (index < RES_FACTORS_MAX) \
       { \
         RES[index *3 + 1]=f.d2.comp; \
         RES[index *3 + 2]=f.d1.comp; \
@@ -229,7 +249,7 @@ inline uint_v generic_bitalign(const uint_v high, const uint_v low, const int sh
   if(a.comp == 1) \
   { \
       int index =ATOMIC_INC(RES[0]); \
-      if(index <10) \
+      if(index < RES_FACTORS_MAX) \
       { \
         RES[index *3 + 1]=0; \
         RES[index *3 + 2]=convert_uint(f.comp >> 32); \
@@ -241,7 +261,7 @@ inline uint_v generic_bitalign(const uint_v high, const uint_v low, const int sh
   if((tmp.comp)==0) \
   { \
       int index = ATOMIC_INC(RES[0]); \
-      if (index < 10) \
+      if (index < RES_FACTORS_MAX) \
       { \
         RES[index *3 + 1]=n.d2.comp; \
         RES[index *3 + 2]=n.d1.comp; \
@@ -261,7 +281,7 @@ inline uint_v generic_bitalign(const uint_v high, const uint_v low, const int sh
   if(amd_max3(a.d4.comp, a.d3.comp, a.d2.comp|a.d1.comp)==0 && a.d0.comp==1) \
   { \
       tid=ATOMIC_INC(RES[0]); \
-      if(tid<10) \
+      if(tid<RES_FACTORS_MAX) \
       { \
         RES[tid*3 + 1]=f.d4.comp;  \
         RES[tid*3 + 2]=mad24(f.d3.comp,0x8000u, f.d2.comp); \
@@ -274,7 +294,7 @@ inline uint_v generic_bitalign(const uint_v high, const uint_v low, const int sh
   if(amd_max3(amd_max3(a.d5.comp, a.d4.comp, a.d3.comp), a.d2.comp, a.d1.comp)==0 && a.d0.comp==1) \
   { \
       tid=ATOMIC_INC(RES[0]); \
-      if(tid<10) \
+      if(tid<RES_FACTORS_MAX) \
       { \
         RES[tid*3 + 1]=mad24(f.d5.comp,0x8000u, f.d4.comp); \
         RES[tid*3 + 2]=mad24(f.d3.comp,0x8000u, f.d2.comp); \
@@ -286,7 +306,7 @@ inline uint_v generic_bitalign(const uint_v high, const uint_v low, const int sh
   if((tmp.comp)==0) \
   { \
       int index = ATOMIC_INC(RES[0]); \
-      if (index < 10) \
+      if (index < RES_FACTORS_MAX) \
       { \
         RES[index*3 + 1]=n.d4.comp;  \
         RES[index*3 + 2]=mad24(n.d3.comp,0x8000u, n.d2.comp); \
@@ -298,7 +318,7 @@ inline uint_v generic_bitalign(const uint_v high, const uint_v low, const int sh
   if((tmp.comp)==0) \
   { \
       int index = ATOMIC_INC(RES[0]); \
-      if (index < 10) \
+      if (index < RES_FACTORS_MAX) \
       { \
         RES[index*3 + 1]=mad24(n.d5.comp,0x8000u, n.d4.comp); \
         RES[index*3 + 2]=mad24(n.d3.comp,0x8000u, n.d2.comp); \
@@ -320,7 +340,7 @@ now used everywhere. */
 #endif
 /* in contrast to the other kernels the two barrett based kernels are only allowed for factors above 2^64 so there is no need to check for f != 1 */
     int index=ATOMIC_INC(RES[0]);
-    if(index<10)				/* limit to 10 factors per class */
+    if(index<RES_FACTORS_MAX)				/* more factors are only counted */
     {
       RES[index*3 + 1]=f.d2;
       RES[index*3 + 2]=f.d1;
@@ -669,7 +689,7 @@ so we compare the LSB of qi and q.d0, if they are the same (both even or both od
     {
       int index;
       index =ATOMIC_INC(RES[0]);
-      if(index < 10)                              /* limit to 10 factors per class */
+      if(index < RES_FACTORS_MAX)                 /* more factors are only counted */
       {
         RES[index * 3 + 1] = n.d2;
         RES[index * 3 + 2] = n.d1;
@@ -776,7 +796,7 @@ so we compare the LSB of qi and q.d0, if they are the same (both even or both od
     {
       int index;
       index =ATOMIC_INC(RES[0]);
-      if(index < 10)                              /* limit to 10 factors per class */
+      if(index < RES_FACTORS_MAX)                 /* more factors are only counted */
       {
         RES[index * 3 + 1] = n.d2;
         RES[index * 3 + 2] = n.d1;
@@ -1067,7 +1087,7 @@ so we compare the LSB of qi and q.d0, if they are the same (both even or both od
     {
       int index;
       index =ATOMIC_INC(RES[0]);
-      if(index < 10)                              /* limit to 10 factors per class */
+      if(index < RES_FACTORS_MAX)                 /* more factors are only counted */
       {
         RES[index*3 + 1]=n.d4;
         RES[index*3 + 2]=mad24(n.d3,0x8000u, n.d2);
@@ -1196,7 +1216,7 @@ so we compare the LSB of qi and q.d0, if they are the same (both even or both od
     {
       int index;
       index =ATOMIC_INC(RES[0]);
-      if(index < 10)                              /* limit to 10 factors per class */
+      if(index < RES_FACTORS_MAX)                 /* more factors are only counted */
       {
         RES[index*3 + 1]=n.d4;
         RES[index*3 + 2]=mad24(n.d3,0x8000u, n.d2);
@@ -1321,7 +1341,7 @@ so we compare the LSB of qi and q.d0, if they are the same (both even or both od
     {
       int index;
       index =ATOMIC_INC(RES[0]);
-      if(index < 10)                              /* limit to 10 factors per class */
+      if(index < RES_FACTORS_MAX)                 /* more factors are only counted */
       {
         RES[index*3 + 1]=n.d4;
         RES[index*3 + 2]=mad24(n.d3,0x8000u, n.d2);
@@ -1636,7 +1656,7 @@ so we compare the LSB of qi and q.d0, if they are the same (both even or both od
     {
       int index;
       index =ATOMIC_INC(RES[0]);
-      if(index < 10)                              /* limit to 10 factors per class */
+      if(index < RES_FACTORS_MAX)                 /* more factors are only counted */
       {
         RES[index*3 + 1]=mad24(n.d5,0x8000u, n.d4);
         RES[index*3 + 2]=mad24(n.d3,0x8000u, n.d2);
@@ -1768,7 +1788,7 @@ so we compare the LSB of qi and q.d0, if they are the same (both even or both od
     {
       int index;
       index =ATOMIC_INC(RES[0]);
-      if(index < 10)                              /* limit to 10 factors per class */
+      if(index < RES_FACTORS_MAX)                 /* more factors are only counted */
       {
         RES[index*3 + 1]=mad24(n.d5,0x8000u, n.d4);
         RES[index*3 + 2]=mad24(n.d3,0x8000u, n.d2);
@@ -45,6 +45,13 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #define my_usleep(A) usleep(A)
 #endif
 
+#ifdef _MSC_VER
+#include <process.h>
+#define my_getpid() _getpid()
+#else
+#define my_getpid() getpid()
+#endif
+
 #ifdef __cplusplus
 #define MAX(a, b) (((a) > (b)) ? (a) : (b))
 #define MIN(a, b) (((a) < (b)) ? (a) : (b))
@@ -0,0 +1,792 @@
+/*
+This file is part of mfaktc (mfakto).
+Copyright (C) 2009 - 2014  Oliver Weihe (o.weihe@t-online.de)
+                           Bertram Franz (bertramf@gmx.net)
+
+mfaktc (mfakto) is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+mfaktc (mfakto) is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Trial factoring on the host.
+
+This does the same as the TF kernels, f = 2 * k * exp + 1 is a factor of
+M<exp> if 2^exp mod f == 1, but on the CPU. The modular squarings use
+Montgomery multiplication (R = 2^64 while f < 2^63, otherwise two 64-bit
+words and R = 2^128), the only division per candidate is R mod f (the
+Montgomery form of 1). The first few bits of the exponent are done by
+doubling, the remaining bits are one squaring and, for a 1 bit, one doubling
+each.
+
+CPU_TF_LANES candidates are processed side by side, all of them need exactly
+the same sequence of operations (the exponent is the same), so the CPU can
+overlap the otherwise dependent multiplications of the lanes.
+CPU_TF_IFMA does the same with AVX-512 IFMA on 16 candidates at a time, see
+cpu_tf_check_ifma(). It is only selected if the CPU supports it.
+
+The candidates of a grid are handed out to the TF threads in chunks of
+CPU_TF_CHUNK. The host thread sieves the next grid meanwhile, the time it has
+to wait for the TF threads is reported as "CPU wait", just like when waiting
+for the GPU.
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#if defined _MSC_VER
+  #include <intrin.h>
+#endif
+#if defined __x86_64__ || defined _M_X64
+  #define CPU_TF_X86
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #define CPU_TF_TARGET(x)
+  #else
+    #define CPU_TF_TARGET(x) __attribute__((target(x)))
+  #endif
+#endif
+#include "my_types.h"
+#include "compatibility.h"
+#include "params.h"
+#include "sieve.h"
+#include "sievepool.h"
+#include "mfakto.h"
+#include "timer.h"
+#include "output.h"
+#include "cpu_tf.h"
+
+#if defined __SIZEOF_INT128__
+  #define CPU_TF_INT128
+#endif
+
+#define CPU_TF_LANES 4     /* candidates processed side by side */
+#define CPU_TF_CHUNK 4096  /* candidates per work item of the TF threads */
+#define CPU_TF_PRESHIFT 5  /* bits of the exponent done by doubling */
+
+#define CPU_TF_IFMA_LANES 16               /* two AVX-512 vectors of candidates */
+#define CPU_TF_MASK52 0xFFFFFFFFFFFFFULL  /* one 52-bit limb */
+
+static std::thread            *threads = NULL;
+static cl_uint                 num_threads = 0;
+static cl_uint                *ktabs[2] = {NULL, NULL};
+static cl_uint                 ktab_size = 0;
+
+static std::mutex              tf_lock;
+static std::mutex              res_lock;
+static std::condition_variable cv_work;   /* signalled to the TF threads */
+static std::condition_variable cv_done;   /* signalled to the host thread */
+
+/* all of these are protected by tf_lock */
+static int                     shutdown_pool = 0;
+static cl_uint                 job_id = 0;
+static cl_uint                 busy = 0;           /* TF threads still working on the current job */
+static enum GPUKernels        job_kernel = CPU_TF;
+static cl_uint                 job_exp = 0, job_count = 0;
+static cl_ulong                job_k_base = 0;
+static const cl_uint          *job_ktab = NULL;
+static cl_uint                *job_res = NULL;
+
+static std::atomic<cl_uint>    next_chunk(0);
+
+
+static inline cl_ulong mac64(cl_ulong a, cl_ulong b, cl_ulong c, cl_ulong d, cl_ulong *hi)
+/* a + b * c + d, returns the lower 64 bits, the upper 64 bits go to *hi */
+{
+#if defined CPU_TF_INT128
+  unsigned __int128 r = (unsigned __int128)b * c + a + d;
+
+  *hi = (cl_ulong)(r >> 64);
+  return (cl_ulong)r;
+#else
+  cl_ulong lo, h;
+  #if defined _MSC_VER && defined _M_X64
+  lo = _umul128(b, c, &h);
+  #else
+  cl_ulong b0 = b & 0xFFFFFFFF, b1 = b >> 32, c0 = c & 0xFFFFFFFF, c1 = c >> 32;
+  cl_ulong p00 = b0 * c0, p01 = b0 * c1, p10 = b1 * c0, p11 = b1 * c1;
+  cl_ulong mid = (p00 >> 32) + (p01 & 0xFFFFFFFF) + (p10 & 0xFFFFFFFF);
+
+  lo = (mid << 32) | (p00 & 0xFFFFFFFF);
+  h  = p11 + (p01 >> 32) + (p10 >> 32) + (mid >> 32);
+  #endif
+  lo += a; h += (lo < a);
+  lo += d; h += (lo < d);
+  *hi = h;
+  return lo;
+#endif
+}
+
+
+static inline cl_uint bits64(cl_ulong x)
+/* number of significant bits of x, x must not be 0 */
+{
+#if defined _MSC_VER && defined _M_X64
+  unsigned long idx;
+  _BitScanReverse64(&idx, x);
+  return (cl_uint)idx + 1;
+#elif defined _MSC_VER
+  cl_uint n = 0;
+  while (x) { n++; x >>= 1; }
+  return n;
+#else
+  return 64 - (cl_uint)__builtin_clzll(x);
+#endif
+}
+
+
+static inline cl_ulong mont_inv(cl_ulong f)
+/* -1/f mod 2^64, f odd */
+{
+  cl_ulong inv = f;  /* f * f == 1 mod 8 */
+
+  inv *= 2 - f * inv;
+  inv *= 2 - f * inv;
+  inv *= 2 - f * inv;
+  inv *= 2 - f * inv;
+  inv *= 2 - f * inv;
+  return 0 - inv;
+}
+
+
+/* one word, f < 2^63 */
+
+static inline cl_ulong mont_mul1(cl_ulong a, cl_ulong b, cl_ulong f, cl_ulong finv)
+/* a * b / 2^64 mod f, a, b < f */
+{
+  cl_ulong t0, t1, c;
+
+  t0 = mac64(0, a, b, 0, &t1);
+  mac64(t0, t0 * finv, f, 0, &c);
+  t0 = t1 + c;
+  return (t0 >= f) ? t0 - f : t0;
+}
+
+
+static inline cl_ulong mont_dbl1(cl_ulong a, cl_ulong f)
+{
+  a += a;
+  return (a >= f) ? a - f : a;
+}
+
+
+/* two words, f < 2^127 */
+
+static inline void mont_sub2(cl_ulong *r, cl_ulong t0, cl_ulong t1, const cl_ulong *f)
+/* r = t < f ? t : t - f, without branches, the CPU can't predict them */
+{
+  cl_ulong s0, s1, borrow, keep;
+
+  s0     = t0 - f[0];
+  borrow = t0 < f[0];
+  s1     = t1 - f[1] - borrow;
+  keep   = 0 - (cl_ulong)((t1 < f[1]) | ((t1 == f[1]) & borrow));
+  r[0]   = (t0 & keep) | (s0 & ~keep);
+  r[1]   = (t1 & keep) | (s1 & ~keep);
+}
+
+
+static inline void mont_mul2(cl_ulong *r, const cl_ulong *a, const cl_ulong *b, const cl_ulong *f, cl_ulong finv)
+/* a * b / 2^128 mod f, a, b < f (CIOS) */
+{
+  cl_ulong t0, t1, t2, c, m;
+
+  t0 = mac64(0, a[0], b[0], 0, &c);
+  t1 = mac64(0, a[1], b[0], c, &t2);
+  m  = t0 * finv;
+  mac64(t0, m, f[0], 0, &c);
+  t0 = mac64(t1, m, f[1], c, &c);
+  t1 = t2 + c;
+
+  t0 = mac64(t0, a[0], b[1], 0, &c);
+  t1 = mac64(t1, a[1], b[1], c, &t2);
+  m  = t0 * finv;
+  mac64(t0, m, f[0], 0, &c);
+  t0 = mac64(t1, m, f[1], c, &c);
+  t1 = t2 + c;
+
+  mont_sub2(r, t0, t1, f);
+}
+
+
+static inline void mont_dbl2(cl_ulong *a, const cl_ulong *f)
+{
+  mont_sub2(a, a[0] << 1, (a[1] << 1) | (a[0] >> 63), f);
+}
+
+
+static inline void mont_one2(cl_ulong *one, const cl_ulong *f)
+/* 2^128 mod f */
+{
+#if defined CPU_TF_INT128
+  unsigned __int128 ff = ((unsigned __int128)f[1] << 64) | f[0];
+
+  ff = (0 - ff) % ff;
+  one[0] = (cl_ulong)ff;
+  one[1] = (cl_ulong)(ff >> 64);
+#else
+  cl_uint n, j;
+
+  /* 2^(bits(f) - 1) < f, double it up to 2^128 */
+  if (f[1])
+  {
+    n = bits64(f[1]) + 64;
+    one[0] = 0;
+    one[1] = 1ULL << (n - 65);
+  }
+  else
+  {
+    n = bits64(f[0]);
+    one[0] = 1ULL << (n - 1);
+    one[1] = 0;
+  }
+  for (j = n - 1; j < 128; j++) mont_dbl2(one, f);
+#endif
+}
+
+
+static void cpu_tf_report(cl_uint *res, cl_uint d2, cl_uint d1, cl_uint d0)
+/* same as the kernels: RES[0] counts the factors, the first RES_FACTORS_MAX are stored */
+{
+  std::lock_guard<std::mutex> lock(res_lock);
+  cl_uint index = res[0]++;
+
+  if (index < RES_FACTORS_MAX)
+  {
+    res[index * 3 + 1] = d2;
+    res[index * 3 + 2] = d1;
+    res[index * 3 + 3] = d0;
+  }
+}
+
+
+static void cpu_tf_check1(cl_uint exp, cl_ulong k_base, const cl_uint *ktab, cl_uint count, cl_uint *res, cl_uint shift, cl_uint preshift)
+/* all candidates of ktab are below 2^63 */
+{
+  cl_ulong f[CPU_TF_LANES], finv[CPU_TF_LANES], one[CPU_TF_LANES], x[CPU_TF_LANES];
+  cl_uint  i, l, j, lanes;
+  int      b;
+
+  for (i = 0; i < count; i += CPU_TF_LANES)
+  {
+    lanes = MIN(CPU_TF_LANES, count - i);
+    for (l = 0; l < CPU_TF_LANES; l++)
+    {
+      /* unused lanes repeat the last candidate */
+      f[l]    = 2 * (k_base + (cl_ulong)ktab[i + MIN(l, lanes - 1)] * NUM_CLASSES) * exp + 1;
+      finv[l] = mont_inv(f[l]);
+      one[l]  = (0 - f[l]) % f[l];  /* 2^64 mod f */
+      x[l]    = one[l];
+      for (j = 0; j < preshift; j++) x[l] = mont_dbl1(x[l], f[l]);
+    }
+    for (b = (int)shift - 1; b >= 0; b--)
+    {
+      for (l = 0; l < CPU_TF_LANES; l++) x[l] = mont_mul1(x[l], x[l], f[l], finv[l]);
+      if (exp & (1U << b))
+      {
+        for (l = 0; l < CPU_TF_LANES; l++) x[l] = mont_dbl1(x[l], f[l]);
+      }
+    }
+    for (l = 0; l < lanes; l++)
+    {
+      if (x[l] == one[l]) cpu_tf_report(res, 0, (cl_uint)(f[l] >> 32), (cl_uint)f[l]);
+    }
+  }
+}
+
+
+static void cpu_tf_check2(cl_uint exp, cl_ulong k_base, const cl_uint *ktab, cl_uint count, cl_uint *res, cl_uint shift, cl_uint preshift)
+/* candidates up to 2^97 */
+{
+  cl_ulong f[CPU_TF_LANES][2], finv[CPU_TF_LANES], one[CPU_TF_LANES][2], x[CPU_TF_LANES][2];
+  cl_uint  i, l, j, lanes;
+  int      b;
+
+  for (i = 0; i < count; i += CPU_TF_LANES)
+  {
+    lanes = MIN(CPU_TF_LANES, count - i);
+    for (l = 0; l < CPU_TF_LANES; l++)
+    {
+      f[l][0] = mac64(1, k_base + (cl_ulong)ktab[i + MIN(l, lanes - 1)] * NUM_CLASSES, 2 * (cl_ulong)exp, 0, &f[l][1]);
+      finv[l] = mont_inv(f[l][0]);
+      mont_one2(one[l], f[l]);
+      x[l][0] = one[l][0];
+      x[l][1] = one[l][1];
+      for (j = 0; j < preshift; j++) mont_dbl2(x[l], f[l]);
+    }
+    for (b = (int)shift - 1; b >= 0; b--)
+    {
+      for (l = 0; l < CPU_TF_LANES; l++) mont_mul2(x[l], x[l], x[l], f[l], finv[l]);
+      if (exp & (1U << b))
+      {
+        for (l = 0; l < CPU_TF_LANES; l++) mont_dbl2(x[l], f[l]);
+      }
+    }
+    for (l = 0; l < lanes; l++)
+    {
+      if (x[l][0] == one[l][0] && x[l][1] == one[l][1])
+        cpu_tf_report(res, (cl_uint)f[l][1], (cl_uint)(f[l][0] >> 32), (cl_uint)f[l][0]);
+    }
+  }
+}
+
+
+#ifdef CPU_TF_X86
+/* CPU_TF_IFMA: the same as cpu_tf_check2() but with AVX-512 IFMA, 8 candidates
+per vector. A number is stored in two 52-bit limbs, VPMADD52LUQ/VPMADD52HUQ
+add the lower/upper 52 bits of the 104-bit product of two limbs to a 64-bit
+accumulator. Montgomery multiplication uses R = 2^104.
+The values are not fully reduced: as long as 16 * f < R the result of a
+squaring of x < 4f is below 2f again, so the doubling needs no correction at
+all and the comparison is done once at the end. f < 2^97 because k < 2^64.
+The start value 2^preshift * R mod f is 2^(104 + preshift) - q * f, q from a
+double precision division. As long as q < 2^51 it is off by at most 1, so
+only the sign of the remainder needs a correction. This limits the preshift
+to bits(f) - 54 bits. */
+
+#define CPU_TF_IFMA_TARGET CPU_TF_TARGET("avx512f,avx512dq,avx512ifma")
+/* all 8 lanes: the zero-masked shifts/conversions start from a zeroed vector, the unmasked
+   forms pass _mm512_undefined_epi32() to the builtins and GCC 12 warns about that at -O3 */
+#define IFMA_ALL ((__mmask8)0xFF)
+
+CPU_TF_IFMA_TARGET
+static inline void ifma_redc(__m512i *x0, __m512i *x1, __m512i t0, __m512i t1, __m512i t2, __m512i t3,
+                             __m512i f0, __m512i f1, __m512i finv)
+/* x = t / 2^104 mod f, t < 2^104 * f */
+{
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i m;
+
+  m  = _mm512_madd52lo_epu64(zero, t0, finv);
+  t0 = _mm512_madd52lo_epu64(t0, m, f0);
+  t1 = _mm512_madd52hi_epu64(t1, m, f0);
+  t1 = _mm512_madd52lo_epu64(t1, m, f1);
+  t2 = _mm512_madd52hi_epu64(t2, m, f1);
+  t1 = _mm512_add_epi64(t1, _mm512_maskz_srli_epi64(IFMA_ALL, t0, 52));
+
+  m  = _mm512_madd52lo_epu64(zero, t1, finv);
+  t1 = _mm512_madd52lo_epu64(t1, m, f0);
+  t2 = _mm512_madd52hi_epu64(t2, m, f0);
+  t2 = _mm512_madd52lo_epu64(t2, m, f1);
+  t3 = _mm512_madd52hi_epu64(t3, m, f1);
+  t2 = _mm512_add_epi64(t2, _mm512_maskz_srli_epi64(IFMA_ALL, t1, 52));
+
+  *x0 = _mm512_and_si512(t2, _mm512_set1_epi64(CPU_TF_MASK52));
+  *x1 = _mm512_add_epi64(t3, _mm512_maskz_srli_epi64(IFMA_ALL, t2, 52));
+}
+
+
+CPU_TF_IFMA_TARGET
+static inline void ifma_sqr(__m512i *x0, __m512i *x1, __m512i f0, __m512i f1, __m512i finv)
+/* x = x^2 / 2^104 mod f, x < 4f */
+{
+  const __m512i zero = _mm512_setzero_si512();
+  __m512i t0, t1, t2, t3, x1d = _mm512_add_epi64(*x1, *x1);
+
+  t0 = _mm512_madd52lo_epu64(zero, *x0, *x0);
+  t1 = _mm512_madd52hi_epu64(zero, *x0, *x0);
+  t1 = _mm512_madd52lo_epu64(t1, *x0, x1d);
+  t2 = _mm512_madd52hi_epu64(zero, *x0, x1d);
+  t2 = _mm512_madd52lo_epu64(t2, *x1, *x1);
+  t3 = _mm512_madd52hi_epu64(zero, *x1, *x1);
+  ifma_redc(x0, x1, t0, t1, t2, t3, f0, f1, finv);
+}
+
+
+CPU_TF_IFMA_TARGET
+static inline void ifma_dbl(__m512i *x0, __m512i *x1)
+{
+  *x1 = _mm512_or_si512(_mm512_maskz_slli_epi64(IFMA_ALL, *x1, 1), _mm512_maskz_srli_epi64(IFMA_ALL, *x0, 51));
+  *x0 = _mm512_and_si512(_mm512_maskz_slli_epi64(IFMA_ALL, *x0, 1), _mm512_set1_epi64(CPU_TF_MASK52));
+}
+
+
+CPU_TF_IFMA_TARGET
+static inline void ifma_init(const cl_uint *ktab, cl_ulong k_base, cl_uint exp, __m512d b,
+                             __m512i *f0, __m512i *f1, __m512i *finv, __m512i *x0, __m512i *x1)
+/* f = 2 * k * exp + 1 for the 8 candidates ktab[0..7], x = b mod f */
+{
+  const __m512i zero = _mm512_setzero_si512(), mask = _mm512_set1_epi64(CPU_TF_MASK52);
+  const __m512i one = _mm512_set1_epi64(1), two = _mm512_set1_epi64(2), e2 = _mm512_set1_epi64(2 * (cl_ulong)exp);
+  __m512i  k, p0, p1, inv;
+  __m512d  fd, q;
+  __mmask8 m;
+  int      i;
+
+  k   = _mm512_maskz_cvtepu32_epi64(IFMA_ALL, _mm256_loadu_si256((const __m256i *)ktab));
+  k   = _mm512_add_epi64(_mm512_maskz_mul_epu32(IFMA_ALL, k, _mm512_set1_epi64(NUM_CLASSES)), _mm512_set1_epi64(k_base));
+
+  p0  = _mm512_madd52lo_epu64(one, k, e2);
+  p1  = _mm512_madd52hi_epu64(zero, k, e2);
+  p1  = _mm512_madd52lo_epu64(p1, _mm512_maskz_srli_epi64(IFMA_ALL, k, 52), e2);
+  *f1 = _mm512_add_epi64(p1, _mm512_maskz_srli_epi64(IFMA_ALL, p0, 52));
+  *f0 = _mm512_and_si512(p0, mask);
+
+  /* -1/f mod 2^52, Newton iteration */
+  inv = *f0;
+  for (i = 0; i < 5; i++)
+  {
+    p0  = _mm512_sub_epi64(two, _mm512_madd52lo_epu64(zero, *f0, inv));
+    inv = _mm512_madd52lo_epu64(zero, inv, p0);
+  }
+  *finv = _mm512_and_si512(_mm512_sub_epi64(zero, inv), mask);
+
+  /* x = b - q * f mod 2^104 */
+  fd = _mm512_fmadd_pd(_mm512_cvtepu64_pd(*f1), _mm512_set1_pd(4503599627370496.0), _mm512_cvtepu64_pd(*f0));
+  q  = _mm512_maskz_roundscale_pd(IFMA_ALL, _mm512_div_pd(b, fd), _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC);
+  k  = _mm512_cvttpd_epu64(q);
+  p0 = _mm512_madd52lo_epu64(zero, k, *f0);
+  p1 = _mm512_madd52hi_epu64(zero, k, *f0);
+  p1 = _mm512_madd52lo_epu64(p1, k, *f1);
+  m  = _mm512_cmpneq_epu64_mask(p0, zero);  /* borrow */
+  p0 = _mm512_and_si512(_mm512_sub_epi64(zero, p0), mask);
+  p1 = _mm512_sub_epi64(zero, p1);
+  p1 = _mm512_mask_sub_epi64(p1, m, p1, one);
+  /* negative, q was one too big: add f */
+  m  = _mm512_test_epi64_mask(p1, _mm512_set1_epi64(1ULL << 51));
+  p0 = _mm512_mask_add_epi64(p0, m, p0, *f0);
+  p1 = _mm512_mask_add_epi64(p1, m, p1, *f1);
+  *x1 = _mm512_and_si512(_mm512_add_epi64(p1, _mm512_maskz_srli_epi64(IFMA_ALL, p0, 52)), mask);
+  *x0 = _mm512_and_si512(p0, mask);
+}
+
+
+CPU_TF_IFMA_TARGET
+static void cpu_tf_report_ifma(cl_uint *res, __mmask8 found, __m512i f0, __m512i f1, cl_uint lanes)
+{
+  cl_ulong lo[8], hi[8], f;
+  cl_uint  l;
+
+  _mm512_storeu_si512(lo, f0);
+  _mm512_storeu_si512(hi, f1);
+  for (l = 0; l < 8 && l < lanes; l++)
+  {
+    if (found & (1 << l))
+    {
+      f = lo[l] | (hi[l] << 52);
+      cpu_tf_report(res, (cl_uint)(hi[l] >> 12), (cl_uint)(f >> 32), (cl_uint)f);
+    }
+  }
+}
+
+
+CPU_TF_IFMA_TARGET
+static void cpu_tf_check_ifma(cl_uint exp, cl_ulong k_base, const cl_uint *ktab, cl_uint count, cl_uint *res, cl_uint shift, cl_uint preshift)
+/* candidates of at least 2^(preshift + 54) and below 2^100 */
+{
+  const __m512i zero = _mm512_setzero_si512(), one = _mm512_set1_epi64(1);
+  __m512i  f0[2], f1[2], finv[2], x0[2], x1[2];
+  __m512d  b = _mm512_set1_pd(ldexp(1.0, 104 + preshift));
+  __mmask8 found;
+  cl_uint  i, j, lanes, tail[CPU_TF_IFMA_LANES];
+  const cl_uint *kt;
+  int      bit;
+
+  for (i = 0; i < count; i += CPU_TF_IFMA_LANES)
+  {
+    lanes = MIN(CPU_TF_IFMA_LANES, count - i);
+    kt = ktab + i;
+    if (lanes < CPU_TF_IFMA_LANES)
+    {
+      /* unused lanes repeat the last candidate */
+      for (j = 0; j < CPU_TF_IFMA_LANES; j++) tail[j] = ktab[i + MIN(j, lanes - 1)];
+      kt = tail;
+    }
+    ifma_init(kt,     k_base, exp, b, &f0[0], &f1[0], &finv[0], &x0[0], &x1[0]);
+    ifma_init(kt + 8, k_base, exp, b, &f0[1], &f1[1], &finv[1], &x0[1], &x1[1]);
+
+    for (bit = (int)shift - 1; bit >= 0; bit--)
+    {
+      ifma_sqr(&x0[0], &x1[0], f0[0], f1[0], finv[0]);
+      ifma_sqr(&x0[1], &x1[1], f0[1], f1[1], finv[1]);
+      if (exp & (1U << bit))
+      {
+        ifma_dbl(&x0[0], &x1[0]);
+        ifma_dbl(&x0[1], &x1[1]);
+      }
+    }
+
+    /* back from Montgomery form, this is fully reduced: f is a factor if x == 1 */
+    for (j = 0; j < 2; j++)
+    {
+      ifma_redc(&x0[j], &x1[j], x0[j], x1[j], zero, zero, f0[j], f1[j], finv[j]);
+      found = _mm512_cmpeq_epu64_mask(x0[j], one) & _mm512_cmpeq_epu64_mask(x1[j], zero);
+      if (found && lanes > j * 8) cpu_tf_report_ifma(res, found, f0[j], f1[j], lanes - j * 8);
+    }
+  }
+}
+
+
+static int cpu_tf_ifma_supported()
+{
+  static int supported = -1;
+
+  if (supported < 0)
+  {
+#ifdef _MSC_VER
+    int info[4];
+    unsigned long long xcr0;
+
+    supported = 0;
+    __cpuid(info, 0);
+    if (info[0] < 7) return supported;
+    __cpuid(info, 1);
+    if ((info[2] & (1 << 27)) == 0) return supported; /* no OSXSAVE */
+    xcr0 = _xgetbv(0);
+    __cpuidex(info, 7, 0);
+    /* AVX512F, AVX512DQ, AVX512IFMA */
+    supported = ((info[1] & 0x230000) == 0x230000) && ((xcr0 & 0xE6) == 0xE6);
+#else
+    __builtin_cpu_init();
+    supported = __builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq") &&
+                __builtin_cpu_supports("avx512ifma");
+#endif
+  }
+  return supported;
+}
+#endif /* CPU_TF_X86 */
+
+
+static void cpu_tf_thread()
+{
+  cl_uint my_job = 0, chunk, first;
+
+  std::unique_lock<std::mutex> lock(tf_lock);
+  while (!shutdown_pool)
+  {
+    if (job_id == my_job)
+    {
+      cv_work.wait(lock);
+      continue;
+    }
+    my_job = job_id;
+    lock.unlock();
+
+    while ((first = (chunk = next_chunk++) * CPU_TF_CHUNK) < job_count)
+    {
+      cpu_tf_candidates(job_kernel, job_exp, job_k_base, job_ktab + first, MIN(CPU_TF_CHUNK, job_count - first), job_res);
+    }
+
+    lock.lock();
+    if (--busy == 0) cv_done.notify_all();
+  }
+}
+
+
+static void cpu_tf_start(enum GPUKernels kernel, cl_uint exp, cl_ulong k_base, const cl_uint *ktab, cl_uint count, cl_uint *res)
+{
+  {
+    std::lock_guard<std::mutex> lock(tf_lock);
+    job_kernel = kernel;
+    job_exp    = exp;
+    job_k_base = k_base;
+    job_ktab   = ktab;
+    job_count  = count;
+    job_res    = res;
+    next_chunk = 0;
+    busy       = num_threads;
+    job_id++;
+  }
+  cv_work.notify_all();
+}
+
+
+static void cpu_tf_wait()
+{
+  std::unique_lock<std::mutex> lock(tf_lock);
+  while (busy > 0) cv_done.wait(lock);
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int cpu_tf_kernel_supported(enum GPUKernels kernel)
+/* can this CPU (and this build) run the host TF kernel? */
+{
+  if (kernel == CPU_TF) return 1;
+#ifdef CPU_TF_X86
+  if (kernel == CPU_TF_IFMA) return cpu_tf_ifma_supported();
+#endif
+  return 0;
+}
+
+
+void cpu_tf_candidates(enum GPUKernels kernel, cl_uint exp, cl_ulong k_base, const cl_uint *ktab, cl_uint count, cl_uint *res)
+/* check the factor candidates k_base + ktab[i] * NUM_CLASSES, i < count, of M<exp> in the
+calling thread. CPU_TF_IFMA falls back to the scalar code for candidates below 2^55. */
+{
+  cl_uint shift, preshift;
+
+  if (count == 0) return;
+
+#ifdef CPU_TF_X86
+  if (kernel == CPU_TF_IFMA && cpu_tf_ifma_supported())
+  {
+    cl_ulong f_lo, f_hi;
+    cl_uint  maxpre;
+
+    /* ktab is sorted, the first candidate is the smallest one, it limits the preshift */
+    f_lo   = mac64(1, k_base + (cl_ulong)ktab[0] * NUM_CLASSES, 2 * (cl_ulong)exp, 0, &f_hi);
+    maxpre = f_hi ? bits64(f_hi) + 10 : ((bits64(f_lo) > 54) ? bits64(f_lo) - 54 : 0);
+    if (maxpre > 0)
+    {
+      for (shift = bits64(exp); shift > 0 && (exp >> (shift - 1)) <= maxpre; shift--);
+      preshift = exp >> shift;
+      cpu_tf_check_ifma(exp, k_base, ktab, count, res, shift, preshift);
+      return;
+    }
+  }
+#endif
+
+  shift    = (bits64(exp) > CPU_TF_PRESHIFT) ? bits64(exp) - CPU_TF_PRESHIFT : 0;
+  preshift = exp >> shift;  /* 16 .. 31 for all useful exponents */
+
+  /* the last candidate is the biggest one */
+  if (k_base + (cl_ulong)ktab[count - 1] * NUM_CLASSES <= ((1ULL << 62) - 1) / exp)
+    cpu_tf_check1(exp, k_base, ktab, count, res, shift, preshift);
+  else
+    cpu_tf_check2(exp, k_base, ktab, count, res, shift, preshift);
+}
+
+
+int cpu_tf_init(mystuff_t *mystuff)
+/* start the TF threads and allocate the host buffers which would otherwise come
+from init_CLstreams() */
+{
+  cl_uint i;
+
+  num_threads = mystuff->host_tf_threads;
+  if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+  if (num_threads == 0) num_threads = 1;
+
+  ktab_size = mystuff->threads_per_grid;
+  for (i = 0; i < 2; i++)
+  {
+    if ((ktabs[i] = (cl_uint *) malloc(ktab_size * sizeof(cl_uint) + 4)) == NULL)
+    {
+      printf("ERROR: malloc(ktab[%d]) failed\n", i);
+      return 1;
+    }
+  }
+  if ((mystuff->h_RES = (cl_uint *) calloc(RES_SIZE, sizeof(cl_uint))) == NULL)
+  {
+    printf("ERROR: malloc(h_RES) failed\n");
+    return 1;
+  }
+
+  shutdown_pool = 0;
+  busy = 0;
+  threads = new std::thread[num_threads];
+  for (i = 0; i < num_threads; i++)
+  {
+    threads[i] = std::thread(cpu_tf_thread);
+  }
+  if (mystuff->verbosity >= 1) logprintf(mystuff, "Trial factoring on the host using %u threads\n", num_threads);
+
+  return 0;
+}
+
+
+void cpu_tf_free(mystuff_t *mystuff)
+{
+  cl_uint i;
+
+  if (threads != NULL)
+  {
+    {
+      std::lock_guard<std::mutex> lock(tf_lock);
+      shutdown_pool = 1;
+    }
+    cv_work.notify_all();
+    for (i = 0; i < num_threads; i++) threads[i].join();
+    delete[] threads;
+    threads = NULL;
+    num_threads = 0;
+  }
+  for (i = 0; i < 2; i++)
+  {
+    free(ktabs[i]);
+    ktabs[i] = NULL;
+  }
+  free(mystuff->h_RES);
+  mystuff->h_RES = NULL;
+}
+
+
+int tf_class_cpu(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPUKernels use_kernel)
+/* same as tf_class_opencl() for the host TF kernels CPU_TF and CPU_TF_IFMA */
+{
+  struct timeval timer, timer2;
+  cl_ulong twait = 0, k_grid = 0;
+  cl_uint  count = 0, *ktab = NULL;
+  int      running = 0, prepared;
+
+  timer_init(&timer);
+#ifdef DETAILED_INFO
+  printf("tf_class_cpu(%u, %d, %llu, %llu, ...)\n",
+      mystuff->exponent, mystuff->bit_min, (long long unsigned int) k_min, (long long unsigned int) k_max);
+#endif
+
+  if (k_max <= k_min) k_max = k_min + 1;  // otherwise it would skip small bit ranges
+  memset(mystuff->h_RES, 0, RES_SIZE * sizeof(cl_uint));
+
+  while ((k_min <= k_max) || running)
+  {
+    /* sieve the next grid while the TF threads work on the previous one */
+    prepared = 0;
+    if (k_min <= k_max)
+    {
+      ktab = ktabs[count & 1];
+      if (mystuff->sieve_threads > 0)
+        sievepool_candidates(ktab_size, ktab);
+      else
+        sieve_candidates(mystuff->sieve_ctx, ktab_size, ktab, mystuff->sieve_primes);
+      k_grid = k_min;
+      k_min += ((cl_ulong)ktab[ktab_size - 1] + 1) * NUM_CLASSES;
+      prepared = 1;
+    }
+
+    if (running)
+    {
+      timer_init(&timer2);
+      cpu_tf_wait();
+      if (prepared) twait += timer_diff(&timer2);  // waiting for the last grid is unavoidable
+      running = 0;
+    }
+
+    if (prepared)
+    {
+      cpu_tf_start(use_kernel, mystuff->exponent, k_grid, ktab, ktab_size, mystuff->h_RES);
+      running = 1;
+      count++;
+    }
+  }
+
+  if (mystuff->verbosity > 2)
+  {
+    printArray("RES", mystuff->h_RES, 32, 0);
+  }
+
+  return tf_class_finish(mystuff, use_kernel, count, twait, timer_diff(&timer));
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,42 @@
+/*
+This file is part of mfaktc (mfakto).
+Copyright (C) 2009 - 2014  Oliver Weihe (o.weihe@t-online.de)
+                           Bertram Franz (bertramf@gmx.net)
+
+mfaktc (mfakto) is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+mfaktc (mfakto) is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef CPU_TF_H_
+#define CPU_TF_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "my_types.h"
+
+/* Trial factoring on the host, no OpenCL needed (-d h, kernels CPU_TF and
+CPU_TF_IFMA). The CPU sieve fills the ktabs as usual, a pool of threads checks
+the candidates with Montgomery arithmetic and reports the factors in h_RES, in
+the same format as the 32-bit GPU kernels. */
+
+int  cpu_tf_init(mystuff_t *mystuff);
+void cpu_tf_free(mystuff_t *mystuff);
+int  cpu_tf_kernel_supported(enum GPUKernels kernel);
+int  tf_class_cpu(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPUKernels use_kernel);
+void cpu_tf_candidates(enum GPUKernels kernel, cl_uint exp, cl_ulong k_base, const cl_uint *ktab, cl_uint count, cl_uint *res);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -33,6 +33,10 @@ See (http://www.mersenneforum.org/showthread.php?t=11900) for Ben's initial work
 unsigned int modularinverse (uint n, uint orig_d);
 
 uint extract_bits(const uint bits_to_process, const uint tid, const uint lid, __local ushort *bitcount, __local ushort *smem, const __global uint * restrict bit_array);
+int96_t class_k_base96(const int96_t k_base, const uint delta);
+int75_t class_k_base75(const int75_t k_base, const uint delta);
+uint compact_scan(__local uint *sum, const uint count, const uint lid);
+uint compact_chunk_count(const __global uint * restrict chunk);
 
 // end prototypes
 
@@ -45,8 +49,8 @@ uint extract_bits(const uint bits_to_process, const uint tid, const uint lid, __
 // diagnostics
 // #define GWDEBUG
 
-// Primes up to 16M can be handled by this many "rows" of 256 primes
-#define MAX_PRIMES_PER_THREAD	4224
+// Primes up to 16M can be handled by this many "rows" of 256 primes, plus the "rows" of bucket-sieved primes
+#define MAX_PRIMES_PER_THREAD	39168
 
 // Size of shared memory array in bytes
 #define block_size_in_bytes 8192
@@ -55,6 +59,10 @@ __constant uint block_size = block_size_in_bytes * 8;
 // Threads per block
 #define threadsPerBlock 256
 
+// The sieve kernels are only built into the gpusieve program, the TF-kernels need just
+// extract_bits(), class_k_base*(), compact_chunk_count() and the GS_ macros below.
+#ifdef KERNEL_GROUP_GPUSIEVE
+
 #ifdef MORE_CLASSES
 // Primes 2, 3, 5, 7, 11 are not sieved
 #define primesNotSieved 5
@@ -252,14 +260,28 @@ __inline void bitOrSometimesIffy (__local uchar *locsieve, uint bclr)
 	contention between threads because the marking process is write only.  Because each thread
 	block starts at a different part of the big bit array, a small amount of computation must
 	be done for each prime prior to sieving to figure out the first bit to clear.
+
+	When several classes are sieved at once, the big bit array consists of one segment of
+	blocks_per_class blocks per class, and each class has its own copy of the prime info
+	(pinfo_stride bytes apart) holding the bit-to-clear values of that class.
+	For a single class, blocks_per_class is the number of blocks.
+
+	The primes above the bucket threshold are not in the maxp "rows".  BucketScatter has put
+	their hits into the bucket of each block (bucket_count[block] hits, at most bucket_size),
+	the block only has to clear these bits.  SegSieve empties the buckets for the next run.
 */
 
-__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) SegSieve (__global uchar *big_bit_array_dev, __global uchar *pinfo_dev, uint maxp)
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) SegSieve (__global uchar *big_bit_array_dev, __global uchar *pinfo_dev, uint maxp,
+                                                                         uint blocks_per_class, uint pinfo_stride, uint bucket_size,
+                                                                         __global uint *bucket_count, const __global ushort * restrict bucket_hits)
 {
 	__local uchar locsieve[block_size_in_bytes];
-	uint block_start = get_group_id(0) * block_size;
+	uint class_index = get_group_id(0) / blocks_per_class;
+	uint block_start = (get_group_id(0) - class_index * blocks_per_class) * block_size;
 	uint i, j, p, pinv, bclr;
 
+	pinfo_dev += class_index * pinfo_stride;
+
 #define big_bit_array32	((__global uint *) big_bit_array_dev)
 #define locsieve32	((__local uint *) locsieve)
 #define locsieve64	((__local ulong *) locsieve)
@@ -1285,8 +1307,19 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1))) SegSieve (__globa
 		if (bclr < block_size) bitOr (locsieve, bclr);
 	}
 
-	// sync before copying
-	barrier(CLK_LOCAL_MEM_FENCE);
+	// Clear the hits of the bucket-sieved primes
+	if (bucket_size > 0) {
+		uint	count = min (bucket_count[get_group_id(0)], bucket_size);
+		const __global ushort *hits = bucket_hits + get_group_id(0) * bucket_size;
+
+		for (i = get_local_id(0); i < count; i += threadsPerBlock)
+			bitOr (locsieve, hits[i]);
+	}
+
+	// sync before copying (and before emptying the bucket)
+	barrier(CLK_LOCAL_MEM_FENCE | CLK_GLOBAL_MEM_FENCE);
+
+	if (bucket_size > 0 && get_local_id(0) == 0) bucket_count[get_group_id(0)] = 0;
 
 #if (TRACE_SIEVE_KERNEL > 0)
     if (get_global_id(0) == TRACE_SIEVE_TID)
@@ -1304,6 +1337,37 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1))) SegSieve (__globa
 		big_bit_array32[j * threadsPerBlock + get_local_id(0)] = ~locsieve32[j * threadsPerBlock + get_local_id(0)];
 }
 
+// Scatter the hits of the bucket-sieved primes into the buckets of the SegSieve blocks.
+// These primes are above the bucket threshold (at least one block), so they hit most blocks not at all
+// and each block at most once: instead of having every block check every prime, each thread walks
+// the bits of one prime through all blocks of a class and appends each hit to the bucket of that block.
+// The "rows" of these primes start at calc_info row first_row, the second dimension of the NDRange is
+// the class like in CalcBitToClear.  A full bucket drops the hit, that only lets a candidate survive.
+
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) BucketScatter (__global int *calc_info, __global uchar *pinfo_dev, uint pinfo_stride,
+                                                                              uint first_row, uint blocks_per_class, uint bucket_size,
+                                                                              __global uint *bucket_count, __global ushort *bucket_hits)
+{
+	uint	row = first_row + get_group_id(0);
+	uint	index;		// Index for prime data in calc_info
+	uint	prime;		// The bucket-sieved prime
+	uint	bit, end, block, slot;
+
+	pinfo_dev += get_group_id(1) * pinfo_stride + calc_info[row] + get_local_id(0) * 4;
+	index = calc_info[MAX_PRIMES_PER_THREAD + row] + get_local_id(0);
+	prime = calc_info[MAX_PRIMES_PER_THREAD*4 + index * 2];
+
+	end = blocks_per_class * block_size;
+	for (bit = *pinfo32; bit < end; bit += prime) {
+		block = get_group_id(1) * blocks_per_class + bit / block_size;
+		slot = ATOMIC_INC(bucket_count[block]);
+		if (slot < bucket_size) bucket_hits[block * bucket_size + slot] = bit & (block_size - 1);
+	}
+#if (TRACE_SIEVE_KERNEL > 2)
+    if (get_global_id(0) == TRACE_SIEVE_TID) printf((__constant char *)"BucketScatter: row=%u, prime=%u, bit_to_clear=%u\n", row, prime, *pinfo32);
+#endif
+}
+
 //
 // Sieve initialization kernels
 //
@@ -1373,9 +1437,13 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CalcModularInvers
 }
 
 
-// Calculate the initial bit-to-clear values
+// Calculate the initial bit-to-clear values.
+// The second dimension of the NDRange is the class: class i starts at k_base + class_delta[i]
+// and stores its bit-to-clear values in the prime info copy pinfo_stride bytes after class i-1.
+// A single class is a 1-dimensional launch with class_delta[0] = 0.
 
-__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CalcBitToClear (uint exponent, ulong k_base, __global int *calc_info, __global uchar *pinfo_dev)
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CalcBitToClear (uint exponent, ulong k_base, __global int *calc_info, __global uchar *pinfo_dev,
+                                                                               const __global uint * restrict class_delta, uint pinfo_stride)
 {
 	uint	index;		// Index for prime and modinv data in calc_info
 	uint	mask;		// Mask that tells us what bits must be preserved in pinfo_dev when setting bit-to-clear
@@ -1388,6 +1456,9 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CalcBitToClear (u
 #if (TRACE_SIEVE_KERNEL > 3)
     if (get_global_id(0) == TRACE_SIEVE_TID) printf((__constant char *)"CalcBitToClear: grpid=%d, locid=%d, exp=%u, k_base=%llu\n", get_group_id(0), get_local_id(0), exponent, k_base);
 #endif
+	k_base += class_delta[get_group_id(1)];
+	pinfo_dev += get_group_id(1) * pinfo_stride;
+
 	if (get_group_id(0) == 0) {
 		if (get_local_id(0) < primesNotSieved || get_local_id(0) >= primesNotSieved + primesHandledWithSpecialCode) return;
 		pinfo_dev += get_local_id(0) * 2;
@@ -1454,6 +1525,60 @@ if (factor_mod_p != 0)
 }	
 
 
+// Advance the bit-to-clear values by <advance> bits, i.e. to what CalcBitToClear would
+// calculate for k_base + advance * NUM_CLASSES.  Used for all but the first chunk of a class:
+// a 32-bit modulo and a subtraction instead of the 64-bit modulos and multiplications.
+
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) AdvanceBitToClear (uint advance, __global int *calc_info, __global uchar *pinfo_dev)
+{
+	uint	index;		// Index for prime data in calc_info
+	uint	mask;		// Mask that tells us what bits must be preserved in pinfo_dev when setting bit-to-clear
+	uint	prime;		// Advance the bit-to-clear of this prime number
+	uint	advance_mod_p;	// advance mod prime
+	uint	bit_to_clear;	// Old, then new bit to clear
+
+// Handle the primes that are processed with special code.  That is, they are not part of an official "row" in pinfo_dev.
+
+	if (get_group_id(0) == 0) {
+		if (get_local_id(0) < primesNotSieved || get_local_id(0) >= primesNotSieved + primesHandledWithSpecialCode) return;
+		pinfo_dev += get_local_id(0) * 2;
+		index = get_local_id(0);
+		bit_to_clear = *pinfo16;
+	}
+
+// Get info on the "row" of pinfo_dev we are working on, same as in CalcBitToClear.
+
+	else {
+		pinfo_dev += calc_info[(get_group_id(0) - 1)];
+		pinfo_dev += get_local_id(0) * 4;
+		index = calc_info[MAX_PRIMES_PER_THREAD + (get_group_id(0) - 1)];
+		index += get_local_id(0) * calc_info[MAX_PRIMES_PER_THREAD*2 + (get_group_id(0) - 1)];
+		mask = calc_info[MAX_PRIMES_PER_THREAD*3 + (get_group_id(0) - 1)];
+		bit_to_clear = *pinfo32 & ~mask;
+	}
+
+	prime = calc_info[MAX_PRIMES_PER_THREAD*4 + index * 2];
+	advance_mod_p = advance % prime;
+
+// The first k divisible by prime moved advance bits closer to the start: bit_to_clear - advance mod prime
+
+	bit_to_clear = (bit_to_clear >= advance_mod_p) ? bit_to_clear - advance_mod_p : bit_to_clear + prime - advance_mod_p;
+
+#if (TRACE_SIEVE_KERNEL > 2)
+    if (get_global_id(0) == TRACE_SIEVE_TID) printf((__constant char *)"AdvanceBitToClear: prime=%d, advance=%u, bit_to_clear=%d\n", prime, advance, bit_to_clear);
+#endif
+
+	if (get_group_id(0) == 0) {
+		*pinfo16 = bit_to_clear;
+	}
+	else {
+		*pinfo32 = (*pinfo32 & mask) + bit_to_clear;
+	}
+}
+
+#endif // KERNEL_GROUP_GPUSIEVE
+
+
 /* This function is used at the beginning of each GPU-sieve TF-kernel in order to extract the bits from the sieve.
    returns total number of bits set */
 
@@ -1631,4 +1756,198 @@ uint extract_bits(const uint bits_to_process, const uint tid, const uint lid, __
         total_bit_count-2, smem[total_bit_count-2], smem[total_bit_count-1]);
 #endif
   return total_bit_count;
-}
\ No newline at end of file
+}
+
+
+/* The GPU-sieve TF-kernels may process several classes in one launch, one segment of
+   blocks_per_class blocks per class (see SegSieve). These return the k_base of a class,
+   given the k_base of the first class and the distance delta (< NUM_CLASSES) to it. */
+
+int96_t class_k_base96(const int96_t k_base, const uint delta)
+{
+  int96_t k;
+
+  k.d0 = k_base.d0 + delta;
+  k.d1 = k_base.d1 + (k.d0 < delta);
+  k.d2 = k_base.d2;
+
+  return k;
+}
+
+int75_t class_k_base75(const int75_t k_base, const uint delta)
+{
+  int75_t k;
+
+  k.d0 = k_base.d0 + delta;
+  k.d1 = k_base.d1 + (k.d0 >> 15);
+  k.d2 = k_base.d2 + (k.d1 >> 15);
+  k.d3 = k_base.d3 + (k.d2 >> 15);
+  k.d4 = k_base.d4 + (k.d3 >> 15);
+
+  k.d0 &= 0x7FFF;
+  k.d1 &= 0x7FFF;
+  k.d2 &= 0x7FFF;
+  k.d3 &= 0x7FFF;
+
+  return k;
+}
+
+
+/* Optional stream compaction of the GPU sieve output (GPUSieveCompact=1, -DGPU_SIEVE_COMPACT).
+   Instead of each GPU-sieve TF-kernel block extracting the candidates of its slice of bits_to_process
+   bits into local memory, three small kernels write the bit numbers of all candidates into one dense
+   list: CompactCount counts the candidates of each slice, CompactScan turns these counts into list
+   offsets and CompactWrite stores the bit numbers.  Each class starts at a multiple of
+   GS_COMPACT_CHUNK entries, so every TF block gets up to GS_COMPACT_CHUNK candidates of one class,
+   independent of the survival rate of the sieve.  The unused entries at the end of a class are set to
+   GS_COMPACT_UNUSED and the TF blocks stop at the first of them (compact_chunk_count): padding with a
+   real bit would test (and report) that k once per padded entry and could overflow RES. */
+
+// Each thread of a TF block tests up to GS_COMPACT_LOOPS * VECTOR_SIZE candidates of the compacted list
+#define GS_COMPACT_LOOPS 4
+#define GS_COMPACT_CHUNK (256 * VECTOR_SIZE * GS_COMPACT_LOOPS)
+#define GS_COMPACT_UNUSED 0xFFFFFFFF
+
+#ifdef GPU_SIEVE_COMPACT
+  // bit_array is the compacted list: all entries of a TF block belong to the same class.
+  // Lanes of the last vector beyond total_bit_count repeat the last candidate (reported at most VECTOR_SIZE times).
+  #define GS_CLASS_INDEX (bit_array[get_group_id(0) * GS_COMPACT_CHUNK] / (blocks_per_class * bits_to_process))
+  #define GS_K_DELTA(i)  (bit_array[get_group_id(0) * GS_COMPACT_CHUNK + min((uint)(i), total_bit_count - 1)] - class_index * blocks_per_class * bits_to_process)
+
+/* Number of candidates in a chunk of the compacted list: the candidates come first, followed by
+   GS_COMPACT_UNUSED entries.  The first entry of a chunk is always a candidate. */
+
+uint compact_chunk_count(const __global uint * restrict chunk)
+{
+  uint lo = 1, hi = GS_COMPACT_CHUNK, mid;
+
+  while (lo < hi)
+  {
+    mid = (lo + hi) >> 1;
+    if (chunk[mid] == GS_COMPACT_UNUSED) hi = mid;
+    else                                 lo = mid + 1;
+  }
+  return lo;
+}
+#else
+  #define GS_CLASS_INDEX (get_group_id(0) / blocks_per_class)
+  #define GS_K_DELTA(i)  mad24(bits_to_process, block, (uint)(smem[i]))
+#endif
+
+#ifdef KERNEL_GROUP_GPUSIEVE
+
+/* Exclusive prefix sum of count over the 256 threads of a block, sum[255] is the total afterwards.
+   Same tallies as in extract_bits, but in 32 bits as a slice may hold more than 64K candidates. */
+
+uint compact_scan(__local uint *sum, const uint count, const uint lid)
+{
+  uint i;
+
+  sum[lid] = count;
+  barrier(CLK_LOCAL_MEM_FENCE);
+  for (i = 1; i < 256; i <<= 1)
+  {
+    if (lid & i) sum[lid] += sum[(lid & ~(2 * i - 1)) | (i - 1)];
+    barrier(CLK_LOCAL_MEM_FENCE);
+  }
+  return sum[lid] - count;
+}
+
+// Count the candidates of each slice of bits_to_process bits, one block per slice.
+
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CompactCount (const __global uint * restrict bit_array, const uint bits_to_process,
+                                                                             __global uint * restrict slice_count)
+{
+  __local  uint sum[256];
+  __private uint i, count = 0, lid = get_local_id(0);
+  __private uint words_per_thread = bits_to_process / 8192; // 256 threads * 32 bits per word
+
+  bit_array += mul24((uint)get_global_id(0), words_per_thread);
+  for (i = 0; i < words_per_thread; i++)
+    count += popcount(bit_array[i]);
+
+  compact_scan(sum, count, lid);
+  if (lid == 0) slice_count[get_group_id(0)] = sum[255];
+}
+
+// Turn the candidate counts of the slices into offsets in the compacted list (in place), class by class,
+// and pad each class to full TF blocks.  A single block of 256 threads.
+// list_info[0]: number of TF blocks, [1]: number of candidates, [2]: 1 if the list was too small.
+
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CompactScan (__global uint * restrict slice_count, const uint num_slices,
+                                                                            const uint slices_per_class, const uint bits_to_process,
+                                                                            const uint list_size, __global uint * restrict list,
+                                                                            __global uint * restrict list_info)
+{
+  __local  uint sum[256];
+  __private uint lid = get_local_id(0);
+  __private uint per_thread = (slices_per_class + 255) / 256;
+  __private uint class_index, s, first, last, count, offset, end, i;
+  __private uint base = 0, candidates = 0;
+
+  for (class_index = 0; class_index < num_slices / slices_per_class; class_index++)
+  {
+    first = class_index * slices_per_class + min(lid * per_thread, slices_per_class);
+    last  = class_index * slices_per_class + min((lid + 1) * per_thread, slices_per_class);
+
+    count = 0;
+    for (s = first; s < last; s++) count += slice_count[s];
+
+    offset = base + compact_scan(sum, count, lid);
+    for (s = first; s < last; s++)
+    {
+      i = slice_count[s];
+      slice_count[s] = offset;
+      offset += i;
+    }
+
+    end = base + sum[255];
+    candidates += sum[255];
+    base += (sum[255] + GS_COMPACT_CHUNK - 1) / GS_COMPACT_CHUNK * GS_COMPACT_CHUNK;
+    for (i = end + lid; i < min(base, list_size); i += 256)
+      list[i] = GS_COMPACT_UNUSED;
+
+    barrier(CLK_LOCAL_MEM_FENCE);  // sum[] is reused by the next class
+  }
+
+  if (lid == 0)
+  {
+    list_info[0] = (base <= list_size) ? base / GS_COMPACT_CHUNK : 0;
+    list_info[1] = candidates;
+    list_info[2] = (base > list_size);
+  }
+#if (TRACE_SIEVE_KERNEL > 1)
+  if (lid == TRACE_SIEVE_TID) printf((__constant char *)"CompactScan: %u slices, %u candidates, %u list entries\n", num_slices, candidates, base);
+#endif
+}
+
+// Write the bit numbers of the candidates of each slice to the compacted list, one block per slice.
+
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CompactWrite (const __global uint * restrict bit_array, const uint bits_to_process,
+                                                                             const __global uint * restrict slice_offset,
+                                                                             const uint list_size, __global uint * restrict list)
+{
+  __local  uint sum[256];
+  __private uint i, count = 0, pos, sieve_word, k_bit_base, lid = get_local_id(0);
+  __private uint words_per_thread = bits_to_process / 8192; // 256 threads * 32 bits per word
+
+  bit_array += mul24((uint)get_global_id(0), words_per_thread);
+  for (i = 0; i < words_per_thread; i++)
+    count += popcount(bit_array[i]);
+
+  pos = slice_offset[get_group_id(0)] + compact_scan(sum, count, lid);
+  k_bit_base = get_global_id(0) * words_per_thread * 32;
+
+  for (i = 0; i < words_per_thread; i++, k_bit_base += 32)
+  {
+    for (sieve_word = bit_array[i]; sieve_word != 0; pos++)
+    {
+      int bit_to_test = 31 - clz(sieve_word);
+
+      sieve_word &= ~(1 << bit_to_test);
+      if (pos < list_size) list[pos] = k_bit_base + bit_to_test;
+    }
+  }
+}
+
+#endif // KERNEL_GROUP_GPUSIEVE
@@ -36,13 +36,12 @@ See (http://www.mersenneforum.org/showthread.php?t=11900) for Ben's initial work
 #include "my_types.h"
 #include "compatibility.h"
 #include "mfakto.h"
+#include "gpusieve.h"
 #include "output.h"
 
 // valgrind tests complain a lot about the blocks being uninitialized
 #define malloc(x) calloc(x,1)
 
-extern  cl_command_queue    QUEUE;
-extern  mystuff_t           mystuff;
 
 #define gen_pinv(p)  (0xFFFFFFFF / (p) + 1)
 #define gen_sloppy_pinv(p)  ((cl_uint) floor (4294967296.0 / (p) - 0.5))
@@ -50,14 +49,8 @@ extern  mystuff_t           mystuff;
 const cl_uint block_size_in_bytes = 8192;    // Size of shared memory array in bytes
 const cl_uint block_size = block_size_in_bytes * 8;  // Number of bits generated by each block
 const cl_uint threadsPerBlock = 256;      // Threads per block
-static    int  gpusieve_initialized = 0;
-static cl_uint last_exponent_initialized = 0;
-static cl_uint last_maxp = 0xFFFFFFFF;  // 0 is a bad choice for "uninitialized" as it can happen for small GPUSievePrimes
 
-
-// Global vars.  These could be moved to mystuff, but no other code needs to know about these internal values.
-
-cl_uint primes_per_thread = 0;    // Number of "rows" in the GPU sieving info array that each thread processes
+// The state of the GPU sieve of a device is in its device_t (dev->gpusieve_*, primes_per_thread, ...).
 
 // Various padding required to keep warps accessing primes data on 128-byte boundaries
 
@@ -126,11 +119,13 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   cl_uint  *rowinfo, *row;
   cl_uint  i, j, pinfo_size, rowinfo_size;
   cl_uint  k, loop_count, loop_end;
+  cl_uint  requested_primes;
   cl_int  status;
 
   // If we've already allocated GPU memory, return
-  if (gpusieve_initialized) return 0;
-  gpusieve_initialized = 1;
+  if (dev->gpusieve_initialized) return 0;
+  dev->gpusieve_initialized = 1;
+  dev->gpusieve_maxp = 0xFFFFFFFF;  // 0 is a bad choice for "uninitialized" as it can happen for small GPUSievePrimes
 
   cl_uint primesNotSieved = 5;      // Primes 2, 3, 5, 7, 11 are not sieved
   // cl_uint primesHandledWithSpecialCode = 13;  // Count of primes handled with inline code (not using primes array)
@@ -225,6 +220,18 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
   tiny_soe (mystuff->sieve_primes_upper_limit, primes);
 
+  // The "rows" of SegSieve can handle primes up to 16M. With the bucket sieve enabled, they only get the
+  // primes below the bucket threshold, the rest of the requested primes is bucket-sieved (see below).
+  requested_primes = mystuff->sieve_primes;
+  dev->bucket_rows = 0;
+  if (mystuff->sieve_primes > GPU_SIEVE_ROW_PRIMES_MAX) mystuff->sieve_primes = GPU_SIEVE_ROW_PRIMES_MAX;
+  if (mystuff->gpu_sieve_bucket_threshold > 0)
+  {
+    for (i = primesNotSieved + primesHandledWithSpecialCode; i < (cl_uint) mystuff->sieve_primes; i++)
+      if (primes[i] >= mystuff->gpu_sieve_bucket_threshold * block_size) break;
+    if (requested_primes > i + threadsPerBlock) mystuff->sieve_primes = i;
+  }
+
   // Round up SIEVE_PRIMES so that all threads stay busy in the last sieving loop
   // The first several primes are handled with special code.  After that, they
   // are processed in chunks of threadsPerBlock (256).
@@ -243,33 +250,33 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   for ( ; ; mystuff->sieve_primes += threadsPerBlock) {
 
     // compute how many "rows" of the primes info array each thread will be responsible for
-    primes_per_thread = (mystuff->sieve_primes - primesNotSieved - primesHandledWithSpecialCode) / threadsPerBlock;
+    dev->primes_per_thread = (mystuff->sieve_primes - primesNotSieved - primesHandledWithSpecialCode) / threadsPerBlock;
 
     // Make sure there are 0 mod 3 rows in the under 64K section!
-    if (primes_per_thread > 1) {
-      loop_count = MIN(primes_per_thread, sieving64KCrossover) - 1;
+    if (dev->primes_per_thread > 1) {
+      loop_count = MIN(dev->primes_per_thread, sieving64KCrossover) - 1;
       if ((loop_count % 3) != 0) continue;
     }
 
     // Make sure we don't try the 64K crossover row
-    if (primes_per_thread == sieving64KCrossover + 1) continue;
+    if (dev->primes_per_thread == sieving64KCrossover + 1) continue;
 
     // Make sure there are 1 mod 3 rows in 64K to 128K section!
-    if (primes_per_thread > sieving64KCrossover + 1) {
-      loop_count = MIN (primes_per_thread, sieving128KCrossover + 1) - (sieving64KCrossover + 1);
+    if (dev->primes_per_thread > sieving64KCrossover + 1) {
+      loop_count = MIN (dev->primes_per_thread, sieving128KCrossover + 1) - (sieving64KCrossover + 1);
       if ((loop_count % 3) != 1) continue;
     }
 
     // Make sure there are 1 mod 4 rows in 128K to 1M section!
-    if (primes_per_thread > sieving128KCrossover + 1) {
-      loop_count = MIN (primes_per_thread, sieving1MCrossover) - (sieving128KCrossover + 1);
+    if (dev->primes_per_thread > sieving128KCrossover + 1) {
+      loop_count = MIN (dev->primes_per_thread, sieving1MCrossover) - (sieving128KCrossover + 1);
       if ((loop_count % 4) != 1) continue;
     }
 
     // Make sure there are 1 mod 4 rows in 1M to 16M section!
-    loop_count = primes_per_thread - sieving1MCrossover;
-    if (primes_per_thread > sieving1MCrossover) {
-      loop_count = primes_per_thread - sieving1MCrossover;
+    loop_count = dev->primes_per_thread - sieving1MCrossover;
+    if (dev->primes_per_thread > sieving1MCrossover) {
+      loop_count = dev->primes_per_thread - sieving1MCrossover;
       if ((loop_count % 4) != 1) continue;
     }
 
@@ -306,15 +313,46 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
     break;
   }
 
+  // Add the bucket-sieved primes in chunks of threadsPerBlock, as far as they fit the exponent
+  if (mystuff->gpu_sieve_bucket_threshold > 0 && requested_primes > (cl_uint) mystuff->sieve_primes + threadsPerBlock)
+  {
+    dev->bucket_rows = MIN((requested_primes - mystuff->sieve_primes) / threadsPerBlock, MAX_PRIMES_PER_THREAD - dev->primes_per_thread);
+    if (mystuff->sieve_primes + dev->bucket_rows * threadsPerBlock > (cl_uint) mystuff->sieve_primes_upper_limit)
+    {
+      // need to enlarge the primes array
+      mystuff->sieve_primes_upper_limit = mystuff->sieve_primes + dev->bucket_rows * threadsPerBlock;
+      cl_uint* realloc_temp = (cl_uint*)realloc(primes, mystuff->sieve_primes_upper_limit * sizeof(cl_uint));
+      if (realloc_temp != NULL) {
+          primes = realloc_temp;
+      }
+      if (primes == NULL)
+      {
+        printf ("error in realloc primes\n");
+        exit (1);
+      }
+      tiny_soe (mystuff->sieve_primes_upper_limit, primes);
+    }
+    while (dev->bucket_rows > 0 && mystuff->exponent > 0 && mystuff->exponent <= primes[mystuff->sieve_primes + dev->bucket_rows * threadsPerBlock - 1])
+      dev->bucket_rows--;
+    mystuff->sieve_primes += dev->bucket_rows * threadsPerBlock;
+  }
+
+  dev->primes_not_sieved = primesNotSieved;
+  dev->primes_special_code = primesHandledWithSpecialCode;
   mystuff->gpu_sieve_min_exp = primes[mystuff->sieve_primes - 1] + 1;
   if(mystuff->verbosity >= 1)
   {
     printf("  GPUSievePrimes (adjusted) %d\n", mystuff->sieve_primes);
     printf("  GPUsieve minimum exponent %u\n", mystuff->gpu_sieve_min_exp);
+    if (dev->bucket_rows > 0)
+      printf("  GPUsieve bucket-sieved    %u primes above %u\n", dev->bucket_rows * threadsPerBlock,
+             primes[mystuff->sieve_primes - dev->bucket_rows * threadsPerBlock - 1]);
   }
 
-  // allocate memory for compressed prime info -- assumes prime data can be stored in 12 bytes
-  pinfo = (cl_uchar *) malloc (mystuff->sieve_primes * 12);
+  // allocate memory for compressed prime info -- assumes prime data can be stored in 12 bytes,
+  // bucket-sieved primes only need 4 bytes
+  pinfo_size = (mystuff->sieve_primes - dev->bucket_rows * threadsPerBlock) * 12 + dev->bucket_rows * threadsPerBlock * 4;
+  pinfo = (cl_uchar *) malloc (pinfo_size);
   if (pinfo == NULL)
   {
     printf ("error in malloc pinfo\n");
@@ -322,7 +360,7 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
 
 #ifdef DETAILED_INFO
-  printf("gpusieve_init: h_sieve_info (%d bytes) allocated\n", mystuff->sieve_primes * 12);
+  printf("gpusieve_init: h_sieve_info (%d bytes) allocated\n", pinfo_size);
 #endif
 
   // allocate memory for info that describes each row of 256 primes AND has the primes and modular inverses
@@ -344,7 +382,7 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
 
   // In this section (primes below 64K) we store p in 16 bits, bit-to-clr in 16 bits, and pinv in 32 bits.
   row = rowinfo;
-  loop_end = MIN (primes_per_thread, sieving64KCrossover);
+  loop_end = MIN (dev->primes_per_thread, sieving64KCrossover);
   for ( ; i < primesNotSieved + primesHandledWithSpecialCode + loop_end * threadsPerBlock; i += threadsPerBlock, pinfo += threadsPerBlock * 8) {
     row[0] = (cl_uint)(pinfo - saveptr);      // Offset to first pinfo byte in the row
     row[MAX_PRIMES_PER_THREAD] = i;      // First pinfo entry is for the i-th prime number
@@ -358,7 +396,7 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
 
   // In this section (primes both below and above 64K) we store bit-to-clr in 32 bits, pinv in 32 bits, and p in 32 bits.
-  loop_end = MIN (primes_per_thread, sieving64KCrossover + 1);
+  loop_end = MIN (dev->primes_per_thread, sieving64KCrossover + 1);
   for ( ; i < primesNotSieved + primesHandledWithSpecialCode + loop_end * threadsPerBlock; i += threadsPerBlock, pinfo += threadsPerBlock * 12) {
     row[0] = (cl_uint)(pinfo - saveptr);      // Offset to first pinfo byte in the row
     row[MAX_PRIMES_PER_THREAD] = i;      // First pinfo entry is for the i-th prime number
@@ -373,8 +411,8 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
 
   // In this section (transitioning to dense primes storage) we store bit-to-clr 32 bits, pinv in 32 bits, and p in 32 bits.
-  if (primes_per_thread > sieving64KCrossover + 1) {
-    loop_count = MIN (primes_per_thread, sieving128KCrossover + 1) - (sieving64KCrossover + 1);
+  if (dev->primes_per_thread > sieving64KCrossover + 1) {
+    loop_count = MIN (dev->primes_per_thread, sieving128KCrossover + 1) - (sieving64KCrossover + 1);
     row[0] = (cl_uint)(pinfo - saveptr);      // Offset to first pinfo byte in the row
     row[MAX_PRIMES_PER_THREAD] = i;      // First pinfo entry is for the i-th prime number
     row[MAX_PRIMES_PER_THREAD*2] = loop_count;  // Pinfo entries skip loop_count prime numbers
@@ -389,7 +427,7 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
 
   // In this section (primes from 64K through 128K) we store bit-to-clr 18 bits, (p diff) / 2 in 7 bits, and pinv diff in 7-bits.
-  if (primes_per_thread > sieving64KCrossover + 2) {
+  if (dev->primes_per_thread > sieving64KCrossover + 2) {
     for (k = 1; k < loop_count; k++) {
       row[0] = (cl_uint)(pinfo - saveptr) + (k - 1) * threadsPerBlock * 4;  // Offset to first pinfo byte in the row
       row[MAX_PRIMES_PER_THREAD] = i + k;    // First pinfo entry is for the i+k-th prime number
@@ -423,8 +461,8 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
 
   // In this section (first complete row of primes above 128K) we store bit-to-clr 32 bits, pinv in 32 bits, and p in 32-bits.
-  if (primes_per_thread > sieving128KCrossover + 1) {
-    loop_count = MIN (primes_per_thread, sieving1MCrossover) - (sieving128KCrossover + 1);
+  if (dev->primes_per_thread > sieving128KCrossover + 1) {
+    loop_count = MIN (dev->primes_per_thread, sieving1MCrossover) - (sieving128KCrossover + 1);
     row[0] = (cl_uint)(pinfo - saveptr);      // Offset to first pinfo byte in the row
     row[MAX_PRIMES_PER_THREAD] = i;      // First pinfo entry is for the i-th prime number
     row[MAX_PRIMES_PER_THREAD*2] = loop_count;  // Pinfo entries skip loop_count prime numbers
@@ -439,7 +477,7 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
 
   // In this section (primes from 128K to 1M) we store bit-to-clr 20 bits, (p diff) / 2 in 7 bits, and pinv diff in 5 bits.
-  if (primes_per_thread > sieving128KCrossover + 2) {
+  if (dev->primes_per_thread > sieving128KCrossover + 2) {
     for (k = 1; k < loop_count; k++) {
       row[0] = (cl_uint)(pinfo - saveptr) + (k - 1) * threadsPerBlock * 4;  // Offset to first pinfo byte in the row
       row[MAX_PRIMES_PER_THREAD] = i + k;    // First pinfo entry is for the i+k-th prime number
@@ -479,8 +517,8 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
 
   // In this section (primes both below and above 1M) we store bit-to-clr 32 bits, pinv in 32 bits, and p in 32-bits.
-  if (primes_per_thread > sieving1MCrossover) {
-    loop_count = primes_per_thread - sieving1MCrossover;
+  if (dev->primes_per_thread > sieving1MCrossover) {
+    loop_count = dev->primes_per_thread - sieving1MCrossover;
     row[0] = (cl_uint)(pinfo - saveptr);      // Offset to first pinfo byte in the row
     row[MAX_PRIMES_PER_THREAD] = i;      // First pinfo entry is for the i-th prime number
     row[MAX_PRIMES_PER_THREAD*2] = loop_count;  // Pinfo entries skip loop_count prime numbers
@@ -495,7 +533,7 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
   }
 
   // In this section (primes above 1M to 16M) we store bit-to-clr 24 bits, (p diff) / 2 in 7 bits, and pinv diff in 1 bit.
-  if (primes_per_thread > sieving1MCrossover + 1) {
+  if (dev->primes_per_thread > sieving1MCrossover + 1) {
     for (k = 1; k < loop_count; k++) {
       row[0] = (cl_uint)(pinfo - saveptr) + (k - 1) * threadsPerBlock * 4;  // Offset to first pinfo byte in the row
       row[MAX_PRIMES_PER_THREAD] = i + k;    // First pinfo entry is for the i+k-th prime number
@@ -533,6 +571,17 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
     pinfo += (loop_count - 1) * threadsPerBlock * 4;
     i += loop_count * threadsPerBlock;
   }
+
+  // In this section (bucket-sieved primes, see BucketScatter) we store bit-to-clr in 32 bits.  SegSieve does
+  // not read these "rows", p is taken from the rowinfo.
+  i = primesNotSieved + primesHandledWithSpecialCode + dev->primes_per_thread * threadsPerBlock;
+  for (k = 0; k < dev->bucket_rows; k++, i += threadsPerBlock, pinfo += threadsPerBlock * 4) {
+    row[0] = (cl_uint)(pinfo - saveptr);      // Offset to first pinfo byte in the row
+    row[MAX_PRIMES_PER_THREAD] = i;      // First pinfo entry is for the i-th prime number
+    row[MAX_PRIMES_PER_THREAD*2] = 1;    // Pinfo entries represent successive prime numbers
+    row[MAX_PRIMES_PER_THREAD*3] = 0;    // Mask of bits to preserve when setting bit-to-clear
+    row++;
+  }
   pinfo_size = (cl_uint)(pinfo - saveptr);
   pinfo = saveptr;
 
@@ -541,31 +590,149 @@ int gpusieve_init (mystuff_t *mystuff, cl_context context)
     rowinfo[MAX_PRIMES_PER_THREAD*4 + 2 * i] = primes[i];
   }
 
-  // Allocate and copy the device compressed prime sieving info
+  // Allocate and copy the device compressed prime sieving info.
+  // When sieving several classes at once, each class gets its own copy (with its own bit-to-clear values).
   mystuff->h_sieve_info = (cl_uint *) realloc(pinfo, pinfo_size);
+  mystuff->gpu_sieve_info_size = pinfo_size;
+  mystuff->gpu_sieve_info_stride = (pinfo_size + PINFO_PAD1 - 1) / PINFO_PAD1 * PINFO_PAD1;
+  // Many bucket-sieved primes make the sieve info big, limit the copies for multi-class launches to 256 MB
+  if ((cl_ulong) mystuff->gpu_sieve_info_stride * mystuff->gpu_sieve_classes > 256*1024*1024)
+  {
+    mystuff->gpu_sieve_classes = MAX(1, 256*1024*1024 / mystuff->gpu_sieve_info_stride);
+    if(mystuff->verbosity >= 1)
+      printf("  GPUSieveClasses (adjusted) %u\n", mystuff->gpu_sieve_classes);
+  }
   mystuff->d_sieve_info = clCreateBuffer(context,
-                        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-                        pinfo_size,
-                        mystuff->h_sieve_info,
+                        CL_MEM_READ_WRITE,
+                        mystuff->gpu_sieve_info_stride * mystuff->gpu_sieve_classes,
+                        NULL,
                         &status);
   if(status != CL_SUCCESS)
   {
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_sieve_info)\n";
     return 1;
   }
-  status = clEnqueueWriteBuffer(QUEUE,
-              mystuff->d_sieve_info,
-              CL_FALSE,          // Dont wait for completion;
-              0,
-              pinfo_size,
-              mystuff->h_sieve_info,
-              0,
-              NULL,
-              NULL);
+  for (i = 0; i < mystuff->gpu_sieve_classes; i++)
+  {
+    status = clEnqueueWriteBuffer(QUEUE,
+                mystuff->d_sieve_info,
+                CL_FALSE,          // Dont wait for completion;
+                i * mystuff->gpu_sieve_info_stride,
+                pinfo_size,
+                mystuff->h_sieve_info,
+                0,
+                NULL,
+                NULL);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying rowinfo(clEnqueueWriteBuffer)\n";
+      return RET_ERROR;
+    }
+  }
+
+  // k_base offsets of the classes of a multi-class launch. The first class is always at offset 0,
+  // which is all that single-class launches use.
+  mystuff->h_class_delta = (cl_uint *) malloc(mystuff->gpu_sieve_classes * sizeof(cl_uint));
+  if (mystuff->h_class_delta == NULL)
+  {
+    printf("ERROR: malloc(h_class_delta, %u bytes) failed\n", (unsigned int) (mystuff->gpu_sieve_classes * sizeof(cl_uint)));
+    return 1;
+  }
+  mystuff->d_class_delta = clCreateBuffer(context,
+                        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                        mystuff->gpu_sieve_classes * sizeof(cl_uint),
+                        mystuff->h_class_delta,
+                        &status);
   if(status != CL_SUCCESS)
   {
-    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying rowinfo(clEnqueueWriteBuffer)\n";
-    return RET_ERROR;
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_class_delta)\n";
+    return 1;
+  }
+
+  // The buckets: a hit counter and gpu_sieve_bucket_size hits for each SegSieve block of the bit array.
+  // Size the buckets for the expected number of hits per block plus a safe margin. SegSieve resets the counters.
+  mystuff->gpu_sieve_bucket_size = 0;
+  if (dev->bucket_rows > 0)
+  {
+    double hits = 0.0;
+    for (i = mystuff->sieve_primes - dev->bucket_rows * threadsPerBlock; i < (cl_uint) mystuff->sieve_primes; i++)
+      hits += (double) block_size / primes[i];
+    mystuff->gpu_sieve_bucket_size = ((cl_uint) (hits + 8.0 * sqrt(hits)) + 2 * threadsPerBlock - 1) / threadsPerBlock * threadsPerBlock;
+  }
+  cl_uint *bucket_count = (cl_uint *) malloc (mystuff->gpu_sieve_size / block_size * sizeof(cl_uint));
+  if (bucket_count == NULL)
+  {
+    printf ("error in malloc bucket_count\n");
+    exit (1);
+  }
+  mystuff->d_bucket_count = clCreateBuffer(context,
+                        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                        mystuff->gpu_sieve_size / block_size * sizeof(cl_uint),
+                        bucket_count,
+                        &status);
+  free (bucket_count);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_bucket_count)\n";
+    return 1;
+  }
+  mystuff->d_bucket_hits = clCreateBuffer(context,
+                        CL_MEM_READ_WRITE,
+                        (size_t) mystuff->gpu_sieve_size / block_size * MAX(1, mystuff->gpu_sieve_bucket_size) * sizeof(cl_ushort),
+                        NULL,
+                        &status);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_bucket_hits)\n";
+    return 1;
+  }
+  if(mystuff->verbosity >= 2 && dev->bucket_rows > 0)
+  {
+    printf("  GPUsieve bucket size      %u hits per block (%u MiB)\n", mystuff->gpu_sieve_bucket_size,
+           (cl_uint) ((cl_ulong) mystuff->gpu_sieve_size / block_size * mystuff->gpu_sieve_bucket_size * sizeof(cl_ushort) >> 20));
+  }
+
+  // GPUSieveCompact: the candidate counts (later offsets) of the TF slices, the compacted list and its info.
+  // The list has room for the expected candidates of the whole bit array plus the padding of each class.
+  if (mystuff->gpu_sieve_compact)
+  {
+    mystuff->gpu_sieve_compact_size = (cl_uint) ((cl_ulong) mystuff->gpu_sieve_size * gpusieve_survival_percent(mystuff) / 100)
+                                    + mystuff->gpu_sieve_classes * GS_COMPACT_CHUNK(mystuff->vectorsize);
+    mystuff->d_compact_count = clCreateBuffer(context,
+                          CL_MEM_READ_WRITE,
+                          mystuff->gpu_sieve_size / 8192 * sizeof(cl_uint),  // the smallest GPUSieveProcessSize is 8 Kibit
+                          NULL,
+                          &status);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_compact_count)\n";
+      return 1;
+    }
+    mystuff->d_compact_list = clCreateBuffer(context,
+                          CL_MEM_READ_WRITE,
+                          (size_t) mystuff->gpu_sieve_compact_size * sizeof(cl_uint),
+                          NULL,
+                          &status);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_compact_list)\n";
+      return 1;
+    }
+    mystuff->d_compact_info = clCreateBuffer(context,
+                          CL_MEM_READ_WRITE,
+                          4 * sizeof(cl_uint),
+                          NULL,
+                          &status);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_compact_info)\n";
+      return 1;
+    }
+    if(mystuff->verbosity >= 2)
+    {
+      printf("  GPUsieve compact list     %u candidates (%u MiB)\n", mystuff->gpu_sieve_compact_size,
+             (cl_uint) ((cl_ulong) mystuff->gpu_sieve_compact_size * sizeof(cl_uint) >> 20));
+    }
   }
 
 #ifdef DETAILED_INFO
@@ -628,13 +795,13 @@ void gpusieve_init_exponent (mystuff_t *mystuff)
 #endif
 
   // If we've already initialized this exponent, return
-  if (mystuff->exponent == last_exponent_initialized) return;
-  last_exponent_initialized = mystuff->exponent;
+  if (mystuff->exponent == dev->gpusieve_exponent) return;
+  dev->gpusieve_exponent = mystuff->exponent;
 
   // Calculate the modular inverses that will be used by each class to calculate initial bit-to-clear for each prime
   // CalcModularInverses<<<primes_per_thread+1, threadsPerBlock>>>(mystuff->exponent, (int *)mystuff->d_calc_bit_to_clear_info);
   // cudaThreadSynchronize ();
-  run_calc_mod_inv(primes_per_thread+1, threadsPerBlock, NULL);
+  run_calc_mod_inv(dev->primes_per_thread+dev->bucket_rows+1, threadsPerBlock, NULL);
 }
 
 
@@ -651,7 +818,54 @@ void gpusieve_init_class (mystuff_t *mystuff, unsigned long long k_min)
   // Calculate the initial bit-to-clear for each prime
   // CalcBitToClear<<<primes_per_thread+1, threadsPerBlock>>>(mystuff->exponent, k_base, (int *)mystuff->d_calc_bit_to_clear_info, (cl_uchar *)mystuff->d_sieve_info);
   // cudaThreadSynchronize ();
-  run_calc_bit_to_clear(primes_per_thread+1, threadsPerBlock, NULL, k_min);
+  run_calc_bit_to_clear(dev->primes_per_thread+dev->bucket_rows+1, threadsPerBlock, NULL, k_min, 1);
+}
+
+
+// Same for num_classes classes that are sieved together (see gpusieve_classes).  Class i starts at
+// k_min + h_class_delta[i], h_class_delta[0] must be 0.  The caller must not change h_class_delta
+// before the queue has processed the copy, i.e. not before reading the results of these classes.
+
+void gpusieve_init_classes (mystuff_t *mystuff, unsigned long long k_min, cl_uint num_classes)
+{
+  cl_int status;
+
+#ifdef RAW_GPU_BENCH
+  // Quick hack (leave bit array set to all ones) to eliminate sieve time from GPU-code benchmarks.
+  // Can also be used to isolate a bug by eliminating the GPU sieving code as a possible cause.
+  return;
+#endif
+
+  status = clEnqueueWriteBuffer(QUEUE,
+              mystuff->d_class_delta,
+              CL_FALSE,
+              0,
+              num_classes * sizeof(cl_uint),
+              mystuff->h_class_delta,
+              0,
+              NULL,
+              NULL);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_class_delta (clEnqueueWriteBuffer)\n";
+    return;
+  }
+  run_calc_bit_to_clear(dev->primes_per_thread+dev->bucket_rows+1, threadsPerBlock, NULL, k_min, num_classes);
+}
+
+
+// Move the bit-to-clear values of the current class num_bits forward, i.e. to the next chunk
+// of the class. Same result as gpusieve_init_class(k_min + num_bits * num_classes), but cheaper.
+
+void gpusieve_advance_class (mystuff_t *mystuff, cl_uint num_bits)
+{
+#ifdef RAW_GPU_BENCH
+  // Quick hack (leave bit array set to all ones) to eliminate sieve time from GPU-code benchmarks.
+  // Can also be used to isolate a bug by eliminating the GPU sieving code as a possible cause.
+  return;
+#endif
+
+  run_advance_bit_to_clear(dev->primes_per_thread+dev->bucket_rows+1, threadsPerBlock, NULL, num_bits);
 }
 
 
@@ -673,25 +887,111 @@ void gpusieve (mystuff_t *mystuff, unsigned long long num_k_remaining)
     sieve_size = mystuff->gpu_sieve_size;
   else
     sieve_size = (int) num_k_remaining;
-  if (primes_per_thread != last_maxp)
+  if (dev->primes_per_thread != dev->gpusieve_maxp)
   {
-    last_maxp = primes_per_thread;
-    maxp = primes_per_thread;
+    dev->gpusieve_maxp = dev->primes_per_thread;
+    maxp = dev->primes_per_thread;
   }
 
   // Do some sieving on the GPU!
   // SegSieve<<<(sieve_size + block_size - 1) / block_size, threadsPerBlock>>>((cl_uchar *)mystuff->d_bitarray, (cl_uchar *)mystuff->d_sieve_info, primes_per_thread);
   // cudaThreadSynchronize ();
-  run_cl_sieve((sieve_size + block_size - 1) / block_size, threadsPerBlock, NULL, maxp);
+  // No events needed: QUEUE is in-order with the GPU sieve (see init_CLstreams), SegSieve starts when
+  // BucketScatter has filled the buckets and the TF kernels when SegSieve has written the bit array.
+  if (dev->bucket_rows > 0)
+    run_bucket_scatter(dev->bucket_rows, threadsPerBlock, NULL, dev->primes_per_thread, (sieve_size + block_size - 1) / block_size, 1);
+  run_cl_sieve((sieve_size + block_size - 1) / block_size, threadsPerBlock, NULL, maxp, (sieve_size + block_size - 1) / block_size);
+}
+
+
+// GPU sieve num_classes classes in one go: class i gets bits_per_class bits starting at bit i * bits_per_class
+// of the bit array.  bits_per_class must be a multiple of the SegSieve block size, see gpusieve_class_bits().
+
+void gpusieve_classes (mystuff_t *mystuff, cl_uint num_classes, cl_uint bits_per_class)
+{
+  cl_uint maxp = 0xFFFFFFFF; // marker to not copy the param to the GPU
+
+#ifdef RAW_GPU_BENCH
+  // Quick hack (leave bit array set to all ones) to eliminate sieve time from GPU-code benchmarks.
+  // Can also be used to isolate a bug by eliminating the GPU sieving code as a possible cause.
+  return;
+#endif
+
+  if (dev->primes_per_thread != dev->gpusieve_maxp)
+  {
+    dev->gpusieve_maxp = dev->primes_per_thread;
+    maxp = dev->primes_per_thread;
+  }
+
+  // in-order QUEUE, as in gpusieve()
+  if (dev->bucket_rows > 0)
+    run_bucket_scatter(dev->bucket_rows, threadsPerBlock, NULL, dev->primes_per_thread, bits_per_class / block_size, num_classes);
+  run_cl_sieve(num_classes * bits_per_class / block_size, threadsPerBlock, NULL, maxp, bits_per_class / block_size);
+}
+
+
+// GPUSieveCompact: collect the candidates of the last gpusieve() or gpusieve_classes() into the dense list
+// d_compact_list for the GPU-sieve TF kernels.  num_slices TF slices (gpu_sieve_processing_size bits each),
+// slices_per_class of them per class.  Returns the number of TF blocks to start in *numblocks.
+
+int gpusieve_compact (mystuff_t *mystuff, cl_uint num_slices, cl_uint slices_per_class, cl_uint *numblocks)
+{
+  cl_uint list_info[3];
+
+  if (run_compact_candidates(num_slices, slices_per_class, list_info)) return RET_ERROR;
+  if (list_info[2])
+  {
+    printf("ERROR: %u candidates of the GPU sieve don't fit into the compacted list (%u entries)\n",
+           list_info[1], mystuff->gpu_sieve_compact_size);
+    return RET_ERROR;
+  }
+  *numblocks = list_info[0];
+  return 0;
+}
+
+
+// Expected percentage of the k's that survive the GPU sieve (rounded up), used to size the candidate
+// buffers of the TF kernels.
+
+cl_uint gpusieve_survival_percent (mystuff_t *mystuff)
+{
+#ifdef RAW_GPU_BENCH
+  return 100;            // no sieving = 100%
+#else
+  if (mystuff->sieve_primes < 54) return 100;  // no sieving = 100%
+  else if (mystuff->sieve_primes < 310) return 50;  // 54 primes expect 48.30%
+  else if (mystuff->sieve_primes < 1846) return 38;  // 310 primes expect 35.50%
+  else if (mystuff->sieve_primes < 21814) return 30;  // 1846 primes expect 28.10%
+  else if (mystuff->sieve_primes < 34101) return 24;  // 21814 primes expect 21.93%
+  else if (mystuff->sieve_primes < 63797) return 23;  // 34101 primes expect 20.94%
+  else if (mystuff->sieve_primes < 115253) return 22;    // 63797 primes expect 19.87%
+  else if (mystuff->sieve_primes < 239157) return 21;    // 115253 primes expect 18.98%
+  else if (mystuff->sieve_primes < 550453) return 20;    // 239257 primes expect 17.99%
+  else return 19;          // 550453 primes expect 16.97%
+#endif
+}
+
+
+// Number of bits of the GPU sieve each class of k_min..k_max takes in a multi-class sieve: whole SegSieve
+// blocks and whole TF blocks, enough for the class with the most k's (class 0).
+
+unsigned long long gpusieve_class_bits (mystuff_t *mystuff, unsigned long long k_min, unsigned long long k_max)
+{
+  unsigned long long k_remaining, bits = block_size;
+
+  if (k_max < k_min) k_max = k_min;
+  while (bits % mystuff->gpu_sieve_processing_size != 0) bits += block_size;
+  k_remaining = ((k_max - k_min + 1) + mystuff->num_classes - 1) / mystuff->num_classes;
+  return (k_remaining + bits - 1) / bits * bits;
 }
 
 int gpusieve_free (mystuff_t *mystuff)
 {
   int status;
-  if (gpusieve_initialized == 0) return 0;
-  gpusieve_initialized = 0;
-  last_exponent_initialized = 0;
-  last_maxp = 0xFFFFFFFF;
+  if (dev->gpusieve_initialized == 0) return 0;
+  dev->gpusieve_initialized = 0;
+  dev->gpusieve_exponent = 0;
+  dev->gpusieve_maxp = 0xFFFFFFFF;
 
   status = clReleaseMemObject(mystuff->d_bitarray); mystuff->d_bitarray=NULL;
   if(status != CL_SUCCESS)
@@ -717,6 +1017,50 @@ int gpusieve_free (mystuff_t *mystuff)
   }
   free(mystuff->h_sieve_info); mystuff->h_sieve_info=NULL;
 
+  status = clReleaseMemObject(mystuff->d_class_delta); mystuff->d_class_delta=NULL;
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (mystuff->d_class_delta)\n";
+    return 1;
+  }
+  free(mystuff->h_class_delta); mystuff->h_class_delta=NULL;
+
+  status = clReleaseMemObject(mystuff->d_bucket_count); mystuff->d_bucket_count=NULL;
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (mystuff->d_bucket_count)\n";
+    return 1;
+  }
+  status = clReleaseMemObject(mystuff->d_bucket_hits); mystuff->d_bucket_hits=NULL;
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (mystuff->d_bucket_hits)\n";
+    return 1;
+  }
+  dev->bucket_rows = 0;
+
+  if (mystuff->gpu_sieve_compact)
+  {
+    status = clReleaseMemObject(mystuff->d_compact_count); mystuff->d_compact_count=NULL;
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (mystuff->d_compact_count)\n";
+      return 1;
+    }
+    status = clReleaseMemObject(mystuff->d_compact_list); mystuff->d_compact_list=NULL;
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (mystuff->d_compact_list)\n";
+      return 1;
+    }
+    status = clReleaseMemObject(mystuff->d_compact_info); mystuff->d_compact_info=NULL;
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (mystuff->d_compact_info)\n";
+      return 1;
+    }
+  }
+
   return 0;
 }
 
@@ -28,7 +28,13 @@ extern "C" {
 int gpusieve_init(mystuff_t *mystuff, cl_context context);
 void gpusieve_init_exponent(mystuff_t *mystuff);
 void gpusieve_init_class(mystuff_t *mystuff, unsigned long long k_min);
+void gpusieve_init_classes(mystuff_t *mystuff, unsigned long long k_min, cl_uint num_classes);
+void gpusieve_advance_class(mystuff_t *mystuff, cl_uint num_bits);
 void gpusieve(mystuff_t *mystuff, unsigned long long num_k_remaining);
+void gpusieve_classes(mystuff_t *mystuff, cl_uint num_classes, cl_uint bits_per_class);
+int gpusieve_compact(mystuff_t *mystuff, cl_uint num_slices, cl_uint slices_per_class, cl_uint *numblocks);
+cl_uint gpusieve_survival_percent(mystuff_t *mystuff);
+unsigned long long gpusieve_class_bits(mystuff_t *mystuff, unsigned long long k_min, unsigned long long k_max);
 int gpusieve_free(mystuff_t *mystuff);
 void tiny_soe(cl_uint limit, cl_uint *primes);
 
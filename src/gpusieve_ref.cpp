@@ -0,0 +1,370 @@
+/*
+This file is part of mfaktc (mfakto).
+Copyright (C) 2009 - 2014  Oliver Weihe (o.weihe@t-online.de)
+                           Bertram Franz (bertramf@gmx.net)
+
+mfaktc (mfakto) is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+mfaktc (mfakto) is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Host reference of the GPU sieve, used by --gpusievetest to validate the GPU sieve kernels on any
+OpenCL device.
+
+The prime info layout is the one gpusieve_init() builds:
+- h_sieve_info: the 16-bit bit-to-clear values of the primes sieved with inline code (at byte
+  2 * prime index), then from PINFO_PAD1 on the "rows" of 256 primes, one per SegSieve thread.
+  Depending on the section a row stores bit-to-clear, p and the inverse of p in 4, 8 or 12 bytes
+  per prime, the compressed rows store p and its inverse as differences to an earlier row.
+  The bucket_rows rows of bucket-sieved primes (see BucketScatter) follow the primes_per_thread
+  rows of SegSieve, they only store a 32-bit bit-to-clear per prime.
+- h_calc_bit_to_clear_info: per row the byte offset into h_sieve_info, the index of the first
+  prime, the index distance between the primes of the row and the mask of the bits of each word
+  that are not the bit-to-clear. After MAX_PRIMES_PER_THREAD*4 words follow the primes (and,
+  on the device only, their modular inverses).
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include <vector>
+#include <string.h>
+#include <stdio.h>
+#include <math.h>
+#include "my_types.h"
+#include "compatibility.h"
+#include "mfakto.h"
+#include "gpusieve.h"
+#include "gpusieve_ref.h"
+
+#define gen_pinv(p)  (0xFFFFFFFF / (p) + 1)
+#define gen_sloppy_pinv(p)  ((cl_uint) floor (4294967296.0 / (p) - 0.5))
+
+#define PINFO_PAD1    1024      // Start of the rows in the prime info
+#define ROW_PRIMES    256       // Primes per row (threadsPerBlock of SegSieve)
+#define REPORT_MAX    10        // Details are printed for this many mismatches
+
+typedef struct
+{
+  cl_uint prime;
+  cl_uint index;      // prime is the index-th prime number
+  cl_uint offset;     // byte offset of the bit-to-clear value in the prime info
+  cl_uint mask;       // bits of the word at offset that are not the bit-to-clear value
+  int     short_bclr; // 1: 16-bit bit-to-clear value of a prime sieved with inline code
+} ref_prime_t;
+
+
+static cl_uint row_prime(const cl_uint *rowinfo, cl_uint index)
+{
+  return rowinfo[MAX_PRIMES_PER_THREAD*4 + 2 * index];
+}
+
+
+static std::vector<ref_prime_t> ref_primes(mystuff_t *mystuff)
+/* all sieved primes and where their bit-to-clear values are stored */
+{
+  const cl_uint *rowinfo = mystuff->h_calc_bit_to_clear_info;
+  std::vector<ref_prime_t> list;
+  ref_prime_t e;
+  cl_uint i, r, j;
+
+  list.reserve(mystuff->sieve_primes);
+  for (i = dev->primes_not_sieved; i < dev->primes_not_sieved + dev->primes_special_code; i++)
+  {
+    e.prime = row_prime(rowinfo, i);
+    e.index = i;
+    e.offset = i * 2;
+    e.mask = 0;
+    e.short_bclr = 1;
+    list.push_back(e);
+  }
+  for (r = 0; r < dev->primes_per_thread + dev->bucket_rows; r++)
+  {
+    for (j = 0; j < ROW_PRIMES; j++)
+    {
+      e.index = rowinfo[MAX_PRIMES_PER_THREAD + r] + j * rowinfo[MAX_PRIMES_PER_THREAD*2 + r];
+      e.prime = row_prime(rowinfo, e.index);
+      e.offset = rowinfo[r] + j * 4;
+      e.mask = rowinfo[MAX_PRIMES_PER_THREAD*3 + r];
+      e.short_bclr = 0;
+      list.push_back(e);
+    }
+  }
+  return list;
+}
+
+
+static cl_uint get_bclr(const cl_uchar *pinfo, const ref_prime_t &e)
+{
+  if (e.short_bclr) return *(const cl_ushort *)(pinfo + e.offset);
+  return *(const cl_uint *)(pinfo + e.offset) & ~e.mask;
+}
+
+
+static void set_bclr(cl_uchar *pinfo, const ref_prime_t &e, cl_uint bclr)
+{
+  if (e.short_bclr) *(cl_ushort *)(pinfo + e.offset) = (cl_ushort) bclr;
+  else *(cl_uint *)(pinfo + e.offset) = (*(cl_uint *)(pinfo + e.offset) & e.mask) + bclr;
+}
+
+
+static cl_uint modular_inverse(cl_uint n, cl_uint p)
+/* 1/n mod p, same as modularinverse() in gpusieve.cl */
+{
+  long long d = p, x = 0, lastx = 1, q, t, m = n;
+
+  while (d != 0)
+  {
+    q = m / d;
+    t = d; d = m - q * d; m = t;
+    t = x; x = lastx - q * x; lastx = t;
+  }
+  return (cl_uint) ((lastx < 0) ? lastx + p : lastx);
+}
+
+
+static cl_uint popcount32(cl_uint x)
+{
+  cl_uint n = 0;
+
+  while (x) { x &= x - 1; n++; }
+  return n;
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+cl_uint gpusieve_ref_check_layout(mystuff_t *mystuff)
+/* Check the prime info built by gpusieve_init() against an independent list of primes: every sieved
+prime has exactly one bit-to-clear slot and p and its inverse are encoded correctly. Returns the
+number of errors found. */
+{
+  const cl_uint *rowinfo = mystuff->h_calc_bit_to_clear_info;
+  const cl_uchar *pinfo = (const cl_uchar *) mystuff->h_sieve_info;
+  const cl_uint size = mystuff->gpu_sieve_info_size;
+  std::vector<ref_prime_t> list;
+  std::vector<cl_uchar> seen, used;
+  cl_uint *primes, errors = 0, i, r, j;
+  cl_uint full_index = 0, dense_rows = 0, exact_pinv = 1;
+
+#define pinfo32(offset) (*(const cl_uint *)(pinfo + (offset)))
+#define LAYOUT_ERROR(...) { if (errors++ < REPORT_MAX) { printf("  ERROR: "); printf(__VA_ARGS__); } }
+
+  primes = (cl_uint *) malloc(mystuff->sieve_primes * sizeof(cl_uint));
+  if (primes == NULL)
+  {
+    printf("ERROR: malloc(primes) failed\n");
+    return 1;
+  }
+  tiny_soe(mystuff->sieve_primes, primes);
+  for (i = dev->primes_not_sieved; i < mystuff->sieve_primes; i++)
+  {
+    if (row_prime(rowinfo, i) != primes[i]) LAYOUT_ERROR("prime #%u is %u in the bit-to-clear info, expected %u\n", i, row_prime(rowinfo, i), primes[i]);
+  }
+  free(primes);
+
+  list = ref_primes(mystuff);
+  if (list.size() != mystuff->sieve_primes - dev->primes_not_sieved)
+    LAYOUT_ERROR("%u primes in the prime info, expected %u\n", (cl_uint) list.size(), mystuff->sieve_primes - dev->primes_not_sieved);
+
+  seen.assign(mystuff->sieve_primes, 0);
+  used.assign(size, 0);
+  for (i = 0; i < list.size(); i++)
+  {
+    const ref_prime_t &e = list[i];
+    cl_uint bytes = e.short_bclr ? 2 : 4;
+
+    if (e.index < dev->primes_not_sieved || e.index >= mystuff->sieve_primes)
+    {
+      LAYOUT_ERROR("prime index %u out of range\n", e.index);
+      continue;
+    }
+    if (seen[e.index]++) LAYOUT_ERROR("prime #%u (%u) is sieved more than once\n", e.index, e.prime);
+    if (e.offset + bytes > (e.short_bclr ? PINFO_PAD1 : size))
+    {
+      LAYOUT_ERROR("bit-to-clear of prime %u at offset %u is out of range\n", e.prime, e.offset);
+      continue;
+    }
+    for (j = e.offset; j < e.offset + bytes; j++)
+    {
+      if (used[j]++)
+      {
+        LAYOUT_ERROR("bit-to-clear of prime %u at offset %u overlaps another one\n", e.prime, e.offset);
+        break;
+      }
+    }
+  }
+
+  // the p and pinv encodings of each row, see gpusieve_init()
+  for (r = 0; r < dev->primes_per_thread + dev->bucket_rows; r++)
+  {
+    cl_uint offset = rowinfo[r];
+    cl_uint first  = rowinfo[MAX_PRIMES_PER_THREAD + r];
+    cl_uint step   = rowinfo[MAX_PRIMES_PER_THREAD*2 + r];
+    cl_uint mask   = rowinfo[MAX_PRIMES_PER_THREAD*3 + r];
+
+    // bucket-sieved primes: successive primes with just the bit-to-clear, p is in the rowinfo
+    if (r >= dev->primes_per_thread)
+    {
+      if (step != 1 || mask != 0 || offset + ROW_PRIMES * 4 > size)
+        LAYOUT_ERROR("bucket row %u at offset %u: bad step %u, mask %#x or size\n", r, offset, step, mask);
+      continue;
+    }
+
+    // The first row of each dense section has p and pinv in full, the following rows store the
+    // differences to it. Only the first dense section (primes below 128K) uses exact inverses.
+    if (mask == 0 && step > 1)
+    {
+      full_index = first;
+      exact_pinv = (dense_rows++ == 0);
+    }
+
+    if (offset + ROW_PRIMES * ((mask == 0) ? 12 : (mask == 0xFFFF0000) ? 8 : 4) > size)
+    {
+      LAYOUT_ERROR("row %u at offset %u exceeds the prime info (%u bytes)\n", r, offset, size);
+      continue;
+    }
+    for (j = 0; j < ROW_PRIMES; j++)
+    {
+      cl_uint index = first + j * step;
+      cl_uint p = row_prime(rowinfo, index);
+      cl_uint word = pinfo32(offset + j * 4);
+
+      if (index >= mystuff->sieve_primes) break; // reported above
+      if (mask == 0xFFFF0000)   // 16-bit p, 32-bit pinv
+      {
+        if ((word >> 16) != p || pinfo32(offset + ROW_PRIMES * 4 + j * 4) != gen_pinv(p))
+          LAYOUT_ERROR("row %u, prime %u: wrong p or pinv\n", r, p);
+      }
+      else if (mask == 0)       // 32-bit p and pinv
+      {
+        cl_uint pinv = (step == 1 || exact_pinv) ? gen_pinv(p) : gen_sloppy_pinv(p);
+        if (pinfo32(offset + ROW_PRIMES * 8 + j * 4) != p || pinfo32(offset + ROW_PRIMES * 4 + j * 4) != pinv)
+          LAYOUT_ERROR("row %u, prime %u: wrong p or pinv\n", r, p);
+      }
+      else                      // p and pinv as difference to the prime of an earlier row
+      {
+        cl_uint shift = 0, group = (mask == 0xFFFC0000) ? 3 : 4, base, pb, pinvdiff;
+
+        while (!(mask & (1U << shift))) shift++;
+        base = full_index + j * step + (first - full_index - 1) / group * group;
+        pb = row_prime(rowinfo, base);
+        pinvdiff = exact_pinv ? gen_pinv(pb) - gen_pinv(p) : gen_sloppy_pinv(pb) - gen_sloppy_pinv(p);
+        if (((word >> shift) & 0x7F) * 2 != p - pb || (word >> (shift + 7)) != pinvdiff)
+          LAYOUT_ERROR("row %u, prime %u: p or pinv difference to %u does not fit\n", r, p, pb);
+      }
+    }
+  }
+#undef pinfo32
+#undef LAYOUT_ERROR
+
+  return errors;
+}
+
+
+void gpusieve_ref_bit_to_clear(mystuff_t *mystuff, unsigned long long k_min, cl_uchar *pinfo)
+/* CalcModularInverses and CalcBitToClear: set the bit-to-clear values in pinfo for the class starting
+at k_min, i.e. bit i of the sieve is k_min + i * num_classes */
+{
+  std::vector<ref_prime_t> list = ref_primes(mystuff);
+  cl_ulong facdist = 2ULL * mystuff->num_classes * mystuff->exponent;
+  cl_ulong p, factor_mod_p;
+  size_t i;
+
+  for (i = 0; i < list.size(); i++)
+  {
+    p = list[i].prime;
+    factor_mod_p = (2 * (k_min % p) * mystuff->exponent + 1) % p;
+    set_bclr(pinfo, list[i], (cl_uint) ((p - factor_mod_p) * modular_inverse((cl_uint) (facdist % p), (cl_uint) p) % p));
+  }
+}
+
+
+void gpusieve_ref_sieve(mystuff_t *mystuff, const cl_uchar *pinfo, cl_uint *bit_array, cl_uint num_bits)
+/* SegSieve without the sloppiness: bit i of bit_array stays set if no sieve prime divides the factor
+candidate of bit i */
+{
+  std::vector<ref_prime_t> list = ref_primes(mystuff);
+  cl_uint b, p;
+  size_t i;
+
+  memset(bit_array, 0xFF, (num_bits + 31) / 32 * sizeof(cl_uint));
+  for (i = 0; i < list.size(); i++)
+  {
+    p = list[i].prime;
+    for (b = get_bclr(pinfo, list[i]); b < num_bits; b += p) bit_array[b >> 5] &= ~(1U << (b & 31));
+  }
+}
+
+
+cl_uint gpusieve_ref_compare_bit_to_clear(mystuff_t *mystuff, const cl_uchar *ref_pinfo, const cl_uchar *dev_pinfo)
+/* returns the number of bit-to-clear values of dev_pinfo that differ from ref_pinfo */
+{
+  std::vector<ref_prime_t> list = ref_primes(mystuff);
+  cl_uint errors = 0, ref, got;
+  size_t i;
+
+  for (i = 0; i < list.size(); i++)
+  {
+    ref = get_bclr(ref_pinfo, list[i]);
+    got = get_bclr(dev_pinfo, list[i]);
+    if (ref != got && errors++ < REPORT_MAX)
+      printf("  ERROR: bit-to-clear of prime %u is %u, expected %u\n", list[i].prime, got, ref);
+  }
+  return errors;
+}
+
+
+cl_uint gpusieve_ref_compare_bits(mystuff_t *mystuff, const cl_uchar *ref_pinfo, const cl_uint *ref_bits, const cl_uint *dev_bits,
+                                  cl_uint num_bits, unsigned long long k_min, unsigned long long *survivors)
+/* Compare the first num_bits bits of a GPU sieve with the reference. Returns the number of candidates
+the GPU sieve removed although the reference keeps them, these would be lost factors. Candidates
+that only survived the GPU sieve (sloppy sieving) are added to *survivors. */
+{
+  std::vector<ref_prime_t> list;
+  cl_uint errors = 0, w, b, mask, lost;
+  size_t i;
+
+  for (w = 0; w < (num_bits + 31) / 32; w++)
+  {
+    mask = (w == num_bits / 32) ? (1U << (num_bits & 31)) - 1 : 0xFFFFFFFF;
+    *survivors += popcount32(dev_bits[w] & ~ref_bits[w] & mask);
+    lost = ref_bits[w] & ~dev_bits[w] & mask;
+    for (b = 0; lost; b++, lost >>= 1)
+    {
+      if (!(lost & 1) || errors++ >= REPORT_MAX) continue;
+
+      // double check the reference directly: no sieve prime may divide 2 * k * exp + 1
+      unsigned long long k = k_min + (unsigned long long) (w * 32 + b) * mystuff->num_classes;
+      cl_ulong p = 0;
+
+      if (list.empty()) list = ref_primes(mystuff);
+      for (i = 0; i < list.size(); i++)
+      {
+        p = list[i].prime;
+        if ((2 * (k % p) * mystuff->exponent + 1) % p == 0) break;
+      }
+      if (i < list.size())
+        printf("  ERROR: bit %u (k = %llu) cleared, the reference missed the divisor %u (bit-to-clear %u)\n",
+               w * 32 + b, k, (cl_uint) p, get_bclr(ref_pinfo, list[i]));
+      else
+        printf("  ERROR: bit %u (k = %llu) cleared, but no sieve prime divides the factor candidate\n", w * 32 + b, k);
+    }
+  }
+  return errors;
+}
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,44 @@
+/*
+This file is part of mfaktc (mfakto).
+Copyright (C) 2009 - 2014  Oliver Weihe (o.weihe@t-online.de)
+                           Bertram Franz (bertramf@gmx.net)
+
+mfaktc (mfakto) is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+mfaktc (mfakto) is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef GPUSIEVE_REF_H_
+#define GPUSIEVE_REF_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "my_types.h"
+
+/* Host reference of the GPU sieve (CalcModularInverses, CalcBitToClear and SegSieve in gpusieve.cl).
+It works on the host copies of the prime info built by gpusieve_init() (h_sieve_info and
+h_calc_bit_to_clear_info) and needs no OpenCL device. The reference sieve is exact: SegSieve may let
+a few composite candidates survive, but it must never clear a bit the reference keeps.
+pinfo buffers have gpu_sieve_info_size bytes, the layout of one class of d_sieve_info. */
+
+cl_uint gpusieve_ref_check_layout(mystuff_t *mystuff);
+void    gpusieve_ref_bit_to_clear(mystuff_t *mystuff, unsigned long long k_min, cl_uchar *pinfo);
+void    gpusieve_ref_sieve(mystuff_t *mystuff, const cl_uchar *pinfo, cl_uint *bit_array, cl_uint num_bits);
+cl_uint gpusieve_ref_compare_bit_to_clear(mystuff_t *mystuff, const cl_uchar *ref_pinfo, const cl_uchar *dev_pinfo);
+cl_uint gpusieve_ref_compare_bits(mystuff_t *mystuff, const cl_uchar *ref_pinfo, const cl_uint *ref_bits, const cl_uint *dev_bits,
+                                  cl_uint num_bits, unsigned long long k_min, unsigned long long *survivors);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
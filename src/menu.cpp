@@ -31,6 +31,7 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "mfakto.h"
 #include "compatibility.h"
 #include "sieve.h"
+#include "sievepool.h"
 #include "gpusieve.h"
 #include <stdio.h>
 #include <iostream>
@@ -273,12 +274,16 @@ void check_and_do_reinit(mystuff_t *saved_mystuff, mystuff_t *mystuff)
     {
       if (mystuff->verbosity > 0)
         printf("Reinitializing CPU sieve\n");
-      sieve_free();
-#ifdef SIEVE_SIZE_LIMIT
-      sieve_init();
-#else
-      sieve_init(mystuff->sieve_size, mystuff->sieve_primes_max);
-#endif
+      sievepool_free();
+      sieve_ctx_free(mystuff->sieve_ctx);
+      mystuff->sieve_ctx = sieve_ctx_new(mystuff->sieve_size, mystuff->sieve_bucket_threshold, mystuff->sieve_wheel_primes);
+      if (mystuff->sieve_ctx == NULL)
+      {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+      }
+      sieve_ctx_set_extractor(mystuff->sieve_ctx, mystuff->sieve_extractor);
+      sievepool_init(mystuff);
     }
   }
 }
@@ -34,11 +34,14 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "mfakto.h"
 #include "compatibility.h"
 #include "sieve.h"
+#include "sievepool.h"
+#include "cpu_tf.h"
 #include "read_config.h"
 #include "params.h"
 #include "parse.h"
 #include "timer.h"
 #include "checkpoint.h"
+#include "classpool.h"
 #include "signal_handler.h"
 #include "filelocking.h"
 #include "perftest.h"
@@ -48,7 +51,6 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 
 mystuff_t mystuff;
 
-extern OpenCL_deviceinfo_t deviceinfo;
 extern kernel_info_t       kernel_info[];
 GPU_type gpu_types[]={
   {GPU_AUTO,     0,  "AUTO"},
@@ -122,9 +124,27 @@ The variables exp, bit_min and bit_max must be a valid assignment! */
       mystuff->bit_max_stage > k.bit_max  ||
       ((k.stages == 0) && (mystuff->bit_max_stage - mystuff->bit_min) > 1))
     ret = 0;  // out-of-bounds or multiple bit stages requested but not supported by the kernel
+  else
+    request_kernel(kernel);  // likely to be used: start building it in the background
   return ret;
 }
 
+unsigned int factor_class(int96 factor, unsigned int exp, unsigned int num_classes)
+/* the class of the factor f = 2 * k * exp + 1, i.e. k % num_classes */
+{
+  unsigned long long int m = 2ULL * exp * num_classes, r = 0;
+  int i;
+
+  /* (f - 1) % m, 16 bits at a time as m has up to 46 bits */
+  factor.d0--;  /* f is odd, no borrow */
+  for (i = 16; i >= 0; i -= 16) r = ((r << 16) | ((factor.d2 >> i) & 0xFFFF)) % m;
+  for (i = 16; i >= 0; i -= 16) r = ((r << 16) | ((factor.d1 >> i) & 0xFFFF)) % m;
+  for (i = 16; i >= 0; i -= 16) r = ((r << 16) | ((factor.d0 >> i) & 0xFFFF)) % m;
+
+  return (unsigned int) (r / (2ULL * exp));
+}
+
+
 int class_needed(unsigned int expo, unsigned long long int k_min, int c)
 {
 /*
@@ -567,6 +587,12 @@ GPUKernels find_fastest_kernel(mystuff_t *mystuff, cl_uint do_test)
   cl_uint            i;
   cl_uint            gpusieve_offset = 0;
 
+  if (mystuff->host_tf) // no OpenCL: IFMA if the CPU has it, otherwise the scalar code
+  {
+    if (cpu_tf_kernel_supported(CPU_TF_IFMA) && kernel_possible(CPU_TF_IFMA, mystuff)) return CPU_TF_IFMA;
+    return kernel_possible(CPU_TF, mystuff) ? CPU_TF : UNKNOWN_KERNEL;
+  }
+
   if (do_test)
   {
     test_use_kernel = test_fastest_kernel();
@@ -606,6 +632,343 @@ void close_log(mystuff_t* mystuff)
 }
 
 
+/* tf() with several devices: the bit level all of them work on, see tf_device() */
+typedef struct
+{
+  class_pool_t           *pool;
+  mystuff_t              *mystuff;         /* of device 0, which has the assignment */
+  unsigned long long int  k_min, k_max;
+  GPUKernels              use_kernel;      /* kernel of device 0 */
+  unsigned int            class_counter;   /* classes finished before */
+  unsigned long long int  bit_level_time;  /* and their time */
+} tf_job_t;
+
+
+static void set_sieve_primes_limit(mystuff_t *mystuff)
+/* the sieve must not use primes >= the exponent of a new assignment */
+{
+  if (mystuff->gpu_sieving == 0)
+  {
+    mystuff->sieve_primes_upper_limit = sieve_sieve_primes_max(mystuff->exponent, mystuff->sieve_primes_max);
+    if(mystuff->sieve_primes > mystuff->sieve_primes_upper_limit)
+    {
+      mystuff->sieve_primes = mystuff->sieve_primes_upper_limit;
+      logprintf(mystuff, "Warning: SievePrimes is too big for the current assignment, lowering to %u\n", mystuff->sieve_primes_upper_limit);
+      logprintf(mystuff, "         It is not allowed to sieve primes which are equal or bigger than the \n");
+      logprintf(mystuff, "         exponent itself!\n");
+    }
+  }
+  else
+  {
+    if (mystuff->exponent < mystuff->gpu_sieve_min_exp)
+    {
+      logprintf(mystuff, "Warning: SievePrimes is too big for the current assignment, adjusting\n");
+      logprintf(mystuff, "         It is not allowed to sieve primes which are equal or bigger than the \n");
+      logprintf(mystuff, "         exponent itself.\n");
+      gpusieve_free(mystuff);
+      init_CLstreams(1);
+    }
+  }
+}
+
+
+static int tf_kernel(mystuff_t *mystuff, GPUKernels *use_kernel)
+/* tf(): select (AUTOSELECT_KERNEL) and build the kernel of the device of the calling thread for the
+current assignment. Returns 0 or RET_ERROR. */
+{
+  if(*use_kernel == AUTOSELECT_KERNEL)
+  {
+    *use_kernel = find_fastest_kernel(mystuff, 0);
+
+    if(*use_kernel == AUTOSELECT_KERNEL || *use_kernel == UNKNOWN_KERNEL)
+    {
+      logprintf(mystuff, "ERROR: No suitable kernel found for bit_min=%d, bit_max=%d.\n",
+                 mystuff->bit_min, mystuff->bit_max_stage);
+      return RET_ERROR;
+    }
+  }
+
+  if(load_kernel(*use_kernel))
+  {
+    logprintf(mystuff, "ERROR: Could not build kernel %s.\n", kernel_info[*use_kernel].kernelname);
+    return RET_ERROR;
+  }
+  /* SpecializeKernels=1: build this kernel for the assignment in the background, the selftests wait
+     for it so that they check the specialized kernel */
+  specialize_kernel(*use_kernel, mystuff->exponent, mystuff->bit_max_stage);
+  if(mystuff->mode != MODE_NORMAL) use_specialized_kernel(*use_kernel, 1);
+
+  sprintf(mystuff->stats.kernelname, "%s_%d", kernel_info[*use_kernel].kernelname, mystuff->vectorsize);
+
+  if(mystuff->mode != MODE_SELFTEST_SHORT && mystuff->verbosity >= 1)logprintf(mystuff, "Using GPU kernel \"%s\"\n", mystuff->stats.kernelname);
+
+  return 0;
+}
+
+
+static int tf_classes(mystuff_t *mystuff, class_pool_t *pool, unsigned long long int k_min, unsigned long long int k_max, GPUKernels use_kernel)
+/*
+the class loop of tf(): tests the classes of the pool on the device of the calling thread until there are
+none left. With several devices each one runs it on a host thread of its own, see tf_device().
+
+return value:
+number of factors found (self-tests, MODE_NORMAL collects them in the pool)
+RET_ERROR any CL function returned an error, the pool hands out no more classes
+RET_QUIT if early exit was requested by SIGINT
+*/
+{
+  unsigned int cur_class = 0;
+  unsigned int batch_classes[GPU_SIEVE_CLASSES_MAX], num_batch = 1, max_batch = 1;
+  unsigned int *done_classes, num_finished, done_class, pending_class = 0, num_pending = 0;
+  unsigned long long int tmp;
+  time_t time_last_checkpoint, time_add_file_check=0;
+  int factorsfound = 0, numfactors = 0, checkpoint_now, do_checkpoint = mystuff->checkpoints;
+  int add_file_exists = 0, pipeline;
+
+  time(&time_last_checkpoint);
+
+  if (mystuff->gpu_sieving == 1)
+  {
+    gpusieve_init_exponent(mystuff);
+
+    /* when several classes fit into the GPU sieve, sieve and TF up to GPUSieveClasses of them at once */
+    tmp = gpusieve_class_bits(mystuff, k_min, k_max);
+    tmp = mystuff->gpu_sieve_size / tmp;
+    max_batch = (tmp < mystuff->gpu_sieve_classes) ? (unsigned int) tmp : mystuff->gpu_sieve_classes;
+    if (max_batch < 1) max_batch = 1;
+    if ((use_kernel < BARRETT79_MUL32_GS) || (use_kernel >= UNKNOWN_GS_KERNEL))
+    {
+      logprintf(mystuff, "ERROR: Unknown GPU sieve kernel selected (%d)!\n", use_kernel);
+      classpool_stop(pool);
+      return RET_ERROR;
+    }
+  }
+
+  /* single OpenCL classes overlap: the next class is sieved and started before the results of the previous
+     one are collected, its status line and checkpoint are done while the GPU works on the next class */
+  pipeline = max_batch == 1 &&
+             ((mystuff->gpu_sieving == 1) || ((use_kernel >= _71BIT_MUL24) && (use_kernel < UNKNOWN_KERNEL)));
+
+/* the classes come from the pool in ascending order, with several devices each one gets the next free ones */
+  while((num_batch = classpool_take(pool, mystuff, batch_classes, max_batch)) > 0 || num_pending > 0)
+  {
+    if(mystuff->quit && mystuff->mode == MODE_NORMAL)
+    {
+/* check if quit is requested. Because this is at the beginning of the class
+   we can be sure that if RET_QUIT is returned the last class hasn't
+   finished. A self-test finishes its classes, the class of the known factor
+   is the last one, selftest() stops after this test case. */
+      if (num_pending == 0)
+      {
+        if(mystuff->printmode == 1)logprintf(mystuff, "\n");
+        return RET_QUIT;
+      }
+      num_batch = 0;  // but collect the class in flight
+    }
+
+    if (num_batch > 0)
+    {
+      cur_class = batch_classes[num_batch - 1];
+      mystuff->stats.class_number = cur_class;
+      /* with several devices this includes the classes the other devices have finished */
+      mystuff->stats.class_counter = pool->num_done + num_pending + num_batch;
+      use_specialized_kernel(use_kernel, 0);  // switch once its build is done
+    }
+    done_classes = batch_classes;
+    num_finished = num_batch;
+
+    if (pipeline)
+    {
+      if (num_batch > 0)
+      {
+        if (mystuff->gpu_sieving == 1)
+          gpusieve_init_class(mystuff, k_min+cur_class);
+        else if (mystuff->sieve_threads > 0)
+          sievepool_init_class(mystuff->exponent, k_min+cur_class, mystuff->sieve_primes);
+        else
+          sieve_init_class(mystuff->sieve_ctx, mystuff->exponent, k_min+cur_class, mystuff->sieve_primes);
+        if (tf_class_opencl_start(k_min+cur_class, k_max, mystuff, use_kernel) != 0)
+        {
+          logprintf(mystuff, "ERROR from tf_class.\n");
+          tf_class_opencl_abort(mystuff);  // the previous class may still be in flight
+          classpool_stop(pool);
+          return RET_ERROR;
+        }
+        if (num_pending == 0)  // nothing to collect yet
+        {
+          pending_class = cur_class;
+          num_pending = 1;
+          continue;
+        }
+      }
+      /* collect the previous class */
+      done_class = pending_class;
+      done_classes = &done_class;
+      num_finished = 1;
+      if (num_batch > 0) pending_class = cur_class;
+      else               num_pending = 0;
+      mystuff->stats.class_number = done_class;
+      mystuff->stats.class_counter = pool->num_done + 1;
+      numfactors = tf_class_opencl_wait(mystuff, use_kernel);
+    }
+    else if (mystuff->gpu_sieving == 1)
+    {
+      if (num_batch > 1)
+      {
+        /* all of these classes complete together */
+        numfactors = tf_classes_opencl (k_min, k_max, batch_classes, num_batch, mystuff, use_kernel);
+      }
+      else
+      {
+        gpusieve_init_class(mystuff, k_min+cur_class);
+        numfactors = tf_class_opencl (k_min+cur_class, k_max, mystuff, use_kernel);
+      }
+    }
+    else
+    {
+      if (mystuff->sieve_threads > 0)
+        sievepool_init_class(mystuff->exponent, k_min+cur_class, mystuff->sieve_primes);
+      else
+        sieve_init_class(mystuff->sieve_ctx, mystuff->exponent, k_min+cur_class, mystuff->sieve_primes);
+      if ((use_kernel >= _71BIT_MUL24) && (use_kernel < UNKNOWN_KERNEL))
+      {
+        numfactors = tf_class_opencl (k_min+cur_class, k_max, mystuff, use_kernel);
+      }
+      else if ((use_kernel == CPU_TF) || (use_kernel == CPU_TF_IFMA))
+      {
+        numfactors = tf_class_cpu (k_min+cur_class, k_max, mystuff, use_kernel);
+      }
+      else
+      {
+        logprintf(mystuff, "ERROR: Unknown kernel selected (%d)!\n", use_kernel);
+        classpool_stop(pool);
+        return RET_ERROR;
+      }
+    }
+
+    if (numfactors == RET_ERROR)
+    {
+      logprintf(mystuff, "ERROR from tf_class.\n");
+      /* drop the grids still queued, in the pipeline the next class may already be in flight */
+      if ((use_kernel != CPU_TF) && (use_kernel != CPU_TF_IFMA)) tf_class_opencl_abort(mystuff);
+      classpool_stop(pool);
+      return RET_ERROR;
+    }
+
+    if(mystuff->mode == MODE_NORMAL)
+    {
+      int96 factors[RES_FACTORS_MAX];
+
+      for (int idx = 0; idx < numfactors && idx < RES_FACTORS_MAX; idx++) /* the factors stored in the result buffer of the class (or multi-class launch) */
+      {
+        int96 factor;
+        factor.d2 = mystuff->h_RES[idx * 3 + 1];
+        factor.d1 = mystuff->h_RES[idx * 3 + 2];
+        factor.d0 = mystuff->h_RES[idx * 3 + 3];
+        if (use_kernel == _71BIT_MUL24 || use_kernel == _63BIT_MUL24)
+        {
+          factor.d0 = (factor.d1 << 24) + factor.d0;
+          factor.d1 = (factor.d2 << 16) + (factor.d1 >> 8);
+          factor.d2 = factor.d2 >> 16;
+        }
+        else if ((use_kernel >= BARRETT73_MUL15_GS && use_kernel <= BARRETT74_MUL15_GS) || (use_kernel >= BARRETT73_MUL15 && use_kernel <= BARRETT74_MUL15) || use_kernel == MG88)
+        {
+          factor.d0 = (factor.d1 << 30) + factor.d0;
+          factor.d1 = (factor.d2 << 28) + (factor.d1 >> 2);
+          factor.d2 = factor.d2 >> 4;
+        }
+
+        if (num_finished > 1 && mystuff->verbosity >= 2)
+        {
+          char string[MAX_DEZ_96_STRING_LENGTH];
+          print_dez96(factor, string);
+          logprintf(mystuff, "  factor %s is in class %u\n", string, factor_class(factor, mystuff->exponent, mystuff->num_classes));
+        }
+        factors[idx] = factor;
+      }
+
+      time_t now = time(NULL);
+      if (add_file_exists)
+      {
+        if (now > time_add_file_check + 300)   // do not process the add file until it is 5 minutes old
+        {
+          process_add_file(mystuff->workfile);
+          add_file_exists = 0;
+        } // else just wait until after the next class
+      }
+      else if (dev == &device_list[0])  // device 0 looks after the add file
+      {
+        add_file_exists = add_file_available(mystuff->workfile);
+        time_add_file_check = now;
+      }
+
+      checkpoint_now = 0;
+      if (mystuff->checkpoints > 0)
+      {
+        if ( ((mystuff->checkpoints > 1) && (--do_checkpoint == 0)) ||
+             ((mystuff->checkpoints == 1) && (now - time_last_checkpoint > (time_t) mystuff->checkpointdelay)) ||
+               mystuff->quit )
+        {
+          checkpoint_now = 1;
+          do_checkpoint = mystuff->checkpoints;
+          time_last_checkpoint = now;
+        }
+      }
+      if (classpool_done(pool, mystuff, done_classes, num_finished, factors, numfactors < RES_FACTORS_MAX ? numfactors : RES_FACTORS_MAX, checkpoint_now) == RET_QUIT)
+      {
+        classpool_stop(pool);
+        return RET_QUIT;
+      }
+    }
+    else
+    {
+      factorsfound += numfactors;
+      classpool_done(pool, mystuff, done_classes, num_finished, NULL, 0, 0);
+    }
+    fflush(NULL);
+  }
+  if(mystuff->mode == MODE_NORMAL && mystuff->quit)
+  {
+    if(mystuff->printmode == 1)logprintf(mystuff, "\n");
+    return RET_QUIT;
+  }
+  return factorsfound;
+}
+
+
+static int tf_device(void *arg)
+/* run_on_devices() callback of tf(): the other devices take over the bit level of device 0 and pick
+   their own kernel, then all of them run the class loop */
+{
+  tf_job_t   *job        = (tf_job_t *)arg;
+  mystuff_t  *mystuff    = dev->mystuff;
+  GPUKernels  use_kernel = AUTOSELECT_KERNEL;
+
+  if(mystuff == job->mystuff) return tf_classes(mystuff, job->pool, job->k_min, job->k_max, job->use_kernel);
+
+  if(mystuff->exponent != job->mystuff->exponent)
+  {
+    mystuff->exponent = job->mystuff->exponent;
+    set_sieve_primes_limit(mystuff);
+  }
+  mystuff->bit_min              = job->mystuff->bit_min;
+  mystuff->bit_max_assignment   = job->mystuff->bit_max_assignment;
+  mystuff->bit_max_stage        = job->mystuff->bit_max_stage;
+  mystuff->stats.output_counter = 0;
+  mystuff->stats.ghzdays        = job->mystuff->stats.ghzdays;
+  mystuff->stats.class_counter  = job->class_counter;
+  mystuff->stats.bit_level_time = job->bit_level_time;
+  mystuff->factors_string[0]    = 0;
+
+  if(tf_kernel(mystuff, &use_kernel))
+  {
+    classpool_stop(job->pool);
+    return RET_ERROR;
+  }
+  return tf_classes(mystuff, job->pool, job->k_min, job->k_max, use_kernel);
+}
+
+
 int tf(mystuff_t *mystuff, int class_hint, cl_ulong k_hint, GPUKernels use_kernel)
 /*
 tf M<mystuff->exponent> from 2^<mystuff->bit_min> to 2^<mystuff->mystuff->bit_max_stage>
@@ -629,25 +992,24 @@ other return value
 -1 unknown mode
 */
 {
-  unsigned int cur_class, max_class, i = 0;
+  unsigned int i = 0;
+  class_pool_t pool;
+  tf_job_t job;
   unsigned long long int k_min, k_max, k_range, tmp;
   unsigned int f_hi, f_med, f_low;
   struct timeval timer;
-  time_t time_last_checkpoint, time_add_file_check=0;
-  int factorsfound = 0, numfactors = 0, restart = 0, factorindex = 0, do_checkpoint = mystuff->checkpoints;
+  int factorsfound = 0, restart = 0;
 
-  int retval = 0, add_file_exists = 0;
+  int retval = 0;
 
   cl_ulong time_run, time_est;
 
   mystuff->stats.output_counter = 0; /* reset output counter, needed for status headline */
   mystuff->stats.ghzdays = primenet_ghzdays(mystuff->exponent, mystuff->bit_min, mystuff->bit_max_stage);
-  max_class = mystuff->num_classes-1;
 
   if(mystuff->mode != MODE_SELFTEST_SHORT)logprintf(mystuff, "Starting trial factoring M%u from 2^%d to 2^%d (%.2f GHz-days)\n",
     mystuff->exponent, mystuff->bit_min, mystuff->bit_max_stage, mystuff->stats.ghzdays);
   timer_init(&timer);
-  time(&time_last_checkpoint);
 
   mystuff->stats.class_counter = 0;
   mystuff->stats.bit_level_time = 0;
@@ -687,192 +1049,61 @@ other return value
     #endif
   }
 
-  if(use_kernel == AUTOSELECT_KERNEL)
-  {
-    use_kernel = find_fastest_kernel(mystuff, 0);
-
-    if(use_kernel == AUTOSELECT_KERNEL || use_kernel == UNKNOWN_KERNEL)
-    {
-      logprintf(mystuff, "ERROR: No suitable kernel found for bit_min=%d, bit_max=%d.\n",
-                 mystuff->bit_min, mystuff->bit_max_stage);
-      return RET_ERROR;
-    }
-  }
-
-  sprintf(mystuff->stats.kernelname, "%s_%d", kernel_info[use_kernel].kernelname, mystuff->vectorsize);
-
-  if(mystuff->mode != MODE_SELFTEST_SHORT && mystuff->verbosity >= 1)logprintf(mystuff, "Using GPU kernel \"%s\"\n", mystuff->stats.kernelname);
+  if(tf_kernel(mystuff, &use_kernel)) return RET_ERROR;
 
-  if(mystuff->mode == MODE_NORMAL)
+  restart = classpool_init(&pool, mystuff, k_min, mystuff->mode == MODE_NORMAL ? -1 : (int)(class_hint % mystuff->num_classes));
+  if (restart > 0)
   {
-      if (mystuff->checkpoints > 0 && checkpoint_read(mystuff->exponent, mystuff->bit_min, mystuff->bit_max_stage, &cur_class, &factorsfound, mystuff->factors, &(mystuff->stats.bit_level_time), mystuff->verbosity) == 1)
-      {
-          logprintf(mystuff, "\nFound a valid checkpoint file.\n");
-          if (mystuff->verbosity >= 1) {
-              logprintf(mystuff, "  last finished class was: %d\n", cur_class);
-          }
-          if (factorsfound > 0) {
-              // don't overwrite existing factors
-              factorindex = factorsfound;
-              if (mystuff->verbosity >= 1) {
-                  logprintf(mystuff, "  found %d factor%s so far: ", factorsfound, factorsfound == 1 ? "" : "s");
-              }
-              for (i = 0; i < MAX_FACTORS_PER_JOB; i++) {
-                  if (mystuff->factors[i].d0 || mystuff->factors[i].d1 || mystuff->factors[i].d2) {
-                      char factor[MAX_DEZ_96_STRING_LENGTH];
-                      print_dez96(mystuff->factors[i], factor);
-                      logprintf(mystuff, "%s ", factor);
-                  }
-              }
-              logprintf(mystuff, "\n");
-          } else {
-              logprintf(mystuff, "  no factors found so far.\n");
-          }
+      logprintf(mystuff, "\nFound a valid checkpoint file.\n");
+      if (mystuff->verbosity >= 1) {
+          logprintf(mystuff, "  %u of %u classes finished\n", pool.num_done, pool.num_needed);
+      }
+      if (pool.num_factors > 0) {
           if (mystuff->verbosity >= 1) {
-              logprintf(mystuff, "  previous work took %llu ms\n\n", mystuff->stats.bit_level_time);
+              logprintf(mystuff, "  found %d factor%s so far: ", pool.num_factors, pool.num_factors == 1 ? "" : "s");
           }
-          else {
-              logprintf(mystuff, "\n");
+          for (i = 0; i < (unsigned int)pool.num_factors; i++) {
+              char factor[MAX_DEZ_96_STRING_LENGTH];
+              print_dez96(pool.factors[i], factor);
+              logprintf(mystuff, "%s ", factor);
           }
-
-      cur_class++; // the checkpoint contains the last completely processed class!
-
-/* calculate the number of classes which are already processed. This value is needed to estimate ETA */
-      for(i = 0; i < cur_class; i++)
-      {
-        if(class_needed(mystuff->exponent, k_min, i))mystuff->stats.class_counter++;
+          logprintf(mystuff, "\n");
+      } else {
+          logprintf(mystuff, "  no factors found so far.\n");
+      }
+      if (mystuff->verbosity >= 1) {
+          logprintf(mystuff, "  previous work took %llu ms\n\n", pool.bit_level_time);
+      }
+      else {
+          logprintf(mystuff, "\n");
       }
-      restart = mystuff->stats.class_counter;
-    }
-    else
-    {
-      cur_class=0;
-    }
-  }
-  else // mystuff->mode != MODE_NORMAL
-  {
-    cur_class = class_hint % mystuff->num_classes;
-    max_class = cur_class;
   }
+  /* ETA: the classes which are already processed */
+  mystuff->stats.class_counter = pool.num_done;
+  mystuff->stats.bit_level_time = pool.bit_level_time;
+  restart = (int)pool.num_done;
 
-  if (mystuff->gpu_sieving == 1)
+  if(pool.shared)
   {
-    gpusieve_init_exponent(mystuff);
+    /* -d x,y,...: all devices take classes of this bit level */
+    job.pool           = &pool;
+    job.mystuff        = mystuff;
+    job.k_min          = k_min;
+    job.k_max          = k_max;
+    job.use_kernel     = use_kernel;
+    job.class_counter  = pool.num_done;
+    job.bit_level_time = pool.bit_level_time;
+    factorsfound = run_on_devices(tf_device, &job);
   }
+  else factorsfound = tf_classes(mystuff, &pool, k_min, k_max, use_kernel);
+  if(factorsfound == RET_ERROR || factorsfound == RET_QUIT) return factorsfound;
 
-  for(; cur_class <= max_class; cur_class++)
+  if(mystuff->mode == MODE_NORMAL)
   {
-    if(class_needed(mystuff->exponent, k_min, cur_class))
-    {
-      mystuff->stats.class_number = cur_class;
-      if(mystuff->quit)
-      {
-/* check if quit is requested. Because this is at the beginning of the class
-   we can be sure that if RET_QUIT is returned the last class hasn't
-   finished. The signal handler which sets mystuff->quit not active during
-   selftests so we need to check for RET_QUIT only when doing real work. */
-        if(mystuff->printmode == 1)logprintf(mystuff, "\n");
-        return RET_QUIT;
-      }
-      else
-      {
-        // count++;
-        mystuff->stats.class_counter++;
-
-        if (mystuff->gpu_sieving == 1)
-        {
-          gpusieve_init_class(mystuff, k_min+cur_class);
-          if ((use_kernel >= BARRETT79_MUL32_GS) && (use_kernel < UNKNOWN_GS_KERNEL))
-          {
-            numfactors = tf_class_opencl (k_min+cur_class, k_max, mystuff, use_kernel);
-          }
-          else
-          {
-            logprintf(mystuff, "ERROR: Unknown GPU sieve kernel selected (%d)!\n", use_kernel);  return RET_ERROR;
-          }
-        }
-        else
-        {
-          sieve_init_class(mystuff->exponent, k_min+cur_class, mystuff->sieve_primes);
-          if ((use_kernel >= _71BIT_MUL24) && (use_kernel < UNKNOWN_KERNEL))
-          {
-            numfactors = tf_class_opencl (k_min+cur_class, k_max, mystuff, use_kernel);
-          }
-          else
-          {
-            logprintf(mystuff, "ERROR: Unknown kernel selected (%d)!\n", use_kernel);  return RET_ERROR;
-          }
-        }
-
-        if (numfactors == RET_ERROR)
-        {
-          logprintf(mystuff, "ERROR from tf_class.\n");
-          return RET_ERROR;
-        }
-        factorsfound+=numfactors;
-
-        if(mystuff->mode == MODE_NORMAL)
-        {
-            if (numfactors > 0) {
-                int96 factor;
-                for (int idx = 0; idx < factorsfound && idx < 10; idx++) /* 10 is the max factors per class allowed in every kernel */
-                {
-                    factor.d2 = mystuff->h_RES[idx * 3 + 1];
-                    factor.d1 = mystuff->h_RES[idx * 3 + 2];
-                    factor.d0 = mystuff->h_RES[idx * 3 + 3];
-                    if (use_kernel == _71BIT_MUL24 || use_kernel == _63BIT_MUL24)
-                    {
-                        factor.d0 = (factor.d1 << 24) + factor.d0;
-                        factor.d1 = (factor.d2 << 16) + (factor.d1 >> 8);
-                        factor.d2 = factor.d2 >> 16;
-                    }
-                    else if ((use_kernel >= BARRETT73_MUL15_GS && use_kernel <= BARRETT74_MUL15_GS) || (use_kernel >= BARRETT73_MUL15 && use_kernel <= BARRETT74_MUL15) || use_kernel == MG88)
-                    {
-                        factor.d0 = (factor.d1 << 30) + factor.d0;
-                        factor.d1 = (factor.d2 << 28) + (factor.d1 >> 2);
-                        factor.d2 = factor.d2 >> 4;
-                    }
-
-                    mystuff->factors[factorindex++] = factor;
-                    if (factorindex >= MAX_FACTORS_PER_JOB) {
-                        logprintf(mystuff, "ERROR: reached limit of %u factors for this job, try a different range\n",
-                            MAX_FACTORS_PER_JOB);
-                        return RET_QUIT;
-                    }
-                }
-            }
-
-          time_t now = time(NULL);
-          if (add_file_exists)
-          {
-            if (now > time_add_file_check + 300)   // do not process the add file until it is 5 minutes old
-            {
-              process_add_file(mystuff->workfile);
-              add_file_exists = 0;
-            } // else just wait until after the next class
-          }
-          else
-          {
-            add_file_exists = add_file_available(mystuff->workfile);
-            time_add_file_check = now;
-          }
-
-          if (mystuff->checkpoints > 0)
-          {
-            if ( ((mystuff->checkpoints > 1) && (--do_checkpoint == 0)) ||
-                 ((mystuff->checkpoints == 1) && (now - time_last_checkpoint > (time_t) mystuff->checkpointdelay)) ||
-                   mystuff->quit )
-            {
-              checkpoint_write(mystuff->exponent, mystuff->bit_min, mystuff->bit_max_stage, cur_class, factorsfound, mystuff->factors, mystuff->stats.bit_level_time);
-              do_checkpoint = mystuff->checkpoints;
-              time_last_checkpoint = now;
-            }
-          }
-          if((mystuff->stopafterfactor >= 2) && (factorsfound > 0) && (cur_class != max_class))cur_class = max_class + 1;
-        }
-      }
-      fflush(NULL);
-    }
+    factorsfound = pool.num_factors;
+    memset(mystuff->factors, 0, sizeof(mystuff->factors));
+    memcpy(mystuff->factors, pool.factors, pool.num_factors * sizeof(pool.factors[0]));
+    mystuff->stats.class_counter = pool.num_done;
   }
   if(mystuff->mode != MODE_SELFTEST_SHORT && mystuff->printmode == 1)logprintf(mystuff, "\n");
   print_result_line(mystuff, factorsfound);
@@ -938,7 +1169,7 @@ k_max and k_min are used as 64bit temporary integers here...
         f_low  &= 0x3FFFFFFF;
       }
       k_min=0; /* using k_min for counting the number of matches here */
-      for(i=0; (i<mystuff->h_RES[0]) && (i<10); i++)
+      for(i=0; (i<mystuff->h_RES[0]) && (i<RES_FACTORS_MAX); i++)
       {
         if(mystuff->h_RES[i*3 + 1] == f_hi  && \
            mystuff->h_RES[i*3 + 2] == f_med && \
@@ -956,7 +1187,7 @@ k_max and k_min are used as 64bit temporary integers here...
           // the extra spaces are used to clear the #'s
           logprintf(mystuff, "ERROR: self-test failed for M%u (%s)     \n", mystuff->exponent, kernel_info[use_kernel].kernelname);
           logprintf(mystuff, "  expected result: %08X %08X %08X\n", f_hi, f_med, f_low);
-          for (i=0; (i < mystuff->h_RES[0]) && (i < 10); i++)
+          for (i=0; (i < mystuff->h_RES[0]) && (i < RES_FACTORS_MAX); i++)
           {
               logprintf(mystuff, "  reported result: %08X %08X %08X\n", mystuff->h_RES[i*3 + 1], mystuff->h_RES[i*3 + 2], mystuff->h_RES[i*3 + 3]);
           }
@@ -985,7 +1216,7 @@ k_max and k_min are used as 64bit temporary integers here...
     if(time_run > 3600000ULL) logprintf(mystuff, "%2" PRIu64 "h ", (time_run /  3600000ULL) % 24ULL);
     if(time_run > 60000ULL)   logprintf(mystuff, "%2" PRIu64 "m ", (time_run /    60000ULL) % 60ULL);
     logprintf(mystuff, "%2" PRIu64 ".%03" PRIu64 "s", (time_run / 1000ULL) % 60ULL, time_run % 1000ULL);
-    if(restart != 0)
+    if(restart != 0 && mystuff->stats.class_counter > (unsigned int)restart)
     {
       time_est = (time_run * mystuff->stats.class_counter ) / (cl_ulong)(mystuff->stats.class_counter-restart);
       logprintf(mystuff, "\n      estimated total time spent: ");
@@ -1005,11 +1236,242 @@ k_max and k_min are used as 64bit temporary integers here...
 }
 
 
+static void report_clear_assignment(mystuff_t *mystuff, int parse_ret)
+{
+       if(parse_ret == CANT_OPEN_WORKFILE)   logprintf(mystuff, "ERROR: clear_assignment() / modify_assignment(): can't open \"%s\"\n", mystuff->workfile);
+  else if(parse_ret == CANT_OPEN_TEMPFILE)   logprintf(mystuff, "ERROR: clear_assignment() / modify_assignment(): can't open \"__worktodo__.tmp\"\n");
+  else if(parse_ret == ASSIGNMENT_NOT_FOUND) logprintf(mystuff, "ERROR: clear_assignment() / modify_assignment(): assignment not found in \"%s\"\n", mystuff->workfile);
+  else if(parse_ret == CANT_RENAME)          logprintf(mystuff, "ERROR: clear_assignment() / modify_assignment(): can't rename workfiles\n");
+  else if(parse_ret != OK)                   logprintf(mystuff, "ERROR: clear_assignment() / modify_assignment(): Unknown error (%d)\n", parse_ret);
+}
+
+
+static unsigned int batch_assignments(mystuff_t *mystuff, int use_worktodo, GPUKernels *use_kernel)
+/*
+BatchExponents > 1: collect the assignments which are TF'd together with the current one in
+mystuff->batch, the ones which follow it in the worktodo file with the same bit range. A batch
+needs the multi-grid variant of the kernel and stops at an assignment which would be split into
+stages or needs less SievePrimes. Checkpoint files are read by tf_batch().
+
+return value: the number of exponents in mystuff->batch, 0 if the current assignment is done on its own
+*/
+{
+  unsigned int exponents[BATCH_EXPONENTS_MAX], n, j;
+
+  mystuff->batch.num = 0;
+  if (mystuff->batch_exponents < 2 || !use_worktodo || mystuff->host_tf || num_device_list > 1 ||
+      mystuff->bit_max_stage != mystuff->bit_max_assignment) return 0;
+
+  *use_kernel = find_fastest_kernel(mystuff, 0);
+  if (*use_kernel == AUTOSELECT_KERNEL || *use_kernel == UNKNOWN_KERNEL || load_kernel(*use_kernel) ||
+      dev->kernel_grids[*use_kernel] == NULL) return 0;
+
+  exponents[0] = mystuff->exponent;
+  strcpy(mystuff->batch.assignment_key[0], mystuff->assignment_key);
+  n = (unsigned int)get_assignment_batch(mystuff->workfile, exponents, mystuff->batch.assignment_key, (int)mystuff->batch_exponents,
+                                         mystuff->bit_min, mystuff->bit_max_assignment);
+
+  for (j = 0; j < n; j++)
+  {
+    if (mystuff->stages == 1 && (mystuff->bit_max_stage - mystuff->bit_min) > 1 &&
+        (calculate_k(exponents[j], mystuff->bit_max_stage) - calculate_k(exponents[j], mystuff->bit_min)) > (250000000ULL * mystuff->num_classes)) break;
+    if (sieve_sieve_primes_max(exponents[j], mystuff->sieve_primes_max) < mystuff->sieve_primes) break;
+    mystuff->batch.exponent[j] = exponents[j];
+  }
+  if (j < 2) return 0;
+
+  mystuff->batch.num = j;
+  return j;
+}
+
+
+static int tf_batch(mystuff_t *mystuff, GPUKernels use_kernel)
+/*
+tf the exponents of mystuff->batch from 2^<mystuff->bit_min> to 2^<mystuff->bit_max_stage>, see
+batch_assignments(). Class by class, the grids of all exponents which need the class are packed into
+the launches of the multi-grid kernel, tf_class_finish() tells which exponent a factor belongs to.
+Each exponent gets its own checkpoint file and its own result line.
+
+return value:
+number of factors found in all exponents
+RET_ERROR any CL function returned an error
+RET_QUIT if early exit was requested by SIGINT
+*/
+{
+  batch_t *batch = &mystuff->batch;
+  int96 factors[BATCH_EXPONENTS_MAX][MAX_FACTORS_PER_JOB];
+  int num_factors[BATCH_EXPONENTS_MAX], factorsfound = 0, numfactors, idx, do_checkpoint = mystuff->checkpoints;
+  cl_uchar done[BATCH_EXPONENTS_MAX][CLASS_BITMAP_BYTES];
+  unsigned int classes_done[BATCH_EXPONENTS_MAX], cur_class, first, j;
+  unsigned long long int k_min, bit_level_time[BATCH_EXPONENTS_MAX];
+  struct timeval timer;
+  cl_ulong time_run;
+  time_t now, time_last_checkpoint;
+
+  memset(factors, 0, sizeof(factors));
+  memset(num_factors, 0, sizeof(num_factors));
+  memset(done, 0, sizeof(done));
+  memset(classes_done, 0, sizeof(classes_done));
+  memset(bit_level_time, 0, sizeof(bit_level_time));
+  time(&time_last_checkpoint);
+
+  mystuff->stats.output_counter = 0; /* reset output counter, needed for status headline */
+  mystuff->stats.ghzdays = 0.0;
+  for (j = 0; j < batch->num; j++)
+  {
+    k_min = calculate_k(batch->exponent[j], mystuff->bit_min);
+    batch->k_min[j] = k_min - (k_min % mystuff->num_classes);
+    batch->k_max[j] = calculate_k(batch->exponent[j], mystuff->bit_max_stage);
+    mystuff->stats.ghzdays += primenet_ghzdays(batch->exponent[j], mystuff->bit_min, mystuff->bit_max_stage);
+  }
+
+  logprintf(mystuff, "Starting trial factoring M%u and %u more exponents from 2^%d to 2^%d (%.2f GHz-days)\n",
+    batch->exponent[0], batch->num - 1, mystuff->bit_min, mystuff->bit_max_stage, mystuff->stats.ghzdays);
+  timer_init(&timer);
+
+  mystuff->stats.class_counter = 0;
+  for (j = 0; j < batch->num && mystuff->checkpoints > 0; j++)
+  {
+    if (checkpoint_read(batch->exponent[j], mystuff->bit_min, mystuff->bit_max_stage, done[j], &num_factors[j], factors[j],
+                        &bit_level_time[j], mystuff->verbosity) != 1) continue;
+    for (cur_class = 0; cur_class < mystuff->num_classes; cur_class++)
+    {
+      if (CLASS_TEST(done[j], cur_class)) classes_done[j]++;
+    }
+    if (classes_done[j] > mystuff->stats.class_counter) mystuff->stats.class_counter = classes_done[j];
+    if (mystuff->verbosity >= 1)
+      logprintf(mystuff, "Found a valid checkpoint file for M%u: %u classes finished, %d factor%s so far\n",
+                batch->exponent[j], classes_done[j], num_factors[j], num_factors[j] == 1 ? "" : "s");
+  }
+  mystuff->stats.bit_level_time = 0;
+  mystuff->factors_string[0] = 0;
+
+  sprintf(mystuff->stats.kernelname, "%s_%d", kernel_info[use_kernel].kernelname, mystuff->vectorsize);
+  if(mystuff->verbosity >= 1)logprintf(mystuff, "Using GPU kernel \"%s\" for %u exponents\n", mystuff->stats.kernelname, batch->num);
+
+  for (cur_class = 0; cur_class < mystuff->num_classes; cur_class++)
+  {
+    if(mystuff->quit)
+    {
+      /* the checkpoints were written after the last class */
+      batch->num = 0;
+      if(mystuff->printmode == 1)logprintf(mystuff, "\n");
+      return RET_QUIT;
+    }
+
+    batch->num_cur = 0;
+    for (j = 0; j < batch->num; j++)
+    {
+      if (mystuff->stopafterfactor >= 2 && num_factors[j] > 0) continue;
+      if (CLASS_TEST(done[j], cur_class)) continue;  // from the checkpoint file
+      if (class_needed(batch->exponent[j], batch->k_min[j], cur_class))
+      {
+        batch->cur[batch->num_cur++] = j;
+        classes_done[j]++;
+        if (classes_done[j] > mystuff->stats.class_counter) mystuff->stats.class_counter = classes_done[j];
+      }
+    }
+    if (batch->num_cur == 0) continue;
+
+    /* the first exponent is set up here, tf_class_opencl_start() sets up the others */
+    first = batch->cur[0];
+    mystuff->exponent = batch->exponent[first];
+    mystuff->stats.class_number = cur_class;
+    if (mystuff->sieve_threads > 0)
+      sievepool_init_class(mystuff->exponent, batch->k_min[first] + cur_class, mystuff->sieve_primes);
+    else
+      sieve_init_class(mystuff->sieve_ctx, mystuff->exponent, batch->k_min[first] + cur_class, mystuff->sieve_primes);
+
+    numfactors = tf_class_opencl(batch->k_min[first] + cur_class, batch->k_max[first], mystuff, use_kernel);
+    if (numfactors == RET_ERROR)
+    {
+      logprintf(mystuff, "ERROR from tf_class.\n");
+      tf_class_opencl_abort(mystuff);
+      batch->num = 0;
+      return RET_ERROR;
+    }
+
+    for (idx = 0; idx < numfactors && idx < RES_FACTORS_MAX; idx++)
+    {
+      int96 factor;
+
+      j = batch->factor_job[idx];
+
+      /* the barrett15 kernels report 30 bits per int */
+      factor.d2 = mystuff->h_RES[idx * 3 + 1];
+      factor.d1 = mystuff->h_RES[idx * 3 + 2];
+      factor.d0 = mystuff->h_RES[idx * 3 + 3];
+      factor.d0 = (factor.d1 << 30) + factor.d0;
+      factor.d1 = (factor.d2 << 28) + (factor.d1 >> 2);
+      factor.d2 = factor.d2 >> 4;
+
+      if (num_factors[j] >= MAX_FACTORS_PER_JOB)
+      {
+        logprintf(mystuff, "ERROR: reached limit of %u factors for M%u, try a different range\n", MAX_FACTORS_PER_JOB, batch->exponent[j]);
+        continue;
+      }
+      factors[j][num_factors[j]++] = factor;
+    }
+
+    /* tf_class_finish() accounts the time of the class, the exponents share it */
+    for (j = 0; j < batch->num_cur; j++)
+    {
+      CLASS_SET(done[batch->cur[j]], cur_class);
+      bit_level_time[batch->cur[j]] += mystuff->stats.class_time / batch->num_cur;
+    }
+    if (mystuff->checkpoints > 0)
+    {
+      time(&now);
+      if ( ((mystuff->checkpoints > 1) && (--do_checkpoint == 0)) ||
+           ((mystuff->checkpoints == 1) && (now - time_last_checkpoint > (time_t) mystuff->checkpointdelay)) ||
+             mystuff->quit )
+      {
+        for (j = 0; j < batch->num; j++)
+        {
+          if (classes_done[j] > 0)
+            checkpoint_write(batch->exponent[j], mystuff->bit_min, mystuff->bit_max_stage, done[j], num_factors[j], factors[j], bit_level_time[j]);
+        }
+        do_checkpoint = mystuff->checkpoints;
+        time_last_checkpoint = now;
+      }
+    }
+    fflush(NULL);
+  }
+
+  if(mystuff->printmode == 1)logprintf(mystuff, "\n");
+  for (j = 0; j < batch->num; j++)
+  {
+    mystuff->exponent = batch->exponent[j];
+    strcpy(mystuff->assignment_key, batch->assignment_key[j]);
+    memset(mystuff->factors, 0, sizeof(mystuff->factors));
+    memcpy(mystuff->factors, factors[j], num_factors[j] * sizeof(factors[j][0]));
+    mystuff->stats.class_counter = classes_done[j];
+    print_result_line(mystuff, num_factors[j]);
+    factorsfound += num_factors[j];
+    if (mystuff->checkpoints > 0) checkpoint_delete(batch->exponent[j]);
+  }
+  batch->num = 0;
+
+  time_run = timer_diff(&timer)/1000;
+  logprintf(mystuff, "tf(): total time spent: ");
+  if(time_run > 86400000ULL)logprintf(mystuff, "%" PRIu64 "d ",   time_run / 86400000ULL);
+  if(time_run > 3600000ULL) logprintf(mystuff, "%2" PRIu64 "h ", (time_run /  3600000ULL) % 24ULL);
+  if(time_run > 60000ULL)   logprintf(mystuff, "%2" PRIu64 "m ", (time_run /    60000ULL) % 60ULL);
+  logprintf(mystuff, "%2" PRIu64 ".%03" PRIu64 "s\n\n", (time_run / 1000ULL) % 60ULL, time_run % 1000ULL);
+
+  return factorsfound;
+}
+
+
 int selftest(mystuff_t *mystuff, enum MODES type)
 /*
 type = 1: small selftest (this is executed EACH time mfakto is started)
 type = 2: quick, full selftest: find each factor using the kernel that would normally be used (the fastest kernels for the bitlevel)
 type = 3: full selftest: find each factor using each kernel capable of running this bitlevel
+type = 4: GPU sieve selftest: like type 1 (but the full k range), with a tiny GPU sieve so that
+          each class is sieved in many chunks (tests gpusieve_advance_class())
+Each test case TFs the class of the known factor and up to SELFTEST_CLASSES - 1 needed classes below it,
+see classpool_init().
 
 return value
 0 selftest passed
@@ -1035,13 +1497,31 @@ RET_ERROR we might have a serios problem
   // save the SievePrimes ini value as the selftest may lower it to fit small test-exponents
   unsigned int sieve_primes_save = mystuff->sieve_primes;
   unsigned int verbosity_save = mystuff->verbosity;
+  unsigned int gpu_sieve_size_save = mystuff->gpu_sieve_size;
   mystuff->verbosity = 0;
 
   register_signal_handler(mystuff);
 
+  if (type == MODE_SELFTEST_GPUSIEVE)
+  {
+    if (mystuff->gpu_sieving)
+    {
+      // smallest multiple of the SegSieve block size that is also a multiple of GPUSieveProcessSize
+      mystuff->gpu_sieve_size = GPU_SIEVE_SIZE_SELFTEST;
+      while (mystuff->gpu_sieve_size % mystuff->gpu_sieve_processing_size != 0) mystuff->gpu_sieve_size += GPU_SIEVE_SIZE_SELFTEST;
+      logprintf(mystuff, "GPU sieve self-test using a %u bit GPU sieve\n", mystuff->gpu_sieve_size);
+      gpusieve_free(mystuff);
+      init_CLstreams(1);
+    }
+    else
+    {
+      logprintf(mystuff, "Warning: -st3 tests the GPU sieve, but SieveOnGPU=0\n");
+    }
+  }
+
   for(i=0; i<total_selftests; ++i)
   {
-    if(type == MODE_SELFTEST_SHORT)
+    if(type == MODE_SELFTEST_SHORT || type == MODE_SELFTEST_GPUSIEVE)
     {
       if (i < (sizeof(index)/sizeof(index[0])))
       {
@@ -1084,7 +1564,12 @@ RET_ERROR we might have a serios problem
 
     if (type == MODE_SELFTEST_FULL)
     {
-      if (mystuff->gpu_sieving == 0)
+      if (mystuff->host_tf)
+      {
+        if(kernel_possible(CPU_TF, mystuff)) kernels[j++] = CPU_TF;
+        if(cpu_tf_kernel_supported(CPU_TF_IFMA) && kernel_possible(CPU_TF_IFMA, mystuff)) kernels[j++] = CPU_TF_IFMA;
+      }
+      else if (mystuff->gpu_sieving == 0)
       {
   //      for (kernel_index = _71BIT_MUL24; kernel_index < BARRETT88_MUL15; ++kernel_index) // test-only: skip 6x15-bit kernels
   //      for (kernel_index = BARRETT79_MUL32; kernel_index <= BARRETT87_MUL32; ++kernel_index) // test-only: only use 32-bit kernels
@@ -1139,6 +1624,12 @@ RET_ERROR we might have a serios problem
 
   // restore SievePrimes ini value
   mystuff->sieve_primes = sieve_primes_save;
+  if (mystuff->gpu_sieve_size != gpu_sieve_size_save)
+  {
+    mystuff->gpu_sieve_size = gpu_sieve_size_save;
+    gpusieve_free(mystuff);
+    init_CLstreams(1);
+  }
 
   if(st_success == num_selftests)
   {
@@ -1153,16 +1644,173 @@ RET_ERROR we might have a serios problem
   return retval;
 }
 
+static int parse_device(const char *arg, int *devicenumber, cl_uint *host_tf)
+/* one device of option "-d": c(PU), g(PU), h(ost TF) or a device number. Returns 0 or -1 if it can't be parsed. */
+{
+  char *ptr;
+  long n;
+
+  *host_tf = 0;
+  if (arg[0] == 'c')       // run on CPU
+  {
+    *devicenumber = -1;
+  }
+  else if (arg[0] == 'g')  // run on GPU
+  {
+    *devicenumber = 0;
+  }
+  else if (arg[0] == 'h')  // no OpenCL, TF on the host
+  {
+    *host_tf = 1;
+  }
+  else
+  {
+    errno = 0;
+    n = strtol(arg, &ptr, 10);
+    if (*ptr || errno || n != (int)n) return -1;
+    *devicenumber = (int)n;
+  }
+  return 0;
+}
+
+static int parse_device_list(char *arg, int *devicenumber, cl_uint *host_tf)
+/*
+option "-d x,y,...": one mfakto drives several devices, the first one is device 0. Returns the number
+of devices or -1 on a bad list. The host TF backend has global state, it can be in the list once.
+*/
+{
+  char *token;
+  int n = 0, num_host = 0;
+
+  for (token = strtok(arg, ","); token != NULL; token = strtok(NULL, ","))
+  {
+    if (n == MAX_DEVICES)
+    {
+      logprintf(&mystuff, "ERROR: too many devices for option \"-d\", at most %d are supported\n", MAX_DEVICES);
+      return -1;
+    }
+    if (parse_device(token, &devicenumber[n], &host_tf[n]))
+    {
+      logprintf(&mystuff, "ERROR: can't parse <device number> \"%s\" for option \"-d\"\n", token);
+      return -1;
+    }
+    num_host += host_tf[n++];
+  }
+  if (n == 0)
+  {
+    logprintf(&mystuff, "ERROR: can't parse <device number> for option \"-d\"\n");
+    return -1;
+  }
+  if (num_host > 1)
+  {
+    logprintf(&mystuff, "ERROR: \"h\" can be used once for option \"-d\"\n");
+    return -1;
+  }
+  return n;
+}
+
+static int init_device(mystuff_t *mystuff, int *devicenumber)
+/* the OpenCL (or host TF) state and the CPU sieve context of the device selected with select_device() */
+{
+  if (mystuff->host_tf)
+  {
+    // no OpenCL at all, the grids are processed by the TF threads of cpu_tf.cpp
+    mystuff->threads_per_grid = mystuff->threads_per_grid_max;
+    if (cpu_tf_init(mystuff))
+    {
+      logprintf(mystuff, "ERROR: cpu_tf_init (malloc buffers?) failed\n");
+      return ERR_MEM;
+    }
+  }
+  else
+  {
+    if(init_CL(mystuff->num_streams, devicenumber)!=CL_SUCCESS)
+    {
+      logprintf(mystuff, "ERROR: init_CL(%d, %d) failed\n", mystuff->num_streams, *devicenumber);
+      return ERR_INIT;
+    }
+
+    set_gpu_type();
+
+    if (mystuff->gpu_sieving == 0)
+    {
+      mystuff->threads_per_grid = mystuff->threads_per_grid_max;
+      if (mystuff->threads_per_grid > dev->deviceinfo.maxThreadsPerGrid)
+      {
+        mystuff->threads_per_grid = (cl_uint)dev->deviceinfo.maxThreadsPerGrid;
+      }
+      // threads_per_grid is the number of FC's per kernel invocation. It must be divisible by the vectorsize
+      // as only threads_per_grid / vectorsize threads will actually be started.
+      cl_uint diff_threads = mystuff->threads_per_grid % (mystuff->vectorsize * dev->deviceinfo.maxThreadsPerBlock);
+      // on some devices, such as certain Intel CPUs, the number of threads per
+      // grid could be set to zero when less than vector size * maximum threads
+      // per block
+      if (mystuff->threads_per_grid > diff_threads) {
+        mystuff->threads_per_grid -= diff_threads;
+      } else {
+        logprintf(mystuff, "Info: threads per grid was not adjusted\n");
+      }
+    }
+    else
+    {
+      // GPU sieving ONLY works with 256 threads per grid
+      mystuff->threads_per_grid = 256;
+      if (mystuff->threads_per_grid > dev->deviceinfo.maxThreadsPerGrid)
+      {
+        logprintf(mystuff, "ERROR: device only supports %u threads per grid. A minimum of 256 is required for GPU sieving.\n", (unsigned int) dev->deviceinfo.maxThreadsPerGrid);
+        return ERR_MEM;
+      }
+    }
+
+    if (load_kernels(devicenumber)!=CL_SUCCESS)
+    {
+      logprintf(mystuff, "ERROR: load_kernels(%d) failed\n", *devicenumber);
+      return ERR_INIT;
+    }
+
+    if (init_CLstreams(0))
+    {
+      logprintf(mystuff, "ERROR: init_CLstreams (malloc buffers?) failed\n");
+      return ERR_MEM;
+    }
+  }
+  return ERR_OK;
+}
+
+static void cleanup_all(void)
+/* release the OpenCL (or host TF) state of all devices and the sieves before main() returns. This
+also stops the kernel build threads, which must not be running when the process exits. */
+{
+  cl_uint d;
+
+  for (d = 0; d < num_device_list; d++)
+  {
+    select_device(d);
+    if (dev->mystuff->host_tf) cpu_tf_free(dev->mystuff);
+    else                       cleanup_CL();
+  }
+  select_device(0);
+
+  sievepool_free();
+  for (d = 0; d < num_device_list; d++) sieve_ctx_free(device_list[d].mystuff->sieve_ctx);
+  sieve_free();
+}
+
+
 int main(int argc, char **argv)
 {
   unsigned long exponent = 1;
   long bit_min = -1, bit_max = -1;
   int parse_ret = -1;
-  int devicenumber = 0;
+  int devicenumber[MAX_DEVICES] = {0};  // -d x,y,...: one entry per device
+  cl_uint host_tf[MAX_DEVICES] = {0};
+  int num_devices = 1;
+  cl_uint d;
 
   int i = 1, tmp = 0;
   char *ptr;
   int use_worktodo = 1;
+  GPUKernels batch_kernel;
 
   //memset(&mystuff, 0, sizeof(mystuff));
   mystuff.mode = MODE_NORMAL;
@@ -1179,8 +1827,10 @@ int main(int argc, char **argv)
   mystuff.gpu_sieve_size = GPU_SIEVE_SIZE_DEFAULT * 1024 * 1024;
   /* Default to 16 Kib processed by each block in a Barrett kernel. */
   mystuff.gpu_sieve_processing_size = GPU_SIEVE_PROCESS_SIZE_DEFAULT * 1024;
+  mystuff.gpu_sieve_classes = GPU_SIEVE_CLASSES_DEFAULT;
   snprintf(mystuff.inifile, sizeof(mystuff.inifile), CFG_FILE);
   mystuff.force_rebuild = 0;
+  mystuff.host_tf = 0;
 
 
   // need to see if we should log all the output before all of the other preamble
@@ -1235,23 +1885,9 @@ int main(int argc, char **argv)
         logprintf(&mystuff, "ERROR: no device number specified for option \"-d\"\n");
         return ERR_PARAM;
       }
-      if (argv[i+1][0] == 'c')  // run on CPU
-      {
-        devicenumber = -1;
-      }
-      else if (argv[i+1][0] == 'g')  // run on GPU
-      {
-        devicenumber = 0;
-      }
-      else
-      {
-        devicenumber = strtol(argv[i+1],&ptr,10);
-        if(*ptr || errno || devicenumber != strtol(argv[i+1],&ptr,10) )
-        {
-          logprintf(&mystuff, "ERROR: can't parse <device number> for option \"-d\"\n");
-          return ERR_PARAM;
-	      }
-      }
+      num_devices = parse_device_list(argv[i+1], devicenumber, host_tf);
+      if (num_devices < 0) return ERR_PARAM;
+      mystuff.host_tf = host_tf[0];
       i++;
     }
     else if(!strcmp((char*)"-tf", argv[i]))
@@ -1291,6 +1927,10 @@ int main(int argc, char **argv)
     {
       mystuff.mode = MODE_SELFTEST_FULL;
     }
+    else if(!strcmp((char*)"-st3", argv[i]))
+    {
+      mystuff.mode = MODE_SELFTEST_GPUSIEVE;
+    }
     else if(!strcmp((char*)"-i", argv[i]) || !strcmp((char*)"--inifile", argv[i]))
     {
       i++;
@@ -1308,7 +1948,7 @@ int main(int argc, char **argv)
         tmp = (int)strtol(argv[i+1],&ptr,10);
       else
         tmp = 0;
-      perftest(tmp, devicenumber);
+      perftest(tmp, devicenumber[0]);
       return ERR_OK;
     }
     else if(!strcmp((char*)"--timertest", argv[i]))
@@ -1324,14 +1964,17 @@ int main(int argc, char **argv)
     else if(!strcmp((char*)"--CLtest", argv[i]))
     {
       read_config(&mystuff);
-      CL_test(devicenumber);
+      CL_test(devicenumber[0]);
       return ERR_OK;
     }
     else if(!strcmp((char*)"--gpusievetest", argv[i]))
     {
+      if ((i+1)<argc)
+        tmp = (int)strtol(argv[i+1],&ptr,10);
+      else
+        tmp = 0;
       read_config(&mystuff);
-      init_CL(mystuff.num_streams, &devicenumber);
-      return ERR_OK;
+      return gpusieve_test((cl_uint)tmp, devicenumber[0]) ? ERR_SELFTEST : ERR_OK;
     }
     else if((!strcmp((char*)"-r", argv[i])) || (!strcmp((char*)"--rebuild", argv[i])))
     {
@@ -1354,7 +1997,21 @@ int main(int argc, char **argv)
     }
   }
 
-  read_config(&mystuff);
+  for (d = 1; d < (cl_uint)num_devices; d++) mystuff.host_tf |= host_tf[d];  // read_config(): no GPU sieve with "h" in a device list
+  if (read_config(&mystuff)) return ERR_PARAM;
+
+  /* -d x,y,...: the devices share the classes of an assignment, so they need the same classes: with
+     "h" in the list (no GPU sieve) all of them sieve on the CPU. Device 0 has the global mystuff. */
+  mystuff.host_tf = host_tf[0];
+  for (d = 1; d < (cl_uint)num_devices; d++)
+  {
+    device_list[d].mystuff = (mystuff_t *) malloc(sizeof(mystuff_t));
+    if (device_list[d].mystuff == NULL) return ERR_MEM;
+    memcpy(device_list[d].mystuff, &mystuff, sizeof(mystuff_t));
+    device_list[d].mystuff->host_tf       = host_tf[d];
+    device_list[d].mystuff->sieve_threads = 0;  // the siever threads work for device 0, the others sieve on their own host thread
+  }
+  num_device_list = (cl_uint)num_devices;
 
 /* print current configuration */
   if(mystuff.verbosity >= 1)
@@ -1403,55 +2060,18 @@ int main(int argc, char **argv)
     logprintf(&mystuff, "\n");
   }
 
-  if(init_CL(mystuff.num_streams, &devicenumber)!=CL_SUCCESS)
-  {
-    logprintf(&mystuff, "ERROR: init_CL(%d, %d) failed\n", mystuff.num_streams, devicenumber);
-    return ERR_INIT;
-  }
-
-  set_gpu_type();
-
-  if (mystuff.gpu_sieving == 0)
+  for (d = 0; d < num_device_list; d++)
   {
-    mystuff.threads_per_grid = mystuff.threads_per_grid_max;
-    if (mystuff.threads_per_grid > deviceinfo.maxThreadsPerGrid)
-    {
-      mystuff.threads_per_grid = (cl_uint)deviceinfo.maxThreadsPerGrid;
-    }
-    // threads_per_grid is the number of FC's per kernel invocation. It must be divisible by the vectorsize
-    // as only threads_per_grid / vectorsize threads will actually be started.
-    cl_uint diff_threads = mystuff.threads_per_grid % (mystuff.vectorsize * deviceinfo.maxThreadsPerBlock);
-    // on some devices, such as certain Intel CPUs, the number of threads per
-    // grid could be set to zero when less than vector size * maximum threads
-    // per block
-    if (mystuff.threads_per_grid > diff_threads) {
-      mystuff.threads_per_grid -= diff_threads;
-    } else {
-      logprintf(&mystuff, "Info: threads per grid was not adjusted\n");
-    }
-  }
-  else
-  {
-    // GPU sieving ONLY works with 256 threads per grid
-    mystuff.threads_per_grid = 256;
-    if (mystuff.threads_per_grid > deviceinfo.maxThreadsPerGrid)
+    select_device(d);
+    tmp = init_device(device_list[d].mystuff, &devicenumber[d]);
+    if (tmp != ERR_OK)
     {
-      logprintf(&mystuff, "ERROR: device only supports %u threads per grid. A minimum of 256 is required for GPU sieving.\n", (unsigned int) deviceinfo.maxThreadsPerGrid);
-      return ERR_MEM;
+      num_device_list = d;  // release the devices which are up already
+      cleanup_all();
+      return tmp;
     }
   }
-
-  if (load_kernels(&devicenumber)!=CL_SUCCESS)
-  {
-    logprintf(&mystuff, "ERROR: load_kernels(%d) failed\n", devicenumber);
-    return ERR_INIT;
-  }
-
-  if (init_CLstreams(0))
-  {
-    logprintf(&mystuff, "ERROR: init_CLstreams (malloc buffers?) failed\n");
-    return ERR_MEM;
-  }
+  select_device(0);
   if (mystuff.gpu_sieving == 0)
   {
     // do not set the CPU affinity earlier as the OpenCL initialization will
@@ -1472,21 +2092,65 @@ int main(int argc, char **argv)
 #ifdef SIEVE_SIZE_LIMIT
     sieve_init();
 #else
-    sieve_init(mystuff.sieve_size, mystuff.sieve_primes_max);
+    sieve_init(mystuff.sieve_primes_max);
 #endif
+    mystuff.sieve_ctx = sieve_ctx_new(mystuff.sieve_size, mystuff.sieve_bucket_threshold, mystuff.sieve_wheel_primes);
+    if (mystuff.sieve_ctx == NULL)
+    {
+      logprintf(&mystuff, "ERROR: sieve_ctx_new (malloc buffers?) failed\n");
+      return ERR_MEM;
+    }
+    if (!sieve_extractor_supported(mystuff.sieve_extractor))
+    {
+      logprintf(&mystuff, "Warning: SieveExtractor=%s is not supported on this CPU\n", sieve_extractor_name(mystuff.sieve_extractor));
+    }
+    mystuff.sieve_extractor = sieve_ctx_set_extractor(mystuff.sieve_ctx, mystuff.sieve_extractor);
+    if(mystuff.verbosity >= 2) logprintf(&mystuff, "Using %s bit extraction for the CPU sieve\n", sieve_extractor_name(mystuff.sieve_extractor));
+    if (sievepool_init(&mystuff))
+    {
+      logprintf(&mystuff, "ERROR: sievepool_init (malloc buffers?) failed\n");
+      return ERR_MEM;
+    }
     mystuff.sieve_primes_upper_limit = mystuff.sieve_primes_max;
+
+    /* the other devices of -d x,y,... sieve on their own host thread */
+    for (d = 1; d < num_device_list; d++)
+    {
+      mystuff_t *m = device_list[d].mystuff;
+
+      m->sieve_ctx = sieve_ctx_new(m->sieve_size, m->sieve_bucket_threshold, m->sieve_wheel_primes);
+      if (m->sieve_ctx == NULL)
+      {
+        logprintf(&mystuff, "ERROR: sieve_ctx_new (malloc buffers?) failed\n");
+        return ERR_MEM;
+      }
+      m->sieve_extractor = sieve_ctx_set_extractor(m->sieve_ctx, m->sieve_extractor);
+      m->sieve_primes_upper_limit = m->sieve_primes_max;
+    }
   }
 
   if(mystuff.mode == MODE_NORMAL)
   {
 
 /* before we start real work run a small selftest */
-    mystuff.mode = MODE_SELFTEST_SHORT;
     if(mystuff.verbosity >= 1) logprintf(&mystuff, "Started a simple self-test ...\n");
-    if (selftest(&mystuff, MODE_SELFTEST_SHORT) != 0) return ERR_SELFTEST; /* selftest failed :( */
-    mystuff.mode = MODE_NORMAL;
-    /* allow for ^C */
-    register_signal_handler(&mystuff);
+    for (d = 0; d < num_device_list; d++)
+    {
+      mystuff_t *m = device_list[d].mystuff;
+
+      select_device(d);
+      m->mode = MODE_SELFTEST_SHORT;
+      if (selftest(m, MODE_SELFTEST_SHORT) != 0) /* selftest failed :( */
+      {
+        if (num_device_list > 1) logprintf(&mystuff, "ERROR: self-test failed on entry %u of the device list\n", d + 1);
+        cleanup_all();
+        return ERR_SELFTEST;
+      }
+      m->mode = MODE_NORMAL;
+      /* allow for ^C */
+      register_signal_handler(m);
+    }
+    select_device(0);
 
     do
     {
@@ -1512,37 +2176,46 @@ int main(int argc, char **argv)
 
         mystuff.bit_max_stage = mystuff.bit_max_assignment;
 
-        if (mystuff.gpu_sieving == 0)
+        set_sieve_primes_limit(&mystuff);
+        if(mystuff.stages == 1)
         {
-          mystuff.sieve_primes_upper_limit = sieve_sieve_primes_max(mystuff.exponent, mystuff.sieve_primes_max);
-          if(mystuff.sieve_primes > mystuff.sieve_primes_upper_limit)
-          {
-            mystuff.sieve_primes = mystuff.sieve_primes_upper_limit;
-            logprintf(&mystuff, "Warning: SievePrimes is too big for the current assignment, lowering to %u\n", mystuff.sieve_primes_upper_limit);
-            logprintf(&mystuff, "         It is not allowed to sieve primes which are equal or bigger than the \n");
-            logprintf(&mystuff, "         exponent itself!\n");
-          }
+          while( ((calculate_k(mystuff.exponent, mystuff.bit_max_stage) - calculate_k(mystuff.exponent, mystuff.bit_min)) > (250000000ULL * mystuff.num_classes)) && ((mystuff.bit_max_stage - mystuff.bit_min) > 1) )mystuff.bit_max_stage--;
         }
-        else
+        /* BatchExponents: this assignment and the following ones with the same bit range at once */
+        if(batch_assignments(&mystuff, use_worktodo, &batch_kernel) > 1)
         {
-          if (mystuff.exponent < mystuff.gpu_sieve_min_exp)
+          int num_batch = (int)mystuff.batch.num;
+          unsigned int batch_exp[BATCH_EXPONENTS_MAX];
+
+          memcpy(batch_exp, mystuff.batch.exponent, sizeof(batch_exp));
+          tmp = tf_batch(&mystuff, batch_kernel);
+          if(tmp == RET_ERROR)
           {
-            logprintf(&mystuff, "Warning: SievePrimes is too big for the current assignment, adjusting\n");
-            logprintf(&mystuff, "         It is not allowed to sieve primes which are equal or bigger than the \n");
-            logprintf(&mystuff, "         exponent itself.\n");
-            gpusieve_free(&mystuff);
-            init_CLstreams(1);
+            cleanup_all();
+            return ERR_RUNTIME;
           }
+          if(tmp != RET_QUIT)
+          {
+            for(i = 0; i < num_batch; i++)
+            {
+              parse_ret = clear_assignment(mystuff.workfile, batch_exp[i], mystuff.bit_min, mystuff.bit_max_assignment, 0);
+              report_clear_assignment(&mystuff, parse_ret);
+            }
+          }
+          parse_ret = OK;
+          continue;
         }
-        if(mystuff.stages == 1)
-        {
-          while( ((calculate_k(mystuff.exponent, mystuff.bit_max_stage) - calculate_k(mystuff.exponent, mystuff.bit_min)) > (250000000ULL * mystuff.num_classes)) && ((mystuff.bit_max_stage - mystuff.bit_min) > 1) )mystuff.bit_max_stage--;
-        }
+
         tmp = 0;
         while(mystuff.bit_max_stage <= mystuff.bit_max_assignment && !mystuff.quit)
         {
           tmp = tf(&mystuff, 0, 0, AUTOSELECT_KERNEL);
-          if(tmp == RET_ERROR) return ERR_RUNTIME; /* bail out, we might have a serios problem  */
+          if(tmp == RET_ERROR)
+          {
+            /* bail out, we might have a serios problem */
+            cleanup_all();
+            return ERR_RUNTIME;
+          }
 
           if(tmp != RET_QUIT)
           {
@@ -1557,11 +2230,7 @@ int main(int argc, char **argv)
               if(mystuff.bit_max_stage == mystuff.bit_max_assignment)parse_ret = clear_assignment(mystuff.workfile, mystuff.exponent, mystuff.bit_min, mystuff.bit_max_assignment, 0);
               else                                                   parse_ret = clear_assignment(mystuff.workfile, mystuff.exponent, mystuff.bit_min, mystuff.bit_max_assignment, mystuff.bit_max_stage);
 
-                   if(parse_ret == CANT_OPEN_WORKFILE)   logprintf(&mystuff, "ERROR: clear_assignment() / modify_assignment(): can't open \"%s\"\n", mystuff.workfile);
-              else if(parse_ret == CANT_OPEN_TEMPFILE)   logprintf(&mystuff, "ERROR: clear_assignment() / modify_assignment(): can't open \"__worktodo__.tmp\"\n");
-              else if(parse_ret == ASSIGNMENT_NOT_FOUND) logprintf(&mystuff, "ERROR: clear_assignment() / modify_assignment(): assignment not found in \"%s\"\n", mystuff.workfile);
-              else if(parse_ret == CANT_RENAME)          logprintf(&mystuff, "ERROR: clear_assignment() / modify_assignment(): can't rename workfiles\n");
-              else if(parse_ret != OK)                   logprintf(&mystuff, "ERROR: clear_assignment() / modify_assignment(): Unknown error (%d)\n", parse_ret);
+              report_clear_assignment(&mystuff, parse_ret);
             }
 
             mystuff.bit_min = mystuff.bit_max_stage;
@@ -1577,18 +2246,21 @@ int main(int argc, char **argv)
   }
   else // mystuff.mode != MODE_NORMAL
   {
-    if (0 != selftest(&mystuff, mystuff.mode))
+    for (d = 0; d < num_device_list; d++)  // each device of -d x,y,...
     {
-      printf ("ERROR: self-test failed, exiting.\n");
-      cleanup_CL();
-      sieve_free();
-      return ERR_SELFTEST;
+      select_device(d);
+      if (0 != selftest(device_list[d].mystuff, mystuff.mode))
+      {
+        printf ("ERROR: self-test failed, exiting.\n");
+        select_device(0);
+        cleanup_all();
+        return ERR_SELFTEST;
+      }
     }
+    select_device(0);
   }
 
-  cleanup_CL();
-
-  sieve_free();
+  cleanup_all();
 
   return ERR_OK;
 }
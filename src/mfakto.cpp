@@ -21,6 +21,14 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include <cstdlib>
 #include <iostream>
 #include <fstream>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <string>
 #ifdef _MSC_VER
 #include <tuple>
 #endif
@@ -30,6 +38,7 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "read_config.h"
 #include "parse.h"
 #include "sieve.h"
+#include "sievepool.h"
 #include "timer.h"
 #include "checkpoint.h"
 #include "filelocking.h"
@@ -39,7 +48,9 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "menu.h"
 #ifndef _MSC_VER
 #include <sys/time.h>
+#include <dirent.h>
 #else
+#include <io.h>
 #include "time.h"
 #define time _time64
 #define localtime _localtime64
@@ -49,16 +60,129 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 // valgrind tests complain a lot about the blocks being uninitialized
 #define malloc(x) calloc(x,1)
 
-/* Global variables */
+/* Kernel groups: the kernels are built into one program per group, and a group is only built
+when one of its kernels is needed.  load_kernels() builds just the gpusieve group (the sieve kernels
+are used for every assignment); kernel_possible() queues the group of a kernel it accepts on a
+background thread, so the build overlaps with the remaining startup (and the sieve init), and
+load_kernel() waits for it (or builds the group right away) before the kernel is used. */
+enum kernel_group
+{
+  KG_TEST = 0,
+  KG_MUL24,
+  KG_BARRETT32,
+  KG_BARRETT15,
+  KG_MONTGOMERY,
+  KG_GPUSIEVE,
+  NUM_KERNEL_GROUPS,
+  KG_NONE = NUM_KERNEL_GROUPS, /* not an OpenCL kernel */
+  KG_SPECIALIZED               /* build queue entry of the exponent-specialized kernel */
+};
+
+enum kernel_group_state
+{
+  KG_NOT_BUILT = 0,
+  KG_QUEUED,
+  KG_BUILDING,
+  KG_READY,
+  KG_FAILED
+};
+
+// the group name is used for the binary file (mfakto_Kernels_<name>.elf), the define selects the group in mfakto_Kernels.cl
+static const char *kernel_group_name[NUM_KERNEL_GROUPS]   = {"test", "mul24", "barrett32", "barrett15", "montgomery", "gpusieve"};
+static const char *kernel_group_define[NUM_KERNEL_GROUPS] = {"TEST", "MUL24", "BARRETT32", "BARRETT15", "MONTGOMERY", "GPUSIEVE"};
+
+/* Completion of the TF kernels of tf_class_opencl(): the OpenCL runtime calls
+stream_complete_callback() from its own thread when exec_events[i] completes,
+with stream_ref[i] of the device as user_data. The callback stores the status
+and sets bit i in streams_completed (a lock-free set of finished streams,
+NUM_STREAMS_MAX fits into one word), the host thread sleeps on cv_streams until
+a bit is set instead of polling each event. */
+struct device_host;
+typedef struct
+{
+  device_host *host;
+  cl_uint      stream;
+} stream_ref_t;
+
+/* Class pipeline: tf_class_opencl_start() returns as soon as the last grid of
+a class is queued, tf() prepares and starts the next class before it collects
+the results of the previous one with tf_class_opencl_wait(). Every class in
+flight has its own result buffer. The non-blocking read of it is queued right
+behind the last grid of the class, the in-order queue completes it when the
+class is done. The grids on the streams are not tied to a class: the next
+class cleans up the streams of the previous one. */
+typedef struct
+{
+  int            running;                          // grids on the streams, of all classes in flight
+  cl_uint        completed;                        // streams whose completion callback fired, but which are not yet cleaned up
+  cl_uint        next;                             // result slot of the next class
+  cl_uint        in_flight;                        // classes started but not yet collected
+  cl_uint        first_stream;                     // the next class starts on this stream
+  cl_event       cleared;                          // reset of d_RES of the class being queued, its grids wait for it
+  cl_mem         d_RES[TF_PIPELINE_DEPTH];         // d_RES[0] is the buffer allocated as mystuff->d_RES
+  cl_uint        h_RES[TF_PIPELINE_DEPTH][RES_SIZE_BATCH + 12];  // OpenCL libs may read&write after the end, see h_RES
+  cl_event       read_event[TF_PIPELINE_DEPTH];
+  cl_uint        count[TF_PIPELINE_DEPTH];         // grids of the class
+  cl_ulong       twait[TF_PIPELINE_DEPTH];
+  struct timeval timer[TF_PIPELINE_DEPTH];         // start of the class
+  struct timeval last_done;                        // the previous class was collected
+} tf_pipe_t;
+
+/* the C++ part of device_t */
+struct device_host
+{
+  std::atomic<cl_uint>    streams_completed{0};
+  cl_int                  stream_exec_status[NUM_STREAMS_MAX] = {0};
+  std::mutex              streams_lock;
+  std::condition_variable cv_streams;
+  stream_ref_t            stream_ref[NUM_STREAMS_MAX];
+
+  tf_pipe_t               tf_pipe = {};
+
+  cl_program              group_program[NUM_KERNEL_GROUPS] = {NULL};
+  int                     group_state[NUM_KERNEL_GROUPS] = {KG_NOT_BUILT};
+  char                    group_base_options[256] = "";  // build options without the group define, empty until load_kernels()
+  cl_int                  group_devnumber = 0;
+  cl_uint                 group_device_key = 0;          // hash of device name and version, see kernel_cache_key()
+  cl_uint                 group_cache_key = 0;           // hash of driver and kernel sources, see kernel_cache_key()
+  std::mutex              group_lock;
+  std::condition_variable cv_group;
+  std::deque<int>         group_queue;
+  std::thread             group_thread;
+  bool                    group_thread_stop = false;
+
+/* Exponent-specialized kernel (SpecializeKernels=1): one barrett kernel rebuilt for the current assignment
+with the exponent, shiftcount and bit_max65 as constants (see TF_EXPONENT in common.cl). It is built on the
+background thread while the generic kernel runs, and use_specialized_kernel() puts it into dev->kernel[]
+at the start of a class once it is ready. Protected by group_lock like the groups. */
+  int                     spec_state = KG_NOT_BUILT;
+  int                     spec_kernel_id = -1;
+  cl_uint                 spec_exponent = 0, spec_shiftcount = 0, spec_bit_max65 = 0;
+  cl_uint                 spec_generation = 0;         // a build of an older generation is discarded
+  cl_program              spec_program = NULL;
+  cl_kernel               spec_kernel = NULL;
+  cl_kernel               spec_generic_kernel = NULL;  // the generic kernel while dev->kernel[] holds spec_kernel
+};
 
-cl_uint             new_class = 1;
-cl_device_id        *devices;
-cl_program          program = NULL;
+static void CL_CALLBACK stream_complete_callback(cl_event event, cl_int event_status, void *user_data)
+{
+  stream_ref_t *ref  = (stream_ref_t *)user_data;
+  device_host  *host = ref->host;
 
-cl_context          context = NULL;
-cl_command_queue    commandQueue, commandQueuePrf = NULL;
+  (void)event;
+  host->stream_exec_status[ref->stream] = event_status;  // CL_COMPLETE or an error code
+  host->streams_completed.fetch_or(1U << ref->stream);
+  {
+    std::lock_guard<std::mutex> lock(host->streams_lock);  // don't let the host thread miss the wakeup
+  }
+  host->cv_streams.notify_one();
+}
 
-int only_use_cpu = 0;
+static void wait_for_any_stream()
+{
+  std::unique_lock<std::mutex> lock(dev->host->streams_lock);
+  while (dev->host->streams_completed.load() == 0) dev->host->cv_streams.wait(lock);
+}
 
 #ifdef __cplusplus
 extern "C"
@@ -68,59 +192,218 @@ extern "C"
 #include "signal_handler.h"
 extern mystuff_t    mystuff;
 extern GPU_type     gpu_types[];
-OpenCL_deviceinfo_t deviceinfo={{0}};
+
+/* Global variables */
+
+/* the devices of this mfakto: device_list[0] is the one of -d N (or the first one of -d x,y,...) and has the
+global mystuff. The other devices of -d x,y,... get host threads of their own, see run_on_devices(). */
+device_t              device_list[MAX_DEVICES] = {{&mystuff}};
+cl_uint               num_device_list = 1;
+THREAD_LOCAL device_t *dev = &device_list[0];
+static std::mutex     devices_mutex;
 kernel_info_t       kernel_info[] = {
-  /*   kernel (in sequence) | kernel function name | bit_min | bit_max | stages? | loaded kernel pointer */
-     {   AUTOSELECT_KERNEL,   "auto",                  0,      0,         0,      NULL},
-     {   _TEST_MOD_,          "test_k",                0,      0,         0,      NULL}, // used for various tests
-     {   _71BIT_MUL24,        "mfakto_cl_71",         61,     71,         1,      NULL},
-     {   _63BIT_MUL24,        "mfakto_cl_63",         58,     64,         1,      NULL},
-     {   BARRETT79_MUL32,     "cl_barrett32_79",      64,     79,         1,      NULL},
-     {   BARRETT77_MUL32,     "cl_barrett32_77",      64,     77,         1,      NULL},
-     {   BARRETT76_MUL32,     "cl_barrett32_76",      64,     76,         1,      NULL},
-     {   BARRETT92_MUL32,     "cl_barrett32_92",      65,     92,         0,      NULL},
-     {   BARRETT88_MUL32,     "cl_barrett32_88",      65,     88,         0,      NULL},
-     {   BARRETT87_MUL32,     "cl_barrett32_87",      65,     87,         0,      NULL},
-     {   BARRETT73_MUL15,     "cl_barrett15_73",      60,     73,         0,      NULL},
-     {   BARRETT69_MUL15,     "cl_barrett15_69",      60,     69,         0,      NULL},
-     {   BARRETT70_MUL15,     "cl_barrett15_70",      60,     69,         0,      NULL},
-     {   BARRETT71_MUL15,     "cl_barrett15_71",      60,     70,         0,      NULL},
-     {   BARRETT88_MUL15,     "cl_barrett15_88",      60,     87,         0,      NULL},
-     {   BARRETT83_MUL15,     "cl_barrett15_83",      60,     82,         0,      NULL},
-     {   BARRETT82_MUL15,     "cl_barrett15_82",      60,     81,         0,      NULL},
-     {   BARRETT74_MUL15,     "cl_barrett15_74",      60,     74,         0,      NULL},
-     {   MG62,                "cl_mg62",              58,     62,         1,      NULL},
-     {   MG88,                "cl_mg88",              73,     88,         1,      NULL},
-     {   UNKNOWN_KERNEL,      "UNKNOWN kernel",        0,      0,         0,      NULL}, // end of automatic loading
-     {   _64BIT_64_OpenCL,    "mfakto_cl_64",          0,     64,         0,      NULL}, // slow shift-cmp-sub kernel: removed
-     {   BARRETT92_64_OpenCL, "cl_barrett32_92",      64,     92,         0,      NULL}, // mapped to 32-bit barrett so far
-     {   CL_CALC_BIT_TO_CLEAR, "CalcBitToClear",       0,      0,         0,      NULL}, // called by gpusieve_init_class
-     {   CL_CALC_MOD_INV,     "CalcModularInverses",   0,      0,         0,      NULL}, // called by gpusieve_init_exponent
-     {   CL_SIEVE,            "SegSieve",              0,      0,         0,      NULL}, // GPU sieve
-     {   BARRETT79_MUL32_GS,  "cl_barrett32_79_gs",   64,     79,         1,      NULL}, // keep the GPU-sieve-based kernels in the same order as their CPU-sieve versions
-     {   BARRETT77_MUL32_GS,  "cl_barrett32_77_gs",   64,     77,         1,      NULL},
-     {   BARRETT76_MUL32_GS,  "cl_barrett32_76_gs",   64,     76,         1,      NULL},
-     {   BARRETT92_MUL32_GS,  "cl_barrett32_92_gs",   65,     92,         0,      NULL},
-     {   BARRETT88_MUL32_GS,  "cl_barrett32_88_gs",   65,     88,         0,      NULL},
-     {   BARRETT87_MUL32_GS,  "cl_barrett32_87_gs",   65,     87,         0,      NULL},
-     {   BARRETT73_MUL15_GS,  "cl_barrett15_73_gs",   60,     73,         0,      NULL},
-     {   BARRETT69_MUL15_GS,  "cl_barrett15_69_gs",   60,     69,         0,      NULL},
-     {   BARRETT70_MUL15_GS,  "cl_barrett15_70_gs",   60,     69,         0,      NULL},
-     {   BARRETT71_MUL15_GS,  "cl_barrett15_71_gs",   60,     70,         0,      NULL},
-     {   BARRETT88_MUL15_GS,  "cl_barrett15_88_gs",   60,     87,         0,      NULL},
-     {   BARRETT83_MUL15_GS,  "cl_barrett15_83_gs",   60,     82,         0,      NULL},
-     {   BARRETT82_MUL15_GS,  "cl_barrett15_82_gs",   60,     81,         0,      NULL},
-     {   BARRETT74_MUL15_GS,  "cl_barrett15_74_gs",   60,     74,         0,      NULL},
-     {   UNKNOWN_GS_KERNEL,   "UNKNOWN GS kernel",     0,      0,         0,      NULL}, // delimiter
+  /*   kernel (in sequence) | kernel function name | bit_min | bit_max | stages? */
+     {   AUTOSELECT_KERNEL,   "auto",                  0,      0,         0},
+     {   _TEST_MOD_,          "test_k",                0,      0,         0}, // used for various tests
+     {   _71BIT_MUL24,        "mfakto_cl_71",         61,     71,         1},
+     {   _63BIT_MUL24,        "mfakto_cl_63",         58,     64,         1},
+     {   BARRETT79_MUL32,     "cl_barrett32_79",      64,     79,         1},
+     {   BARRETT77_MUL32,     "cl_barrett32_77",      64,     77,         1},
+     {   BARRETT76_MUL32,     "cl_barrett32_76",      64,     76,         1},
+     {   BARRETT92_MUL32,     "cl_barrett32_92",      65,     92,         0},
+     {   BARRETT88_MUL32,     "cl_barrett32_88",      65,     88,         0},
+     {   BARRETT87_MUL32,     "cl_barrett32_87",      65,     87,         0},
+     {   BARRETT73_MUL15,     "cl_barrett15_73",      60,     73,         0},
+     {   BARRETT69_MUL15,     "cl_barrett15_69",      60,     69,         0},
+     {   BARRETT70_MUL15,     "cl_barrett15_70",      60,     69,         0},
+     {   BARRETT71_MUL15,     "cl_barrett15_71",      60,     70,         0},
+     {   BARRETT88_MUL15,     "cl_barrett15_88",      60,     87,         0},
+     {   BARRETT83_MUL15,     "cl_barrett15_83",      60,     82,         0},
+     {   BARRETT82_MUL15,     "cl_barrett15_82",      60,     81,         0},
+     {   BARRETT74_MUL15,     "cl_barrett15_74",      60,     74,         0},
+     {   MG62,                "cl_mg62",              58,     62,         1},
+     {   MG88,                "cl_mg88",              73,     88,         1},
+     {   UNKNOWN_KERNEL,      "UNKNOWN kernel",        0,      0,         0}, // end of automatic loading
+     {   _64BIT_64_OpenCL,    "mfakto_cl_64",          0,     64,         0}, // slow shift-cmp-sub kernel: removed
+     {   BARRETT92_64_OpenCL, "cl_barrett32_92",      64,     92,         0}, // mapped to 32-bit barrett so far
+     {   CPU_TF,              "cpu_tf",                0,     95,         1}, // no OpenCL kernel, runs on the host (-d h)
+     {   CPU_TF_IFMA,         "cpu_tf_ifma",           0,     95,         1}, // no OpenCL kernel, runs on the host (-d h)
+     {   CL_CALC_BIT_TO_CLEAR, "CalcBitToClear",       0,      0,         0}, // called by gpusieve_init_class
+     {   CL_CALC_MOD_INV,     "CalcModularInverses",   0,      0,         0}, // called by gpusieve_init_exponent
+     {   CL_SIEVE,            "SegSieve",              0,      0,         0}, // GPU sieve
+     {   CL_ADVANCE_BIT_TO_CLEAR, "AdvanceBitToClear", 0,      0,         0}, // called by gpusieve_advance_class
+     {   CL_BUCKET_SCATTER,   "BucketScatter",         0,      0,         0}, // GPU sieve of the large primes
+     {   CL_COMPACT_COUNT,    "CompactCount",          0,      0,         0}, // called by gpusieve_compact
+     {   CL_COMPACT_SCAN,     "CompactScan",           0,      0,         0}, // called by gpusieve_compact
+     {   CL_COMPACT_WRITE,    "CompactWrite",          0,      0,         0}, // called by gpusieve_compact
+     {   BARRETT79_MUL32_GS,  "cl_barrett32_79_gs",   64,     79,         1}, // keep the GPU-sieve-based kernels in the same order as their CPU-sieve versions
+     {   BARRETT77_MUL32_GS,  "cl_barrett32_77_gs",   64,     77,         1},
+     {   BARRETT76_MUL32_GS,  "cl_barrett32_76_gs",   64,     76,         1},
+     {   BARRETT92_MUL32_GS,  "cl_barrett32_92_gs",   65,     92,         0},
+     {   BARRETT88_MUL32_GS,  "cl_barrett32_88_gs",   65,     88,         0},
+     {   BARRETT87_MUL32_GS,  "cl_barrett32_87_gs",   65,     87,         0},
+     {   BARRETT73_MUL15_GS,  "cl_barrett15_73_gs",   60,     73,         0},
+     {   BARRETT69_MUL15_GS,  "cl_barrett15_69_gs",   60,     69,         0},
+     {   BARRETT70_MUL15_GS,  "cl_barrett15_70_gs",   60,     69,         0},
+     {   BARRETT71_MUL15_GS,  "cl_barrett15_71_gs",   60,     70,         0},
+     {   BARRETT88_MUL15_GS,  "cl_barrett15_88_gs",   60,     87,         0},
+     {   BARRETT83_MUL15_GS,  "cl_barrett15_83_gs",   60,     82,         0},
+     {   BARRETT82_MUL15_GS,  "cl_barrett15_82_gs",   60,     81,         0},
+     {   BARRETT74_MUL15_GS,  "cl_barrett15_74_gs",   60,     74,         0},
+     {   UNKNOWN_GS_KERNEL,   "UNKNOWN GS kernel",     0,      0,         0}, // delimiter
 };
 
+/* map the buffer behind h_ktab[i]: the staging buffer (pinned) or d_ktab[i] itself (zero-copy) */
+static cl_int map_ktab(cl_uint i)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  cl_int status;
+  size_t size = (size_t)mystuff->threads_per_grid * mystuff->grids_per_launch * sizeof(cl_uint);
+
+  mystuff->h_ktab[i] = (cl_uint *) clEnqueueMapBuffer(XFER_QUEUE,
+                    (mystuff->ktab_transfer == KTAB_PINNED) ? mystuff->p_ktab[i] : mystuff->d_ktab[i],
+                    CL_TRUE,
+                    CL_MAP_READ | CL_MAP_WRITE,
+                    0,
+                    size + 4,
+                    0,
+                    NULL,
+                    NULL,
+                    &status);
+  if(status != CL_SUCCESS) mystuff->h_ktab[i] = NULL;
+  return status;
+}
+
+/* Allocate h_ktab[i] and d_ktab[i] according to mystuff.ktab_transfer.
+   KTAB_ZERO_COPY: d_ktab is allocated in host memory and mapped, the siever
+   writes straight into it. A kernel must not read a mapped buffer, so
+   ktab_to_device() unmaps it before the kernel and ktab_to_host() maps it
+   again when the kernel has finished. KTAB_PINNED: h_ktab is a mapped
+   staging buffer, the driver can DMA from it without copying it to a pinned
+   buffer first. It stays mapped until cleanup_CL(), the kernels never read it. */
+static cl_int alloc_ktab(cl_uint i)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  cl_int status;
+  size_t size = (size_t)mystuff->threads_per_grid * mystuff->grids_per_launch * sizeof(cl_uint);
+
+  mystuff->p_ktab[i] = NULL;
+  if (mystuff->ktab_transfer == KTAB_PAGEABLE)
+  {
+    if( (mystuff->h_ktab[i] = (cl_uint *) malloc(size + 4)) == NULL )
+    {
+      printf("ERROR: malloc(h_ktab[%d]) failed\n", i);
+      return CL_OUT_OF_HOST_MEMORY;
+    }
+    memset(mystuff->h_ktab[i], 0, sizeof(*mystuff->h_ktab[i]));
+    mystuff->d_ktab[i] = clCreateBuffer(dev->context,
+                      CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
+                      size,
+                      mystuff->h_ktab[i],
+                      &status);
+    return status;
+  }
+
+  mystuff->d_ktab[i] = clCreateBuffer(dev->context,
+                    (mystuff->ktab_transfer == KTAB_ZERO_COPY) ? CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR : CL_MEM_READ_ONLY,
+                    size + 4,
+                    NULL,
+                    &status);
+  if(status != CL_SUCCESS) return status;
+
+  if (mystuff->ktab_transfer == KTAB_PINNED)
+  {
+    mystuff->p_ktab[i] = clCreateBuffer(dev->context,
+                      CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR,
+                      size + 4,
+                      NULL,
+                      &status);
+    if(status != CL_SUCCESS) return status;
+  }
+
+  status = map_ktab(i);
+  if(status != CL_SUCCESS) return status;
+
+  memset(mystuff->h_ktab[i], 0, sizeof(*mystuff->h_ktab[i]));
+  return CL_SUCCESS;
+}
+
+/* Hand the first size bytes of the sieved h_ktab[i] over to the device: copy_events[i]
+   completes when a kernel may read d_ktab[i]. Zero-copy: unmap d_ktab[i], h_ktab[i]
+   is NULL until ktab_to_host(). Otherwise: upload it on XFER_QUEUE. */
+cl_int ktab_to_device(cl_uint i, size_t size)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  cl_int status;
+
+  if (mystuff->ktab_transfer == KTAB_ZERO_COPY)
+  {
+    status = clEnqueueUnmapMemObject(XFER_QUEUE, mystuff->d_ktab[i], mystuff->h_ktab[i], 0, NULL, &mystuff->copy_events[i]);
+    if (status == CL_SUCCESS) mystuff->h_ktab[i] = NULL;
+  }
+  else
+  {
+    status = clEnqueueWriteBuffer(XFER_QUEUE,
+                    mystuff->d_ktab[i],
+                    CL_FALSE,
+                    0,
+                    size,
+                    mystuff->h_ktab[i],
+                    0,
+                    NULL,
+                    &mystuff->copy_events[i]);
+  }
+  if (status == CL_SUCCESS) clFlush(XFER_QUEUE);  // the kernel on QUEUE waits for it
+  return status;
+}
+
+/* The kernels reading d_ktab[i] have finished. Zero-copy: map it again for the siever,
+   XFER_QUEUE holds no kernels so this does not wait for the other streams. */
+cl_int ktab_to_host(cl_uint i)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  if (mystuff->ktab_transfer != KTAB_ZERO_COPY || mystuff->h_ktab[i] != NULL) return CL_SUCCESS;
+  return map_ktab(i);
+}
+
+/* unmap/free h_ktab[i], release d_ktab[i] and the staging buffer */
+static cl_int free_ktab(cl_uint i)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  cl_int status = CL_SUCCESS;
+  cl_mem mapped = (mystuff->ktab_transfer == KTAB_PINNED) ? mystuff->p_ktab[i] : mystuff->d_ktab[i];
+
+  if (mystuff->h_ktab[i] != NULL)
+  {
+    if (mystuff->ktab_transfer == KTAB_PAGEABLE)
+      free(mystuff->h_ktab[i]);
+    else if (mapped != NULL)
+    {
+      status = clEnqueueUnmapMemObject(XFER_QUEUE, mapped, mystuff->h_ktab[i], 0, NULL, NULL);
+      if (status == CL_SUCCESS) status = clFinish(XFER_QUEUE);
+    }
+    mystuff->h_ktab[i] = NULL;
+  }
+  if (mystuff->p_ktab[i] != NULL)
+  {
+    clReleaseMemObject(mystuff->p_ktab[i]); mystuff->p_ktab[i]=NULL;
+  }
+  if (mystuff->d_ktab[i] != NULL)
+  {
+    cl_int rel_status = clReleaseMemObject(mystuff->d_ktab[i]); mystuff->d_ktab[i]=NULL;
+    if (status == CL_SUCCESS) status = rel_status;
+  }
+  return status;
+}
+
 /* allocate memory buffer arrays, test a small kernel */
 int init_CLstreams(int gs_reinit_only)
 {
+  mystuff_t *mystuff = dev->mystuff;
   cl_uint i;
   cl_int status;
 
-  if (context==NULL)
+  if (dev->context==NULL)
   {
     fprintf(stderr, "invalid context.\n");
     return 1;
@@ -128,53 +411,80 @@ int init_CLstreams(int gs_reinit_only)
 
   if (!gs_reinit_only)
   {
-    for(i=0;i<(mystuff.num_streams);i++)
+    /* APUs and the CPU device share the memory with the host: the copy to the
+       device is pure overhead. The first stream decides, if that fails fall
+       back to the next slower method. */
+    if (dev->deviceinfo.host_unified_memory || mystuff->gpu_type == GPU_APU || mystuff->gpu_type == GPU_CPU)
+      mystuff->ktab_transfer = KTAB_ZERO_COPY;
+    else
+      mystuff->ktab_transfer = KTAB_PINNED;
+
+    for(i=0;i<(mystuff->num_streams);i++)
     {
-      mystuff.stream_status[i] = UNUSED;
-      if( (mystuff.h_ktab[i] = (cl_uint *) malloc( mystuff.threads_per_grid * sizeof(cl_uint) + 4)) == NULL )
+      mystuff->stream_status[i] = UNUSED;
+      mystuff->h_ktab[i] = NULL;
+      mystuff->d_ktab[i] = NULL;
+      status = alloc_ktab(i);
+      while (status != CL_SUCCESS && i == 0 && mystuff->ktab_transfer != KTAB_PAGEABLE)
       {
-        printf("ERROR: malloc(h_ktab[%d]) failed\n", i);
-        return 1;
+        if (mystuff->verbosity > 1)
+          std::cout << "Info: " << ClErrorString(status) << " while allocating " << ((mystuff->ktab_transfer == KTAB_ZERO_COPY) ? "zero-copy" : "pinned") << " ktab buffers, trying "
+                    << ((mystuff->ktab_transfer == KTAB_ZERO_COPY) ? "pinned" : "pageable") << " buffers\n";
+        free_ktab(i);
+        mystuff->ktab_transfer = (mystuff->ktab_transfer == KTAB_ZERO_COPY) ? KTAB_PINNED : KTAB_PAGEABLE;
+        status = alloc_ktab(i);
       }
-      memset(mystuff.h_ktab[i], 0, sizeof(*mystuff.h_ktab[i]));
-      mystuff.d_ktab[i] = clCreateBuffer(context,
-                        CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
-                        mystuff.threads_per_grid * sizeof(cl_uint),
-                        mystuff.h_ktab[i],
-                        &status);
       if(status != CL_SUCCESS)
       {
         std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (h_ktab[" << i << "]) \n";
         return 1;
       }
     }
-    if( (mystuff.h_RES = (cl_uint *) malloc(32 * sizeof(cl_uint) + 48)) == NULL )  // only 32 uints required, but OpenCL libs read&write after that (valgrind error)
+    if (mystuff->verbosity > 1)
+      printf("Using %s ktab buffers\n", (mystuff->ktab_transfer == KTAB_ZERO_COPY) ? "zero-copy" : (mystuff->ktab_transfer == KTAB_PINNED) ? "pinned" : "pageable");
+    /* RES_SIZE_BATCH: one result buffer per exponent of a batch, see res_size() */
+    if( (mystuff->h_RES = (cl_uint *) malloc(RES_SIZE_BATCH * sizeof(cl_uint) + 48)) == NULL )  // only RES_SIZE_BATCH uints required, but OpenCL libs read&write after that (valgrind error)
     {
       printf("ERROR: malloc(h_RES) failed\n");
       return 1;
     }
-    memset(mystuff.h_RES, 0, sizeof(*mystuff.h_RES));
-    mystuff.d_RES = clCreateBuffer(context,
+    memset(mystuff->h_RES, 0, RES_SIZE_BATCH * sizeof(cl_uint));
+    mystuff->d_RES = clCreateBuffer(dev->context,
                       CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
-                      32 * sizeof(cl_uint),
-                      mystuff.h_RES,
+                      RES_SIZE_BATCH * sizeof(cl_uint),
+                      mystuff->h_RES,
                       &status);
     if(status != CL_SUCCESS)
     {
       std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_RES)\n";
       return 1;
     }
+    /* one result buffer per class in flight, see tf_class_opencl_start() */
+    dev->host->tf_pipe.d_RES[0] = mystuff->d_RES;
+    for (i=1; i<TF_PIPELINE_DEPTH; i++)
+    {
+      dev->host->tf_pipe.d_RES[i] = clCreateBuffer(dev->context,
+                        CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
+                        RES_SIZE_BATCH * sizeof(cl_uint),
+                        mystuff->h_RES,
+                        &status);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer (d_RES[" << i << "])\n";
+        return 1;
+      }
+    }
   #ifdef CHECKS_MODBASECASE
-    if( (mystuff.h_modbasecase_debug = (cl_uint *) malloc(32 * sizeof(cl_uint) + 4)) == NULL )
+    if( (mystuff->h_modbasecase_debug = (cl_uint *) malloc(32 * sizeof(cl_uint) + 4)) == NULL )
     {
       printf("ERROR: malloc(h_modbasecase_debug) failed\n");
       return 1;
     }
-    memset(mystuff.h_modbasecase_debug, 0, sizeof(mystuff.h_modbasecase_debug));
-    mystuff.d_modbasecase_debug = clCreateBuffer(context,
+    memset(mystuff->h_modbasecase_debug, 0, sizeof(mystuff->h_modbasecase_debug));
+    mystuff->d_modbasecase_debug = clCreateBuffer(dev->context,
                       CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
                       32 * sizeof(cl_uint),
-                      mystuff.h_modbasecase_debug,
+                      mystuff->h_modbasecase_debug,
                       &status);
     if(status != CL_SUCCESS)
     {
@@ -184,19 +494,31 @@ int init_CLstreams(int gs_reinit_only)
   #endif
   }
 
-  if (mystuff.gpu_sieving == 1)
+  if (mystuff->gpu_sieving == 1)
   {
+    cl_command_queue_properties queue_props = 0;
+
+    // The GPU sieve enqueues its uploads and kernels (CalcBitToClear, BucketScatter, SegSieve, the compaction
+    // and the TF kernels) without events: each one has to see the results of the previous ones, so QUEUE
+    // must execute in order. init_CL() asks for out-of-order execution only for the CPU sieve.
+    status = clGetCommandQueueInfo(QUEUE, CL_QUEUE_PROPERTIES, sizeof(queue_props), &queue_props, NULL);
+    if (status != CL_SUCCESS || (queue_props & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE))
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): the GPU sieve needs an in-order command queue\n";
+      return 1;
+    }
+
     // alloc GPU buffers, calculate the prime info and copy to device
-    gpusieve_init(&mystuff, context);
+    gpusieve_init(mystuff, dev->context);
 
     // now already set the fix parameters for the GPU sieve kernels
     // CL_CALC_MOD_INV
     // CalcModularInverses<<<primes_per_thread+1, threadsPerBlock>>>(mystuff->exponent, (int *)mystuff->d_calc_bit_to_clear_info);
 
-    status = clSetKernelArg(kernel_info[CL_CALC_MOD_INV].kernel,
+    status = clSetKernelArg(dev->kernel[CL_CALC_MOD_INV],
                       1,
                       sizeof(cl_mem),
-                      (void *)&mystuff.d_calc_bit_to_clear_info);
+                      (void *)&mystuff->d_calc_bit_to_clear_info);
     if(status != CL_SUCCESS)
     {
       std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_calc_bit_to_clear_info)\n";
@@ -206,19 +528,57 @@ int init_CLstreams(int gs_reinit_only)
     // CL_CALC_BIT_TO_CLEAR
     // CalcBitToClear<<<primes_per_thread+1, threadsPerBlock>>>(mystuff->exponent, k_base, (int *)mystuff->d_calc_bit_to_clear_info, (cl_uchar *)mystuff->d_sieve_info);
 
-    status = clSetKernelArg(kernel_info[CL_CALC_BIT_TO_CLEAR].kernel,
+    status = clSetKernelArg(dev->kernel[CL_CALC_BIT_TO_CLEAR],
                       2,
                       sizeof(cl_mem),
-                      (void *)&mystuff.d_calc_bit_to_clear_info);
+                      (void *)&mystuff->d_calc_bit_to_clear_info);
     if(status != CL_SUCCESS)
     {
       std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_calc_bit_to_clear_info)\n";
       return 1;
     }
-    status = clSetKernelArg(kernel_info[CL_CALC_BIT_TO_CLEAR].kernel,
+    status = clSetKernelArg(dev->kernel[CL_CALC_BIT_TO_CLEAR],
                       3,
                       sizeof(cl_mem),
-                      (void *)&mystuff.d_sieve_info);
+                      (void *)&mystuff->d_sieve_info);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_sieve_info)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_CALC_BIT_TO_CLEAR],
+                      4,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_class_delta);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_class_delta)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_CALC_BIT_TO_CLEAR],
+                      5,
+                      sizeof(cl_uint),
+                      (void *)&mystuff->gpu_sieve_info_stride);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_info_stride)\n";
+      return 1;
+    }
+
+    // CL_ADVANCE_BIT_TO_CLEAR: same buffers as CalcBitToClear
+    status = clSetKernelArg(dev->kernel[CL_ADVANCE_BIT_TO_CLEAR],
+                      1,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_calc_bit_to_clear_info);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_calc_bit_to_clear_info)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_ADVANCE_BIT_TO_CLEAR],
+                      2,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_sieve_info);
     if(status != CL_SUCCESS)
     {
       std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_sieve_info)\n";
@@ -227,25 +587,212 @@ int init_CLstreams(int gs_reinit_only)
 
     // CL_SIEVE
     // SegSieve<<<(sieve_size + block_size - 1) / block_size, threadsPerBlock>>>((cl_uchar *)mystuff->d_bitarray, (cl_uchar *)mystuff->d_sieve_info, primes_per_thread);
-    status = clSetKernelArg(kernel_info[CL_SIEVE].kernel,
+    status = clSetKernelArg(dev->kernel[CL_SIEVE],
                       0,
                       sizeof(cl_mem),
-                      (void *)&mystuff.d_bitarray);
+                      (void *)&mystuff->d_bitarray);
     if(status != CL_SUCCESS)
     {
       std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bitarray)\n";
       return 1;
     }
-    status = clSetKernelArg(kernel_info[CL_SIEVE].kernel,
+    status = clSetKernelArg(dev->kernel[CL_SIEVE],
+                      1,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_sieve_info);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_sieve_info)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_SIEVE],
+                      4,
+                      sizeof(cl_uint),
+                      (void *)&mystuff->gpu_sieve_info_stride);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_info_stride)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_SIEVE],
+                      5,
+                      sizeof(cl_uint),
+                      (void *)&mystuff->gpu_sieve_bucket_size);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_bucket_size)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_SIEVE],
+                      6,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_bucket_count);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bucket_count)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_SIEVE],
+                      7,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_bucket_hits);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bucket_hits)\n";
+      return 1;
+    }
+    // params 2 (primes_per_thread) and 3 (blocks_per_class) are variable, can't set them now.
+
+    // CL_BUCKET_SCATTER: params 3 (first_row) and 4 (blocks_per_class) are set by run_bucket_scatter
+    status = clSetKernelArg(dev->kernel[CL_BUCKET_SCATTER],
+                      0,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_calc_bit_to_clear_info);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_calc_bit_to_clear_info)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_BUCKET_SCATTER],
                       1,
                       sizeof(cl_mem),
-                      (void *)&mystuff.d_sieve_info);
+                      (void *)&mystuff->d_sieve_info);
     if(status != CL_SUCCESS)
     {
       std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_sieve_info)\n";
       return 1;
     }
-    // param 2 (primes_per_thread) is variable, can't set it now.
+    status = clSetKernelArg(dev->kernel[CL_BUCKET_SCATTER],
+                      2,
+                      sizeof(cl_uint),
+                      (void *)&mystuff->gpu_sieve_info_stride);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_info_stride)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_BUCKET_SCATTER],
+                      5,
+                      sizeof(cl_uint),
+                      (void *)&mystuff->gpu_sieve_bucket_size);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_bucket_size)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_BUCKET_SCATTER],
+                      6,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_bucket_count);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bucket_count)\n";
+      return 1;
+    }
+    status = clSetKernelArg(dev->kernel[CL_BUCKET_SCATTER],
+                      7,
+                      sizeof(cl_mem),
+                      (void *)&mystuff->d_bucket_hits);
+    if(status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bucket_hits)\n";
+      return 1;
+    }
+
+    if (mystuff->gpu_sieve_compact)
+    {
+      // CL_COMPACT_COUNT, CL_COMPACT_SCAN, CL_COMPACT_WRITE: the sizes are set by run_compact_candidates
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_COUNT],
+                        0,
+                        sizeof(cl_mem),
+                        (void *)&mystuff->d_bitarray);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bitarray)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_COUNT],
+                        2,
+                        sizeof(cl_mem),
+                        (void *)&mystuff->d_compact_count);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_compact_count)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_SCAN],
+                        0,
+                        sizeof(cl_mem),
+                        (void *)&mystuff->d_compact_count);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_compact_count)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_SCAN],
+                        4,
+                        sizeof(cl_uint),
+                        (void *)&mystuff->gpu_sieve_compact_size);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_compact_size)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_SCAN],
+                        5,
+                        sizeof(cl_mem),
+                        (void *)&mystuff->d_compact_list);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_compact_list)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_SCAN],
+                        6,
+                        sizeof(cl_mem),
+                        (void *)&mystuff->d_compact_info);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_compact_info)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_WRITE],
+                        0,
+                        sizeof(cl_mem),
+                        (void *)&mystuff->d_bitarray);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bitarray)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_WRITE],
+                        2,
+                        sizeof(cl_mem),
+                        (void *)&mystuff->d_compact_count);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_compact_count)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_WRITE],
+                        3,
+                        sizeof(cl_uint),
+                        (void *)&mystuff->gpu_sieve_compact_size);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_compact_size)\n";
+        return 1;
+      }
+      status = clSetKernelArg(dev->kernel[CL_COMPACT_WRITE],
+                        4,
+                        sizeof(cl_mem),
+                        (void *)&mystuff->d_compact_list);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_compact_list)\n";
+        return 1;
+      }
+    }
   }
 
   return 0;
@@ -258,6 +805,7 @@ int init_CLstreams(int gs_reinit_only)
  */
 int init_CL(int num_streams, cl_int *devnumber)
 {
+  mystuff_t *mystuff = dev->mystuff;
   cl_int status;
   size_t dev_s;
   cl_uint numplatforms, i;
@@ -265,7 +813,15 @@ int init_CL(int num_streams, cl_int *devnumber)
   cl_platform_id* platformlist = NULL;
   cl_device_type devtype = CL_DEVICE_TYPE_GPU|CL_DEVICE_TYPE_ACCELERATOR;
 
-  if (mystuff.verbosity > 0) {printf("Select device - "); fflush(NULL);}
+  dev->host = new device_host;
+  for (i = 0; i < NUM_STREAMS_MAX; i++)
+  {
+    dev->host->stream_ref[i].host   = dev->host;
+    dev->host->stream_ref[i].stream = i;
+  }
+  dev->new_class = 1;
+
+  if (mystuff->verbosity > 0) {printf("Select device - "); fflush(NULL);}
   status = clGetPlatformIDs(0, NULL, &numplatforms);
   if(status != CL_SUCCESS)
   {
@@ -277,11 +833,11 @@ int init_CL(int num_streams, cl_int *devnumber)
   {
       devtype = CL_DEVICE_TYPE_CPU;
       *devnumber = 0;
-      if (mystuff.verbosity > 0) {
+      if (mystuff->verbosity > 0) {
           printf("(CPU) - ");
           fflush(NULL);
       }
-      only_use_cpu = 1;
+      dev->only_use_cpu = 1;
   }
 
   if (numplatforms > 0)
@@ -377,12 +933,12 @@ int init_CL(int num_streams, cl_int *devnumber)
   }
 
   cl_context_properties cps[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
-  context = clCreateContextFromType(cps, devtype, NULL, NULL, &status);
+  dev->context = clCreateContextFromType(cps, devtype, NULL, NULL, &status);
   if (status == CL_DEVICE_NOT_FOUND)
   {
-    clReleaseContext(context);
+    clReleaseContext(dev->context);
     std::cout << "Could not find a supported GPU, falling back to CPU." << std::endl;
-    context = clCreateContextFromType(cps, CL_DEVICE_TYPE_CPU, NULL, NULL, &status);
+    dev->context = clCreateContextFromType(cps, CL_DEVICE_TYPE_CPU, NULL, NULL, &status);
     if(status != CL_SUCCESS)
     {
        std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clCreateContextFromType(CPU)\n";
@@ -396,14 +952,14 @@ int init_CL(int num_streams, cl_int *devnumber)
   }
 
   cl_uint num_devices;
-  status = clGetContextInfo(context, CL_CONTEXT_NUM_DEVICES, sizeof(num_devices), &num_devices, NULL);
+  status = clGetContextInfo(dev->context, CL_CONTEXT_NUM_DEVICES, sizeof(num_devices), &num_devices, NULL);
   if(status != CL_SUCCESS)
   {
     std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_CONTEXT_NUM_DEVICES) - assuming one device\n";
     num_devices = 1;
   }
 
-  status = clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &dev_s);
+  status = clGetContextInfo(dev->context, CL_CONTEXT_DEVICES, 0, NULL, &dev_s);
   if(status != CL_SUCCESS)
   {
     std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(numdevs)\n";
@@ -416,14 +972,14 @@ int init_CL(int num_streams, cl_int *devnumber)
     return 1;
   }
 
-  devices = (cl_device_id *)malloc(dev_s*sizeof(cl_device_id));  // *sizeof(...) should not be needed (dev_s is in bytes)
-  if(devices == 0)
+  dev->devices = (cl_device_id *)malloc(dev_s*sizeof(cl_device_id));  // *sizeof(...) should not be needed (dev_s is in bytes)
+  if(dev->devices == 0)
   {
     std::cerr << "Error: Out of memory.\n";
     return 1;
   }
 
-  status = clGetContextInfo(context, CL_CONTEXT_DEVICES, dev_s*sizeof(cl_device_id), devices, NULL);
+  status = clGetContextInfo(dev->context, CL_CONTEXT_DEVICES, dev_s*sizeof(cl_device_id), dev->devices, NULL);
   if(status != CL_SUCCESS)
   {
     std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(devices)\n";
@@ -446,93 +1002,99 @@ int init_CL(int num_streams, cl_int *devnumber)
     }
   }
 
-  if (mystuff.verbosity > 0) {printf("Get device info:\n");}
+  if (mystuff->verbosity > 0) {printf("Get device info:\n");}
 
   for (i=dev_from; i<dev_to; i++)
   {
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_NAME, sizeof(deviceinfo.d_name), deviceinfo.d_name, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_NAME, sizeof(dev->deviceinfo.d_name), dev->deviceinfo.d_name, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_NAME)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_VERSION, sizeof(deviceinfo.d_ver), deviceinfo.d_ver, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_VERSION, sizeof(dev->deviceinfo.d_ver), dev->deviceinfo.d_ver, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_VERSION)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_VENDOR, sizeof(deviceinfo.v_name), deviceinfo.v_name, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_VENDOR, sizeof(dev->deviceinfo.v_name), dev->deviceinfo.v_name, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_VENDOR)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DRIVER_VERSION, sizeof(deviceinfo.dr_version), deviceinfo.dr_version, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DRIVER_VERSION, sizeof(dev->deviceinfo.dr_version), dev->deviceinfo.dr_version, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DRIVER_VERSION)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_EXTENSIONS, sizeof(deviceinfo.exts), deviceinfo.exts, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_EXTENSIONS, sizeof(dev->deviceinfo.exts), dev->deviceinfo.exts, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_EXTENSIONS)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, sizeof(deviceinfo.gl_cache), &deviceinfo.gl_cache, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, sizeof(dev->deviceinfo.gl_cache), &dev->deviceinfo.gl_cache, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_GLOBAL_MEM_CACHE_SIZE)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(deviceinfo.gl_mem), &deviceinfo.gl_mem, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(dev->deviceinfo.gl_mem), &dev->deviceinfo.gl_mem, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_GLOBAL_MEM_SIZE)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(deviceinfo.max_clock), &deviceinfo.max_clock, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(dev->deviceinfo.max_clock), &dev->deviceinfo.max_clock, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_CLOCK_FREQUENCY)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(deviceinfo.units), &deviceinfo.units, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(dev->deviceinfo.units), &dev->deviceinfo.units, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_COMPUTE_UNITS)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(deviceinfo.wg_size), &deviceinfo.wg_size, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(dev->deviceinfo.wg_size), &dev->deviceinfo.wg_size, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_WORK_GROUP_SIZE)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(deviceinfo.w_dim), &deviceinfo.w_dim, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(dev->deviceinfo.w_dim), &dev->deviceinfo.w_dim, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(deviceinfo.wi_sizes), deviceinfo.wi_sizes, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(dev->deviceinfo.wi_sizes), dev->deviceinfo.wi_sizes, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_WORK_ITEM_SIZES)\n";
       return 1;
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(deviceinfo.l_mem), &deviceinfo.l_mem, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(dev->deviceinfo.l_mem), &dev->deviceinfo.l_mem, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_LOCAL_MEM_SIZE)\n";
       return 1;
     }
+    // deprecated since OpenCL 2.0, but still the only portable way to detect APUs and CPU devices: not fatal
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_HOST_UNIFIED_MEMORY, sizeof(dev->deviceinfo.host_unified_memory), &dev->deviceinfo.host_unified_memory, NULL);
+    if(status != CL_SUCCESS)
+    {
+      dev->deviceinfo.host_unified_memory = CL_FALSE;
+    }
 
 #if defined CL_VERSION_2_0
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_QUEUE_ON_DEVICE_PROPERTIES, sizeof(deviceinfo.queue_properties), &deviceinfo.queue_properties, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_QUEUE_ON_DEVICE_PROPERTIES, sizeof(dev->deviceinfo.queue_properties), &dev->deviceinfo.queue_properties, NULL);
 #else
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_QUEUE_PROPERTIES, sizeof(deviceinfo.queue_properties), &deviceinfo.queue_properties, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_QUEUE_PROPERTIES, sizeof(dev->deviceinfo.queue_properties), &dev->deviceinfo.queue_properties, NULL);
 #endif
     if (status != CL_SUCCESS)
     {
@@ -544,16 +1106,17 @@ int init_CL(int num_streams, cl_int *devnumber)
         return 1;
     }
 
-    if (mystuff.verbosity > 1)
-      std::cout << "Device " << (i+1)  << "/" << num_devices << ": " << deviceinfo.d_name << " (" << deviceinfo.v_name << "),\ndevice version: "
-        << deviceinfo.d_ver << ", driver version: " << deviceinfo.dr_version << "\nExtensions: " << deviceinfo.exts
-        << "\nGlobal memory:" << deviceinfo.gl_mem << ", Global memory cache: " << deviceinfo.gl_cache
-        << ", local memory: " << deviceinfo.l_mem << ", workgroup size: " << deviceinfo.wg_size << ", Work dimensions: " << deviceinfo.w_dim
-        << "[" << deviceinfo.wi_sizes[0] << ", " << deviceinfo.wi_sizes[1] << ", " << deviceinfo.wi_sizes[2] << ", " << deviceinfo.wi_sizes[3] << ", " << deviceinfo.wi_sizes[4]
-        << "] , Max clock speed:" << deviceinfo.max_clock << ", compute units:" << deviceinfo.units << std::endl;
+    if (mystuff->verbosity > 1)
+      std::cout << "Device " << (i+1)  << "/" << num_devices << ": " << dev->deviceinfo.d_name << " (" << dev->deviceinfo.v_name << "),\ndevice version: "
+        << dev->deviceinfo.d_ver << ", driver version: " << dev->deviceinfo.dr_version << "\nExtensions: " << dev->deviceinfo.exts
+        << "\nGlobal memory:" << dev->deviceinfo.gl_mem << ", Global memory cache: " << dev->deviceinfo.gl_cache
+        << ", local memory: " << dev->deviceinfo.l_mem << ", workgroup size: " << dev->deviceinfo.wg_size << ", Work dimensions: " << dev->deviceinfo.w_dim
+        << "[" << dev->deviceinfo.wi_sizes[0] << ", " << dev->deviceinfo.wi_sizes[1] << ", " << dev->deviceinfo.wi_sizes[2] << ", " << dev->deviceinfo.wi_sizes[3] << ", " << dev->deviceinfo.wi_sizes[4]
+        << "] , Max clock speed:" << dev->deviceinfo.max_clock << ", compute units:" << dev->deviceinfo.units
+        << ", host unified memory: " << (dev->deviceinfo.host_unified_memory ? "yes" : "no") << std::endl;
   }
 
-  if (strstr(deviceinfo.exts, "global_int32_base_atomics") == NULL)
+  if (strstr(dev->deviceinfo.exts, "global_int32_base_atomics") == NULL)
   {
     printf("\nWarning: Device does not support atomic operations. mfakto may report only\n"
            "      one factor or an invalid one when multiple factors are found in the same\n"
@@ -574,12 +1137,12 @@ int init_CL(int num_streams, cl_int *devnumber)
     kernel_info[BARRETT88_MUL15_GS].bit_max = 0;
   }
   */
-  deviceinfo.maxThreadsPerBlock = deviceinfo.wi_sizes[0];
-  deviceinfo.maxThreadsPerGrid  = deviceinfo.wi_sizes[0];
-  for (i=1; i<deviceinfo.w_dim && i<5; i++)
+  dev->deviceinfo.maxThreadsPerBlock = dev->deviceinfo.wi_sizes[0];
+  dev->deviceinfo.maxThreadsPerGrid  = dev->deviceinfo.wi_sizes[0];
+  for (i=1; i<dev->deviceinfo.w_dim && i<5; i++)
   {
-    if (deviceinfo.wi_sizes[i])
-      deviceinfo.maxThreadsPerGrid *= deviceinfo.wi_sizes[i];
+    if (dev->deviceinfo.wi_sizes[i])
+      dev->deviceinfo.maxThreadsPerGrid *= dev->deviceinfo.wi_sizes[i];
   }
 
 #if defined CL_VERSION_2_0
@@ -587,13 +1150,13 @@ int init_CL(int num_streams, cl_int *devnumber)
 #else
     cl_command_queue_properties props = 0;
 #endif
-    // GPU sieving is started without synchronization events, but CPU sieving
-    // can execute out of order if appropriate kernels and copy events are
-    // queued with event dependencies. However, the GPU driver does not support
-    // this as of Catalyst 12.9
-    if (mystuff.gpu_sieving == 0) {
+    // GPU sieving is started without synchronization events and needs an in-order
+    // queue (checked in init_CLstreams), but CPU sieving can execute out of order
+    // if appropriate kernels and copy events are queued with event dependencies.
+    // However, the GPU driver does not support this as of Catalyst 12.9
+    if (mystuff->gpu_sieving == 0) {
         // determine whether device supports out-of-order operations
-        if (deviceinfo.queue_properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) {
+        if (dev->deviceinfo.queue_properties & CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE) {
 #if defined CL_VERSION_2_0
             props[1] = CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;
 #else
@@ -604,9 +1167,9 @@ int init_CL(int num_streams, cl_int *devnumber)
         }
     }
 #if defined CL_VERSION_2_0
-    commandQueue = clCreateCommandQueueWithProperties(context, devices[*devnumber], props, &status);
+    dev->commandQueue = clCreateCommandQueueWithProperties(dev->context, dev->devices[*devnumber], props, &status);
 #else
-    commandQueue = clCreateCommandQueue(context, devices[*devnumber], props, &status);
+    dev->commandQueue = clCreateCommandQueue(dev->context, dev->devices[*devnumber], props, &status);
 #endif
     if (status != CL_SUCCESS) {
 #if defined CL_VERSION_2_0
@@ -619,10 +1182,10 @@ int init_CL(int num_streams, cl_int *devnumber)
 
 #if defined CL_VERSION_2_0
     props[1] |= CL_QUEUE_PROFILING_ENABLE;
-    commandQueuePrf = clCreateCommandQueueWithProperties(context, devices[*devnumber], props, &status);
+    dev->commandQueuePrf = clCreateCommandQueueWithProperties(dev->context, dev->devices[*devnumber], props, &status);
 #else
     props |= CL_QUEUE_PROFILING_ENABLE;
-    commandQueuePrf = clCreateCommandQueue(context, devices[*devnumber], props, &status);
+    dev->commandQueuePrf = clCreateCommandQueue(dev->context, dev->devices[*devnumber], props, &status);
 #endif
     if (status != CL_SUCCESS) {
 #if defined CL_VERSION_2_0
@@ -632,6 +1195,33 @@ int init_CL(int num_streams, cl_int *devnumber)
 #endif
         return 1;
     }
+
+    // CPU sieving: the d_ktab uploads get their own in-order queue, so that the upload for
+    // the next stream runs while the TF kernel of the previous one is still busy. The
+    // kernels wait for the copy_events of their streams.
+    if (mystuff->gpu_sieving == 0) {
+#if defined CL_VERSION_2_0
+        props[1] = 0;
+#else
+        props = 0;
+#endif
+#ifdef CL_PERFORMANCE_INFO
+#if defined CL_VERSION_2_0
+        props[1] = CL_QUEUE_PROFILING_ENABLE;
+#else
+        props = CL_QUEUE_PROFILING_ENABLE;
+#endif
+#endif
+#if defined CL_VERSION_2_0
+        dev->commandQueueXfer = clCreateCommandQueueWithProperties(dev->context, dev->devices[*devnumber], props, &status);
+#else
+        dev->commandQueueXfer = clCreateCommandQueue(dev->context, dev->devices[*devnumber], props, &status);
+#endif
+        if (status != CL_SUCCESS) {
+            printf("\nINFO: Could not create a transfer queue (%s). The uploads share the queue of the kernels.\n", ClErrorString(status));
+            dev->commandQueueXfer = NULL;
+        }
+    }
     return CL_SUCCESS;
 }
 
@@ -651,11 +1241,12 @@ int init_CL(int num_streams, cl_int *devnumber)
  */
 void set_gpu_type()
 {
-#define PAT(b) patmatch(deviceinfo.d_name,"*" b "*",0)
-#define STM(b) strstr(deviceinfo.d_name,b)
+  mystuff_t *mystuff = dev->mystuff;
+#define PAT(b) patmatch(dev->deviceinfo.d_name,"*" b "*",0)
+#define STM(b) strstr(dev->deviceinfo.d_name,b)
 
   // attempt to automatically detect the type of GPU
-  if (mystuff.gpu_type == GPU_AUTO)
+  if (mystuff->gpu_type == GPU_AUTO)
   {
     // clGetDeviceInfo() basically returns two styles of device names:
     //
@@ -685,7 +1276,7 @@ void set_gpu_type()
         PAT("HD [78][0-7][0-9][0-9]")
         )
     {
-      mystuff.gpu_type = GPU_GCN;
+      mystuff->gpu_type = GPU_GCN;
     }
     else if (STM("Malta")             ||    // 7990
              STM("Tahiti")            ||    // 7870XT, 7950, 7970, 8970, 8950, R9 280X
@@ -694,7 +1285,7 @@ void set_gpu_type()
              PAT("gfx60[0-9]")              // GCN-GFX6 Southern Islands
              )
     {
-      mystuff.gpu_type = GPU_GCN2;   // these cards have faster DP performance, allowing to use it for the division algorithms
+      mystuff->gpu_type = GPU_GCN2;   // these cards have faster DP performance, allowing to use it for the division algorithms
     }
     else if (STM("Hawaii")        || // R9 290, R9 290X
                 // Hawaii is both desktop graphics (1:8) and workstation graphics (1:2) in W8100, W9100, S9150
@@ -707,7 +1298,7 @@ void set_gpu_type()
              PAT("W[89]1[01][05]0")
             )
     {
-      mystuff.gpu_type = GPU_GCN3;   // these cards have improved int32 performance over the previous GCNs, making for a changed kernel selection
+      mystuff->gpu_type = GPU_GCN3;   // these cards have improved int32 performance over the previous GCNs, making for a changed kernel selection
     }
     else if (STM("Ellesmere")      ||    // RX 470/480/570/580/590
              STM("gfx804")         ||    // RX 550
@@ -723,7 +1314,7 @@ void set_gpu_type()
         //   PAT("A1[02]-")        ||    // APU (guess)
             )
     {
-      mystuff.gpu_type = GPU_GCN4;
+      mystuff->gpu_type = GPU_GCN4;
     }
      else if (STM("gfx901")   ||     // Vega 64(?)
               STM("gfx900")   ||     // Vega 56
@@ -731,7 +1322,7 @@ void set_gpu_type()
               STM("gfx903")          //  Vega Ryzen 2xxx-3xxx iGPU
              )
     {
-      mystuff.gpu_type = GPU_GCN5;
+      mystuff->gpu_type = GPU_GCN5;
     }
      else if (STM("gfx906")         || // Radeon VII and Pro and MI50/60 (1:4, 1:1)
               STM("Radeon Pro VII") || // Radeon VII
@@ -746,7 +1337,7 @@ void set_gpu_type()
               PAT("MI[0-9][0-9][0-9]") // Any MI with three digits
              )
     {
-      mystuff.gpu_type = GPU_GCNF;
+      mystuff->gpu_type = GPU_GCNF;
     }
      else if (STM("gfx101")  || // RDNA1
 
@@ -754,11 +1345,11 @@ void set_gpu_type()
               // Also known as 6[0-9]0M, but might be too vague to match
              )
     {
-      mystuff.gpu_type = GPU_RDNA;
+      mystuff->gpu_type = GPU_RDNA;
     }
      else if (STM("gfx103")) // RDNA2
     {
-      mystuff.gpu_type = GPU_RDNA2;
+      mystuff->gpu_type = GPU_RDNA2;
     }
      else if (STM("gfx110")  ||      // Catch-all RDNA3
               STM("gfx115")  ||      // Catch-all RDNA3.5
@@ -768,11 +1359,11 @@ void set_gpu_type()
               // Also [78][0-9]0M, but might be too vague to match
         )
     {
-        mystuff.gpu_type = GPU_RDNA3;
+        mystuff->gpu_type = GPU_RDNA3;
     }
      else if (STM("gfx120"))        // Catch-all RDNA4
     {
-        mystuff.gpu_type = GPU_RDNA4;
+        mystuff->gpu_type = GPU_RDNA4;
     }
 
     else if (STM("Cayman")      ||  // 6950, 6970
@@ -780,7 +1371,7 @@ void set_gpu_type()
              STM("Scrapper")    ||  // 7xx0G (iGPUs of A4/6/8/10)
              STM("Antilles"))       // 6990
     {
-      mystuff.gpu_type = GPU_VLIW4;
+      mystuff->gpu_type = GPU_VLIW4;
     }
     else if (STM("WinterPark")  ||  // 6370D (E2-3200), 6410D (A4-3300, A4-3400)
              STM("BeaverCreek") ||  // 6530D (A6-3500, A6-3600, A6-3650, A6-3670K), 6550D (A8-3800, A8-3850, A8-3870K)
@@ -788,7 +1379,7 @@ void set_gpu_type()
              STM("Ontario")     ||  // 6290 (C-60)
              STM("Wrestler"))       // 6250 (C-30, C-50), 6310 (E-240, E-300, E-350)
     {
-      mystuff.gpu_type = GPU_APU;
+      mystuff->gpu_type = GPU_APU;
     }
     else if (STM("Caicos")   ||  // (6450, 8450, R5 230) 7450, 7470,
              STM("Cedar")    ||  // 7350, 5450
@@ -799,37 +1390,37 @@ void set_gpu_type()
              STM("Hemlock")  ||  // 5970
              STM("Barts"))       // 6790, 6850, 6870
     {
-      mystuff.gpu_type = GPU_VLIW5;
+      mystuff->gpu_type = GPU_VLIW5;
     }
     else if (STM("RV7")      ||  // 4xxx (ATI RV 7xx)
              STM("Loveland"))    // e.g. 6310 as part of E350: it reports 2 compute units, but only has a total of 80 compute elements
     {
-      mystuff.gpu_type = GPU_VLIW5;
-      gpu_types[mystuff.gpu_type].CE_per_multiprocessor = 40; // though VLIW5, only 40 instead of 80 compute elements
-      if (mystuff.vectorsize > 3)
+      mystuff->gpu_type = GPU_VLIW5;
+      gpu_types[mystuff->gpu_type].CE_per_multiprocessor = 40; // though VLIW5, only 40 instead of 80 compute elements
+      if (mystuff->vectorsize > 3)
       {
         printf("Warning: Using a vector size of 2 may result in better performance on your\n"
                "     device. Please try changing VectorSize to 2 in %s and restarting\n"
-               "     mfakto.\n\n", mystuff.inifile);
+               "     mfakto.\n\n", mystuff->inifile);
       }
     }
     else if (
         STM("CPU")            ||
         STM("cpu")            ||
-        strstr(deviceinfo.v_name, "GenuineIntel")   ||
-        strstr(deviceinfo.v_name, "AuthenticAMD"))
+        strstr(dev->deviceinfo.v_name, "GenuineIntel")   ||
+        strstr(dev->deviceinfo.v_name, "AuthenticAMD"))
     {
-      mystuff.gpu_type = GPU_CPU;
+      mystuff->gpu_type = GPU_CPU;
     }
-    else if (strstr(deviceinfo.v_name, "NVIDIA"))
+    else if (strstr(dev->deviceinfo.v_name, "NVIDIA"))
     {
-      mystuff.gpu_type = GPU_NVIDIA;  // working only with VectorSize=1 and GPU sieving
+      mystuff->gpu_type = GPU_NVIDIA;  // working only with VectorSize=1 and GPU sieving
                                       // NVIDIA uses a non-SIMD architecture. other special trait is fast int32 mul
     }
     else if (STM("Intel(R)") &&
              STM("Graphics"))
     {
-      mystuff.gpu_type = GPU_INTEL;  // IntelHD
+      mystuff->gpu_type = GPU_INTEL;  // IntelHD
                                      // Could be a good idea to split on the fancier Arc/Xe GPUs
     }
     else
@@ -840,124 +1431,234 @@ void set_gpu_type()
           "      mfakto thread: https://www.mersenneforum.org/node/11037\n"
           "      GitHub:        https://github.com/primesearch/mfakto/issues\n\n"
           "      You can also set GPUType in %s to avoid this message.\n",
-          deviceinfo.d_name, deviceinfo.v_name, mystuff.inifile);
-      mystuff.gpu_type = GPU_GCN;
+          dev->deviceinfo.d_name, dev->deviceinfo.v_name, mystuff->inifile);
+      mystuff->gpu_type = GPU_GCN;
     }
   }
 #undef PAT
 #undef STM
 
-  if (((mystuff.gpu_type >= GPU_GCN) && (mystuff.gpu_type <= GPU_GCN3)) && (mystuff.vectorsize > 3))
+  if (((mystuff->gpu_type >= GPU_GCN) && (mystuff->gpu_type <= GPU_GCN3)) && (mystuff->vectorsize > 3))
   {
     printf("\nWarning: Your GPU was detected as a GCN (Graphics Core Next) device. mfakto is\n"
       "      very slow on these chips with a vector size of 4 or above. Please set\n"
       "      VectorSize=2 in %s and restart mfakto for optimal performance.\n\n",
-      mystuff.inifile);
+      mystuff->inifile);
   }
 
-  if(mystuff.verbosity >= 1)
+  if(mystuff->verbosity >= 1)
   {
     printf("\nOpenCL device info\n");
-    printf("  name                      %s (%s)\n", deviceinfo.d_name, deviceinfo.v_name);
-    printf("  device (driver) version   %s (%s)\n", deviceinfo.d_ver, deviceinfo.dr_version);
-    printf("  maximum threads per block %d\n", (int)deviceinfo.maxThreadsPerBlock);
-    printf("  maximum threads per grid  %d\n", (int)deviceinfo.maxThreadsPerGrid);
+    printf("  name                      %s (%s)\n", dev->deviceinfo.d_name, dev->deviceinfo.v_name);
+    printf("  device (driver) version   %s (%s)\n", dev->deviceinfo.d_ver, dev->deviceinfo.dr_version);
+    printf("  maximum threads per block %d\n", (int)dev->deviceinfo.maxThreadsPerBlock);
+    printf("  maximum threads per grid  %d\n", (int)dev->deviceinfo.maxThreadsPerGrid);
 #ifdef _MSC_VER
     // avoid warning C33010 in Visual Studio; this should not be reachable
-    if (mystuff.gpu_type < GPUKernels::AUTOSELECT_KERNEL || mystuff.gpu_type > GPUKernels::UNKNOWN_GS_KERNEL) {
+    if (mystuff->gpu_type < GPUKernels::AUTOSELECT_KERNEL || mystuff->gpu_type > GPUKernels::UNKNOWN_GS_KERNEL) {
         std::cerr << "Error: kernel out of range in set_gpu_type()\n";
         exit(1);
     }
 #endif
-    printf("  number of multiprocessors %d (%d compute elements)\n", deviceinfo.units, deviceinfo.units * gpu_types[mystuff.gpu_type].CE_per_multiprocessor);
+    printf("  number of multiprocessors %d (%d compute elements)\n", dev->deviceinfo.units, dev->deviceinfo.units * gpu_types[mystuff->gpu_type].CE_per_multiprocessor);
     // for some devices, CL_DEVICE_MAX_CLOCK_FREQUENCY can return 0 or 1 MHz
-    if (deviceinfo.max_clock < 5) {
+    if (dev->deviceinfo.max_clock < 5) {
       printf("  clock rate                unavailable\n");
-      if (mystuff.verbosity > 1) {
+      if (mystuff->verbosity > 1) {
         printf("\nInfo: mfakto could not determine the clock rate. Some devices might not report\n");
         printf("      this information due to firmware or driver limitations, or software\n");
         printf("      conflicts. However, this does not affect mfakto's performance.\n");
       }
     } else {
-      printf("  clock rate                %d MHz\n", deviceinfo.max_clock);
+      printf("  clock rate                %d MHz\n", dev->deviceinfo.max_clock);
     }
 
     printf("\nAutomatic parameters\n");
 
-    printf("  threads per grid          %d\n", mystuff.threads_per_grid);
-    printf("  optimizing kernels for    %s\n\n", gpu_types[mystuff.gpu_type].gpu_name);
+    printf("  threads per grid          %d\n", mystuff->threads_per_grid);
+    printf("  optimizing kernels for    %s\n\n", gpu_types[mystuff->gpu_type].gpu_name);
   }
 
-  if (only_use_cpu == 1 && mystuff.gpu_sieving == 1) {
+  if (dev->only_use_cpu == 1 && mystuff->gpu_sieving == 1) {
       printf("Info: overriding SieveOnGPU=1 in INI file as mfakto is running only on CPU\n\n");
-      mystuff.gpu_sieving = 0;
+      mystuff->gpu_sieving = 0;
   }
 }
 
-/*
- * load_kernels
- * compile cl files or load the precompiled binary, and load all kernels
- */
-
-int load_kernels(cl_int *devnumber)
+static int kernel_group(int kernel)
 {
-  cl_int status;
-  size_t i = 0;
-  size_t size;
-  char*  source = NULL;
-  int binary_loaded = 0;
-  char program_options[150];
+  if (kernel == _TEST_MOD_)                                                   return KG_TEST;
+  if (kernel == _71BIT_MUL24 || kernel == _63BIT_MUL24)                       return KG_MUL24;
+  if (kernel >= BARRETT79_MUL32 && kernel <= BARRETT87_MUL32)                 return KG_BARRETT32;
+  if (kernel >= BARRETT73_MUL15 && kernel <= BARRETT74_MUL15)                 return KG_BARRETT15;
+  if (kernel == MG62 || kernel == MG88)                                       return KG_MONTGOMERY;
+  if (kernel >= CL_CALC_BIT_TO_CLEAR && kernel <= CL_COMPACT_WRITE)           return KG_GPUSIEVE;
+  if (kernel >= BARRETT79_MUL32_GS && kernel <= BARRETT87_MUL32_GS)           return KG_BARRETT32;
+  if (kernel >= BARRETT73_MUL15_GS && kernel <= BARRETT74_MUL15_GS)           return KG_BARRETT15;
+  return KG_NONE;
+}
 
-  // so far use the same vector size for all kernels ...
-  if (mystuff.CompileOptions[0] && mystuff.CompileOptions[0] != '+')  // if mfakto.ini defined compile options, override the default with them
+/* FNV-1a, 64 bit */
+static cl_ulong fnv1a_64(cl_ulong hash, const char *data, size_t len)
+{
+  for (size_t i = 0; i < len; i++)
   {
-    strcpy(program_options, mystuff.CompileOptions);
+    hash ^= (unsigned char)data[i];
+    hash *= 0x100000001B3ULL;
   }
-  else
+  return hash;
+}
+
+/* hash a kernel file and, recursively, the files it #includes */
+static cl_ulong hash_kernel_file(cl_ulong hash, const char *filename, int depth)
+{
+  std::ifstream f(filename, std::ifstream::binary);
+  std::string   line;
+
+  if (!f.is_open() || depth > 8) return hash;
+  hash = fnv1a_64(hash, filename, strlen(filename));
+  while (std::getline(f, line))
   {
-    snprintf(
-      program_options,
-      sizeof(program_options),
-      "-I. -DVECTOR_SIZE=%d -D%s",
-      mystuff.vectorsize, gpu_types[mystuff.gpu_type].gpu_name
-    );
-  #ifdef CL_DEBUG
-    strcat(program_options, " -g");
-  #else
-    // Nvidia and Intel do not know optimisation flags
-    if (mystuff.gpu_type != GPU_NVIDIA && mystuff.gpu_type != GPU_INTEL)
+    hash = fnv1a_64(hash, line.c_str(), line.size() + 1);
+
+    size_t inc = line.find("#include \"");
+    if (inc != std::string::npos)
     {
-        // same goes for macOS and Intel CPUs (and possibly others)
-#if !defined __APPLE__
-        if (mystuff.gpu_type != GPU_CPU && strstr(deviceinfo.v_name, "Intel") == NULL) {
-            strcat(program_options, " -O3");
-        }
-#endif
+      size_t end = line.find('"', inc + 10);
+      if (end != std::string::npos)
+        hash = hash_kernel_file(hash, line.substr(inc + 10, end - inc - 10).c_str(), depth + 1);
     }
-  #endif
+  }
+  return hash;
+}
 
-    if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
+/* The binary kernel cache is content-addressed: the file name of a group's binary contains a hash of
+   device name and version, one of driver version and kernel sources and one of the build options. A
+   different device, driver, mfakto version or setting just uses another file, so instances on different
+   GPUs or with different settings never overwrite each other's binaries. A new driver or mfakto version
+   removes the binaries of the old one for the device, see remove_stale_binfiles(). */
+static cl_uint fold_key(cl_ulong hash)
+{
+  return (cl_uint)(hash ^ (hash >> 32));
+}
 
-  #ifdef CHECKS_MODBASECASE
-    strcat(program_options, " -DCHECKS_MODBASECASE");
-  #endif
+static cl_uint kernel_device_key(void)
+{
+  cl_ulong hash = 0xCBF29CE484222325ULL;
 
-    if (mystuff.gpu_sieving == 1)
-      strcat(program_options, " -DCL_GPU_SIEVE");
+  hash = fnv1a_64(hash, dev->deviceinfo.d_name, strlen(dev->deviceinfo.d_name) + 1);
+  hash = fnv1a_64(hash, dev->deviceinfo.d_ver, strlen(dev->deviceinfo.d_ver) + 1);
+  return fold_key(hash);
+}
+
+static cl_uint kernel_cache_key(void)
+{
+  cl_ulong hash = 0xCBF29CE484222325ULL;
+
+  hash = fnv1a_64(hash, dev->deviceinfo.dr_version, strlen(dev->deviceinfo.dr_version) + 1);
+  return fold_key(hash_kernel_file(hash, KERNEL_FILE, 0));
+}
+
+/* remove the binaries of the same group and device which another driver or other kernel sources have
+   built: binfile is <dir><stem><cache key>_<options key><ext>, name points to <stem> in binfile. */
+static void remove_stale_binfiles(const char *binfile, const char *name, size_t stem_len, const char *ext)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  std::string dir(binfile, name - binfile), keep(name), stem(name, stem_len);
+  std::vector<std::string> stale;
+  size_t name_len = strlen(name);
+
+#ifdef _MSC_VER
+  struct _finddata_t fd;
+  intptr_t h = _findfirst((dir + stem + "*").c_str(), &fd);
+  if (h == -1) return;
+  do
+  {
+    std::string entry(fd.name);
+#else
+  DIR *d = opendir(dir.empty() ? "." : dir.c_str());
+  struct dirent *de;
+  if (d == NULL) return;
+  while ((de = readdir(d)) != NULL)
+  {
+    std::string entry(de->d_name);
+#endif
+    // <stem>XXXXXXXX_XXXXXXXX<ext> with another cache key
+    if (entry.size() == name_len && entry.compare(0, stem_len, stem) == 0 && entry != keep &&
+        entry.compare(name_len - strlen(ext), std::string::npos, ext) == 0 && entry[stem_len + 8] == '_' &&
+        entry.compare(stem_len, 8, keep, stem_len, 8) != 0 &&
+        entry.find_first_not_of("0123456789abcdef", stem_len) >= stem_len + 8 &&
+        entry.find_first_not_of("0123456789abcdef", stem_len + 9) >= stem_len + 17)
+      stale.push_back(entry);
+#ifdef _MSC_VER
+  } while (_findnext(h, &fd) == 0);
+  _findclose(h);
+#else
+  }
+  closedir(d);
+#endif
+
+  for (size_t i = 0; i < stale.size(); i++)
+  {
+    std::string path = dir + stale[i];
+    if (remove(path.c_str()) == 0 && mystuff->verbosity > 1) printf("Removed old binary kernel file %s.\n", path.c_str());
+  }
+}
+
+/*
+ * build_group_program
+ * compile the cl files for one kernel group (plus extra_options) or load its precompiled binary.
+ * The binary is only cached when use_cache is set. Returns NULL on errors.
+ */
+
+static cl_program build_group_program(int group, const char *extra_options, int use_cache)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  cl_int status;
+  size_t i = 0;
+  size_t size;
+  char*  source = NULL;
+  int binary_loaded = 0;
+  char program_options[300];
+  char binfile[128];
+  const char *binfile_name = NULL, *binfile_ext = "";  // the file name in binfile and its extension
+  size_t binfile_stem = 0;                             // <base>_<group>_<device key>_ part of binfile_name
+  cl_program program = NULL;
+  cl_int *devnumber = &dev->host->group_devnumber;
+
+  snprintf(program_options, sizeof(program_options), "%s -DKERNEL_GROUP_%s%s", dev->host->group_base_options, kernel_group_define[group], extra_options);
 
-    if (mystuff.CompileOptions[0] == '+')
-      strcat(program_options, mystuff.CompileOptions+1);
+  binfile[0] = '\0';
+  if (mystuff->binfile[0] && use_cache)
+  {
+    // mfakto_Kernels.elf -> mfakto_Kernels_<group>_<device key>_<cache key>_<options key>.elf
+    const char *name = mystuff->binfile, *sep, *ext;
+    int base_len, dir_len;
+
+    // only a dot in the file name itself starts the extension, not one in a directory name
+    if ((sep = strrchr(name, '/')) != NULL)  name = sep + 1;
+    if ((sep = strrchr(name, '\\')) != NULL) name = sep + 1;
+    ext      = strrchr(name, '.');
+    dir_len  = (int)(name - mystuff->binfile);
+    base_len = ext ? (int)(ext - mystuff->binfile) : (int)strlen(mystuff->binfile);
+
+    int len = snprintf(binfile, sizeof(binfile), "%.*s_%s_%08x_", base_len, mystuff->binfile, kernel_group_name[group], dev->host->group_device_key);
+    snprintf(binfile + len, sizeof(binfile) - len, "%08x_%08x%s", dev->host->group_cache_key,
+             fold_key(fnv1a_64(0xCBF29CE484222325ULL, program_options, strlen(program_options))), ext ? ext : "");
+    binfile_name = binfile + dir_len;
+    binfile_stem = len - dir_len;
+    binfile_ext  = ext ? ext : "";
   }
 
-  if (mystuff.binfile[0])
+  if (binfile[0])
   {
-    if (mystuff.force_rebuild == 1) remove(mystuff.binfile);
+    if (mystuff->force_rebuild == 1) remove(binfile);
 
     // check if binfile exists
-    if (file_exists(mystuff.binfile))
+    if (file_exists(binfile))
     {
-      if (mystuff.verbosity > 0) printf("Loading binary kernel file %s\n", mystuff.binfile);
-      std::fstream f(mystuff.binfile, (std::fstream::in | std::fstream::binary));
+      if (mystuff->verbosity > 0) printf("Loading binary kernel file %s\n", binfile);
+      std::fstream f(binfile, (std::fstream::in | std::fstream::binary));
 
       if(f.is_open())
       {
@@ -970,17 +1671,17 @@ int load_kernels(cl_int *devnumber)
         {
           f.close();
           std::cerr << "\noom\n";
-          return 1;
+          return NULL;
         }
 
         f.read(source, size);
         f.close();
         source[size] = '\0';
-        char source_options[150];
+        char source_options[300] = "";
 #ifdef _MSC_VER
-        std::ignore = sscanf(source, "Compile options: %149[^\r\n]\n", source_options);
+        std::ignore = sscanf(source, "Compile options: %299[^\r\n]\n", source_options);
 #else
-        sscanf(source, "Compile options: %149[^\r\n]\n", source_options);
+        sscanf(source, "Compile options: %299[^\r\n]\n", source_options);
 #endif
         if (strcmp(source_options, program_options) != 0)
         {
@@ -998,7 +1699,7 @@ int load_kernels(cl_int *devnumber)
       }
       else
       {
-        fprintf(stderr, "\nBinary kernel file \"%s\" not readable, check permissions.\n", mystuff.binfile);
+        fprintf(stderr, "\nBinary kernel file \"%s\" not readable, check permissions.\n", binfile);
       }
 
       if (source)
@@ -1006,7 +1707,7 @@ int load_kernels(cl_int *devnumber)
         // load and build it. If not successful, use the .cl sources.
         cl_int errcode;
 
-        program = clCreateProgramWithBinary(context, 1, &devices[*devnumber], &size, (const unsigned char **)&source, &status, &errcode);
+        program = clCreateProgramWithBinary(dev->context, 1, &dev->devices[*devnumber], &size, (const unsigned char **)&source, &status, &errcode);
         if (status != CL_SUCCESS || errcode != 0)
         {
           // not successful: try the source
@@ -1042,7 +1743,7 @@ int load_kernels(cl_int *devnumber)
       {
         f.close();
         std::cerr << "\noom\n";
-        return 1;
+        return NULL;
       }
 
       f.read(source, size);
@@ -1052,39 +1753,38 @@ int load_kernels(cl_int *devnumber)
     else
     {
       std::cerr << "\nKernel file \"" KERNEL_FILE "\" not found, it needs to be in the same directory as the executable.\n";
-      return 1;
+      return NULL;
     }
 
-    program = clCreateProgramWithSource(context, 1, (const char **)&source, &size, &status);
+    program = clCreateProgramWithSource(dev->context, 1, (const char **)&source, &size, &status);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clCreateProgramWithSource\n";
-      return 1;
+      return NULL;
     }
   }
   if (source) free(source);
 
-  if (mystuff.verbosity > 1)
-    printf("Compiling kernels (build options: \"%s\").", program_options);
-  else if (mystuff.verbosity > 0)
-    printf("Compiling kernels.\n");
+  if (mystuff->verbosity > 1)
+    printf("Compiling %s kernels (build options: \"%s\").\n", kernel_group_name[group], program_options);
 
   // program_options can be overridden by setting en environment variable AMD_OCL_BUILD_OPTIONS
 
-  status = clBuildProgram(program, 1, &devices[*devnumber], program_options, NULL, NULL);
-  if((status != CL_SUCCESS) || (mystuff.verbosity > 2))
+  status = clBuildProgram(program, 1, &dev->devices[*devnumber], program_options, NULL, NULL);
+  if((status != CL_SUCCESS) || (mystuff->verbosity > 2))
   {
-    if((status == CL_BUILD_PROGRAM_FAILURE) || (mystuff.verbosity > 2))
+    if((status == CL_BUILD_PROGRAM_FAILURE) || (mystuff->verbosity > 2))
     {
       cl_int logstatus;
       char *buildLog = NULL;
       size_t buildLogSize = 0;
-      logstatus = clGetProgramBuildInfo (program, devices[*devnumber], CL_PROGRAM_BUILD_LOG,
+      logstatus = clGetProgramBuildInfo (program, dev->devices[*devnumber], CL_PROGRAM_BUILD_LOG,
                 buildLogSize, buildLog, &buildLogSize);
       if(logstatus != CL_SUCCESS)
       {
         std::cerr << "Error " << logstatus << " (" << ClErrorString(logstatus) << "): clGetProgramBuildInfo failed.";
-        return 1;
+        clReleaseProgram(program);
+        return NULL;
       }
       if (buildLogSize >0)
       {
@@ -1092,25 +1792,27 @@ int load_kernels(cl_int *devnumber)
         if(buildLog == NULL)
         {
           std::cerr << "\noom\n";
-          return 1;
+          clReleaseProgram(program);
+          return NULL;
         }
         fflush(NULL);
-        logstatus = clGetProgramBuildInfo (program, devices[*devnumber], CL_PROGRAM_BUILD_LOG,
+        logstatus = clGetProgramBuildInfo (program, dev->devices[*devnumber], CL_PROGRAM_BUILD_LOG,
                   buildLogSize, buildLog, NULL);
         if(logstatus != CL_SUCCESS)
         {
           std::cerr << "Error " << logstatus << " (" << ClErrorString(logstatus) << "): clGetProgramBuildInfo failed.";
           free(buildLog);
-          return 1;
+          clReleaseProgram(program);
+          return NULL;
         }
 
-        std::cout << " \n\tBUILD OUTPUT\n";
+        std::cout << " \n\tBUILD OUTPUT (" << kernel_group_name[group] << " kernels)\n";
         std::cout << buildLog << std::endl;
         std::cout << " \tEND OF BUILD OUTPUT\n";
         if (strstr(buildLog, " not for the target") && binary_loaded)
         {
-          printf("Removing binary kernel file %s as it seems to be for a different platform.\nPlease restart mfakto.", mystuff.binfile);
-          remove (mystuff.binfile);
+          printf("Removing binary kernel file %s as it seems to be for a different platform.\nPlease restart mfakto.", binfile);
+          remove (binfile);
         }
         free(buildLog);
       }
@@ -1120,13 +1822,18 @@ int load_kernels(cl_int *devnumber)
       }
     }
     std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): clBuildProgram\n";
-    if (status != CL_SUCCESS) return 1;
+    if (status != CL_SUCCESS)
+    {
+      clReleaseProgram(program);
+      return NULL;
+    }
   }
 
   size_t numDevices=0;
   char **binaries=NULL;
   size_t *binarySizes=NULL;
-  while (!binary_loaded && mystuff.binfile[0]) // should be an if, but I want to use break on errors
+  cl_device_id *program_devices=NULL;
+  while (!binary_loaded && binfile[0]) // should be an if, but I want to use break on errors
   {
     // write the binary file if we did not load from there
     status = clGetProgramInfo(
@@ -1141,9 +1848,9 @@ int load_kernels(cl_int *devnumber)
       break;
     }
 
-    cl_device_id *devices = (cl_device_id *)malloc( sizeof(cl_device_id) *
+    program_devices = (cl_device_id *)malloc( sizeof(cl_device_id) *
                             numDevices );
-    if(!devices)
+    if(!program_devices)
     {
       std::cerr << "Failed to allocate host memory.(devices, " << sizeof(cl_device_id) << " bytes)\n";
       break;
@@ -1153,7 +1860,7 @@ int load_kernels(cl_int *devnumber)
                  program,
                  CL_PROGRAM_DEVICES,
                  sizeof(cl_device_id) * numDevices,
-                 devices,
+                 program_devices,
                  NULL );
     if(status != CL_SUCCESS)
     {
@@ -1218,14 +1925,14 @@ int load_kernels(cl_int *devnumber)
     if (1 < numDevices)
     {
         std::cout << "Info: Dumping only 1 of " << numDevices << " binary formats.\n";
-        std::cout << "      If the kernel file " << mystuff.binfile <<  " fails to load, delete it and\n";
+        std::cout << "      If the kernel file " << binfile <<  " fails to load, delete it and\n";
         std::cout << "      restart mfakto with the -d <n> option.\n";
     }
     if(binarySizes[active_device] != 0)
     {
         char deviceName[1024];
         status = clGetDeviceInfo(
-                     devices[active_device],
+                     program_devices[active_device],
                      CL_DEVICE_NAME,
                      sizeof(deviceName),
                      deviceName,
@@ -1236,26 +1943,45 @@ int load_kernels(cl_int *devnumber)
           break;
         }
 
-        std::fstream f(mystuff.binfile, (std::fstream::out | std::fstream::binary | std::fstream::trunc));
+        // write to a temporary file and rename it: other instances never see a partial file
+        char tmpfile[160];
+        snprintf(tmpfile, sizeof(tmpfile), "%s.%d.tmp", binfile, (int)my_getpid());
+        std::fstream f(tmpfile, (std::fstream::out | std::fstream::binary | std::fstream::trunc));
         if(f.is_open())
         {
-          char header[180];
+          char header[350];
           snprintf(header, sizeof(header), "Compile options: %s\n", program_options);
           f.write(header, strlen(header));
           f.write(binaries[active_device], binarySizes[active_device]);
           f.close();
-          if (mystuff.verbosity > 1) printf("Wrote binary kernel for \"%s\" to \"%s\".\n", deviceName, mystuff.binfile);
+          if (f.fail())
+          {
+            std::cerr << "Failed to write binary file " << tmpfile << " to save kernel.\n";
+            remove(tmpfile);
+          }
+          else if (rename(tmpfile, binfile) != 0)
+          {
+            // Windows does not replace an existing file: another instance may have just written the same binary
+            remove(tmpfile);
+            if (!file_exists(binfile)) std::cerr << "Failed to rename " << tmpfile << " to " << binfile << ".\n";
+          }
+          else
+          {
+            if (mystuff->verbosity > 1) printf("Wrote binary kernel for \"%s\" to \"%s\".\n", deviceName, binfile);
+            // a new binary: the ones of an older driver or mfakto version for this device are of no use anymore
+            remove_stale_binfiles(binfile, binfile_name, binfile_stem, binfile_ext);
+          }
         }
         else
         {
-          std::cerr << "Failed to open binary file " << mystuff.binfile << " to save kernel.\n";
+          std::cerr << "Failed to open binary file " << tmpfile << " to save kernel.\n";
         }
     }
     else
     {
-        printf("Did not create binary kernel: %s\n", mystuff.binfile);
+        printf("Did not create binary kernel: %s\n", binfile);
         printf("Skipping as there is no binary data to write.\n");
-        remove(mystuff.binfile);
+        remove(binfile);
     }
     break;
   }
@@ -1278,134 +2004,596 @@ int load_kernels(cl_int *devnumber)
     free(binarySizes);
     binarySizes = NULL;
   }
-  if(devices != NULL)
+  if(program_devices != NULL)
   {
-    free(devices);
-    devices = NULL;
+    free(program_devices);
+    program_devices = NULL;
   }
 
-  /* get kernels by name */
-  if (mystuff.gpu_sieving == 0)
+  return program;
+}
+
+/*
+ * build_kernel_group
+ * build one kernel group and create its kernels.
+ * Can run on the background build thread: only touches group_program[group] and the kernel_info entries of the group.
+ */
+
+static int build_kernel_group(int group)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  cl_int     status;
+  cl_uint    i;
+  cl_program program = build_group_program(group, "", 1);
+
+  if (program == NULL) return 1;
+
+  /* get the group's kernels by name */
+  cl_uint first = (mystuff->gpu_sieving == 0) ? _TEST_MOD_ : CL_CALC_BIT_TO_CLEAR;
+  cl_uint last  = (mystuff->gpu_sieving == 0) ? UNKNOWN_KERNEL : UNKNOWN_GS_KERNEL;
+  for (i=first; i<last; i++)
   {
-    for (i=_TEST_MOD_; i<UNKNOWN_KERNEL; i++)
+    if (kernel_group((int)i) != group) continue;
+    dev->kernel[i] = clCreateKernel(program, kernel_info[i].kernelname, &status);
+    if(status != CL_SUCCESS)
     {
-      kernel_info[i].kernel = clCreateKernel(program, kernel_info[i].kernelname, &status);
+      std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Creating Kernel " << kernel_info[i].kernelname << " from program. (clCreateKernel)\n";
+      clReleaseProgram(program);
+      return 1;
+    }
+    if (mystuff->gpu_sieving == 0 && mystuff->grids_per_launch > 1 && i >= BARRETT73_MUL15 && i <= BARRETT74_MUL15)
+    {
+      char name[48];
+
+      snprintf(name, sizeof(name), "%s_grids", kernel_info[i].kernelname);
+      dev->kernel_grids[i] = clCreateKernel(program, name, &status);
       if(status != CL_SUCCESS)
       {
-        std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Creating Kernel " << kernel_info[i].kernelname << " from program. (clCreateKernel)\n";
+        std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Creating Kernel " << name << " from program. (clCreateKernel)\n";
+        clReleaseProgram(program);
         return 1;
       }
     }
   }
-  else
+
+  dev->host->group_program[group] = program;
+  return 0;
+}
+
+/* build the specialized kernel for the spec_* parameters, called with group_lock held */
+static void build_specialized_kernel(std::unique_lock<std::mutex> &lock)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  cl_int     status;
+  cl_program program;
+  cl_kernel  kernel = NULL;
+  int        kernel_id = dev->host->spec_kernel_id;
+  cl_uint    generation = dev->host->spec_generation;
+  char       options[100];
+
+  snprintf(options, sizeof(options), " -DTF_EXPONENT=%uu -DTF_SHIFTCOUNT=%u -DTF_BIT_MAX65=%u",
+           dev->host->spec_exponent, dev->host->spec_shiftcount, dev->host->spec_bit_max65);
+  dev->host->spec_state = KG_BUILDING;
+  lock.unlock();
+
+  if (mystuff->verbosity > 1) printf("Building %s for M%u in the background.\n", kernel_info[kernel_id].kernelname, dev->host->spec_exponent);
+  // the selftest cases are always the same: only their specialized binaries are worth caching
+  program = build_group_program(kernel_group(kernel_id), options, mystuff->mode != MODE_NORMAL);
+  if (program)
+  {
+    kernel = clCreateKernel(program, kernel_info[kernel_id].kernelname, &status);
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Creating Kernel " << kernel_info[kernel_id].kernelname << " from program. (clCreateKernel)\n";
+      clReleaseProgram(program);
+      program = NULL;
+      kernel  = NULL;
+    }
+  }
+
+  lock.lock();
+  if (generation != dev->host->spec_generation)
+  {
+    // tf() moved on to another assignment meanwhile
+    if (kernel)  clReleaseKernel(kernel);
+    if (program) clReleaseProgram(program);
+    return;
+  }
+  dev->host->spec_program = program;
+  dev->host->spec_kernel  = kernel;
+  dev->host->spec_state   = kernel ? KG_READY : KG_FAILED;
+  dev->host->cv_group.notify_all();
+}
+
+/* background build thread of device d: builds the queued groups one after the other */
+static void group_build_thread(device_t *d)
+{
+  dev = d;
+  std::unique_lock<std::mutex> lock(dev->host->group_lock);
+
+  while (!dev->host->group_thread_stop)
+  {
+    if (dev->host->group_queue.empty())
+    {
+      dev->host->cv_group.wait(lock);
+      continue;
+    }
+    int group = dev->host->group_queue.front();
+    dev->host->group_queue.pop_front();
+    if (group == KG_SPECIALIZED)
+    {
+      build_specialized_kernel(lock);
+      continue;
+    }
+    dev->host->group_state[group] = KG_BUILDING;
+    lock.unlock();
+    int status = build_kernel_group(group);
+    lock.lock();
+    dev->host->group_state[group] = status ? KG_FAILED : KG_READY;
+    dev->host->cv_group.notify_all();
+  }
+}
+
+/* start the background build thread if not yet running, group_lock must be held */
+static void start_build_thread(void)
+{
+  if (!dev->host->group_thread.joinable())
+  {
+    dev->host->group_thread_stop = false;
+    dev->host->group_thread = std::thread(group_build_thread, dev);
+  }
+  dev->host->cv_group.notify_all();
+}
+
+/*
+ * request_kernel
+ * queue the build of the kernel's group on the background thread, if not yet done. Does not wait.
+ */
+
+void request_kernel(int kernel)
+{
+  int group = kernel_group(kernel);
+  if (group == KG_NONE) return;
+
+  std::lock_guard<std::mutex> lock(dev->host->group_lock);
+  if (dev->host->group_base_options[0] == '\0' || dev->host->group_state[group] != KG_NOT_BUILT) return;
+
+  dev->host->group_state[group] = KG_QUEUED;
+  dev->host->group_queue.push_back(group);
+  start_build_thread();
+}
+
+/*
+ * load_kernel
+ * make sure the kernel is built: wait for a build in progress, or build its group now.
+ * Returns 0 when kernel_info[kernel].kernel can be used.
+ */
+
+int load_kernel(int kernel)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  int group = kernel_group(kernel);
+  if (group == KG_NONE) return 0;
+
+  std::unique_lock<std::mutex> lock(dev->host->group_lock);
+  if (dev->host->group_base_options[0] == '\0')  // load_kernels() was not called, CL_test creates its kernels itself
+    return dev->kernel[kernel] ? 0 : 1;
+
+  if (dev->host->group_state[group] != KG_READY && mystuff->verbosity == 1)
+    printf("Compiling %s kernels.\n", kernel_group_name[group]);
+
+  if (dev->host->group_state[group] == KG_NOT_BUILT || dev->host->group_state[group] == KG_QUEUED)
   {
-    for (i=CL_CALC_BIT_TO_CLEAR; i<UNKNOWN_GS_KERNEL; i++)
+    // needed now: do not wait for the background thread to get to it
+    if (dev->host->group_state[group] == KG_QUEUED)
+      dev->host->group_queue.erase(std::find(dev->host->group_queue.begin(), dev->host->group_queue.end(), group));
+    dev->host->group_state[group] = KG_BUILDING;
+    lock.unlock();
+    int status = build_kernel_group(group);
+    lock.lock();
+    dev->host->group_state[group] = status ? KG_FAILED : KG_READY;
+    dev->host->cv_group.notify_all();
+  }
+  while (dev->host->group_state[group] == KG_BUILDING)
+    dev->host->cv_group.wait(lock);
+
+  if (dev->host->group_state[group] != KG_READY)
+  {
+    fprintf(stderr, "ERROR: building the %s kernels failed.\n", kernel_group_name[group]);
+    return 1;
+  }
+  return 0;
+}
+
+/* put the generic kernel back into kernel_info[] and release the specialized one, group_lock must be held */
+static void drop_specialized_kernel(void)
+{
+  if (dev->host->spec_generic_kernel)
+  {
+    dev->kernel[dev->host->spec_kernel_id] = dev->host->spec_generic_kernel;
+    dev->host->spec_generic_kernel = NULL;
+  }
+  if (dev->host->spec_kernel)  clReleaseKernel(dev->host->spec_kernel);
+  if (dev->host->spec_program) clReleaseProgram(dev->host->spec_program);
+  dev->host->spec_kernel    = NULL;
+  dev->host->spec_program   = NULL;
+  dev->host->spec_state     = KG_NOT_BUILT;
+  dev->host->spec_kernel_id = -1;
+}
+
+/* same shiftcount as tf_class_opencl() calculates */
+static cl_uint tf_shiftcount(cl_uint exponent, cl_uint bit_max_stage)
+{
+  cl_uint shiftcount = 10;
+
+  while ((1ULL<<shiftcount) < (unsigned long long int)exponent) shiftcount++;
+  shiftcount -= 6;
+  while ((exponent >> shiftcount) < bit_max_stage) shiftcount--;
+  return shiftcount;
+}
+
+/*
+ * specialize_kernel
+ * called by tf() for each assignment: puts the generic kernel of the previous assignment back and,
+ * with SpecializeKernels=1, queues the build of the barrett kernel specialized for this assignment.
+ */
+
+void specialize_kernel(int kernel, cl_uint exponent, cl_uint bit_max_stage)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  int     group = kernel_group(kernel);
+  cl_uint shiftcount = tf_shiftcount(exponent, bit_max_stage);
+
+  if (dev->host == NULL) return;  // host TF (-d h), init_CL() was not called
+  std::unique_lock<std::mutex> lock(dev->host->group_lock);
+
+  // the same assignment again (e.g. after a restart in the selftest): keep the build
+  if (dev->host->spec_kernel_id == kernel && dev->host->spec_exponent == exponent && dev->host->spec_shiftcount == shiftcount &&
+      dev->host->spec_bit_max65 == bit_max_stage - 65 && dev->host->spec_state != KG_FAILED)
+  {
+    if (dev->host->spec_generic_kernel)
+    {
+      dev->kernel[kernel] = dev->host->spec_generic_kernel;
+      dev->host->spec_generic_kernel = NULL;
+    }
+    return;
+  }
+
+  // a build in progress is discarded when it completes
+  if (dev->host->spec_state == KG_QUEUED)
+    dev->host->group_queue.erase(std::find(dev->host->group_queue.begin(), dev->host->group_queue.end(), (int)KG_SPECIALIZED));
+  drop_specialized_kernel();
+  dev->host->spec_generation++;
+
+  if (!mystuff->specialize_kernels || dev->host->group_base_options[0] == '\0' ||
+      (group != KG_BARRETT15 && group != KG_BARRETT32) || bit_max_stage < 65)
+    return;
+
+  dev->host->spec_kernel_id  = kernel;
+  dev->host->spec_exponent   = exponent;
+  dev->host->spec_shiftcount = shiftcount;
+  dev->host->spec_bit_max65  = bit_max_stage - 65;
+  dev->host->spec_state      = KG_QUEUED;
+  dev->host->group_queue.push_back(KG_SPECIALIZED);
+  start_build_thread();
+}
+
+/*
+ * use_specialized_kernel
+ * switch kernel_info[kernel] to the specialized kernel if its build is done, only between classes.
+ * wait: wait for the build (the selftests check the specialized kernel, not the generic one).
+ * Returns 1 if the specialized kernel is in use.
+ */
+
+int use_specialized_kernel(int kernel, int wait)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  if (dev->host == NULL) return 0;  // host TF (-d h)
+  std::unique_lock<std::mutex> lock(dev->host->group_lock);
+
+  if (dev->host->spec_kernel_id != kernel) return 0;
+  if (dev->host->spec_generic_kernel) return 1;  // already switched
+
+  if (wait && dev->host->spec_state == KG_QUEUED)
+  {
+    // needed now: do not wait for the background thread to get to it
+    dev->host->group_queue.erase(std::find(dev->host->group_queue.begin(), dev->host->group_queue.end(), (int)KG_SPECIALIZED));
+    build_specialized_kernel(lock);
+  }
+  while (wait && dev->host->spec_state == KG_BUILDING) dev->host->cv_group.wait(lock);
+  if (dev->host->spec_state != KG_READY) return 0;
+
+  dev->host->spec_generic_kernel = dev->kernel[kernel];
+  dev->kernel[kernel] = dev->host->spec_kernel;
+  dev->new_class = 1;  // set all kernel arguments of the new kernel
+  if (mystuff->verbosity > 1 && mystuff->mode == MODE_NORMAL)
+    printf("Using %s specialized for M%u.\n", kernel_info[kernel].kernelname, dev->host->spec_exponent);
+  return 1;
+}
+
+/* CPU sieve: grids per launch of kernel. The multi-grid kernels are generic builds,
+   the specialized kernel is launched one grid at a time, but not in a batch of exponents. */
+static cl_uint launch_grids(int kernel)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  std::unique_lock<std::mutex> lock(dev->host->group_lock);
+
+  if (dev->kernel_grids[kernel] == NULL) return 1;
+  if (dev->host->spec_kernel_id == kernel && dev->host->spec_generic_kernel != NULL && mystuff->batch.num == 0) return 1;
+  return mystuff->grids_per_launch;
+}
+
+/* stop the background build thread, dropping queued builds, and release the programs of all groups */
+static int release_kernel_groups(void)
+{
+  cl_int status;
+  int group, ret = 0;
+
+  {
+    std::lock_guard<std::mutex> lock(dev->host->group_lock);
+    dev->host->group_thread_stop = true;
+    dev->host->group_queue.clear();
+    dev->host->cv_group.notify_all();
+  }
+  if (dev->host->group_thread.joinable()) dev->host->group_thread.join();
+
+  {
+    std::lock_guard<std::mutex> lock(dev->host->group_lock);
+    drop_specialized_kernel();
+  }
+
+  for (group = 0; group < NUM_KERNEL_GROUPS; group++)
+  {
+    if (dev->host->group_program[group])
     {
-      kernel_info[i].kernel = clCreateKernel(program, kernel_info[i].kernelname, &status);
+      status = clReleaseProgram(dev->host->group_program[group]); dev->host->group_program[group] = NULL;
       if(status != CL_SUCCESS)
       {
-        std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Creating Kernel " << kernel_info[i].kernelname << " from program. (clCreateKernel)\n";
-        return 1;
+        std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseProgram (" << kernel_group_name[group] << ")\n";
+        ret = 1;
       }
     }
+    dev->host->group_state[group] = KG_NOT_BUILT;
+  }
+  dev->host->group_base_options[0] = '\0';
+  return ret;
+}
+
+/*
+ * load_kernels
+ * set up the build options for the kernel groups and build the gpusieve group if GPU sieving.
+ * All other kernels are built on demand, see request_kernel() and load_kernel().
+ */
+
+int load_kernels(cl_int *devnumber)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  char program_options[256];
+
+  // so far use the same vector size for all kernels ...
+  if (mystuff->CompileOptions[0] && mystuff->CompileOptions[0] != '+')  // if mfakto.ini defined compile options, override the default with them
+  {
+    strcpy(program_options, mystuff->CompileOptions);
+  }
+  else
+  {
+    snprintf(
+      program_options,
+      sizeof(program_options),
+      "-I. -DVECTOR_SIZE=%d -D%s -DRES_FACTORS_MAX=%d",
+      mystuff->vectorsize, gpu_types[mystuff->gpu_type].gpu_name, RES_FACTORS_MAX
+    );
+  #ifdef CL_DEBUG
+    strcat(program_options, " -g");
+  #else
+    // Nvidia and Intel do not know optimisation flags
+    if (mystuff->gpu_type != GPU_NVIDIA && mystuff->gpu_type != GPU_INTEL)
+    {
+        // same goes for macOS and Intel CPUs (and possibly others)
+#if !defined __APPLE__
+        if (mystuff->gpu_type != GPU_CPU && strstr(dev->deviceinfo.v_name, "Intel") == NULL) {
+            strcat(program_options, " -O3");
+        }
+#endif
+    }
+  #endif
+
+    if (mystuff->more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
+
+  #ifdef CHECKS_MODBASECASE
+    strcat(program_options, " -DCHECKS_MODBASECASE");
+  #endif
+
+    if (mystuff->gpu_sieving == 1)
+      strcat(program_options, " -DCL_GPU_SIEVE");
+
+    if (mystuff->gpu_sieving == 1 && mystuff->gpu_sieve_compact == 1)
+      strcat(program_options, " -DGPU_SIEVE_COMPACT");
+
+    if (mystuff->CompileOptions[0] == '+')
+      strcat(program_options, mystuff->CompileOptions+1);
+  }
+
+  cl_uint device_key = mystuff->binfile[0] ? kernel_device_key() : 0;
+  cl_uint cache_key  = mystuff->binfile[0] ? kernel_cache_key() : 0;
+  {
+    std::lock_guard<std::mutex> lock(dev->host->group_lock);
+    strcpy(dev->host->group_base_options, program_options);
+    dev->host->group_devnumber = *devnumber;
+    dev->host->group_device_key = device_key;
+    dev->host->group_cache_key  = cache_key;
   }
 
-  if (mystuff.verbosity > 1)
-    printf("\n");
+  // init_CLstreams() sets the arguments of the sieve kernels: build them now
+  if (mystuff->gpu_sieving == 1)
+    return load_kernel(CL_CALC_BIT_TO_CLEAR);
+
   return 0;
 }
 
-
 int cleanup_CL(void)
 {
+  mystuff_t *mystuff = dev->mystuff;
   cl_int status;
   cl_uint i;
 
+  // first stop background kernel builds, the kernels keep their programs alive until released below
+  if (release_kernel_groups()) return 1;
+
   for (i=0; i<NUM_KERNELS; i++)
   {
-    if (kernel_info[i].kernel)
+    if (dev->kernel[i])
     {
-      status = clReleaseKernel(kernel_info[i].kernel); kernel_info[i].kernel = NULL;
+      status = clReleaseKernel(dev->kernel[i]); dev->kernel[i] = NULL;
       if(status != CL_SUCCESS)
       {
         fprintf(stderr, "Error %d: clReleaseKernel(%d)\n", status, i);
         return 1;
       }
     }
+    if (dev->kernel_grids[i])
+    {
+      status = clReleaseKernel(dev->kernel_grids[i]); dev->kernel_grids[i] = NULL;
+      if(status != CL_SUCCESS)
+      {
+        fprintf(stderr, "Error %d: clReleaseKernel(%d, grids)\n", status, i);
+        return 1;
+      }
+    }
   }
 
-  status = clReleaseProgram(program); program=NULL;
-  if(status != CL_SUCCESS)
+  if (dev->program)  // built by CL_test
   {
-    std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseProgram\n";
-    return 1;
+    status = clReleaseProgram(dev->program); dev->program=NULL;
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseProgram\n";
+      return 1;
+    }
   }
-  for (i=0; i<mystuff.num_streams; i++)
+  for (i=0; i<mystuff->num_streams; i++)
   {
-    status = clReleaseMemObject(mystuff.d_ktab[i]); mystuff.d_ktab[i]=NULL;
+    status = free_ktab(i);
     if(status != CL_SUCCESS)
     {
       std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (d_ktab" << i << ")\n";
       return 1;
     }
-    free(mystuff.h_ktab[i]); mystuff.h_ktab[i]=NULL;
   }
-  status = clReleaseMemObject(mystuff.d_RES); mystuff.d_RES=NULL;
-  if(status != CL_SUCCESS)
+  for (i=0; i<TF_PIPELINE_DEPTH; i++)  // mystuff.d_RES is one of them
   {
-    std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (d_RES)\n";
-    return 1;
+    status = clReleaseMemObject(dev->host->tf_pipe.d_RES[i]); dev->host->tf_pipe.d_RES[i]=NULL;
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (d_RES)\n";
+      return 1;
+    }
   }
-  free(mystuff.h_RES); mystuff.h_RES=NULL;
+  mystuff->d_RES=NULL;
+  free(mystuff->h_RES); mystuff->h_RES=NULL;
 #ifdef CHECKS_MODBASECASE
-  status = clReleaseMemObject(mystuff.d_modbasecase_debug); mystuff.d_modbasecase_debug=NULL;
+  status = clReleaseMemObject(mystuff->d_modbasecase_debug); mystuff->d_modbasecase_debug=NULL;
   if(status != CL_SUCCESS)
   {
     std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseMemObject (d_modbasecase_debug)\n";
     return 1;
   }
-  free(mystuff.h_modbasecase_debug); mystuff.h_modbasecase_debug=NULL;
+  free(mystuff->h_modbasecase_debug); mystuff->h_modbasecase_debug=NULL;
 #endif
-  if (mystuff.gpu_sieving == 1)
+  if (mystuff->gpu_sieving == 1)
   {
-    gpusieve_free (&mystuff);
+    gpusieve_free (mystuff);
   }
 
-  status = clReleaseCommandQueue(commandQueue);
+  status = clReleaseCommandQueue(dev->commandQueue);
   if(status != CL_SUCCESS)
   {
     std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseCommandQueue\n";
     return 1;
   }
-  if (commandQueuePrf) status = clReleaseCommandQueue(commandQueuePrf);
+  if (dev->commandQueuePrf) status = clReleaseCommandQueue(dev->commandQueuePrf);
   if(status != CL_SUCCESS)
   {
     std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseCommandQueuePrf\n";
     return 1;
-    status = clReleaseContext(context);
+    status = clReleaseContext(dev->context);
+  }
+  if (dev->commandQueueXfer) status = clReleaseCommandQueue(dev->commandQueueXfer);
+  dev->commandQueueXfer = NULL;
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseCommandQueueXfer\n";
+    return 1;
   }
   if(status != CL_SUCCESS)
   {
     std::cerr<<"Error" << status << " (" << ClErrorString(status) << "): clReleaseContext\n";
     return 1;
   }
-  if(devices != NULL)
+  if(dev->devices != NULL)
   {
-      free(devices);
-      devices = NULL;
+      free(dev->devices);
+      dev->devices = NULL;
   }
-  clReleaseContext(context);
-  context = NULL;
+  clReleaseContext(dev->context);
+  dev->context = NULL;
+  delete dev->host;
+  dev->host = NULL;
 
   return 0;
 }
 
-#ifdef __cplusplus
+/* make device_list[n] the device of the calling thread */
+void select_device(cl_uint n)
+{
+  dev = &device_list[n];
 }
-#endif
 
-/* error callback function - not used right now */
-void  CL_CALLBACK CL_error_cb(const char *errinfo,
+static void device_thread(cl_uint n, int (*fn)(void *arg), void *arg, int *ret)
+{
+  select_device(n);
+  *ret = fn(arg);
+}
+
+/*
+ * run_on_devices
+ * runs fn(arg) for every device of device_list[], the calling thread takes device 0 and the other
+ * devices get a host thread of their own. Returns the first non-zero return value of fn, in device order.
+ */
+int run_on_devices(int (*fn)(void *arg), void *arg)
+{
+  std::thread threads[MAX_DEVICES];
+  int         ret[MAX_DEVICES] = {0};
+  cl_uint     i;
+
+  for (i = 1; i < num_device_list; i++) threads[i] = std::thread(device_thread, i, fn, arg, &ret[i]);
+  device_thread(0, fn, arg, &ret[0]);
+  for (i = 1; i < num_device_list; i++) threads[i].join();
+
+  for (i = 0; i < num_device_list; i++)
+  {
+    if (ret[i]) return ret[i];
+  }
+  return 0;
+}
+
+/* serializes the device threads of run_on_devices() on shared state, e.g. the class pool */
+void lock_devices(void)
+{
+  devices_mutex.lock();
+}
+
+void unlock_devices(void)
+{
+  devices_mutex.unlock();
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+/* error callback function - not used right now */
+void  CL_CALLBACK CL_error_cb(const char *errinfo,
     const void  *private_info,
     size_t  cb,
     void  *user_data)
@@ -1423,18 +2611,19 @@ __kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CalcModularInvers
 */
 cl_int run_calc_mod_inv(cl_uint numblocks, size_t localThreads, cl_event *run_event)
 {
+  mystuff_t *mystuff = dev->mystuff;
   cl_int status;
   size_t globalThreads = numblocks * localThreads;
 
 #ifdef DETAILED_INFO
     printf("run_calc_mod_inv: %d x %d = %d threads, exp=%u\n",
-        (int) numblocks, (int) localThreads, (int) globalThreads, mystuff.exponent);
+        (int) numblocks, (int) localThreads, (int) globalThreads, mystuff->exponent);
 #endif
 
-  status = clSetKernelArg(kernel_info[CL_CALC_MOD_INV].kernel,
+  status = clSetKernelArg(dev->kernel[CL_CALC_MOD_INV],
                     0,
                     sizeof(cl_uint),
-                    (void *)&mystuff.exponent);
+                    (void *)&mystuff->exponent);
   if(status != CL_SUCCESS)
   {
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (exponent)\n";
@@ -1442,11 +2631,11 @@ cl_int run_calc_mod_inv(cl_uint numblocks, size_t localThreads, cl_event *run_ev
   }
 
 #ifdef CL_PERFORMANCE_INFO
-  if (run_event == NULL) run_event = &mystuff.copy_events[0]; // When checking performance, we need an event to monitor.
+  if (run_event == NULL) run_event = &mystuff->copy_events[0]; // When checking performance, we need an event to monitor.
 #endif
 
   status = clEnqueueNDRangeKernel(QUEUE,
-                 kernel_info[CL_CALC_MOD_INV].kernel,
+                 dev->kernel[CL_CALC_MOD_INV],
                  1,
                  NULL,
                  &globalThreads,
@@ -1485,19 +2674,19 @@ cl_int run_calc_mod_inv(cl_uint numblocks, size_t localThreads, cl_event *run_ev
     return RET_ERROR;
   }
   printf("CalcModularInverses in %2.2f us (%3.2f M/s)\n", (endTime - startTime)/1e3, double(globalThreads) *1e3/ (endTime - startTime));
-  clReleaseEvent(mystuff.copy_events[0]); // dont use run_events - if it was passed in, it will still be needed. Ignore errors here, as we may have used a different event
+  clReleaseEvent(mystuff->copy_events[0]); // dont use run_events - if it was passed in, it will still be needed. Ignore errors here, as we may have used a different event
 #endif
 
 #ifdef DETAILED_INFO
   // get mystuff.d_calc_bit_to_clear_info and print it
-  cl_uint rowinfo_size = MAX_PRIMES_PER_THREAD*4 * sizeof (cl_uint) + mystuff.sieve_primes * 8;
+  cl_uint rowinfo_size = MAX_PRIMES_PER_THREAD*4 * sizeof (cl_uint) + mystuff->sieve_primes * 8;
 
   status = clEnqueueReadBuffer(QUEUE,     // only for tracing/verification - not needed later.
-                mystuff.d_calc_bit_to_clear_info,
+                mystuff->d_calc_bit_to_clear_info,
                 CL_TRUE,
                 0,
                 rowinfo_size,
-                mystuff.h_calc_bit_to_clear_info,
+                mystuff->h_calc_bit_to_clear_info,
                 0,
                 NULL,
                 NULL);
@@ -1508,45 +2697,49 @@ cl_int run_calc_mod_inv(cl_uint numblocks, size_t localThreads, cl_event *run_ev
     return 1;
   }
 
-  printArray("h_calc_bit_to_clear_info", mystuff.h_calc_bit_to_clear_info, rowinfo_size/sizeof(int), 1);
+  printArray("h_calc_bit_to_clear_info", mystuff->h_calc_bit_to_clear_info, rowinfo_size/sizeof(int), 1);
 #endif
 
   return status;
 }
 
 /* Run the CalcBitToClear kernel
-__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CalcBitToClear (uint exponent, ulong k_base, __global int *calc_info, __global uchar *pinfo_dev)
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) CalcBitToClear (uint exponent, ulong k_base, __global int *calc_info, __global uchar *pinfo_dev,
+                                                                               const __global uint * restrict class_delta, uint pinfo_stride)
 
    numblocks and localThreads: correspond to cuda's numblocks and threadsPerBlock,
    run_event:                  can be used to synchronize the following calls.
    k_min:                      starting k for the calculation (passed to the kernel as k_base)
+   num_classes:                number of classes to calculate, starting at k_min + d_class_delta[i]
 */
-cl_int run_calc_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_ulong k_min)
+cl_int run_calc_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_ulong k_min, cl_uint num_classes)
 {
-  static cl_uint last_exponent = 0;
+  mystuff_t *mystuff = dev->mystuff;
+  cl_uint &last_exponent = dev->bit_to_clear_exponent;
   cl_int   status;
-  size_t   globalThreads = numblocks * localThreads;
+  size_t   globalThreads[2] = {numblocks * localThreads, num_classes};
+  size_t   localThreads2[2] = {localThreads, 1};
 
 #ifdef DETAILED_INFO
-    printf("run_calc_bit_to_clear: %d x %d = %d threads, exp=%u, k_min=%llu\n",
-        (int) numblocks, (int) localThreads, (int) globalThreads, mystuff.exponent, (long long unsigned int) k_min);
+    printf("run_calc_bit_to_clear: %d x %d = %d threads, exp=%u, k_min=%llu, %u classes\n",
+        (int) numblocks, (int) localThreads, (int) globalThreads[0], mystuff->exponent, (long long unsigned int) k_min, num_classes);
 #endif
 
-  if (last_exponent != mystuff.exponent) // only copy the exponent if it changed
+  if (last_exponent != mystuff->exponent) // only copy the exponent if it changed
   {
-    last_exponent = mystuff.exponent;
+    last_exponent = mystuff->exponent;
     if (last_exponent == 0) return 1; // only for resetting the last_exponent
-    status = clSetKernelArg(kernel_info[CL_CALC_BIT_TO_CLEAR].kernel,
+    status = clSetKernelArg(dev->kernel[CL_CALC_BIT_TO_CLEAR],
                     0,
                     sizeof(cl_uint),
-                    (void *)&mystuff.exponent);
+                    (void *)&mystuff->exponent);
     if(status != CL_SUCCESS)
     {
       std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (exp)\n";
       return 1;
     }
   }
-  status = clSetKernelArg(kernel_info[CL_CALC_BIT_TO_CLEAR].kernel,
+  status = clSetKernelArg(dev->kernel[CL_CALC_BIT_TO_CLEAR],
                     1,
                     sizeof(cl_ulong),
                     (void *)&k_min);
@@ -1557,15 +2750,15 @@ cl_int run_calc_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *r
   }
 
 #ifdef CL_PERFORMANCE_INFO
-  if (run_event == NULL) run_event = &mystuff.copy_events[0];  // When checking performance, we need an event to monitor.
+  if (run_event == NULL) run_event = &mystuff->copy_events[0];  // When checking performance, we need an event to monitor.
 #endif
 
   status = clEnqueueNDRangeKernel(QUEUE,
-                 kernel_info[CL_CALC_BIT_TO_CLEAR].kernel,
-                 1,
+                 dev->kernel[CL_CALC_BIT_TO_CLEAR],
+                 (num_classes > 1) ? 2 : 1,
                  NULL,
-                 &globalThreads,
-                 &localThreads,
+                 globalThreads,
+                 localThreads2,
                  0,
                  NULL,
                  run_event);
@@ -1600,20 +2793,20 @@ cl_int run_calc_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *r
     std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(endTime)\n";
     return RET_ERROR;
   }
-  std::cout<< "CalcBitToClear " << globalThreads << " primes: " << (endTime - startTime)/1e3 << " us ("
-                       << globalThreads * 1e3 / (endTime - startTime) << " M/s)\n" ;
-  clReleaseEvent(mystuff.copy_events[0]); // ignore errors: we may have use a different event
+  std::cout<< "CalcBitToClear " << globalThreads[0] * num_classes << " primes: " << (endTime - startTime)/1e3 << " us ("
+                       << globalThreads[0] * num_classes * 1e3 / (endTime - startTime) << " M/s)\n" ;
+  clReleaseEvent(mystuff->copy_events[0]); // ignore errors: we may have use a different event
 #endif
 
 #ifdef DETAILED_INFO
     // get mystuff.d_calc_bit_to_clear_info and d_sieve_info and print it
-  cl_uint info_size = MAX_PRIMES_PER_THREAD*4 * sizeof (cl_uint) + mystuff.sieve_primes * 8;
+  cl_uint info_size = MAX_PRIMES_PER_THREAD*4 * sizeof (cl_uint) + mystuff->sieve_primes * 8;
   status = clEnqueueReadBuffer(QUEUE,     // only for tracing/verification - not needed later.
-                mystuff.d_calc_bit_to_clear_info,
+                mystuff->d_calc_bit_to_clear_info,
                 CL_TRUE,
                 0,
                 info_size,
-                mystuff.h_calc_bit_to_clear_info,
+                mystuff->h_calc_bit_to_clear_info,
                 0,
                 NULL,
                 NULL);
@@ -1624,16 +2817,16 @@ cl_int run_calc_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *r
     return 1;
   }
 
-  printArray("h_calc_bit_to_clear_info", mystuff.h_calc_bit_to_clear_info, info_size/sizeof(int), 1);
+  printArray("h_calc_bit_to_clear_info", mystuff->h_calc_bit_to_clear_info, info_size/sizeof(int), 1);
 
-  info_size = mystuff.sieve_size;
+  info_size = mystuff->sieve_size;
 
   status = clEnqueueReadBuffer(QUEUE,     // only for tracing/verification - not needed later.
-                mystuff.d_sieve_info,
+                mystuff->d_sieve_info,
                 CL_TRUE,
                 0,
                 info_size,
-                mystuff.h_sieve_info,
+                mystuff->h_sieve_info,
                 0,
                 NULL,
                 NULL);
@@ -1644,33 +2837,318 @@ cl_int run_calc_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *r
     return 1;
   }
 
-  printArray("h_sieve_info", mystuff.h_sieve_info, info_size/sizeof(int), 1);
+  printArray("h_sieve_info", mystuff->h_sieve_info, info_size/sizeof(int), 1);
   //#endif
 #endif
 
   return 0;
 }
 
+/* Run the AdvanceBitToClear kernel
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) AdvanceBitToClear (uint advance, __global int *calc_info, __global uchar *pinfo_dev)
+
+   numblocks and localThreads: correspond to cuda's numblocks and threadsPerBlock,
+   run_event:                  can be used to synchronize the following calls.
+   advance:                    number of bits (k's of the class) to move the bit-to-clear values forward
+*/
+cl_int run_advance_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_uint advance)
+{
+  cl_int   status;
+  size_t   globalThreads = numblocks * localThreads;
+
+#ifdef DETAILED_INFO
+    printf("run_advance_bit_to_clear: %d x %d = %d threads, exp=%u, advance=%u\n",
+        (int) numblocks, (int) localThreads, (int) globalThreads, dev->mystuff->exponent, advance);
+#endif
+
+  status = clSetKernelArg(dev->kernel[CL_ADVANCE_BIT_TO_CLEAR],
+                    0,
+                    sizeof(cl_uint),
+                    (void *)&advance);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (advance)\n";
+    return 1;
+  }
+
+#ifdef CL_PERFORMANCE_INFO
+  if (run_event == NULL) run_event = &dev->mystuff->copy_events[0];  // When checking performance, we need an event to monitor.
+#endif
+
+  status = clEnqueueNDRangeKernel(QUEUE,
+                 dev->kernel[CL_ADVANCE_BIT_TO_CLEAR],
+                 1,
+                 NULL,
+                 &globalThreads,
+                 &localThreads,
+                 0,
+                 NULL,
+                 run_event);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Enqueuing kernel (clEnqueueNDRangeKernel) " << kernel_info[CL_ADVANCE_BIT_TO_CLEAR].kernelname << "\n";
+    return 1;
+  }
+
+#ifdef CL_PERFORMANCE_INFO
+  clFinish(QUEUE);
+  cl_ulong startTime=0;
+  cl_ulong endTime=1000;
+  /* Get kernel profiling info */
+  status = clGetEventProfilingInfo(*run_event,
+                                CL_PROFILING_COMMAND_START,
+                                sizeof(cl_ulong),
+                                &startTime,
+                                0);
+  if(status != CL_SUCCESS)
+   {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(startTime)\n";
+    return RET_ERROR;
+  }
+  status = clGetEventProfilingInfo(*run_event,
+                                CL_PROFILING_COMMAND_END,
+                                sizeof(cl_ulong),
+                                &endTime,
+                                0);
+  if(status != CL_SUCCESS)
+   {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(endTime)\n";
+    return RET_ERROR;
+  }
+  std::cout<< "AdvanceBitToClear " << globalThreads << " primes: " << (endTime - startTime)/1e3 << " us ("
+                       << globalThreads * 1e3 / (endTime - startTime) << " M/s)\n" ;
+  clReleaseEvent(dev->mystuff->copy_events[0]); // ignore errors: we may have use a different event
+#endif
+
+  return 0;
+}
+
+/* Run the BucketScatter kernel
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) BucketScatter (__global int *calc_info, __global uchar *pinfo_dev, uint pinfo_stride,
+                                                                              uint first_row, uint blocks_per_class, uint bucket_size,
+                                                                              __global uint *bucket_count, __global ushort *bucket_hits)
+
+   numrows and localThreads:   number of "rows" of bucket-sieved primes and the threads per row,
+   run_event:                  can be used to synchronize the following calls.
+   first_row:                  the first "row" of bucket-sieved primes (primes_per_thread)
+   blocks_per_class:           number of SegSieve blocks of each class
+   num_classes:                number of classes sieved together
+*/
+cl_int run_bucket_scatter(cl_uint numrows, size_t localThreads, cl_event *run_event, cl_uint first_row, cl_uint blocks_per_class, cl_uint num_classes)
+{
+  cl_int   status;
+  size_t   globalThreads[2] = {numrows * localThreads, num_classes};
+  size_t   localThreads2[2] = {localThreads, 1};
+
+#ifdef DETAILED_INFO
+    printf("run_bucket_scatter: %d x %d = %d threads, first_row=%u, blocks_per_class=%u, %u classes\n",
+        (int) numrows, (int) localThreads, (int) globalThreads[0], first_row, blocks_per_class, num_classes);
+#endif
+
+  status = clSetKernelArg(dev->kernel[CL_BUCKET_SCATTER],
+                    3,
+                    sizeof(cl_uint),
+                    (void *)&first_row);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (first_row)\n";
+    return 1;
+  }
+  status = clSetKernelArg(dev->kernel[CL_BUCKET_SCATTER],
+                    4,
+                    sizeof(cl_uint),
+                    (void *)&blocks_per_class);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (blocks_per_class)\n";
+    return 1;
+  }
+
+#ifdef CL_PERFORMANCE_INFO
+  if (run_event == NULL) run_event = &dev->mystuff->copy_events[0];  // When checking performance, we need an event to monitor.
+#endif
+
+  status = clEnqueueNDRangeKernel(QUEUE,
+                 dev->kernel[CL_BUCKET_SCATTER],
+                 (num_classes > 1) ? 2 : 1,
+                 NULL,
+                 globalThreads,
+                 localThreads2,
+                 0,
+                 NULL,
+                 run_event);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Enqueuing kernel (clEnqueueNDRangeKernel) " << kernel_info[CL_BUCKET_SCATTER].kernelname << "\n";
+    return 1;
+  }
+
+#ifdef CL_PERFORMANCE_INFO
+  clFinish(QUEUE);
+  cl_ulong startTime=0;
+  cl_ulong endTime=1000;
+  /* Get kernel profiling info */
+  status = clGetEventProfilingInfo(*run_event,
+                                CL_PROFILING_COMMAND_START,
+                                sizeof(cl_ulong),
+                                &startTime,
+                                0);
+  if(status != CL_SUCCESS)
+   {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(startTime)\n";
+    return RET_ERROR;
+  }
+  status = clGetEventProfilingInfo(*run_event,
+                                CL_PROFILING_COMMAND_END,
+                                sizeof(cl_ulong),
+                                &endTime,
+                                0);
+  if(status != CL_SUCCESS)
+   {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(endTime)\n";
+    return RET_ERROR;
+  }
+  std::cout<< "BucketScatter " << globalThreads[0] * num_classes << " primes: " << (endTime - startTime)/1e3 << " us ("
+                       << globalThreads[0] * num_classes * 1e3 / (endTime - startTime) << " M/s)\n" ;
+  clReleaseEvent(dev->mystuff->copy_events[0]); // ignore errors: we may have use a different event
+#endif
+
+  return 0;
+}
+
+/* Compact the candidates of the GPU sieve into a dense list for the GPU-sieve TF kernels (GPUSieveCompact=1)
+__kernel void CompactCount (const __global uint * restrict bit_array, const uint bits_to_process, __global uint * restrict slice_count)
+__kernel void CompactScan (__global uint * restrict slice_count, const uint num_slices, const uint slices_per_class, const uint bits_to_process,
+                           const uint list_size, __global uint * restrict list, __global uint * restrict list_info)
+__kernel void CompactWrite (const __global uint * restrict bit_array, const uint bits_to_process, const __global uint * restrict slice_offset,
+                            const uint list_size, __global uint * restrict list)
+
+   num_slices:                 number of TF slices (gpu_sieve_processing_size bits each) in the bit array
+   slices_per_class:           number of TF slices of each class (num_slices if there is only one class)
+   list_info:                  receives the number of TF blocks, the number of candidates and the overflow flag.
+                               This is a blocking read: the TF kernels need the number of blocks.
+*/
+cl_int run_compact_candidates(cl_uint num_slices, cl_uint slices_per_class, cl_uint *list_info)
+{
+  mystuff_t *mystuff = dev->mystuff;
+  cl_int   status;
+  size_t   globalThreads = num_slices * 256;
+  size_t   localThreads = 256;
+
+#ifdef DETAILED_INFO
+    printf("run_compact_candidates: %u slices, %u per class\n", num_slices, slices_per_class);
+#endif
+
+  status = clSetKernelArg(dev->kernel[CL_COMPACT_COUNT],
+                    1,
+                    sizeof(cl_uint),
+                    (void *)&mystuff->gpu_sieve_processing_size);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_processing_size)\n";
+    return 1;
+  }
+  status = clSetKernelArg(dev->kernel[CL_COMPACT_SCAN],
+                    1,
+                    sizeof(cl_uint),
+                    (void *)&num_slices);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (num_slices)\n";
+    return 1;
+  }
+  status = clSetKernelArg(dev->kernel[CL_COMPACT_SCAN],
+                    2,
+                    sizeof(cl_uint),
+                    (void *)&slices_per_class);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (slices_per_class)\n";
+    return 1;
+  }
+  status = clSetKernelArg(dev->kernel[CL_COMPACT_SCAN],
+                    3,
+                    sizeof(cl_uint),
+                    (void *)&mystuff->gpu_sieve_processing_size);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_processing_size)\n";
+    return 1;
+  }
+  status = clSetKernelArg(dev->kernel[CL_COMPACT_WRITE],
+                    1,
+                    sizeof(cl_uint),
+                    (void *)&mystuff->gpu_sieve_processing_size);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_processing_size)\n";
+    return 1;
+  }
+
+  status = clEnqueueNDRangeKernel(QUEUE, dev->kernel[CL_COMPACT_COUNT], 1, NULL, &globalThreads, &localThreads, 0, NULL, NULL);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Enqueuing kernel (clEnqueueNDRangeKernel) " << kernel_info[CL_COMPACT_COUNT].kernelname << "\n";
+    return 1;
+  }
+  status = clEnqueueNDRangeKernel(QUEUE, dev->kernel[CL_COMPACT_SCAN], 1, NULL, &localThreads, &localThreads, 0, NULL, NULL);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Enqueuing kernel (clEnqueueNDRangeKernel) " << kernel_info[CL_COMPACT_SCAN].kernelname << "\n";
+    return 1;
+  }
+  status = clEnqueueNDRangeKernel(QUEUE, dev->kernel[CL_COMPACT_WRITE], 1, NULL, &globalThreads, &localThreads, 0, NULL, NULL);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Enqueuing kernel (clEnqueueNDRangeKernel) " << kernel_info[CL_COMPACT_WRITE].kernelname << "\n";
+    return 1;
+  }
+
+  status = clEnqueueReadBuffer(QUEUE,
+                mystuff->d_compact_info,
+                CL_TRUE,
+                0,
+                3 * sizeof(cl_uint),
+                list_info,
+                0,
+                NULL,
+                NULL);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Reading d_compact_info (clEnqueueReadBuffer)\n";
+    return 1;
+  }
+
+#ifdef DETAILED_INFO
+    printf("run_compact_candidates: %u candidates in %u TF blocks%s\n", list_info[1], list_info[0], list_info[2] ? ", list overflow" : "");
+#endif
+
+  return 0;
+}
+
 /* Run the SegSieve kernel
-__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) SegSieve (__global uchar *big_bit_array_dev, __global uchar *pinfo_dev, uint maxp)
+__kernel void __attribute__((reqd_work_group_size(256, 1, 1))) SegSieve (__global uchar *big_bit_array_dev, __global uchar *pinfo_dev, uint maxp,
+                                                                         uint blocks_per_class, uint pinfo_stride, uint bucket_size,
+                                                                         __global uint *bucket_count, const __global ushort * restrict bucket_hits)
 
    numblocks and localThreads: correspond to cuda's numblocks and threadsPerBlock,
    run_event:                  can be used to synchronize the following calls.
    maxp:                       numer of primes per thread (passed to the kernel as maxp)
+   blocks_per_class:           number of blocks of each class (numblocks if there is only one class)
 */
-cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_uint maxp)
+cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_uint maxp, cl_uint blocks_per_class)
 {
   cl_int         status;
   size_t         globalThreads = numblocks * localThreads;
 
 #ifdef DETAILED_INFO
     printf("run_cl_sieve: %d x %d = %d threads, exp=%u, maxp=%d\n",
-        (int) numblocks, (int) localThreads, (int) globalThreads, mystuff.exponent, maxp);
+        (int) numblocks, (int) localThreads, (int) globalThreads, dev->mystuff->exponent, maxp);
 #endif
 
   if (0xFFFFFFFF != maxp) // only copy primes-per-thread if it changed, otherwise this function receives 0xFFFFFFFF as "unchanged"
   {
-    status = clSetKernelArg(kernel_info[CL_SIEVE].kernel,
+    status = clSetKernelArg(dev->kernel[CL_SIEVE],
                     2,
                     sizeof(cl_uint),
                     (void *)&maxp);
@@ -1680,13 +3158,22 @@ cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event,
       return 1;
     }
   }
+  status = clSetKernelArg(dev->kernel[CL_SIEVE],
+                  3,
+                  sizeof(cl_uint),
+                  (void *)&blocks_per_class);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (blocks_per_class)\n";
+    return 1;
+  }
 
 #ifdef CL_PERFORMANCE_INFO
-  if (run_event == NULL) run_event = &mystuff.copy_events[0];  // When checking performance, we need an event to monitor.
+  if (run_event == NULL) run_event = &dev->mystuff->copy_events[0];  // When checking performance, we need an event to monitor.
 #endif
 
   status = clEnqueueNDRangeKernel(QUEUE,
-                 kernel_info[CL_SIEVE].kernel,
+                 dev->kernel[CL_SIEVE],
                  1,
                  NULL,
                  &globalThreads,
@@ -1728,20 +3215,20 @@ cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event,
   }
   std::cout<< "sieve using " << globalThreads << " threads: " << (endTime - startTime)/1e6 << " ms ("
                        << globalThreads * 1e3 / (endTime - startTime) << " M/s), " <<
-                       mystuff.gpu_sieve_size * 1e3 / (endTime - startTime) << " M FCs/s sieved\n";
-  clReleaseEvent(mystuff.copy_events[0]);
+                       dev->mystuff->gpu_sieve_size * 1e3 / (endTime - startTime) << " M FCs/s sieved\n";
+  clReleaseEvent(dev->mystuff->copy_events[0]);
 #endif
 
 #ifdef DETAILED_INFO
-  //mystuff->d_bitarray, (cl_uchar *)mystuff->d_sieve_info
-  cl_uint info_size = mystuff.sieve_size;
+  //dev->mystuff->d_bitarray, (cl_uchar *)dev->mystuff->d_sieve_info
+  cl_uint info_size = dev->mystuff->sieve_size;
 
   status = clEnqueueReadBuffer(QUEUE,     // only for tracing/verification - not needed later.
-                mystuff.d_sieve_info,
+                dev->mystuff->d_sieve_info,
                 CL_TRUE,
                 0,
                 info_size,
-                mystuff.h_sieve_info,
+                dev->mystuff->h_sieve_info,
                 0,
                 NULL,
                 NULL);
@@ -1752,16 +3239,16 @@ cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event,
     return 1;
   }
 
-  printArray("h_sieve_info", mystuff.h_sieve_info, info_size/sizeof(int), 1);
+  printArray("h_sieve_info", dev->mystuff->h_sieve_info, info_size/sizeof(int), 1);
 
-  info_size = mystuff.gpu_sieve_size / 8;
+  info_size = dev->mystuff->gpu_sieve_size / 8;
 
   status = clEnqueueReadBuffer(QUEUE,     // only for tracing/verification - not needed later.
-                mystuff.d_bitarray,
+                dev->mystuff->d_bitarray,
                 CL_TRUE,
                 0,
                 info_size,
-                mystuff.h_bitarray,
+                dev->mystuff->h_bitarray,
                 0,
                 NULL,
                 NULL);
@@ -1772,7 +3259,7 @@ cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event,
     return 1;
   }
 
-  printArray("h_bitarray", mystuff.h_bitarray, info_size/sizeof(int), 1);
+  printArray("h_bitarray", dev->mystuff->h_bitarray, info_size/sizeof(int), 1);
 #endif
 
   return 0;
@@ -1780,6 +3267,7 @@ cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event,
 
 int run_mod_kernel(cl_ulong hi, cl_ulong lo, cl_ulong q, cl_float qr, cl_ulong *res_hi, cl_ulong *res_lo)
 {
+  mystuff_t *mystuff = dev->mystuff;
 /* __kernel void mod_128_64_k(const ulong hi, const ulong lo, const ulong q, const float qr, __global ulong *res
 #if (TRACE_KERNEL > 1)
                   , __private uint tid
@@ -1791,7 +3279,9 @@ int run_mod_kernel(cl_ulong hi, cl_ulong lo, cl_ulong q, cl_float qr, cl_ulong *
 
   *res_hi = *res_lo = 0;
 
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  if (load_kernel(_TEST_MOD_)) return 1;
+
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     0,
                     sizeof(cl_ulong),
                     (void *)&hi);
@@ -1800,7 +3290,7 @@ int run_mod_kernel(cl_ulong hi, cl_ulong lo, cl_ulong q, cl_float qr, cl_ulong *
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (hi)\n";
     return 1;
   }
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     1,
                     sizeof(cl_ulong),
                     (void *)&lo);
@@ -1809,7 +3299,7 @@ int run_mod_kernel(cl_ulong hi, cl_ulong lo, cl_ulong q, cl_float qr, cl_ulong *
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (lo)\n";
     return 1;
   }
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     2,
                     sizeof(cl_ulong),
                     (void *)&q);
@@ -1818,7 +3308,7 @@ int run_mod_kernel(cl_ulong hi, cl_ulong lo, cl_ulong q, cl_float qr, cl_ulong *
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (q)\n";
     return 1;
   }
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     3,
                     sizeof(cl_float),
                     (void *)&qr);
@@ -1827,23 +3317,23 @@ int run_mod_kernel(cl_ulong hi, cl_ulong lo, cl_ulong q, cl_float qr, cl_ulong *
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (qr)\n";
     return 1;
   }
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     4,
                     sizeof(cl_mem),
-                    (void *)&mystuff.d_RES);
+                    (void *)&mystuff->d_RES);
   if(status != CL_SUCCESS)
   {
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (RES)\n";
     return 1;
   }
   // dummy arg if KERNEL_TRACE is enabled: ignore errors if not.
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     5,
                     sizeof(cl_uint),
                     (void *)&status);
 
   status = clEnqueueTask(QUEUE,
-                 kernel_info[_TEST_MOD_].kernel,
+                 dev->kernel[_TEST_MOD_],
                  0,
                  NULL,
                  &mod_evt);
@@ -1893,11 +3383,11 @@ int run_mod_kernel(cl_ulong hi, cl_ulong lo, cl_ulong q, cl_float qr, cl_ulong *
     return 1;
   }
   status = clEnqueueReadBuffer(QUEUE,
-                mystuff.d_RES,
+                mystuff->d_RES,
                 CL_TRUE,
                 0,
                 32 * sizeof(int),
-                mystuff.h_RES,
+                mystuff->h_RES,
                 0,
                 NULL,
                 NULL);
@@ -1907,8 +3397,8 @@ int run_mod_kernel(cl_ulong hi, cl_ulong lo, cl_ulong q, cl_float qr, cl_ulong *
     std::cout << "Error " << status << " (" << ClErrorString(status) << "): clEnqueueReadBuffer RES failed. (clEnqueueReadBuffer)\n";
     return 1;
   }
-  *res_hi = mystuff.h_RES[0];
-  *res_lo = mystuff.h_RES[1];
+  *res_hi = mystuff->h_RES[0];
+  *res_lo = mystuff->h_RES[1];
 
   return 0;
 
@@ -1939,7 +3429,7 @@ __kernel void barrett15_73(__private uint exp, const int75_t k_base, const __glo
   ///////
 
   // first set the specific params that don't change per block: b_preinit, shiftcount, RES
-  if (new_class)
+  if (dev->new_class)
   {
     status = clSetKernelArg(l_kernel,
                     3,
@@ -1973,7 +3463,7 @@ __kernel void barrett15_73(__private uint exp, const int75_t k_base, const __glo
       status = clSetKernelArg(l_kernel,
                     7,
                     sizeof(cl_mem),
-                    (void *)&mystuff.d_modbasecase_debug);
+                    (void *)&dev->mystuff->d_modbasecase_debug);
       if(status != CL_SUCCESS)
       {
         std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_modbasecase_debug)\n";
@@ -2029,7 +3519,7 @@ int run_kernel24(cl_kernel l_kernel, cl_uint exp, int72 k_base, int stream, int1
 
 */
   //////// test test test ...
-  // {k_min_grid[i] = 1777608657747ULL; mystuff->h_ktab[i][0]=0;}
+  // {k_min_grid[i] = 1777608657747ULL; dev->mystuff->h_ktab[i][0]=0;}
   // k_base.d2=0;
   // k_base.d1=0;
   // k_base.d0=1;
@@ -2037,7 +3527,7 @@ int run_kernel24(cl_kernel l_kernel, cl_uint exp, int72 k_base, int stream, int1
   ///////
 
   // first set the specific params that don't change per block: b_preinit, shiftcount, RES
-  if (new_class)
+  if (dev->new_class)
   {
     status = clSetKernelArg(l_kernel,
                     3,
@@ -2068,12 +3558,12 @@ int run_kernel24(cl_kernel l_kernel, cl_uint exp, int72 k_base, int stream, int1
       return 1;
     }
 #ifdef CHECKS_MODBASECASE
-    if ((kernel_info[_71BIT_MUL24].kernel == l_kernel) || (kernel_info[_63BIT_MUL24].kernel == l_kernel))
+    if ((dev->kernel[_71BIT_MUL24] == l_kernel) || (dev->kernel[_63BIT_MUL24] == l_kernel))
     {
       status = clSetKernelArg(l_kernel,
                     6,
                     sizeof(cl_mem),
-                    (void *)&mystuff.d_modbasecase_debug);
+                    (void *)&dev->mystuff->d_modbasecase_debug);
       if(status != CL_SUCCESS)
       {
         std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_modbasecase_debug)\n";
@@ -2112,7 +3602,7 @@ int run_kernel64(cl_kernel l_kernel, cl_uint exp, cl_ulong k_base, int stream, c
   cl_int   status;
   /* __kernel void mfakto_cl_95(uint exp, ulong k, __global uint *k_tab, ulong4 b_pre_shift, int bit_max64, __global uint *RES) */
   // first set the specific params that don't change per block: b_pre_shift, bin_min63
-  if (new_class)
+  if (dev->new_class)
   {
     status = clSetKernelArg(l_kernel,
                     3,
@@ -2161,7 +3651,7 @@ int run_barrett_kernel32(cl_kernel l_kernel, cl_uint exp, int96 k_base, int stre
   /* __kernel void cl_barrett32_79(__private uint exp, __private int96 k, __global uint *k_tab,
          __private int shiftcount, __private int192_v b, __global uint *RES, __private int bit_max64) */
   // first set the specific params that don't change per block: b_pre_shift, bin_min63
-  if (new_class)
+  if (dev->new_class)
   {
     status = clSetKernelArg(l_kernel,
                     3,
@@ -2206,7 +3696,7 @@ int run_barrett_kernel32(cl_kernel l_kernel, cl_uint exp, int96 k_base, int stre
     status = clSetKernelArg(l_kernel,
                     7,
                     sizeof(cl_mem),
-                    (void *)&mystuff.d_modbasecase_debug);
+                    (void *)&dev->mystuff->d_modbasecase_debug);
     if(status != CL_SUCCESS)
     {
        std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_modbasecase_debug)\n";
@@ -2235,35 +3725,75 @@ int run_barrett_kernel32(cl_kernel l_kernel, cl_uint exp, int96 k_base, int stre
   return run_kernel(l_kernel, exp, stream, res);
 }
 
-int run_kernel(cl_kernel l_kernel, cl_uint exp, int stream, cl_mem res)
+/* set the k_tab argument (2) to d_ktab[stream] and start the grid(s) in it */
+static int enqueue_ktab_kernel(cl_kernel l_kernel, int stream)
 {
+  mystuff_t *mystuff = dev->mystuff;
   cl_int   status;
-  cl_mem   k_tab = mystuff.d_ktab[stream];
+  cl_mem   k_tab = mystuff->d_ktab[stream];
   size_t   globalThreads;
   size_t   localThreads;
-  size_t   total_threads = mystuff.threads_per_grid;
+  size_t   total_threads = mystuff->threads_per_grid;
+  cl_event wait_list[2];
+  cl_uint  num_wait = 0;
 
   // adjust for vector kernels: each thread processes 1-16 FC's, use accordingly less threads
-  total_threads /= mystuff.vectorsize;
+  total_threads /= mystuff->vectorsize;
 
   globalThreads = total_threads;
-  localThreads  = (total_threads > deviceinfo.maxThreadsPerBlock) ? deviceinfo.maxThreadsPerBlock : total_threads;  // PERF: test different sizes, also in combination with the __attribute__((reqd_work_group_size(X, Y, Z)))qualifier
+  localThreads  = (total_threads > dev->deviceinfo.maxThreadsPerBlock) ? dev->deviceinfo.maxThreadsPerBlock : total_threads;  // PERF: test different sizes, also in combination with the __attribute__((reqd_work_group_size(X, Y, Z)))qualifier
 
-  // first set the params that don't change per block: exp, RES
-  if (new_class)
+  status = clSetKernelArg(l_kernel,
+                    2,
+                    sizeof(cl_mem),
+                    (void *)&k_tab);
+  if(status != CL_SUCCESS)
   {
-    status = clSetKernelArg(l_kernel,
-                    0,
-                    sizeof(cl_uint),
-                    (void *) &exp);
-    if(status != CL_SUCCESS)
-    {
-      std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (exp)\n";
-      return 1;
-    }
+    std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (k_tab)\n";
+    return 1;
+  }
 
-    /* the output array to the kernel */
-    status = clSetKernelArg(l_kernel,
+  // QUEUE may be out-of-order and the uploads are on XFER_QUEUE: wait explicitly
+  wait_list[num_wait++] = mystuff->copy_events[stream];  // the k_tab write or unmap (ktab_to_device)
+  if (dev->host->tf_pipe.cleared != NULL) wait_list[num_wait++] = dev->host->tf_pipe.cleared;  // the reset of RES
+
+  status = clEnqueueNDRangeKernel(QUEUE,
+                 l_kernel,
+                 1,
+                 NULL,
+                 &globalThreads,
+                 &localThreads,
+                 num_wait,
+                 num_wait ? wait_list : NULL,
+                 &mystuff->exec_events[stream]);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Enqueuing kernel (clEnqueueNDRangeKernel), stream " << stream << "\n";
+    return 1;
+  }
+  clFlush(QUEUE);
+  return 0;
+}
+
+int run_kernel(cl_kernel l_kernel, cl_uint exp, int stream, cl_mem res)
+{
+  cl_int   status;
+
+  // first set the params that don't change per block: exp, RES
+  if (dev->new_class)
+  {
+    status = clSetKernelArg(l_kernel,
+                    0,
+                    sizeof(cl_uint),
+                    (void *) &exp);
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (exp)\n";
+      return 1;
+    }
+
+    /* the output array to the kernel */
+    status = clSetKernelArg(l_kernel,
                     5,
                     sizeof(cl_mem),
                     (void *)&res);
@@ -2273,38 +3803,133 @@ int run_kernel(cl_kernel l_kernel, cl_uint exp, int stream, cl_mem res)
       return 1;
     }
 
-    new_class = 0; // do not set these params again until a new class is started
+    dev->new_class = 0; // do not set these params again until a new class is started
   }
 
-  status = clSetKernelArg(l_kernel,
-                    2,
+  return enqueue_ktab_kernel(l_kernel, stream);
+}
+
+int run_kernel15_grids(cl_kernel l_kernel, const cl_uint *exps, const cl_ulong *k_bases, const cl_uint *jobs, cl_uint grids, int stream, cl_mem res, cl_int bin_max)
+/*
+  multi-grid kernels (cl_barrett15_*_grids): test the ktabs of grids grids in d_ktab[stream],
+  exps[g] and k_bases[g] are the exponent and k_base of grid g. The kernel sets up b_in from
+  the shiftcount of each grid. jobs[g] is the batch index of exps[g] (0 outside a batch), the
+  factors of grid g go to its result buffer at RES + RES_SIZE * jobs[g], see res_size().
+__kernel void cl_barrett15_73_grids(const uint16 exponents, const ulong16 k_bases, const __global uint * restrict k_tab,
+                           const uint16 shiftcounts, const uint16 jobs, const uint grids, __global uint * restrict RES, const int bit_max65
+#ifdef CHECKS_MODBASECASE
+         , __global uint * restrict modbasecase_debug
+#endif
+         )
+*/
+{
+  cl_int     status;
+  cl_uint16  exp_grid = {{0}}, shift_grid = {{0}}, job_grid = {{0}};
+  cl_ulong16 k_grid = {{0}};
+  cl_uint    g, ln2b;
+
+  for (g = 0; g < grids; g++)
+  {
+    exp_grid.s[g]   = exps[g];
+    job_grid.s[g]   = jobs[g];
+    shift_grid.s[g] = tf_shiftcount(exps[g], (cl_uint)bin_max + 65);
+    ln2b = exps[g] >> shift_grid.s[g];
+    if (ln2b < 60 || ln2b >= 180)
+    {
+      fprintf(stderr, "Pre-init (%u) out of range for M%u\n", ln2b, exps[g]);  // should not happen
+      return 1;
+    }
+    k_grid.s[g] = k_bases[g];
+  }
+
+  if (dev->new_class)
+  {
+    status = clSetKernelArg(l_kernel,
+                    6,
                     sizeof(cl_mem),
-                    (void *)&k_tab);
+                    (void *)&res);
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (res)\n";
+      return 1;
+    }
+    status = clSetKernelArg(l_kernel,
+                    7,
+                    sizeof(cl_int),
+                    (void *)&bin_max);
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (bit_max)\n";
+      return 1;
+    }
+#ifdef CHECKS_MODBASECASE
+    status = clSetKernelArg(l_kernel,
+                    8,
+                    sizeof(cl_mem),
+                    (void *)&dev->mystuff->d_modbasecase_debug);
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_modbasecase_debug)\n";
+      return 1;
+    }
+#endif
+    dev->new_class = 0;
+  }
+
+  // now the params that change every time
+  status = clSetKernelArg(l_kernel,
+                    0,
+                    sizeof(cl_uint16),
+                    (void *)&exp_grid);
   if(status != CL_SUCCESS)
   {
-    std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (k_tab)\n";
+    std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (exponents)\n";
     return 1;
   }
-
-  status = clEnqueueNDRangeKernel(QUEUE,
-                 l_kernel,
-                 1,
-                 NULL,
-                 &globalThreads,
-                 &localThreads,
-                 1,
-                 &mystuff.copy_events[stream], // wait for the k_tab write to finish
-                 &mystuff.exec_events[stream]);
+  status = clSetKernelArg(l_kernel,
+                    1,
+                    sizeof(cl_ulong16),
+                    (void *)&k_grid);
   if(status != CL_SUCCESS)
   {
-    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Enqueuing kernel (clEnqueueNDRangeKernel), stream " << stream << "\n";
+    std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (k_bases)\n";
     return 1;
   }
-  clFlush(QUEUE);
-  return 0;
+  status = clSetKernelArg(l_kernel,
+                    3,
+                    sizeof(cl_uint16),
+                    (void *)&shift_grid);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (shiftcounts)\n";
+    return 1;
+  }
+  status = clSetKernelArg(l_kernel,
+                    4,
+                    sizeof(cl_uint16),
+                    (void *)&job_grid);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (jobs)\n";
+    return 1;
+  }
+  status = clSetKernelArg(l_kernel,
+                    5,
+                    sizeof(cl_uint),
+                    (void *)&grids);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (grids)\n";
+    return 1;
+  }
+#ifdef DETAILED_INFO
+  printf("run_kernel15_grids: %u grids, M%u k_base[0]=%llu\n", grids, exps[0], (long long unsigned int) k_bases[0]);
+#endif
+
+  return enqueue_ktab_kernel(l_kernel, stream);
 }
 
-int run_gs_kernel15(cl_kernel kernel, cl_uint numblocks, cl_uint shared_mem_required, int75 k_base, cl_uint8 b_in, cl_uint shiftcount)
+int run_gs_kernel15(cl_kernel kernel, cl_uint numblocks, cl_uint blocks_per_class, cl_uint shared_mem_required, int75 k_base, cl_uint8 b_in, cl_uint shiftcount)
 {
   cl_int   status;
   /*
@@ -2316,7 +3941,7 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
          )
 */
   // first set the specific params that don't change per block: b_in
-  if (new_class)
+  if (dev->new_class)
   {
     status = clSetKernelArg(kernel,
                     6,
@@ -2348,10 +3973,10 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
   printf("run_gs_kernel15: k_base=%x:%x:%x\n", k_base.d2, k_base.d1, k_base.d0);
 #endif
 
-  return run_gs_kernel(kernel, numblocks, shared_mem_required, shiftcount);
+  return run_gs_kernel(kernel, numblocks, blocks_per_class, shared_mem_required, shiftcount);
 }
 
-int run_gs_kernel32(cl_kernel kernel, cl_uint numblocks, cl_uint shared_mem_required, int96 k_base, int192 b_preinit, cl_uint shiftcount)
+int run_gs_kernel32(cl_kernel kernel, cl_uint numblocks, cl_uint blocks_per_class, cl_uint shared_mem_required, int96 k_base, int192 b_preinit, cl_uint shiftcount)
 {
   cl_int   status;
   /*
@@ -2367,7 +3992,7 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
     cl_uint8 b_in={{b_preinit.d0, b_preinit.d1, b_preinit.d2, b_preinit.d3, b_preinit.d4, b_preinit.d5, 0, 0}};
 #endif
 
-  if (new_class)
+  if (dev->new_class)
   {
     status = clSetKernelArg(kernel,
                     6,
@@ -2404,15 +4029,20 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
   printf("run_gs_kernel32: k_base=%x:%x:%x\n", k_base.d2, k_base.d1, k_base.d0);
 #endif
 
-  return run_gs_kernel(kernel, numblocks, shared_mem_required, shiftcount);
+  return run_gs_kernel(kernel, numblocks, blocks_per_class, shared_mem_required, shiftcount);
 }
 
-/* set all generic parameters for GPU-sieve-aware TF kernels and start them */
-int run_gs_kernel(cl_kernel kernel, cl_uint numblocks, cl_uint shared_mem_required, cl_uint shiftcount)
+/* set all generic parameters for GPU-sieve-aware TF kernels and start them.
+   The numblocks blocks consist of one segment of blocks_per_class blocks per class, see tf_classes_opencl().
+   With GPUSieveCompact, numblocks is the number of chunks of the compacted candidate list (gpusieve_compact())
+   and blocks_per_class still the number of TF slices of each class in the bit array. */
+int run_gs_kernel(cl_kernel kernel, cl_uint numblocks, cl_uint blocks_per_class, cl_uint shared_mem_required, cl_uint shiftcount)
 {
+  mystuff_t *mystuff = dev->mystuff;
   /*
 __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const __global uint * restrict bit_array, const uint bits_to_process, __local ushort *smem, const int shiftcount,
-                           __private int192_t bb, __global uint * restrict RES, const int bit_max64, const uint shared_mem_allocated
+                           __private int192_t bb, __global uint * restrict RES, const int bit_max64, const uint shared_mem_allocated,
+                           const uint blocks_per_class, const __global uint * restrict class_delta
 #ifdef CHECKS_MODBASECASE
          , __global uint * restrict modbasecase_debug
 #endif
@@ -2422,10 +4052,10 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
   cl_int   status;
   size_t   globalThreads=numblocks*256;
   size_t   localThreads=256;
-  static cl_event run_event = NULL;
+  cl_event &run_event = dev->gs_run_event;
 #ifndef CL_PERFORMANCE_INFO
-  static cl_uint flush_counter=1;
-  static cl_uint event_step = MAX(1, mystuff.flush / 2); // When to set the event for waiting
+  cl_uint  &flush_counter = dev->gs_flush_counter;
+  cl_uint   event_step = MAX(1, mystuff->flush / 2); // When to set the event for waiting
   cl_event  *p_event = NULL;
 #endif
 
@@ -2433,9 +4063,11 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
 #ifdef DETAILED_INFO
   printf("run_gs_kernel: shared_mem: %u, loc/glob threads: %zu/%zu\n", shared_mem_required, localThreads, globalThreads);
 #endif
-  if (new_class)
+  if (numblocks == 0) return 0;  // GPUSieveCompact: no candidate survived the sieve
+
+  if (dev->new_class)
   {
-    new_class = 0;
+    dev->new_class = 0;
 #ifndef CL_PERFORMANCE_INFO
     flush_counter=1;
 #endif
@@ -2448,7 +4080,7 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
     status = clSetKernelArg(kernel,
                     0,
                     sizeof(cl_uint),
-                    (void *)&mystuff.exponent);
+                    (void *)&mystuff->exponent);
     if(status != CL_SUCCESS)
     {
       std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (exponent)\n";
@@ -2458,7 +4090,7 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
     status = clSetKernelArg(kernel,
                     2,
                     sizeof(cl_mem),
-                    (void *)&mystuff.d_bitarray);
+                    mystuff->gpu_sieve_compact ? (void *)&mystuff->d_compact_list : (void *)&mystuff->d_bitarray);
     if(status != CL_SUCCESS)
     {
       std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bitarray)\n";
@@ -2468,7 +4100,7 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
     status = clSetKernelArg(kernel,
                     3,
                     sizeof(cl_uint),
-                    (void *)&mystuff.gpu_sieve_processing_size);
+                    (void *)&mystuff->gpu_sieve_processing_size);
     if(status != CL_SUCCESS)
     {
       std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (gpu_sieve_processing_size)\n";
@@ -2498,14 +4130,14 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
     status = clSetKernelArg(kernel,
                     7,
                     sizeof(cl_mem),
-                    (void *)&mystuff.d_RES);
+                    (void *)&mystuff->d_RES);
     if(status != CL_SUCCESS)
     {
       std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_bitarray)\n";
       return 1;
     }
 
-    cl_uint tmp = mystuff.bit_max_stage - 65;
+    cl_uint tmp = mystuff->bit_max_stage - 65;
 
     status = clSetKernelArg(kernel,
                     8,
@@ -2527,11 +4159,21 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
       return 1;
     }
 
+    status = clSetKernelArg(kernel,
+                    11,
+                    sizeof(cl_mem),
+                    (void *)&mystuff->d_class_delta);
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_class_delta)\n";
+      return 1;
+    }
+
 #ifdef CHECKS_MODBASECASE
       status = clSetKernelArg(kernel,
-                    10,
+                    12,
                     sizeof(cl_mem),
-                    (void *)&mystuff.d_modbasecase_debug);
+                    (void *)&mystuff->d_modbasecase_debug);
       if(status != CL_SUCCESS)
       {
         std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (d_modbasecase_debug)\n";
@@ -2540,9 +4182,19 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
 #endif
   }
 
+  status = clSetKernelArg(kernel,
+                  10,
+                  sizeof(cl_uint),
+                  (void *)&blocks_per_class);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (blocks_per_class)\n";
+    return 1;
+  }
+
 #ifndef CL_PERFORMANCE_INFO
   // in PI mode, each kernel invocation gets an event and is immediately finished
-  if (mystuff.flush > 0 && flush_counter == event_step && run_event == NULL)
+  if (mystuff->flush > 0 && flush_counter == event_step && run_event == NULL)
   {
 //    putchar('S');
 //  in this loop, set an event that we can wait on in a later loop, but only if the event is not used yet
@@ -2579,7 +4231,7 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
 
 #ifndef CL_PERFORMANCE_INFO
   if (flush_counter == event_step) clFlush(QUEUE);
-  if (flush_counter == mystuff.flush)
+  if (flush_counter == mystuff->flush)
   {
     flush_counter = 0;
     if (run_event != NULL)
@@ -2629,7 +4281,7 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
   }
   std::cout<< "TF using " << globalThreads << " threads: " << (endTime - startTime)/1e6 << " ms ("
                        << globalThreads * 1e3 / (endTime - startTime) << " M/s), " <<
-                       mystuff.gpu_sieve_size * 1e3 / (endTime - startTime) << " M FCs/s TF'd (incl. sieving)\n";
+                       mystuff->gpu_sieve_size * 1e3 / (endTime - startTime) << " M FCs/s TF'd (incl. sieving)\n";
   clReleaseEvent(run_event);
   run_event = NULL;
 #endif
@@ -2638,7 +4290,284 @@ __kernel void cl_barrett32_77_gs(__private uint exp, const int96_t k_base, const
 }
 
 
-int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPUKernels use_kernel)
+static size_t res_size(const mystuff_t *mystuff)
+/* cl_uints of the result buffer of a class: in batch mode each exponent of the
+batch has its own RES_SIZE, the factors of exponent j start at RES_SIZE * j */
+{
+  return (mystuff->batch.num > 0) ? RES_SIZE * mystuff->batch.num : RES_SIZE;
+}
+
+
+static cl_int clear_results(mystuff_t *mystuff, cl_event *event)
+/* set the result array (and the modbasecase debug array) to 0. The fill of d_RES
+does not block, it is queued in front of the kernels of the class. If event is not
+NULL, it receives the event of the fill which the kernels have to wait for. */
+{
+  cl_int status;
+#ifdef CL_VERSION_1_2
+  const cl_uint zero = 0;
+
+  status = clEnqueueFillBuffer(QUEUE,
+                mystuff->d_RES,
+                &zero,
+                sizeof(zero),
+                0,
+                res_size(mystuff) * sizeof(cl_uint),
+                0,
+                NULL,
+                event);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Clearing d_RES (clEnqueueFillBuffer)\n";
+    return status;
+  }
+#else
+  static const cl_uint zero_RES[RES_SIZE_BATCH] = {0};
+
+  status = clEnqueueWriteBuffer(QUEUE,
+                mystuff->d_RES,
+                CL_FALSE,
+                0,
+                res_size(mystuff) * sizeof(cl_uint),
+                zero_RES,
+                0,
+                NULL,
+                event);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_RES (clEnqueueWriteBuffer)\n";
+    return status;
+  }
+#endif
+#ifdef CHECKS_MODBASECASE
+  /* set modbasecase_debug array to 0 */
+  memset(mystuff->h_modbasecase_debug,0,32 * sizeof(int));
+  status = clEnqueueWriteBuffer(QUEUE,
+                mystuff->d_modbasecase_debug,
+                CL_TRUE,
+                0,
+                32 * sizeof(int),
+                mystuff->h_modbasecase_debug,
+                0,
+                NULL,
+                NULL);
+  if(status != CL_SUCCESS)
+  {
+    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_modbasecase_debug (clEnqueueWriteBuffer)\n";
+    return status;
+  }
+#endif
+  return CL_SUCCESS;
+}
+
+
+#ifdef CHECKS_MODBASECASE
+static cl_int read_modbasecase_debug(mystuff_t *mystuff)
+/* wait for the queue and read the modbasecase debug array */
+{
+  cl_int status;
+  cl_uint i;
+
+  status = clEnqueueReadBuffer(QUEUE,
+                mystuff->d_modbasecase_debug,
+                CL_TRUE,
+                0,
+                32 * sizeof(int),
+                mystuff->h_modbasecase_debug,
+                0,
+                NULL,
+                NULL);
+
+  if(status != CL_SUCCESS)
+  {
+    std::cout << "Error " << status << " (" << ClErrorString(status) << "): clEnqueueReadBuffer modbasecase_debug failed.\n";
+    return status;
+  }
+
+#ifdef DETAILED_INFO
+  printArray("modbasecase_debug", mystuff->h_modbasecase_debug, 32, 0);
+#endif
+  for(i=0;i<32;i++)if(mystuff->h_modbasecase_debug[i] != 0)printf("h_modbasecase_debug[%2d] = %u\n", i, mystuff->h_modbasecase_debug[i]);
+  return CL_SUCCESS;
+}
+#endif
+
+
+static cl_int read_results(mystuff_t *mystuff)
+/* wait for the queue and read the result array (and the modbasecase debug array) */
+{
+  cl_int status;
+
+  status = clEnqueueReadBuffer(QUEUE,
+                mystuff->d_RES,
+                CL_TRUE,
+                0,
+                RES_SIZE * sizeof(cl_uint),
+                mystuff->h_RES,
+                0,
+                NULL,
+                NULL);
+
+  if(status != CL_SUCCESS)
+  {
+    std::cout << "Error " << status << " (" << ClErrorString(status) << "): clEnqueueReadBuffer RES failed.\n";
+    return status;
+  }
+
+  if (mystuff->verbosity > 2)
+  {
+    printArray("RES", mystuff->h_RES, 32, 0);
+  }
+#ifdef CHECKS_MODBASECASE
+  return read_modbasecase_debug(mystuff);
+#else
+  return CL_SUCCESS;
+#endif
+}
+
+
+static cl_uint gs_shared_mem_required(mystuff_t *mystuff)
+/* local memory for the candidates of one block of the GPU-sieve TF kernels */
+{
+  if (mystuff->gpu_sieve_compact) return 4;  // the TF kernels read the compacted candidate list, smem is not used
+
+  return mystuff->gpu_sieve_processing_size * sizeof (short) * gpusieve_survival_percent(mystuff) / 100;
+}
+
+
+static cl_int finish_stream(mystuff_t *mystuff, cl_uint i, cl_uint count)
+/* clean up stream i after its completion callback fired. count is the number
+of the current block, for the error message. */
+{
+  cl_int status = CL_SUCCESS, event_status = dev->host->stream_exec_status[i];
+#ifdef CL_PERFORMANCE_INFO
+  cl_ulong startTime=0;
+  cl_ulong endTime=1000;
+  /* Get kernel profiling info */
+  if (!mystuff->gpu_sieving)
+  {
+    status = clGetEventProfilingInfo(mystuff->copy_events[i],
+                      CL_PROFILING_COMMAND_START,
+                      sizeof(cl_ulong),
+                      &startTime,
+                      0);
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(startTime)\n";
+      return status;
+    }
+    status = clGetEventProfilingInfo(mystuff->copy_events[i],
+                      CL_PROFILING_COMMAND_END,
+                      sizeof(cl_ulong),
+                      &endTime,
+                      0);
+    if(status != CL_SUCCESS)
+    {
+      std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(endTime)\n";
+      return status;
+    }
+    printf("%d FCs copied in %2.2f ms (%4.2f MB/s), ", mystuff->threads_per_grid, (endTime - startTime)/1e6,
+            mystuff->threads_per_grid * sizeof(int) * 1e3 / (endTime - startTime) );
+  }
+  status = clGetEventProfilingInfo(mystuff->exec_events[i],
+                    CL_PROFILING_COMMAND_START,
+                    sizeof(cl_ulong),
+                    &startTime,
+                    0);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(startTime)\n";
+    return status;
+  }
+  status = clGetEventProfilingInfo(mystuff->exec_events[i],
+                    CL_PROFILING_COMMAND_END,
+                    sizeof(cl_ulong),
+                    &endTime,
+                    0);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(endTime)\n";
+    return status;
+  }
+  printf("proc'd in %2.2f ms (%3.2f M/s)\n", (endTime - startTime)/1e6, double(mystuff->threads_per_grid) *1e3/ (endTime - startTime));
+#endif
+  status = clReleaseEvent(mystuff->exec_events[i]);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Release exec event object. (clReleaseEvent)\n";
+    return status;
+  }
+  if (!mystuff->gpu_sieving) status = clReleaseEvent(mystuff->copy_events[i]);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Release copy event object. (clReleaseEvent)\n";
+    return status;
+  }
+  if (!mystuff->gpu_sieving) status = ktab_to_host(i);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Mapping h_ktab[" << i << "] (clEnqueueMapBuffer)\n";
+    return status;
+  }
+
+  if (event_status < CL_COMPLETE) // error
+  {
+    std::cerr<< "Error " << event_status << " (" << ClErrorString(event_status) << "): during execution of block " << count << " in h_ktab[" << i << "]\n";
+    return event_status;
+  }
+  return CL_SUCCESS;
+}
+
+
+static int drain_streams(mystuff_t *mystuff, cl_uint count)
+/* wait for the grids which are still on the streams and clean them up */
+{
+  cl_uint i;
+
+  while (dev->host->tf_pipe.running > 0)
+  {
+    dev->host->tf_pipe.completed |= dev->host->streams_completed.exchange(0);
+    for (i = 0; i < mystuff->num_streams; i++)
+    {
+      if (mystuff->stream_status[i] == RUNNING && (dev->host->tf_pipe.completed & (1U << i)))
+      {
+        dev->host->tf_pipe.completed &= ~(1U << i);
+        if (finish_stream(mystuff, i, count) != CL_SUCCESS) return RET_ERROR;
+        mystuff->stream_status[i] = UNUSED;
+        dev->host->tf_pipe.running--;
+      }
+    }
+    for (i = 0; (i < mystuff->num_streams) && (mystuff->stream_status[i] != RUNNING); i++) ;
+    if (i == mystuff->num_streams) dev->host->tf_pipe.running = 0;  // nothing is running, correct this if necessary
+    else if (dev->host->tf_pipe.running > 0 && dev->host->tf_pipe.completed == 0) wait_for_any_stream();
+  }
+  return 0;
+}
+
+
+/* batch mode: class cur_class of the exponent mystuff->batch.cur[job] follows, set up its
+   sieve and k range. The caller has done this for the first exponent (job 0). */
+static void batch_next_exponent(mystuff_t *mystuff, cl_uint cur_class, cl_uint job, cl_uint *exponent, cl_ulong *k_min, cl_ulong *k_max)
+{
+  cl_uint index = mystuff->batch.cur[job];
+
+  *exponent = mystuff->batch.exponent[index];
+  *k_min    = mystuff->batch.k_min[index] + cur_class;
+  *k_max    = mystuff->batch.k_max[index];
+  if (*k_max <= *k_min) *k_max = *k_min + 1;
+
+  if (mystuff->sieve_threads > 0)
+    sievepool_init_class(*exponent, *k_min, mystuff->sieve_primes);
+  else
+    sieve_init_class(mystuff->sieve_ctx, *exponent, *k_min, mystuff->sieve_primes);
+}
+
+
+int tf_class_opencl_start(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPUKernels use_kernel)
+/* queue all grids of a class, the last ones are still running when this returns.
+tf_class_opencl_wait() collects the results. Returns 0 or RET_ERROR.
+In batch mode the class of each exponent in mystuff->batch.cur[] is TF'd, k_min and k_max are
+those of the first one (mystuff->exponent), the others follow in the same launches. */
 {
   size_t size = mystuff->threads_per_grid * sizeof(int);
   int status, wait = 0;
@@ -2653,16 +4582,19 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
   int144 b_preinit = {0};
   int192 b_192 = {0};
   cl_uint8 b_in = {{0}};
-  int96  factor = {0}, prev_factor = {0};
-  cl_uint  factorsfound=0;
-  cl_uint  shiftcount, ln2b, count=1, shared_mem_required, numblocks;
+  cl_uint  shiftcount, ln2b, count=1, shared_mem_required, numblocks, tf_blocks;
   cl_ulong b_preinit_lo, b_preinit_mid, b_preinit_hi;
   cl_ulong k_diff, k_remaining;
-  char string[50];
-  int running=0;
+  cl_uint slot;
+  cl_event marker;
+  cl_uint launches = 0, max_grids = 1;
+  cl_uint exponent = mystuff->exponent, batch_class = (cl_uint)(k_min % mystuff->num_classes), batch_job = 0;
 
   int h_ktab_index = 0;
-  unsigned long long int k_min_grid[NUM_STREAMS_MAX];  // k_min_grid[N] contains the k_min for h_ktab[N], only valid for preprocessed h_ktab[]s
+  cl_ulong k_min_grid[NUM_STREAMS_MAX][GRIDS_PER_LAUNCH_MAX];  // k_min_grid[N][g] contains the k_min of grid g in h_ktab[N], only valid for preprocessed h_ktab[]s
+  cl_uint exp_grid[NUM_STREAMS_MAX][GRIDS_PER_LAUNCH_MAX];     // the exponent of grid g in h_ktab[N], see BatchExponents
+  cl_uint job_grid[NUM_STREAMS_MAX][GRIDS_PER_LAUNCH_MAX];     // its index in the batch, selects the result buffer
+  cl_uint num_grids[NUM_STREAMS_MAX];  // grids in h_ktab[N]
 
   timer_init(&timer);
 #ifdef DETAILED_INFO
@@ -2672,48 +4604,25 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
 
   //  mystuff->exponent=51152869; k_min=20582854459640ULL; k_max=20582854459641ULL;  // test test test
 
-  new_class=1; // tell run_kernel to re-submit the one-time kernel arguments
-  if ( k_max <= k_min) k_max = k_min + 1;  // otherwise it would skip small bit ranges
-
-  /* set result array to 0 */
-  memset(mystuff->h_RES,0,32 * sizeof(int));
-  status = clEnqueueWriteBuffer(QUEUE,
-                mystuff->d_RES,
-                CL_TRUE,          // Wait for completion; it's fast to copy 128 bytes ;-)
-                0,
-                32 * sizeof(int),
-                mystuff->h_RES,
-                0,
-                NULL,
-                NULL);
-  if(status != CL_SUCCESS)
-  {
-    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_RES (clEnqueueWriteBuffer)\n";
-    return RET_ERROR; // # factors found ;-)
-  }
-#ifdef CHECKS_MODBASECASE
-  /* set modbasecase_debug array to 0 */
-  memset(mystuff->h_modbasecase_debug,0,32 * sizeof(int));
-  status = clEnqueueWriteBuffer(QUEUE,
-                mystuff->d_modbasecase_debug,
-                CL_TRUE,
-                0,
-                32 * sizeof(int),
-                mystuff->h_modbasecase_debug,
-                0,
-                NULL,
-                NULL);
-  if(status != CL_SUCCESS)
+  if (dev->host->tf_pipe.in_flight >= TF_PIPELINE_DEPTH)
   {
-    std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_modbasecase_debug (clEnqueueWriteBuffer)\n";
-    return RET_ERROR; // # factors found ;-)
+    fprintf(stderr, "Programming error: %u classes in flight, collect one with tf_class_opencl_wait() first\n", dev->host->tf_pipe.in_flight);
+    return RET_ERROR;
   }
-#endif
+  slot = dev->host->tf_pipe.next;
+  mystuff->d_RES = dev->host->tf_pipe.d_RES[slot];
+  dev->new_class=1; // tell run_kernel to re-submit the one-time kernel arguments, including d_RES
+  if ( k_max <= k_min) k_max = k_min + 1;  // otherwise it would skip small bit ranges
+
+  if (clear_results(mystuff, &dev->host->tf_pipe.cleared) != CL_SUCCESS) return RET_ERROR;
 
-  for(i=0; i<mystuff->num_streams; i++)
+  for(i=0; i<mystuff->num_streams; i++) k_min_grid[i][0] = 0;
+  if (mystuff->gpu_sieving == 0) max_grids = launch_grids(use_kernel);
+  if (dev->host->tf_pipe.running == 0)  // otherwise the streams still run grids of the previous class
   {
-    mystuff->stream_status[i] = UNUSED;
-    k_min_grid[i] = 0;
+    for(i=0; i<mystuff->num_streams; i++) mystuff->stream_status[i] = UNUSED;
+    dev->host->streams_completed = 0;
+    dev->host->tf_pipe.completed = 0;
   }
 
   shiftcount=10;  // no exp below 2^10 ;-)
@@ -2778,25 +4687,11 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
 
   // combine for more efficient passing of parameters
   cl_ulong4 b_preinit4 = {{b_preinit_lo, b_preinit_mid, b_preinit_hi, (cl_ulong)shiftcount-1}};
-#ifdef RAW_GPU_BENCH
-  shared_mem_required = 100;            // no sieving = 100%
-#else
-  if (mystuff->sieve_primes < 54) shared_mem_required = 100;  // no sieving = 100%
-  else if (mystuff->sieve_primes < 310) shared_mem_required = 50;  // 54 primes expect 48.30%
-  else if (mystuff->sieve_primes < 1846) shared_mem_required = 38;  // 310 primes expect 35.50%
-  else if (mystuff->sieve_primes < 21814) shared_mem_required = 30;  // 1846 primes expect 28.10%
-  else if (mystuff->sieve_primes < 34101) shared_mem_required = 24;  // 21814 primes expect 21.93%
-  else if (mystuff->sieve_primes < 63797) shared_mem_required = 23;  // 34101 primes expect 20.94%
-  else if (mystuff->sieve_primes < 115253) shared_mem_required = 22;    // 63797 primes expect 19.87%
-  else if (mystuff->sieve_primes < 239157) shared_mem_required = 21;    // 115253 primes expect 18.98%
-  else if (mystuff->sieve_primes < 550453) shared_mem_required = 20;    // 239257 primes expect 17.99%
-  else shared_mem_required = 19;          // 550453 primes expect 16.97%
-#endif
-  shared_mem_required = mystuff->gpu_sieve_processing_size * sizeof (short) * shared_mem_required / 100;
+  shared_mem_required = gs_shared_mem_required(mystuff);
 
-  while((k_min <= k_max) || (running > 0))
+  while(k_min <= k_max)  // the last grids of the class are left running
   {
-    h_ktab_index = count % mystuff->num_streams;
+    h_ktab_index = (dev->host->tf_pipe.first_stream + launches) % mystuff->num_streams;  // round robin across the classes
 
 /* preprocessing: calculate a ktab (factor table) */
     if((mystuff->stream_status[h_ktab_index] == UNUSED) && (k_min <= k_max))  // if we have an empty h_ktab we can preprocess another one
@@ -2807,26 +4702,38 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
 
       if (mystuff->gpu_sieving == 0)
       {
-        sieve_candidates(mystuff->threads_per_grid, mystuff->h_ktab[h_ktab_index], mystuff->sieve_primes);
-        k_diff=mystuff->h_ktab[h_ktab_index][mystuff->threads_per_grid-1]+1;
-        k_diff*=NUM_CLASSES;        /* NUM_CLASSES because classes are mod NUM_CLASSES */
-
-        k_min_grid[h_ktab_index] = k_min;
-        /* try upload ktab*/
-
-        status = clEnqueueWriteBuffer(QUEUE,
-                  mystuff->d_ktab[h_ktab_index],
-                  CL_FALSE,
-                  0,
-                  size,
-                  mystuff->h_ktab[h_ktab_index],
-                  0,
-                  NULL,
-                  &mystuff->copy_events[h_ktab_index]);
+        /* multi-grid kernels: the grids of one launch follow each other in h_ktab */
+        num_grids[h_ktab_index] = 0;
+        do
+        {
+          cl_uint *ktab = mystuff->h_ktab[h_ktab_index] + (size_t)num_grids[h_ktab_index] * mystuff->threads_per_grid;
+
+          if (mystuff->sieve_threads > 0)
+            sievepool_candidates(mystuff->threads_per_grid, ktab);
+          else
+            sieve_candidates(mystuff->sieve_ctx, mystuff->threads_per_grid, ktab, mystuff->sieve_primes);
+          k_diff=ktab[mystuff->threads_per_grid-1]+1;
+          k_diff*=NUM_CLASSES;        /* NUM_CLASSES because classes are mod NUM_CLASSES */
+
+          exp_grid[h_ktab_index][num_grids[h_ktab_index]] = exponent;
+          job_grid[h_ktab_index][num_grids[h_ktab_index]] = (mystuff->batch.num > 0) ? mystuff->batch.cur[batch_job] : 0;
+          k_min_grid[h_ktab_index][num_grids[h_ktab_index]++] = k_min;
+          k_min += (unsigned long long int)k_diff;
+
+          /* batch: the next exponent that needs this class goes on in the same launch */
+          if (k_min > k_max && batch_job + 1 < mystuff->batch.num_cur)
+            batch_next_exponent(mystuff, batch_class, ++batch_job, &exponent, &k_min, &k_max);
+        } while (num_grids[h_ktab_index] < max_grids && k_min <= k_max);
+#ifdef DETAILED_INFO
+        printf("k-base: %llu, ", (long long unsigned int) k_min_grid[h_ktab_index][0]);
+        printArray("ktab", mystuff->h_ktab[h_ktab_index], mystuff->threads_per_grid, 0);
+#endif
 
+        /* upload ktab, zero-copy: the sieve already wrote it into d_ktab, unmap it */
+        status = ktab_to_device(h_ktab_index, size * num_grids[h_ktab_index]);
         if(status != CL_SUCCESS)
         {
-            std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_ktab (clEnqueueWriteBuffer)\n";
+            std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_ktab (ktab_to_device)\n";
             return RET_ERROR; // # factors found ;-)
         }
       }
@@ -2893,6 +4800,10 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
           i, mystuff->gpu_sieve_size/32, pos, ind, (double) ind * 100.0 / (double) pos, peak, mystuff->sieve_primes);
 #endif
         // Now let the GPU trial factor the candidates that survived the sieving
+        // (GPUSieveCompact: one TF block per chunk of the compacted candidate list)
+
+        tf_blocks = numblocks;
+        if (mystuff->gpu_sieve_compact && gpusieve_compact(mystuff, numblocks, numblocks, &tf_blocks)) return RET_ERROR;
 
         if (use_kernel >= BARRETT73_MUL15_GS && use_kernel <= BARRETT74_MUL15_GS)
         {
@@ -2902,7 +4813,7 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
           k_base.d2 = (k_min >> 30) & 0x7FFF;
           k_base.d3 = (k_min >> 45) & 0x7FFF;
           k_base.d4 =  k_min >> 60;
-          status = run_gs_kernel15(kernel_info[use_kernel].kernel, numblocks, shared_mem_required, k_base, b_in, shiftcount);
+          status = run_gs_kernel15(dev->kernel[use_kernel], tf_blocks, numblocks, shared_mem_required, k_base, b_in, shiftcount);
         }
         else if (use_kernel >= BARRETT79_MUL32_GS && use_kernel <= BARRETT87_MUL32_GS)
         {
@@ -2910,7 +4821,7 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
           k_base.d0 = (cl_uint) k_min;
           k_base.d1 = k_min >> 32;
           k_base.d2 = 0;
-          status = run_gs_kernel32(kernel_info[use_kernel].kernel, numblocks, shared_mem_required, k_base, b_192, shiftcount);
+          status = run_gs_kernel32(dev->kernel[use_kernel], tf_blocks, numblocks, shared_mem_required, k_base, b_192, shiftcount);
         }
         else
         {
@@ -2919,29 +4830,28 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
         }
         // Count the number of blocks processed
         count += numblocks;
+        launches++;
 
         // Move to next batch of k's
         k_min += (cl_ulong) mystuff->gpu_sieve_size * mystuff->num_classes;
         if (k_min > k_max) break;
 
-        //BUG - we should call a different routine to advance the bit-to-clear values by gpusieve_size bits
-        // This will be cheaper than recomputing the bit-to-clears from scratch
-        // HOWEVER, the self-test code will not check this new code unless we make the gpusieve_size much smaller
-        gpusieve_init_class (mystuff, k_min);
+        // Advance the bit-to-clear values by gpu_sieve_size bits instead of recomputing them from scratch.
+        // Only a single class can be bigger than the GPU sieve and take several chunks: the
+        // bit-to-clear values on the device are those of this one class. A multi-class launch
+        // (tf_classes_opencl) holds its classes completely, there is no next chunk to advance to.
+        gpusieve_advance_class (mystuff, mystuff->gpu_sieve_size);
         continue; // don't go to the stream-scheduling code below - the GPU sieve runs the TF kernels all in one stream
       }
       mystuff->stream_status[h_ktab_index] = PREPARED;
-      running++;
-#ifdef DETAILED_INFO
-      printf("k-base: %llu, ", (long long unsigned int) k_min);
-      printArray("ktab", mystuff->h_ktab[h_ktab_index], mystuff->threads_per_grid, 0);
-#endif
+      dev->host->tf_pipe.running++;
 
-      count++;
-      k_min += (unsigned long long int)k_diff;
+      count += num_grids[h_ktab_index];
+      launches++;
     }
 
     wait = 1;
+    dev->host->tf_pipe.completed |= dev->host->streams_completed.exchange(0);
 
     for(i=0; i<mystuff->num_streams; i++)
     {
@@ -2960,28 +4870,32 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
           {
             if ((use_kernel == _71BIT_MUL24) || (use_kernel == _63BIT_MUL24))
             {
-              k_base.d0 =  k_min_grid[i] & 0xFFFFFF;
-              k_base.d1 = (k_min_grid[i] >> 24) & 0xFFFFFF;
-              k_base.d2 =  k_min_grid[i] >> 48;
-              status = run_kernel24(kernel_info[use_kernel].kernel, mystuff->exponent, k_base, i, b_preinit, mystuff->d_RES, shiftcount, mystuff->bit_min-63);
+              k_base.d0 =  k_min_grid[i][0] & 0xFFFFFF;
+              k_base.d1 = (k_min_grid[i][0] >> 24) & 0xFFFFFF;
+              k_base.d2 =  k_min_grid[i][0] >> 48;
+              status = run_kernel24(dev->kernel[use_kernel], mystuff->exponent, k_base, i, b_preinit, mystuff->d_RES, shiftcount, mystuff->bit_min-63);
+            }
+            else if (max_grids > 1)  // the multi-grid variant of a barrett15 kernel, see launch_grids()
+            {
+              status = run_kernel15_grids(dev->kernel_grids[use_kernel], exp_grid[i], k_min_grid[i], job_grid[i], num_grids[i], i, mystuff->d_RES, mystuff->bit_max_stage-65);
             }
             else if (((use_kernel >= BARRETT73_MUL15) && (use_kernel <= BARRETT74_MUL15)) || (use_kernel == MG88))
             {
               int75 k_base = {0};
-              k_base.d0 =  k_min_grid[i] & 0x7FFF;
-              k_base.d1 = (k_min_grid[i] >> 15) & 0x7FFF;
-              k_base.d2 = (k_min_grid[i] >> 30) & 0x7FFF;
-              k_base.d3 = (k_min_grid[i] >> 45) & 0x7FFF;
-              k_base.d4 =  k_min_grid[i] >> 60;
-              status = run_kernel15(kernel_info[use_kernel].kernel, mystuff->exponent, k_base, i, b_in, mystuff->d_RES, shiftcount, mystuff->bit_max_stage-65);
+              k_base.d0 =  k_min_grid[i][0] & 0x7FFF;
+              k_base.d1 = (k_min_grid[i][0] >> 15) & 0x7FFF;
+              k_base.d2 = (k_min_grid[i][0] >> 30) & 0x7FFF;
+              k_base.d3 = (k_min_grid[i][0] >> 45) & 0x7FFF;
+              k_base.d4 =  k_min_grid[i][0] >> 60;
+              status = run_kernel15(dev->kernel[use_kernel], mystuff->exponent, k_base, i, b_in, mystuff->d_RES, shiftcount, mystuff->bit_max_stage-65);
             }
             else if (((use_kernel >= BARRETT79_MUL32) && (use_kernel <= BARRETT87_MUL32)) || (use_kernel == MG62))
             {
               int96 k;
-              k.d0 = (cl_uint) k_min_grid[i];
-              k.d1 = k_min_grid[i] >> 32;
+              k.d0 = (cl_uint) k_min_grid[i][0];
+              k.d1 = k_min_grid[i][0] >> 32;
               k.d2 = 0;
-              status = run_barrett_kernel32(kernel_info[use_kernel].kernel, mystuff->exponent, k, i, b_192, mystuff->d_RES, shiftcount, mystuff->bit_max_stage-65);
+              status = run_barrett_kernel32(dev->kernel[use_kernel], mystuff->exponent, k, i, b_192, mystuff->d_RES, shiftcount, mystuff->bit_max_stage-65);
             }
             else
             {
@@ -2992,16 +4906,22 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
                     return RET_ERROR;
                 }
 #endif
-                status = run_kernel64(kernel_info[use_kernel].kernel, mystuff->exponent, k_min_grid[i], i, b_preinit4, mystuff->d_RES, mystuff->bit_min-63);
+                status = run_kernel64(dev->kernel[use_kernel], mystuff->exponent, k_min_grid[i][0], i, b_preinit4, mystuff->d_RES, mystuff->bit_min-63);
             }
             if(status != CL_SUCCESS)
             {
               std::cerr << "Error " << status << " (" << ClErrorString(status) << "): Starting kernel " << kernel_info[use_kernel].kernelname << ". (run_kernel)\n";
               return RET_ERROR;
             }
+            status = clSetEventCallback(mystuff->exec_events[i], CL_COMPLETE, stream_complete_callback, (void *)&dev->host->stream_ref[i]);
+            if(status != CL_SUCCESS)
+            {
+              std::cerr << "Error " << status << " (" << ClErrorString(status) << "): Registering the completion callback. (clSetEventCallback)\n";
+              return RET_ERROR;
+            }
 
 #ifdef DEBUG_STREAM_SCHEDULE
-            printf(" STREAM_SCHEDULE: started GPU kernel using h_ktab[%d] (%s, %u, %llu, ...)\n", i, kernel_info[use_kernel].kernelname, mystuff->exponent, k_min_grid[i]);
+            printf(" STREAM_SCHEDULE: started GPU kernel using h_ktab[%d] (%s, %u, %llu, ...)\n", i, kernel_info[use_kernel].kernelname, mystuff->exponent, (long long unsigned int) k_min_grid[i][0]);
 #endif
             mystuff->stream_status[i] = RUNNING;
             break;
@@ -3009,112 +4929,27 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
           }
         case RUNNING:                    // check if it really is still running
           {
-            cl_int event_status;
-            status = clGetEventInfo(mystuff->exec_events[i],
-                         CL_EVENT_COMMAND_EXECUTION_STATUS,
-                         sizeof(cl_int),
-                         &event_status,
-                         NULL);
 #ifdef DEBUG_STREAM_SCHEDULE
-            std::cout<<  " STREAM_SCHEDULE: Querying event " << i << " = " << event_status << "\n";
+            std::cout<<  " STREAM_SCHEDULE: Stream " << i << ((dev->host->tf_pipe.completed & (1U << i)) ? " completed\n" : " running\n");
 #endif
-            if(status != CL_SUCCESS)
-            {
-              std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Querying event " << i << ". (clGetEventInfo)\n";
-              return RET_ERROR;
-            }
-            if (event_status > CL_COMPLETE) /* still running: CL_QUEUED=3 (command has been enqueued in the command-queue),
-                                               CL_SUBMITTED=2 (enqueued command has been submitted by the host to the
-                                               device associated with the command-queue),
-                                               CL_RUNNING=1 (device is currently executing this command), CL_COMPLETE=0,
-                                               any error: <0 */
+            if ((dev->host->tf_pipe.completed & (1U << i)) == 0) /* the callback did not fire yet: still queued, submitted or running */
             {
               break;
               // continue; // examine the next stream
             }
-            else // finished
+            else // finished: CL_COMPLETE=0, any error: <0
             {
-#ifdef CL_PERFORMANCE_INFO
-              cl_ulong startTime=0;
-              cl_ulong endTime=1000;
-              /* Get kernel profiling info */
-              if (!mystuff->gpu_sieving)
-              {
-                status = clGetEventProfilingInfo(mystuff->copy_events[i],
-                                  CL_PROFILING_COMMAND_START,
-                                  sizeof(cl_ulong),
-                                  &startTime,
-                                  0);
-                if(status != CL_SUCCESS)
-                {
-                  std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(startTime)\n";
-                  return RET_ERROR;
-                }
-                status = clGetEventProfilingInfo(mystuff->copy_events[i],
-                                  CL_PROFILING_COMMAND_END,
-                                  sizeof(cl_ulong),
-                                  &endTime,
-                                  0);
-                if(status != CL_SUCCESS)
-                {
-                  std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(endTime)\n";
-                  return RET_ERROR;
-                }
-                printf("%d FCs copied in %2.2f ms (%4.2f MB/s), ", mystuff->threads_per_grid, (endTime - startTime)/1e6,
-                        size * 1e3 / (endTime - startTime) );
-              }
-              status = clGetEventProfilingInfo(mystuff->exec_events[i],
-                                CL_PROFILING_COMMAND_START,
-                                sizeof(cl_ulong),
-                                &startTime,
-                                0);
-              if(status != CL_SUCCESS)
-               {
-                std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(startTime)\n";
-                return RET_ERROR;
-              }
-              status = clGetEventProfilingInfo(mystuff->exec_events[i],
-                                CL_PROFILING_COMMAND_END,
-                                sizeof(cl_ulong),
-                                &endTime,
-                                0);
-              if(status != CL_SUCCESS)
-               {
-                std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): in clGetEventProfilingInfo.(endTime)\n";
-                return RET_ERROR;
-              }
-              printf("proc'd in %2.2f ms (%3.2f M/s)\n", (endTime - startTime)/1e6, double(mystuff->threads_per_grid) *1e3/ (endTime - startTime));
-#endif
-              status = clReleaseEvent(mystuff->exec_events[i]);
-              if(status != CL_SUCCESS)
-              {
-                 std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Release exec event object. (clReleaseEvent)\n";
-                 return RET_ERROR;
-               }
-              if (!mystuff->gpu_sieving) status = clReleaseEvent(mystuff->copy_events[i]);
-               if(status != CL_SUCCESS)
-               {
-                std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Release copy event object. (clReleaseEvent)\n";
-                 return RET_ERROR;
-              }
-
-              if (event_status < CL_COMPLETE) // error
-              {
-                std::cerr<< "Error " << event_status << " (" << ClErrorString(status) << "): during execution of block " << count << " in h_ktab[" << i << "]\n";
-                return RET_ERROR;
-              }
-              else
-              {
-                mystuff->stream_status[i] = DONE;
-                /* no break to fall through to process the DONE value */
-              }
+              dev->host->tf_pipe.completed &= ~(1U << i);
+              if (finish_stream(mystuff, i, count) != CL_SUCCESS) return RET_ERROR;
+              mystuff->stream_status[i] = DONE;
+              /* no break to fall through to process the DONE value */
             }
           }
         case DONE:                       // get the results
           {                              // or maybe not; wait until the class is done.
             mystuff->stream_status[i] = UNUSED;
-            --running;
-            if ((k_min <= k_max) || (running==0))
+            --dev->host->tf_pipe.running;
+            if ((k_min <= k_max) || (dev->host->tf_pipe.running==0))
             {
               wait = 0;  // some k's left to be processed, or nothing running on GPU - not time to sleep!
             }
@@ -3125,121 +4960,325 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
      // break; // out of the loop as we can process another stream (shortcut: don't check the other streams now)
     }
 
-    if(wait > 0)
+    if((wait > 0) && (k_min <= k_max))
     {
       /* no unused h_ktab for preprocessing.
       This usually means that
       a) all GPU streams are busy
       or
-      b) we're at the and of the class
-      so let's wait for the stream that was scheduled first, or any other busy one */
+      b) the grids of the previous class still occupy the streams
+      so let's sleep until any of the running streams completes */
       timer_init(&timer2);
 
-      if (k_min >= k_max)
-      {
-        i = count % mystuff->num_streams; // at the end of the class: just wait for the last stream
-      }
-      else
-      {
-        i = (count - running) % mystuff->num_streams;  // the oldest still running stream
-      }
-
-      if (mystuff->stream_status[i] != RUNNING)     // if that one is not running, take the first running one
-      {
-        for(i=0; (mystuff->stream_status[i] != RUNNING) && (i<mystuff->num_streams); i++) ;
-      }
+      for(i=0; (i<mystuff->num_streams) && (mystuff->stream_status[i] != RUNNING); i++) ;
 
       if(i<mystuff->num_streams)
       {
 #ifdef DEBUG_STREAM_SCHEDULE
-        printf(" STREAM_SCHEDULE: Wait for stream %d, already waited %" PRIu64 "us, %d times of %d blocks\n", i, twait, cwait, count);
+        printf(" STREAM_SCHEDULE: Wait for any stream, already waited %" PRIu64 "us, %d times of %d blocks\n", twait, cwait, count);
 #endif
-        status = clWaitForEvents(1, &mystuff->exec_events[i]); // wait for completion
-        if(status != CL_SUCCESS)
-        {
-          std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Waiting for kernel call to finish. (clWaitForEvents)\n";
-          return RET_ERROR;
-        }
+        if (dev->host->tf_pipe.completed == 0) wait_for_any_stream();
       }
       else
       {
 #ifdef DEBUG_STREAM_SCHEDULE
         printf(" STREAM_SCHEDULE: Tried to wait but nothing is running!\n");
 #endif
-        running = 0; /* if nothing is running, correct this if necessary */
+        dev->host->tf_pipe.running = 0; /* if nothing is running, correct this if necessary */
       }
 
 #ifdef DEBUG_STREAM_SCHEDULE
       unsigned long long twait1 = timer_diff(&timer2);
-      printf(" STREAM_SCHEDULE: Waited %" PRIu64 "us, %d blocks running.\n", twait1, running);
-      if (running > 1) twait += twait1;  // don't count the waiting period for the last block as this is unavoidable
+      printf(" STREAM_SCHEDULE: Waited %" PRIu64 "us, %d blocks running.\n", twait1, dev->host->tf_pipe.running);
+      if (dev->host->tf_pipe.running > 1) twait += twait1;  // don't count the waiting period for the last block as this is unavoidable
 #else
-      if (running > 1) twait += timer_diff(&timer2); // see above. Note this would not work for num_streams=1, and not reliably for num_streams=2
+      if (dev->host->tf_pipe.running > 1) twait += timer_diff(&timer2); // see above. Note this would not work for num_streams=1, and not reliably for num_streams=2
 #endif
 #ifdef DEBUG_STREAM_SCHEDULE
       cwait++;
 #endif
-      // technically the stream we've waited for is finished, but
-      // leave the stream in status RUNNING to let the case-loop above check for errors and do cleanup
+      // the completed streams stay in status RUNNING to let the case-loop above check for errors and do cleanup
     }
   }
 
-  // all done?
-
-  for(i=0; i<mystuff->num_streams; i++)
+  /* all grids of the class are queued, the next class gets its own reset of d_RES */
+  if (dev->host->tf_pipe.cleared != NULL)
   {
-    if (mystuff->stream_status[i] != UNUSED)
-    { // should not happen
-      std::cerr << "Block " << (count -i) << ", k_min=" << k_min_grid[i] << " in h_ktab[" << i << "] not yet complete!\n";
-    }
+    clReleaseEvent(dev->host->tf_pipe.cleared);
+    dev->host->tf_pipe.cleared = NULL;
   }
 
+  /* QUEUE may execute out-of-order: the marker completes when everything queued
+     so far is done, i.e. the last grid of the class, and the read waits for it */
+#ifdef CL_VERSION_1_2
+  status = clEnqueueMarkerWithWaitList(QUEUE, 0, NULL, &marker);
+#else
+  status = clEnqueueMarker(QUEUE, &marker);
+#endif
+  if(status != CL_SUCCESS)
+  {
+    std::cout << "Error " << status << " (" << ClErrorString(status) << "): clEnqueueMarker failed.\n";
+    return RET_ERROR;
+  }
   status = clEnqueueReadBuffer(QUEUE,
-                mystuff->d_RES,
-                CL_TRUE,
+                dev->host->tf_pipe.d_RES[slot],
+                CL_FALSE,
                 0,
-                32 * sizeof(int),
-                mystuff->h_RES,
-                0,
-                NULL,
-                NULL);
-
+                res_size(mystuff) * sizeof(cl_uint),
+                dev->host->tf_pipe.h_RES[slot],
+                1,
+                &marker,
+                &dev->host->tf_pipe.read_event[slot]);
+  clReleaseEvent(marker);
   if(status != CL_SUCCESS)
   {
     std::cout << "Error " << status << " (" << ClErrorString(status) << "): clEnqueueReadBuffer RES failed.\n";
     return RET_ERROR;
   }
+  clFlush(QUEUE);
+
+  if (dev->host->tf_pipe.in_flight == 0) dev->host->tf_pipe.last_done = timer;
+  dev->host->tf_pipe.timer[slot] = timer;
+  dev->host->tf_pipe.count[slot] = count;
+  dev->host->tf_pipe.twait[slot] = twait;
+  dev->host->tf_pipe.first_stream = (dev->host->tf_pipe.first_stream + launches) % mystuff->num_streams;
+  dev->host->tf_pipe.next = (slot + 1) % TF_PIPELINE_DEPTH;
+  dev->host->tf_pipe.in_flight++;
+
+  return 0;
+}
+
+
+int tf_class_opencl_wait(mystuff_t *mystuff, enum GPUKernels use_kernel)
+/* collect the oldest class in flight: wait for its results, print the status
+line and the factors. Returns the number of factors found or RET_ERROR. */
+{
+  cl_uint slot;
+  cl_int status;
+  cl_ulong time_run, time_pipe;
+
+  if (dev->host->tf_pipe.in_flight == 0)
+  {
+    fprintf(stderr, "Programming error: no class in flight\n");
+    return RET_ERROR;
+  }
+  slot = (dev->host->tf_pipe.next + TF_PIPELINE_DEPTH - dev->host->tf_pipe.in_flight) % TF_PIPELINE_DEPTH;
+  dev->host->tf_pipe.in_flight--;
+
+  status = clWaitForEvents(1, &dev->host->tf_pipe.read_event[slot]);
+  if(status != CL_SUCCESS)
+  {
+    std::cerr<< "Error " << status << " (" << ClErrorString(status) << "): Waiting for the results of the class. (clWaitForEvents)\n";
+    return RET_ERROR;
+  }
+  clReleaseEvent(dev->host->tf_pipe.read_event[slot]);
+  dev->host->tf_pipe.read_event[slot] = NULL;
 
+  /* no class behind this one: its grids are done, clean up the streams */
+  if ((dev->host->tf_pipe.in_flight == 0) && (drain_streams(mystuff, dev->host->tf_pipe.count[slot]) != 0)) return RET_ERROR;
+
+  memcpy(mystuff->h_RES, dev->host->tf_pipe.h_RES[slot], res_size(mystuff) * sizeof(cl_uint));
   if (mystuff->verbosity > 2)
   {
     printArray("RES", mystuff->h_RES, 32, 0);
   }
 #ifdef CHECKS_MODBASECASE
-  status = clEnqueueReadBuffer(QUEUE,
-                mystuff->d_modbasecase_debug,
-                CL_TRUE,
-                0,
-                32 * sizeof(int),
-                mystuff->h_modbasecase_debug,
-                0,
-                NULL,
-                NULL);
+  if (read_modbasecase_debug(mystuff) != CL_SUCCESS) return RET_ERROR;
+#endif
 
-  if(status != CL_SUCCESS)
+  /* classes overlap: count the time since the previous class was collected */
+  time_run  = timer_diff(&dev->host->tf_pipe.timer[slot]);
+  time_pipe = timer_diff(&dev->host->tf_pipe.last_done);
+  if (time_pipe < time_run) time_run = time_pipe;
+  timer_init(&dev->host->tf_pipe.last_done);
+
+  return tf_class_finish(mystuff, use_kernel, dev->host->tf_pipe.count[slot], dev->host->tf_pipe.twait[slot], time_run);
+}
+
+
+int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPUKernels use_kernel)
+/* one class, synchronous */
+{
+  if (tf_class_opencl_start(k_min, k_max, mystuff, use_kernel) != 0) return RET_ERROR;
+
+  return tf_class_opencl_wait(mystuff, use_kernel);
+}
+
+
+void tf_class_opencl_abort(mystuff_t *mystuff)
+/* after an error: wait until everything queued is done, i.e. the grids and the result reads
+of the classes in flight, and drop these classes. The next tf_class_opencl_start() begins
+with clean streams. */
+{
+  cl_uint i;
+
+  clFinish(QUEUE);
+  for (i = 0; i < TF_PIPELINE_DEPTH; i++)
   {
-    std::cout << "Error " << status << " (" << ClErrorString(status) << "): clEnqueueReadBuffer modbasecase_debug failed.\n";
-    return RET_ERROR;
+    if (dev->host->tf_pipe.read_event[i] != NULL)
+    {
+      clReleaseEvent(dev->host->tf_pipe.read_event[i]);
+      dev->host->tf_pipe.read_event[i] = NULL;
+    }
+  }
+  if (dev->host->tf_pipe.cleared != NULL)
+  {
+    clReleaseEvent(dev->host->tf_pipe.cleared);
+    dev->host->tf_pipe.cleared = NULL;
   }
+  for (i = 0; i < mystuff->num_streams; i++)
+  {
+    if (mystuff->stream_status[i] == RUNNING) finish_stream(mystuff, i, 0);  // errors were reported already
+    mystuff->stream_status[i] = UNUSED;
+  }
+  dev->host->streams_completed = 0;
+  dev->host->tf_pipe.completed = 0;
+  dev->host->tf_pipe.running   = 0;
+  dev->host->tf_pipe.in_flight = 0;
+}
 
+
+int tf_classes_opencl(cl_ulong k_min, cl_ulong k_max, const cl_uint *classes, cl_uint num_classes, mystuff_t *mystuff, enum GPUKernels use_kernel)
+/* GPU sieving only: process the classes classes[0] < ... < classes[num_classes-1] at once, k_min
+is the k of class 0. Each class gets a segment of gpusieve_class_bits() bits of the GPU sieve; they
+are sieved by one SegSieve and TF'd by one kernel launch, and the results of all of them are read
+once at the end. gpusieve_class_bits() * num_classes must not exceed the GPU sieve size.
+Returns the number of factors found in all of these classes. */
+{
+  struct timeval timer;
+  cl_uint  i, shiftcount, ln2b, shared_mem_required, bits_per_class, blocks_per_class, numblocks;
+  cl_ulong k_first = k_min + classes[0], time_run;
+  cl_uint8 b_in = {{0}};
+  int192   b_192 = {0};
+  int      status;
+
+  timer_init(&timer);
 #ifdef DETAILED_INFO
-  printArray("modbasecase_debug", mystuff->h_modbasecase_debug, 32, 0);
-#endif
-  for(i=0;i<32;i++)if(mystuff->h_modbasecase_debug[i] != 0)printf("h_modbasecase_debug[%2d] = %u\n", i, mystuff->h_modbasecase_debug[i]);
+  printf("tf_classes_opencl(%u, %d, %llu, %llu, classes %u-%u (%u))\n",
+      mystuff->exponent, mystuff->bit_min, (long long unsigned int) k_min, (long long unsigned int) k_max,
+      classes[0], classes[num_classes-1], num_classes);
 #endif
 
+  dev->new_class=1; // tell run_kernel to re-submit the one-time kernel arguments
+  if (k_max <= k_first) k_max = k_first + 1;  // otherwise it would skip small bit ranges
+
+  if (num_classes > mystuff->gpu_sieve_classes || gpusieve_class_bits(mystuff, k_min, k_max) * num_classes > mystuff->gpu_sieve_size)
+  {
+    fprintf(stderr, "Programming error: %u classes don't fit into the GPU sieve\n", num_classes);
+    return RET_ERROR;
+  }
+  bits_per_class = (cl_uint) gpusieve_class_bits(mystuff, k_min, k_max);
+
+  if (clear_results(mystuff, NULL) != CL_SUCCESS) return RET_ERROR;
+
+  // same b_preinit as in tf_class_opencl(), only the variants used by the GPU-sieve kernels
+  shiftcount=10;
+  while((1ULL<<shiftcount) < (unsigned long long int)mystuff->exponent)shiftcount++;
+  shiftcount -= 6;
+  ln2b = mystuff->exponent >> shiftcount;
+  while (ln2b < mystuff->bit_max_stage)
+  {
+    shiftcount--;
+    ln2b = mystuff->exponent >> shiftcount;
+  }
+  {
+    if     (ln2b<60 ){fprintf(stderr, "Pre-init (%u) too small\n", ln2b); return RET_ERROR;}      // should not happen
+    else if(ln2b<75 )b_in.s[0]=1<<(ln2b-60);
+    else if(ln2b<90 )b_in.s[1]=1<<(ln2b-75);
+    else if(ln2b<105)b_in.s[2]=1<<(ln2b-90);
+    else if(ln2b<120)b_in.s[3]=1<<(ln2b-105);
+    else if(ln2b<135)b_in.s[4]=1<<(ln2b-120);
+    else if(ln2b<150)b_in.s[5]=1<<(ln2b-135);
+    else if(ln2b<165)b_in.s[6]=1<<(ln2b-150);
+    else             b_in.s[7]=1<<(ln2b-165);
+  }
+  {
+    if     (ln2b<64 )b_192.d1=1<<(ln2b-32);   // should not happen
+    else if(ln2b<96 )b_192.d2=1<<(ln2b-64);
+    else if(ln2b<128)b_192.d3=1<<(ln2b-96);
+    else if(ln2b<160)b_192.d4=1<<(ln2b-128);
+    else             b_192.d5=1<<(ln2b-160);  // b_preinit = 2^ln2b
+  }
+  shared_mem_required = gs_shared_mem_required(mystuff);
+
+  // the bit-to-clear values of all classes, then sieve all segments at once
+  for (i = 0; i < num_classes; i++) mystuff->h_class_delta[i] = classes[i] - classes[0];
+  gpusieve_init_classes(mystuff, k_first, num_classes);
+  gpusieve_classes(mystuff, num_classes, bits_per_class);
+
+  blocks_per_class = bits_per_class / mystuff->gpu_sieve_processing_size;
+  numblocks = num_classes * blocks_per_class;
+  if (mystuff->gpu_sieve_compact && gpusieve_compact(mystuff, numblocks, blocks_per_class, &numblocks)) return RET_ERROR;
+
+  if (use_kernel >= BARRETT73_MUL15_GS && use_kernel <= BARRETT74_MUL15_GS)
+  {
+    int75 k_base = {0};
+    k_base.d0 =  k_first & 0x7FFF;
+    k_base.d1 = (k_first >> 15) & 0x7FFF;
+    k_base.d2 = (k_first >> 30) & 0x7FFF;
+    k_base.d3 = (k_first >> 45) & 0x7FFF;
+    k_base.d4 =  k_first >> 60;
+    status = run_gs_kernel15(dev->kernel[use_kernel], numblocks, blocks_per_class, shared_mem_required, k_base, b_in, shiftcount);
+  }
+  else if (use_kernel >= BARRETT79_MUL32_GS && use_kernel <= BARRETT87_MUL32_GS)
+  {
+    int96 k_base;
+    k_base.d0 = (cl_uint) k_first;
+    k_base.d1 = k_first >> 32;
+    k_base.d2 = 0;
+    status = run_gs_kernel32(dev->kernel[use_kernel], numblocks, blocks_per_class, shared_mem_required, k_base, b_192, shiftcount);
+  }
+  else
+  {
+    fprintf(stderr, "Programming error: kernel %d unknown or not prepared for GPU-sieving\n", use_kernel);
+    return RET_ERROR;
+  }
+  if (status != 0) return RET_ERROR;
+
+  if (read_results(mystuff) != CL_SUCCESS) return RET_ERROR;
+
+  // tf_class_finish() accounts the time of one class, so the status line shows the average of these classes
+  time_run = timer_diff(&timer);
+  mystuff->stats.bit_level_time += time_run / 1000 - time_run / num_classes / 1000;
+  return tf_class_finish(mystuff, use_kernel, num_classes * blocks_per_class, 0, time_run / num_classes);
+}
+
+
+static void batch_merge_results(mystuff_t *mystuff)
+/* batch mode: the kernels wrote the factors of each exponent into its own result buffer,
+see res_size(). Move them behind the ones of the first exponent, h_RES[0] counts all of
+them, and note the exponent (index) of each one in batch.factor_job. */
+{
+  cl_uint j, n, stored = 0, total = 0;
+
+  for (j = 0; j < mystuff->batch.num; j++)
+  {
+    const cl_uint *res = mystuff->h_RES + (size_t)RES_SIZE * j;
+
+    for (n = 0; n < res[0] && n < RES_FACTORS_MAX && stored < RES_FACTORS_MAX; n++, stored++)
+    {
+      if (j > 0) memcpy(&mystuff->h_RES[stored*3 + 1], &res[n*3 + 1], 3 * sizeof(cl_uint));
+      mystuff->batch.factor_job[stored] = j;
+    }
+    total += res[0];
+  }
+  mystuff->h_RES[0] = total;
+}
+
+
+int tf_class_finish(mystuff_t *mystuff, enum GPUKernels use_kernel, cl_uint count, cl_ulong twait, cl_ulong time_run)
+/* common end of tf_class_*(): update the stats, print the status line and the
+factors found in h_RES. count is the number of grids processed, twait and
+time_run are the time (us) spent waiting for the TF and the total time of the
+class. Returns the number of factors found. */
+{
+  cl_uint  factorsfound, stored, i;
+  int96    factor = {0}, prev_factor = {0};
+  char     string[50];
+
   mystuff->stats.grid_count = count;
-  mystuff->stats.class_time = timer_diff(&timer) / 1000;
-  mystuff->stats.bit_level_time += timer_diff(&timer) / 1000;
+  mystuff->stats.class_time = time_run / 1000;
+  mystuff->stats.bit_level_time += time_run / 1000;
 /* prevent division by zero if timer resolution is too low */
   if(mystuff->stats.class_time == 0)mystuff->stats.class_time = 1;
   if(mystuff->stats.bit_level_time == 0)mystuff->stats.bit_level_time = 1;
@@ -3250,8 +5289,8 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
 
   print_status_line(mystuff);
 
-  /* only adjust sieve_primes if there was no keyboard input handled */
-  if(handle_kb_input(mystuff) == 0 && mystuff->stats.cpu_wait >= 0.0f)
+  /* only adjust sieve_primes if there was no keyboard input handled, device 0 reads the keyboard */
+  if((dev != &device_list[0] || handle_kb_input(mystuff) == 0) && mystuff->stats.cpu_wait >= 0.0f)
   {
 /* if SievePrimesAdjust is enable lets try to get 2 % < CPU wait < 6% */
     if(mystuff->sieve_primes_adjust == 1 && mystuff->stats.cpu_wait > 6.0f && mystuff->sieve_primes < mystuff->sieve_primes_upper_limit && (mystuff->mode != MODE_SELFTEST_SHORT))
@@ -3268,8 +5307,10 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
     }
   }
 
+  if (mystuff->batch.num > 0) batch_merge_results(mystuff);
   factorsfound = mystuff->h_RES[0];
-  for(i=0; (i<factorsfound) && (i<10); i++)
+  stored = (factorsfound < RES_FACTORS_MAX) ? factorsfound : RES_FACTORS_MAX;  // the kernels count all factors
+  for(i=0; i<stored; i++)
   {
     factor.d2  = mystuff->h_RES[i*3 + 1];
     factor.d1  = mystuff->h_RES[i*3 + 2];
@@ -3297,8 +5338,13 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
       {
         printf("Skipping trivial or duplicate factor #%d: %s (%x:%x:%x)\n", i, string, factor.d2, factor.d1, factor.d0);
       }
-      if (factorsfound > i) memmove(&mystuff->h_RES[i*3 + 1], &mystuff->h_RES[i*3 + 4], 3*sizeof(int)*(factorsfound-i));
+      if (stored > i + 1)
+      {
+        memmove(&mystuff->h_RES[i*3 + 1], &mystuff->h_RES[i*3 + 4], 3*sizeof(int)*(stored-i-1));
+        memmove(&mystuff->batch.factor_job[i], &mystuff->batch.factor_job[i + 1], sizeof(cl_uint)*(stored-i-1));
+      }
       mystuff->h_RES[0] = --factorsfound;
+      --stored;
       --i;
       continue;
     }
@@ -3324,7 +5370,17 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
     }
     mystuff->stats.ghzdays = mystuff->stats.ghzdays * (bits - floor(bits));
 
-    print_factor(mystuff, i, string, bits);
+    if (mystuff->batch.num > 0)
+    {
+      /* batch: the factor belongs to the exponent of the result buffer it came from */
+      cl_uint exp_saved = mystuff->exponent;
+
+      mystuff->exponent = mystuff->batch.exponent[mystuff->batch.factor_job[i]];
+      print_factor(mystuff, i, string, bits);
+      mystuff->exponent = exp_saved;
+    }
+    else
+      print_factor(mystuff, i, string, bits);
     snprintf(
       mystuff->factors_string,
       sizeof(mystuff->factors_string),
@@ -3334,9 +5390,9 @@ int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPU
     );
     prev_factor = factor;
   }
-  if(factorsfound>=10)
+  if(factorsfound > stored)
   {
-    print_factor(mystuff, factorsfound, NULL, 0.0);
+    print_factor(mystuff, factorsfound - stored, NULL, 0.0);  // result buffer overflow
   }
 
   return factorsfound;
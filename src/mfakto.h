@@ -26,24 +26,54 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #define NUM_KERNELS (sizeof(kernel_info) / sizeof(kernel_info[0]))
 #define KERNEL_FILE "mfakto_Kernels.cl"
 
-// primes up to 16M can be handled by this many "rows" of 256 primes, for GPU sieving
-#define MAX_PRIMES_PER_THREAD 4224
+// primes up to 16M can be handled by this many "rows" of 256 primes, for GPU sieving, plus the bucket-sieved "rows"
+#define MAX_PRIMES_PER_THREAD 39168
+
+// entries of the compacted GPU sieve candidate list tested by each GPU-sieve TF block, see GS_COMPACT_CHUNK in gpusieve.cl
+#define GS_COMPACT_LOOPS 4
+#define GS_COMPACT_CHUNK(vectorsize) (256 * (vectorsize) * GS_COMPACT_LOOPS)
+
+#ifdef _MSC_VER
+  #define THREAD_LOCAL __declspec(thread)
+#else
+  #define THREAD_LOCAL __thread
+#endif
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+extern device_t              device_list[MAX_DEVICES];
+extern cl_uint               num_device_list;
+extern THREAD_LOCAL device_t *dev;  /* the device of the calling thread */
+
+void select_device(cl_uint n);
+int run_on_devices(int (*fn)(void *arg), void *arg);
+void lock_devices(void);
+void unlock_devices(void);
 int init_CL(int num_streams, cl_int *devicenumber);
 int load_kernels(cl_int *devnumber);
+void request_kernel(int kernel);
+int load_kernel(int kernel);
+void specialize_kernel(int kernel, cl_uint exponent, cl_uint bit_max_stage);
+int use_specialized_kernel(int kernel, int wait);
 void set_gpu_type();
 int init_CLstreams(int gs_reinit_only);
 int cleanup_CL(void);
 void CL_test(cl_int devicenumber);
 int tf_class_opencl(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPUKernels use_kernel);
+int tf_class_opencl_start(cl_ulong k_min, cl_ulong k_max, mystuff_t *mystuff, enum GPUKernels use_kernel);
+int tf_class_opencl_wait(mystuff_t *mystuff, enum GPUKernels use_kernel);
+void tf_class_opencl_abort(mystuff_t *mystuff);
+int tf_classes_opencl(cl_ulong k_min, cl_ulong k_max, const cl_uint *classes, cl_uint num_classes, mystuff_t *mystuff, enum GPUKernels use_kernel);
+int tf_class_finish(mystuff_t *mystuff, enum GPUKernels use_kernel, cl_uint count, cl_ulong twait, cl_ulong time_run);
 cl_int run_calc_mod_inv(cl_uint numblocks, size_t localThreads, cl_event *run_event);
-cl_int run_calc_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_ulong k_min);
-cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_uint maxp);
-int run_gs_kernel(cl_kernel kernel, cl_uint numblocks, cl_uint shared_mem_required, cl_uint shiftcount);
+cl_int run_calc_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_ulong k_min, cl_uint num_classes);
+cl_int run_advance_bit_to_clear(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_uint advance);
+cl_int run_cl_sieve(cl_uint numblocks, size_t localThreads, cl_event *run_event, cl_uint maxp, cl_uint blocks_per_class);
+cl_int run_bucket_scatter(cl_uint numrows, size_t localThreads, cl_event *run_event, cl_uint first_row, cl_uint blocks_per_class, cl_uint num_classes);
+cl_int run_compact_candidates(cl_uint num_slices, cl_uint slices_per_class, cl_uint *list_info);
+int run_gs_kernel(cl_kernel kernel, cl_uint numblocks, cl_uint blocks_per_class, cl_uint shared_mem_required, cl_uint shiftcount);
 int kernel_possible(int kernel, mystuff_t *mystuff);
 
 #ifdef __cplusplus
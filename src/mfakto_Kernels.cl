@@ -79,24 +79,56 @@ Version 0.16.0
 #include "datatypes.h"
 #include "common.cl"
 
+/* The host builds the kernels in separate programs, one per kernel group, each with one of
+   -DKERNEL_GROUP_{TEST,MUL24,BARRETT32,BARRETT15,MONTGOMERY,GPUSIEVE}, and only when a group is needed.
+   Without a group define (e.g. CL_test), all kernels are built as before. */
+#if !defined KERNEL_GROUP_TEST && !defined KERNEL_GROUP_MUL24 && !defined KERNEL_GROUP_BARRETT32 && \
+    !defined KERNEL_GROUP_BARRETT15 && !defined KERNEL_GROUP_MONTGOMERY && !defined KERNEL_GROUP_GPUSIEVE
+  #define KERNEL_GROUP_TEST
+  #define KERNEL_GROUP_BARRETT32
+  #define KERNEL_GROUP_BARRETT15
+  #ifdef CL_GPU_SIEVE
+    #define KERNEL_GROUP_GPUSIEVE
+  #else
+    #define KERNEL_GROUP_MUL24
+    #define KERNEL_GROUP_MONTGOMERY
+  #endif
+#endif
+
 // for the GPU sieve, we don't implement some kernels
 #ifdef CL_GPU_SIEVE
-  #include "gpusieve.cl"
-  #include "barrett15.cl"  // mul24-based barrett kernels using a word size of 15 bit
-  #include "barrett.cl"   // one kernel file for 32-bit-barrett of different vector sizes (1, 2, 4, 8, 16)
+  // the GPU-sieve TF-kernels need extract_bits() and class_k_base*(), the sieve kernels only with KERNEL_GROUP_GPUSIEVE
+  #if defined KERNEL_GROUP_GPUSIEVE || defined KERNEL_GROUP_BARRETT15 || defined KERNEL_GROUP_BARRETT32 || \
+      defined KERNEL_GROUP_MONTGOMERY || defined KERNEL_GROUP_TEST
+    #include "gpusieve.cl"
+  #endif
 #else
   #define EVAL_RES(x) EVAL_RES_b(x)  // no check for f==1 if running the "big" version
+#endif
 
+// montgomery.cl and test_k use the 90-bit helpers of barrett15.cl
+#if defined KERNEL_GROUP_BARRETT15 || defined KERNEL_GROUP_MONTGOMERY || defined KERNEL_GROUP_TEST
   #include "barrett15.cl"  // mul24-based barrett kernels using a word size of 15 bit
+#endif
+#ifdef KERNEL_GROUP_BARRETT32
   #include "barrett.cl"   // one kernel file for 32-bit-barrett of different vector sizes (1, 2, 4, 8, 16)
+#endif
 
-  #include "mul24.cl" // one kernel file for 24-bit-kernels of different vector sizes (1, 2, 4, 8, 16)
-  #include "montgomery.cl"  // montgomery kernels
+#ifndef CL_GPU_SIEVE
+  #ifdef KERNEL_GROUP_MUL24
+    #include "mul24.cl" // one kernel file for 24-bit-kernels of different vector sizes (1, 2, 4, 8, 16)
+  #endif
+  #ifdef KERNEL_GROUP_MONTGOMERY
+    #include "montgomery.cl"  // montgomery kernels
+  #endif
 
-  #define _63BIT_MUL24_K
-  #include "mul24.cl" // include again, now for small factors < 64 bit
+  #ifdef KERNEL_GROUP_MUL24
+    #define _63BIT_MUL24_K
+    #include "mul24.cl" // include again, now for small factors < 64 bit
+  #endif
 #endif
 
+#ifdef KERNEL_GROUP_TEST
 // this kernel is only used for a quick test at startup - no need to be correct ;-)
 // currently this kernel is used for testing what happens without atomics when multiple factors are found
 __kernel void test_k(const ulong hi, const ulong lo, const ulong q,
@@ -366,3 +398,4 @@ __kernel void test_k(const ulong hi, const ulong lo, const ulong q,
     }
   }
 }
+#endif
@@ -279,7 +279,7 @@ bit_max64 is bit_max - 64!
     printf((__constant char *)"cl_mg62: tid=%ld found factor: q=%#llx, k=%x:%x:%x\n", tid, V(f), V(k.d2), V(k.d1), V(k.d0));
 #endif
     tid=ATOMIC_INC(RES[0]);
-    if(tid<10)				/* limit to 10 factors per class */
+    if(tid<RES_FACTORS_MAX)				/* more factors are only counted */
     {
       RES[tid*3 + 1]=0;
       RES[tid*3 + 2]=CONVERT_UINT_V(f>>32);
@@ -847,7 +847,7 @@ bit_max64 is bit_max - 64!
   {
 /* in contrast to the other kernels this barrett based kernel is only allowed for factors above 2^60 so there is no need to check for f != 1 */  
     tid=ATOMIC_INC(RES[0]);
-    if(tid<10)				/* limit to 10 factors per class */
+    if(tid<RES_FACTORS_MAX)				/* more factors are only counted */
     {
       RES[tid*3 + 1]=mad24(f.d5,0x8000u, f.d4);
       RES[tid*3 + 2]=mad24(f.d3,0x8000u, f.d2);  // that's now 30 bits per int
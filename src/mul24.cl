@@ -826,7 +826,7 @@ Precalculated here since it is the same for all steps in the following loop */
 #endif
 
     tid=ATOMIC_INC(RES[0]);
-    if(tid<10)				/* limit to 10 factors per class */
+    if(tid<RES_FACTORS_MAX)				/* more factors are only counted */
     {
       RES[tid*3 + 1]=f.d2;
       RES[tid*3 + 2]=f.d1;
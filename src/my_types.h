@@ -98,13 +98,21 @@ enum STREAM_STATUS
   DONE
 };
 
+enum KTAB_TRANSFER
+{
+  KTAB_PAGEABLE,   /* malloc'd h_ktab, clEnqueueWriteBuffer() */
+  KTAB_PINNED,     /* h_ktab is a mapped CL_MEM_ALLOC_HOST_PTR staging buffer, clEnqueueWriteBuffer() */
+  KTAB_ZERO_COPY   /* h_ktab is the mapped d_ktab itself, no copy at all */
+};
+
 enum MODES
 {
   MODE_PERFTEST,
   MODE_NORMAL,
   MODE_SELFTEST_SHORT,
   MODE_SELFTEST_QUICK,
-  MODE_SELFTEST_FULL
+  MODE_SELFTEST_FULL,
+  MODE_SELFTEST_GPUSIEVE
 };
 
 enum EXIT_VALUES
@@ -142,9 +150,16 @@ enum GPUKernels
   UNKNOWN_KERNEL, /* what comes after this one will not be loaded automatically*/
   _64BIT_64_OpenCL,
   BARRETT92_64_OpenCL,
+  CPU_TF,                // trial factoring on the host (-d h), see cpu_tf.cpp
+  CPU_TF_IFMA,           // same using AVX-512 IFMA
   CL_CALC_BIT_TO_CLEAR,  // loaded if GPU sieving enabled
   CL_CALC_MOD_INV,       // loaded if GPU sieving enabled
   CL_SIEVE,              // loaded if GPU sieving enabled
+  CL_ADVANCE_BIT_TO_CLEAR, // loaded if GPU sieving enabled
+  CL_BUCKET_SCATTER,     // loaded if GPU sieving enabled
+  CL_COMPACT_COUNT,      // loaded if GPU sieving enabled
+  CL_COMPACT_SCAN,       // loaded if GPU sieving enabled
+  CL_COMPACT_WRITE,      // loaded if GPU sieving enabled
   BARRETT79_MUL32_GS,
   BARRETT77_MUL32_GS,
   BARRETT76_MUL32_GS,
@@ -186,6 +201,16 @@ enum GPU_types
   GPU_UNKNOWN   // must be the last one
 };
 
+enum SIEVE_EXTRACTORS  // how the CPU sieve converts the sieve bits to ktab offsets
+{
+  SIEVE_EXTRACT_AUTO,
+  SIEVE_EXTRACT_TABLE,   // byte-wise lookup table, always available
+  SIEVE_EXTRACT_CTZ,     // one bit at a time using count trailing zeros
+  SIEVE_EXTRACT_AVX2,    // lookup table, 8 offsets per store
+  SIEVE_EXTRACT_AVX512,  // VPCOMPRESSD, 16 bits at a time
+  SIEVE_EXTRACT_UNKNOWN  // must be the last one
+};
+
 typedef struct _GPU_type
 {
   enum GPU_types gpu_type;
@@ -240,12 +265,27 @@ typedef struct _stats_t
   char     kernelname[32];
 }stats_t;
 
+typedef struct _sieve_ctx_t sieve_ctx_t; /* CPU sieve state of one class, see sieve.c */
+
+typedef struct _batch_t
+{
+  cl_uint  num;                                       /* exponents in the batch, 0 = no batch running */
+  cl_uint  exponent[BATCH_EXPONENTS_MAX];
+  cl_ulong k_min[BATCH_EXPONENTS_MAX];                /* k_min of class 0 */
+  cl_ulong k_max[BATCH_EXPONENTS_MAX];
+  char     assignment_key[BATCH_EXPONENTS_MAX][MAX_LINE_LENGTH + 1];
+  cl_uint  num_cur, cur[BATCH_EXPONENTS_MAX];         /* the exponents (indices) which need the current class */
+  cl_uint  factor_job[RES_FACTORS_MAX];               /* the exponent (index) of each factor in h_RES */
+}batch_t;                                             /* several assignments TF'd together, see tf_batch() */
+
 typedef struct _mystuff_t
 {
   cl_event copy_events[NUM_STREAMS_MAX];
   cl_event exec_events[NUM_STREAMS_MAX];
   cl_uint *h_ktab[NUM_STREAMS_MAX];
   cl_mem   d_ktab[NUM_STREAMS_MAX];
+  cl_mem   p_ktab[NUM_STREAMS_MAX];         /* KTAB_PINNED only: the staging buffers backing h_ktab */
+  enum KTAB_TRANSFER ktab_transfer;
   cl_uint *h_RES;
   cl_mem   d_RES;
   enum STREAM_STATUS stream_status[NUM_STREAMS_MAX];
@@ -257,6 +297,13 @@ typedef struct _mystuff_t
   cl_mem   d_sieve_info;
   cl_uint *h_calc_bit_to_clear_info;
   cl_mem   d_calc_bit_to_clear_info;
+  cl_uint *h_class_delta;                   /* k_base of each class of a multi-class launch, relative to the first class */
+  cl_mem   d_class_delta;
+  cl_mem   d_bucket_count;                  /* GPU sieve: number of bucket-sieved hits of each block */
+  cl_mem   d_bucket_hits;                   /* GPU sieve: gpu_sieve_bucket_size hits (bit offsets) per block */
+  cl_mem   d_compact_count;                 /* GPUSieveCompact: candidates per TF slice, then their list offsets */
+  cl_mem   d_compact_list;                  /* GPUSieveCompact: bit numbers of all candidates, gpu_sieve_compact_size entries */
+  cl_mem   d_compact_info;                  /* GPUSieveCompact: TF blocks, candidates, overflow flag */
 
   cl_uint  more_classes;                    /* 0= 420 classes, 1= 4620 classes */
   cl_uint  num_classes;                     /* 420 / 4620 classes */
@@ -271,11 +318,19 @@ typedef struct _mystuff_t
   cl_uint  sieve_primes_upper_limit;        /* the upper limit of sieve_primes for the current exponent */
   cl_uint  sieve_primes_min, sieve_primes_max; /* user configurable sieve_primes min/max */
   cl_uint  sieve_size;
+  sieve_ctx_t *sieve_ctx;                   /* CPU sieve context of the host thread */
 
   cl_uint  gpu_sieving;			             /* TRUE if we're letting the GPU do the sieving */
   cl_uint  gpu_sieve_size;			         /* Size (in bits) of the GPU sieve.  4..128M bits. */
   cl_uint  gpu_sieve_processing_size;	   /* The number of GPU sieve bits each thread in a kernel will process.  8,16,24,32K bits. */
   cl_uint  gpu_sieve_min_exp;			       /* minimum exponent for the sieve_primes we have */
+  cl_uint  gpu_sieve_classes;              /* max. number of classes sieved and TF'd in one launch */
+  cl_uint  gpu_sieve_bucket_threshold;     /* bucket-sieve the primes above this many SegSieve blocks, 0 = off */
+  cl_uint  gpu_sieve_bucket_size;          /* capacity of each block's bucket, 0 if no primes are bucket-sieved */
+  cl_uint  gpu_sieve_compact;              /* TRUE if the TF kernels read a compacted candidate list instead of the bit array */
+  cl_uint  gpu_sieve_compact_size;         /* capacity of d_compact_list (entries) */
+  cl_uint  gpu_sieve_info_stride;          /* bytes between the per-class copies of the sieve info in d_sieve_info */
+  cl_uint  gpu_sieve_info_size;            /* bytes of sieve info used by one class (h_sieve_info) */
 
   cl_uint  flush;                        /* GPU sieving only: flush the queue after # kernels, 0=off */
   cl_uint  num_streams;
@@ -283,6 +338,9 @@ typedef struct _mystuff_t
   enum MODES mode;
   cl_uint checkpoints, checkpointdelay, stages, stopafterfactor;
   cl_uint threads_per_grid_max, threads_per_grid;
+  cl_uint grids_per_launch;              /* CPU sieve: grids TF'd by one launch of the multi-grid kernels */
+  cl_uint batch_exponents;               /* CPU sieve: max. number of assignments TF'd together, 1 = off */
+  batch_t batch;
 
 #ifdef CHECKS_MODBASECASE
   cl_mem   d_modbasecase_debug;
@@ -293,12 +351,19 @@ typedef struct _mystuff_t
   cl_uint  printmode;
   cl_uint  print_timestamp;
   cl_uint  quit;
-  cl_ulong cpu_mask;           /* CPU affinity mask for the siever thread */
+  cl_ulong cpu_mask;           /* CPU affinity mask for the siever thread(s) */
+  cl_uint  sieve_threads;      /* number of CPU siever threads, 0 = sieve in the main thread */
+  cl_uint  sieve_bucket_threshold; /* bucket sieve for primes above this multiple of the sieve size, 0 = off */
+  enum SIEVE_EXTRACTORS sieve_extractor; /* bit extraction method of the CPU sieve */
+  cl_uint  sieve_wheel_primes; /* number of small primes sieved with the wheel patterns, 0 = off */
+  cl_uint  host_tf;            /* 1: no OpenCL, trial factoring on the host (-d h) */
+  cl_uint  host_tf_threads;    /* number of TF threads on the host, 0 = one per CPU */
   cl_int   verbosity;          /* -1 = uninitialized, 0 = reduced number of screen printfs, 1= default, >= 2 = some additional printfs */
   cl_int   logging;
   cl_int   legacy_results_txt; /* 0 = output to results.txt disabled (default), 1 = output to results.txt enabled */
   cl_uint  selftestsize;
   cl_uint  force_rebuild;      /* 1: delete the previous binfile */
+  cl_uint  specialize_kernels; /* 1: rebuild the barrett kernel of an assignment with the exponent as a constant */
 
   stats_t  stats;              /* stats for the status line */
 
@@ -327,6 +392,7 @@ typedef struct
     cl_uint max_clock, units, w_dim;
     size_t wg_size, wi_sizes[10], maxThreadsPerBlock, maxThreadsPerGrid;
     cl_command_queue_properties queue_properties;
+    cl_bool host_unified_memory;
 } OpenCL_deviceinfo_t;
 
 typedef struct _kernel_info
@@ -334,9 +400,35 @@ typedef struct _kernel_info
   enum GPUKernels kernel_id;
   char            kernelname[32];
   cl_uint         bit_min, bit_max, stages;
-  cl_kernel       kernel;
 } kernel_info_t;
 
+/* The OpenCL state of one device. With -d x,y,... one mfakto drives several devices, each from a host
+thread of its own, and dev (see mfakto.h) points to the device of the calling thread. */
+typedef struct _device
+{
+  mystuff_t          *mystuff;          /* buffers, sieve and settings of this device, device 0 has the global mystuff */
+  cl_device_id       *devices;
+  cl_context          context;
+  cl_command_queue    commandQueue, commandQueuePrf;
+  cl_command_queue    commandQueueXfer; /* d_ktab uploads of the CPU sieve, overlapping with the TF kernels, see XFER_QUEUE */
+  cl_program          program;
+  cl_uint             new_class;
+  int                 only_use_cpu;
+  OpenCL_deviceinfo_t deviceinfo;
+  cl_kernel           kernel[UNKNOWN_GS_KERNEL + 1];        /* the kernels of kernel_info[], NULL until loaded */
+  cl_kernel           kernel_grids[UNKNOWN_GS_KERNEL + 1];  /* multi-grid variant (<kernelname>_grids) or NULL, see GridsPerLaunch */
+  cl_uint             bit_to_clear_exponent;  /* run_calc_bit_to_clear(): the exponent of the current modular inverses */
+  cl_event            gs_run_event;           /* run_gs_kernel(): flush and wait control */
+  cl_uint             gs_flush_counter;
+  int                 gpusieve_initialized;   /* gpusieve.cpp: buffers allocated, exponent and rows of the prime info */
+  cl_uint             gpusieve_exponent, gpusieve_maxp;
+  cl_uint             primes_per_thread;      /* number of "rows" in the GPU sieving info array that each thread processes */
+  cl_uint             primes_not_sieved;      /* index of the first sieved prime */
+  cl_uint             primes_special_code;    /* number of primes sieved with inline code, their bit-to-clear values precede the "rows" */
+  cl_uint             bucket_rows;            /* number of "rows" of bucket-sieved primes following the SegSieve "rows" (see BucketScatter) */
+  struct device_host *host;             /* streams, class pipeline and kernel builds, see mfakto.cpp */
+} device_t;
+
 
 #define RET_ERROR 1000000001
 #define RET_QUIT  1000000002
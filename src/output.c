@@ -49,6 +49,9 @@ void print_help(char *string)
   printf("                               single-digit argument is passed to -d\n");
   printf("  -d c                   run on the CPU (all cores)\n");
   printf("  -d g                   run on the first GPU found\n");
+  printf("  -d h                   no OpenCL, trial factor on the host (see HostTFThreads)\n");
+  printf("  -d <xy>,<xy>,...       drive several devices, they share the classes of\n");
+  printf("                         each assignment (\"h\" at most once)\n");
   printf("  -v <n>                 verbosity level: terse = 0, default = 1, more = 2,\n");
   printf("                                          maximum = 3\n");
   printf("  -tf <exp> <min> <max>  trial factor M<exp> from <min> to <max> bits, ignores\n");
@@ -56,6 +59,8 @@ void print_help(char *string)
   printf("  -i | --inifile <file>  load a specific INI file (default: %s)\n", CFG_FILE);
   printf("  -st                    self-test using the optimal kernel for each test case\n");
   printf("  -st2                   self-test using all possible kernels\n");
+  printf("  -st3                   GPU sieve self-test: a selection of test cases with a\n");
+  printf("                         tiny GPU sieve, each class is sieved in many chunks\n");
   printf("\n");
   printf("options for debugging purposes\n");
   printf("  --timertest            test timer functions\n");
@@ -63,6 +68,8 @@ void print_help(char *string)
   printf("  --perftest [n]         run performance test <n> times (default: 10)\n");
   printf("  --CLtest               test selected OpenCL functions\n");
   printf("                         use -d option before --CLtest to test specified device\n");
+  printf("  --gpusievetest [exp]   compare the GPU sieve of M<exp> with the host reference\n");
+  printf("                         use -d option before --gpusievetest to test specified device\n");
 }
 
 
@@ -633,6 +640,7 @@ void print_result_line(mystuff_t *mystuff, int factorsfound)
 
 
 void print_factor(mystuff_t *mystuff, int factor_number, char *factor, double bits)
+/* factor == NULL: the kernels found factor_number more factors than the result buffer holds */
 {
   char UID[110]; /* 50 (V5UserID) + 50 (ComputerID) + 8 + spare */
   FILE *txtresultfile = NULL;
@@ -652,7 +660,7 @@ void print_factor(mystuff_t *mystuff, int factor_number, char *factor, double bi
     if(mystuff->print_timestamp == 1 && factor_number == 0)print_timestamp(txtresultfile);
   }
 
-  if(factor_number < 10)
+  if(factor != NULL)
   {
     if(mystuff->mode != MODE_SELFTEST_SHORT)
     {
@@ -667,12 +675,12 @@ void print_factor(mystuff_t *mystuff, int factor_number, char *factor, double bi
         MFAKTO_VERSION, mystuff->stats.kernelname);
     }
   }
-  else /* factor_number >= 10 */
+  else /* result buffer overflow */
   {
-    if(mystuff->mode != MODE_SELFTEST_SHORT)      printf("M%u: %d additional factors not shown\n",      mystuff->exponent, factor_number-10);
+    if(mystuff->mode != MODE_SELFTEST_SHORT)      logprintf(mystuff, "M%u: %d additional factors not shown, the result buffer holds %d factors per class\n", mystuff->exponent, factor_number, RES_FACTORS_MAX);
     if(mystuff->mode == MODE_NORMAL && mystuff->legacy_results_txt == 1)
     {
-      fprintf(txtresultfile,"%sM%u: %d additional factors not shown\n", UID, mystuff->exponent, factor_number-10);
+      fprintf(txtresultfile,"%sM%u: %d additional factors not shown\n", UID, mystuff->exponent, factor_number);
     }
   }
 
@@ -171,11 +171,56 @@ Needs to be less than SIEVE_PRIMES_MIN.*/
 #define SIEVE_SPLIT 250 /* DO NOT CHANGE! */
 
 
+/*
+The number of CPU siever threads (SieveThreads in mfakto.ini). 0 means the
+CPU sieve runs in the main thread, as it always did.
+*/
+
+#define SIEVE_THREADS_MIN      0
+#define SIEVE_THREADS_DEFAULT  0
+#define SIEVE_THREADS_MAX     64
+
+
+/*
+Primes above SIEVE_BUCKET_THRESHOLD * SIEVE_SIZE are sieved using a bucket
+sieve (SieveBucketThreshold in mfakto.ini). Those primes hit a segment only
+every few segments, the buckets make the cost per segment depend on the number
+of hits instead of the number of primes. 0 disables the bucket sieve.
+*/
+
+#define SIEVE_BUCKET_THRESHOLD_MIN      0
+#define SIEVE_BUCKET_THRESHOLD_DEFAULT  1
+#define SIEVE_BUCKET_THRESHOLD_MAX     64
+
+
+/*
+The small primes after 23 (29, 31, 37, ...) can be pre-sieved with a wheel
+of precomputed patterns instead of the mask loop (SieveWheelPrimes in
+mfakto.ini is the number of primes in the wheel). 0 disables the wheel.
+*/
+
+#define SIEVE_WHEEL_PRIMES_MIN      0
+#define SIEVE_WHEEL_PRIMES_DEFAULT 24
+#define SIEVE_WHEEL_PRIMES_MAX     40
+
+
+/*
+The number of threads doing the trial factoring when running on the host
+(-d h, HostTFThreads in mfakto.ini). 0 means one thread per CPU.
+*/
+
+#define HOST_TF_THREADS_MIN       0
+#define HOST_TF_THREADS_DEFAULT   0
+#define HOST_TF_THREADS_MAX     256
+
+
 #ifdef CL_PERFORMANCE_INFO
-#define QUEUE commandQueuePrf
+#define QUEUE dev->commandQueuePrf
 #else
-#define QUEUE commandQueue
+#define QUEUE dev->commandQueue
 #endif
+/* the d_ktab uploads of the CPU sieve, on their own queue if the device has one */
+#define XFER_QUEUE ((dev->commandQueueXfer != NULL) ? dev->commandQueueXfer : QUEUE)
 /*
 The number of streams used by mfakto. No distinction between CPU and GPU streams anymore
 The actual configuration is done in mfakto.ini. This ini-file contains
@@ -187,6 +232,31 @@ The following lines define the min, default and max value.
 #define NUM_STREAMS_DEFAULT 3 /* DO NOT CHANGE! */
 #define NUM_STREAMS_MAX     10 /* DO NOT CHANGE! */
 
+/* CPU sieve: grids per launch of the multi-grid barrett15 kernels (GridsPerLaunch in mfakto.ini),
+the other kernel families have no multi-grid variant.
+The kernels get the k_base of each grid in one ulong16 argument. */
+#define GRIDS_PER_LAUNCH_MAX 16
+
+/* CPU sieve: assignments with the same bit range which are TF'd together (BatchExponents in mfakto.ini) */
+#define BATCH_EXPONENTS_MAX  16
+
+/* classes in flight: tf() starts the next class before it reads the results of the previous one */
+#define TF_PIPELINE_DEPTH    2
+
+/* self-tests: classes TF'd per test case, the class of the known factor and the needed classes right
+below it, so that several classes go through the class pipeline or one multi-class GPU sieve launch */
+#define SELFTEST_CLASSES     4
+
+/* The result buffer of a class (or a multi-class launch): RES[0] counts all factors the kernels find,
+the first RES_FACTORS_MAX of them are stored as 3 words each. The kernels get RES_FACTORS_MAX as a
+build option, a count above it is reported as an overflow. */
+#define RES_FACTORS_MAX     64
+#define RES_SIZE            (1 + 3 * RES_FACTORS_MAX)  /* cl_uints */
+
+/* batch mode: each exponent of a batch has a result buffer of RES_SIZE, the multi-grid kernels
+write a factor into the one of the exponent of its grid. These are allocated back to back. */
+#define RES_SIZE_BATCH      (RES_SIZE * BATCH_EXPONENTS_MAX)
+
 // MORE_CLASSES and SIEVE_SIZE are used for CPU-sieving only. GPU-sieving uses a config setting
 /* set NUM_CLASSES and SIEVE_SIZE depending on MORE_CLASSES and SIEVE_SIZE_LIMIT
    MORE_CLASSES is required for mfakto's CPU sieve */
@@ -211,31 +281,53 @@ Larger values may lead to less wasted cycles by reducing the number of times all
 are not TFing a candidate.  However, more shared memory is used which may reduce occupancy.
 Smaller values should lead to a more responsive system (each kernel takes less time to execute).
 
+GPU_SIEVE_CLASSES defines how many classes may be sieved and TF'd in one launch when a class is
+much smaller than the GPU sieve (large exponents). Each of these classes needs its own copy of the
+sieve info on the GPU.
+
+Primes above GPU_SIEVE_BUCKET_THRESHOLD * 64K (one SegSieve block) hit a block at most once. Instead of
+having every block check every one of these primes, BucketScatter collects their hits in a bucket per
+block first and SegSieve only clears the hits of its own block. This makes GPU_SIEVE_PRIMES above
+GPU_SIEVE_ROW_PRIMES_MAX possible.
+
 The actual configuration is done in mfakto.ini.
 The following lines define the min, default and max value.
 */
 
 #define GPU_SIEVE_PRIMES_MIN                54 /* GPU sieving code can work (inefficiently) with very small numbers */
 #define GPU_SIEVE_PRIMES_DEFAULT         82486 /* Default is to sieve primes up to about 1.05M */
-#define GPU_SIEVE_PRIMES_MAX           1075766 /* Primes to 16,742,237.  GPU sieve should be able to handle up to 16M. */
+#define GPU_SIEVE_PRIMES_MAX          10000000 /* Primes to 179,424,673, the primes above GPU_SIEVE_ROW_PRIMES_MAX are bucket-sieved */
+#define GPU_SIEVE_ROW_PRIMES_MAX       1075766 /* Primes to 16,742,237.  SegSieve's prime "rows" can handle up to 16M. */
 
 #define GPU_SIEVE_SIZE_MIN                   4 /* A 4M bit sieve seems like a reasonable minimum */
 #define GPU_SIEVE_SIZE_DEFAULT              64 /* Default is a 64M bit sieve */
 #define GPU_SIEVE_SIZE_MAX                 128 /* We've only tested up to 128M bits.  The GPU sieve code may be able to go higher. */
+#define GPU_SIEVE_SIZE_SELFTEST          65536 /* In bits(!): one SegSieve block for the -st3 self-test, so that each class spans many sieve chunks */
 
 #define GPU_SIEVE_PROCESS_SIZE_MIN           8 /* Processing 8K bits in each block is minimum (256 threads * 1 word of 32 bits) */
 #define GPU_SIEVE_PROCESS_SIZE_DEFAULT      16 /* Default is processing 16K bits */
 #define GPU_SIEVE_PROCESS_SIZE_MAX          32 /* Upper limit is 64K, since we store k values as "short". Shared memory requirements limit usable values */
 
+#define GPU_SIEVE_CLASSES_MIN                1 /* one class per launch, as before */
+#define GPU_SIEVE_CLASSES_DEFAULT           16
+#define GPU_SIEVE_CLASSES_MAX               64
+
+#define GPU_SIEVE_BUCKET_THRESHOLD_MIN       0 /* 0: no bucket sieve, GPUSievePrimes is limited to GPU_SIEVE_ROW_PRIMES_MAX */
+#define GPU_SIEVE_BUCKET_THRESHOLD_DEFAULT  16 /* bucket-sieve the primes above 1M */
+#define GPU_SIEVE_BUCKET_THRESHOLD_MAX     256 /* the rows can't handle primes above 16M anyway */
+
 /* settings related to worktodo.txt file */
 #define WORKTODO_FILE               "worktodo.txt"  // should not exceed 50 characters
 #define MAX_LINE_LENGTH             100
 
 #define MAX_FACTORS_PER_JOB         20
+#define MAX_DEVICES                 16  // devices one mfakto can drive with -d x,y,...
 #define MAX_DEZ_96_STRING_LENGTH    30  // unsigned int96 can have up to 29 digits + 1 byte for NUL
 
 #define MAX_FACTOR_BUFFER_LENGTH    MAX_FACTORS_PER_JOB * MAX_DEZ_96_STRING_LENGTH
-#define MAX_BUFFER_LENGTH           MAX_FACTOR_BUFFER_LENGTH + 100
+#define CLASS_BITMAP_BYTES          ((NUM_CLASSES + 7) / 8)      // one bit per class, see checkpoint.h
+#define MAX_CLASS_BITMAP_LENGTH     ((NUM_CLASSES + 3) / 4 + 1)  // the bitmap as hex digits in the checkpoint file
+#define MAX_BUFFER_LENGTH           MAX_FACTOR_BUFFER_LENGTH + MAX_CLASS_BITMAP_LENGTH + 200  // + version (up to 80) and the numbers
 
 /* other files - names should not exceed 50 characters */
 #define CFG_FILE                    "mfakto.ini"
@@ -317,7 +317,19 @@ enum PARSE_WARNINGS parse_worktodo_line(FILE *f_in, struct ASSIGNMENT *assignmen
  *     1 - get_next_assignment : cannot open file							                                *
  *     2 - get_next_assignment : no valid assignment found						                            *
  ************************************************************************************************************/
-enum ASSIGNMENT_ERRORS get_next_assignment(char *filename, unsigned int *exponent, unsigned int *bit_min, unsigned int *bit_max, LINE_BUFFER *key, int verbosity)
+static int is_skipped(unsigned int exponent, const unsigned int *skip, int num_skip)
+{
+  int i;
+
+  for (i = 0; i < num_skip; i++)
+  {
+    if (skip[i] == exponent) return 1;
+  }
+  return 0;
+}
+
+static enum ASSIGNMENT_ERRORS find_assignment(char *filename, unsigned int *exponent, unsigned int *bit_min, unsigned int *bit_max, LINE_BUFFER *key,
+                                              const unsigned int *skip, int num_skip, int verbosity)
 {
   FILE *f_in;
   
@@ -344,7 +356,11 @@ enum ASSIGNMENT_ERRORS get_next_assignment(char *filename, unsigned int *exponen
     if (NO_WARNING == value)
     {
       if (valid_assignment(assignment.exponent,assignment.bit_min, assignment.bit_max, verbosity))
-        break;
+      {
+        if (!is_skipped(assignment.exponent, skip, num_skip))
+          break;
+        continue;  // already in the batch, see get_assignment_batch()
+      }
       value = INVALID_DATA;
     }
 
@@ -380,6 +396,28 @@ enum ASSIGNMENT_ERRORS get_next_assignment(char *filename, unsigned int *exponen
     return VALID_ASSIGNMENT_NOT_FOUND;
 }
 
+enum ASSIGNMENT_ERRORS get_next_assignment(char *filename, unsigned int *exponent, unsigned int *bit_min, unsigned int *bit_max, LINE_BUFFER *key, int verbosity)
+{
+  return find_assignment(filename, exponent, bit_min, bit_max, key, NULL, 0, verbosity);
+}
+
+/* BatchExponents: exponent[0] is the assignment from get_next_assignment(), bit_min and bit_max
+   its bit range. Adds the assignments which follow it in the worktodo file as long as they have
+   the same bit range, up to max in total. Returns the number of exponents. */
+int get_assignment_batch(char *filename, unsigned int *exponent, LINE_BUFFER *key, int max, unsigned int bit_min, unsigned int bit_max)
+{
+  unsigned int next_exponent, next_bit_min, next_bit_max;
+  int n = 1;
+
+  while (n < max &&
+         find_assignment(filename, &next_exponent, &next_bit_min, &next_bit_max, &key[n], exponent, n, 0) == OK &&
+         next_bit_min == bit_min && next_bit_max == bit_max)
+  {
+    exponent[n++] = next_exponent;
+  }
+  return n;
+}
+
 
 /************************************************************************************************************
  * Function name : clear_assignment                                                                         *
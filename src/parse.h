@@ -47,6 +47,7 @@ int valid_assignment(unsigned int exp, int bit_min, int bit_max, int verbosity);
 enum ASSIGNMENT_ERRORS get_next_assignment(char *filename, unsigned int *exponent, unsigned int *bit_min, unsigned int *bit_max,
                                            LINE_BUFFER *assignment_key, int verbosity);
 enum ASSIGNMENT_ERRORS clear_assignment(char *filename, unsigned int exponent, int bit_min, int bit_max, int bit_min_new);
+int get_assignment_batch(char *filename, unsigned int *exponent, LINE_BUFFER *key, int max, unsigned int bit_min, unsigned int bit_max);
 
 int add_file_available(char *filename);
 
@@ -30,6 +30,7 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "read_config.h"
 #include "parse.h"
 #include "sieve.h"
+#include "sievepool.h"
 #include "timer.h"
 #include "checkpoint.h"
 #include "filelocking.h"
@@ -37,6 +38,8 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "mfakto.h"
 #include "output.h"
 #include "gpusieve.h"
+#include "gpusieve_ref.h"
+#include "cpu_tf.h"
 #ifndef _MSC_VER
 #include <sys/time.h>
 #else
@@ -46,23 +49,34 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #endif
 
 extern "C" mystuff_t            mystuff;
-extern "C" OpenCL_deviceinfo_t  deviceinfo;
 extern "C" kernel_info_t        kernel_info[];
-extern cl_command_queue         commandQueue, commandQueuePrf;
-extern cl_context               context;
-extern cl_device_id            *devices;
-extern cl_program               program;
-extern cl_uint                  new_class;
-extern int run_gs_kernel15(cl_kernel kernel, cl_uint numblocks, cl_uint shared_mem_required, int75 k_base, cl_uint8 b_in, cl_uint shiftcount);
-extern int run_gs_kernel32(cl_kernel kernel, cl_uint numblocks, cl_uint shared_mem_required, int96 k_base, int192 b_preinit, cl_uint shiftcount);
+extern int run_gs_kernel15(cl_kernel kernel, cl_uint numblocks, cl_uint blocks_per_class, cl_uint shared_mem_required, int75 k_base, cl_uint8 b_in, cl_uint shiftcount);
+extern int run_gs_kernel32(cl_kernel kernel, cl_uint numblocks, cl_uint blocks_per_class, cl_uint shared_mem_required, int96 k_base, int192 b_preinit, cl_uint shiftcount);
 extern int run_kernel15(cl_kernel l_kernel, cl_uint exp, int75 k_base, int stream, cl_uint8 b_in, cl_mem res, cl_int shiftcount, cl_int bin_max);
 extern int run_kernel24(cl_kernel l_kernel, cl_uint exp, int72 k_base, int stream, int144 b_preinit, cl_mem res, cl_int shiftcount, cl_int bin_min63);
 extern int run_barrett_kernel32(cl_kernel l_kernel, cl_uint exp, int96 k_base, int stream, int192 b_preinit, cl_mem res, cl_int shiftcount, cl_int bin_min63);
 extern int run_kernel64(cl_kernel l_kernel, cl_uint exp, cl_ulong k_base, int stream, cl_ulong4 b_preinit, cl_mem res, cl_int bin_min63);
+extern "C" cl_int ktab_to_device(cl_uint i, size_t size);
+extern "C" cl_int ktab_to_host(cl_uint i);
 extern "C" int class_needed(unsigned int expo, unsigned long long int k_min, int c);
 extern "C" unsigned long long int calculate_k(unsigned int exp, int bits);
 
 #define EXP 66362159
+#define EXP2 66362189 // another prime exponent
+
+static sieve_ctx_t *perftest_sieve_ctx(cl_uint ssize, cl_uint bucket_threshold, cl_uint wheel_primes)
+/* a new CPU sieve context with a sieve of ssize bits */
+{
+  sieve_ctx_t *ctx = sieve_ctx_new(ssize, bucket_threshold, wheel_primes);
+
+  if (ctx == NULL)
+  {
+    fprintf(stderr, "ERROR: out of memory\n");
+    exit(1);
+  }
+  sieve_ctx_set_extractor(ctx, mystuff.sieve_extractor);
+  return ctx;
+}
 
 int init_perftest(int devicenumber)
 {
@@ -80,22 +94,36 @@ int init_perftest(int devicenumber)
   sieve_init();
 #else
   mystuff.sieve_size = (36<<13) - (36<<13) % (13*17*19*23);
-  sieve_init(mystuff.sieve_size, mystuff.sieve_primes_max);
+  sieve_init(mystuff.sieve_primes_max);
 #endif
+  mystuff.sieve_ctx = perftest_sieve_ctx(mystuff.sieve_size, mystuff.sieve_bucket_threshold, mystuff.sieve_wheel_primes);
   mystuff.num_streams = 10;
   mystuff.threads_per_grid_max = 2097152;
   mystuff.sieve_primes_adjust = 0;
   mystuff.force_rebuild = 1; // always rebuild from scratch while doing this test
 
-  init_CL(mystuff.num_streams, &devicenumber);
-//  i = (cl_uint)deviceinfo.maxThreadsPerBlock * deviceinfo.units * mystuff.vectorsize;
   i = 2048;
   while( (i * 2) <= mystuff.threads_per_grid_max) i = i * 2;
-  mystuff.threads_per_grid = MIN(i, (cl_uint)deviceinfo.maxThreadsPerGrid);
+  if (mystuff.host_tf) // -d h: no OpenCL, only the ktab for the sieve tests is needed
+  {
+    mystuff.threads_per_grid = i;
+    mystuff.h_ktab[0] = (cl_uint *) malloc(mystuff.threads_per_grid * sizeof(cl_uint));
+    if (mystuff.h_ktab[0] == NULL)
+    {
+      fprintf(stderr, "ERROR: out of memory\n");
+      exit(1);
+    }
+  }
+  else
+  {
+    init_CL(mystuff.num_streams, &devicenumber);
+//    i = (cl_uint)deviceinfo.maxThreadsPerBlock * deviceinfo.units * mystuff.vectorsize;
+    mystuff.threads_per_grid = MIN(i, (cl_uint)dev->deviceinfo.maxThreadsPerGrid);
 
-  set_gpu_type();
-  load_kernels(&devicenumber);
-  init_CLstreams(0);  // alloc buffers
+    set_gpu_type();
+    load_kernels(&devicenumber);
+    init_CLstreams(0);  // alloc buffers
+  }
 
   register_signal_handler(&mystuff);
 
@@ -108,27 +136,53 @@ int init_perftest(int devicenumber)
 int test_sieve_init(int par)
 {
   struct timeval timer;
-  double time1;
+  double time1, time2;
   cl_uint test_sizes[] = {5000, 20000, 80000, 200000, 500000, 1000000};
   cl_uint test_loops = sizeof(test_sizes) / sizeof(test_sizes[0]);
-  cl_uint i, j;
+  cl_uint i, j, exp;
   cl_ulong k=0;
 
   printf("1. CPU-Sieve-Init (once per class, 960 times per test, avg. for %d iterations)\n", par);
   for (j=0; j<test_loops; j++)
   {
+    // the first class of an exponent also sets up the per-exponent data, use a different exponent each time
+    exp = (j & 1) ? EXP2 : EXP;
     timer_init(&timer);
+    sieve_init_class(mystuff.sieve_ctx, exp, k++, test_sizes[j]);
+    time2 = (double)timer_diff(&timer);
 
+    timer_init(&timer);
     for (i=0; i<(cl_uint)par; i++)
     {
-      sieve_init_class(EXP, k++, test_sizes[j]);
+      sieve_init_class(mystuff.sieve_ctx, exp, k++, test_sizes[j]);
     }
     time1 = (double)timer_diff(&timer);
-    printf("\tInit_class(sieveprimes=%7d): %8.2f ms\n", test_sizes[j], time1/par/1000);
+    printf("\tInit_class(sieveprimes=%7d): %8.2f ms, first class of an exponent: %8.2f ms\n", test_sizes[j], time1/par/1000, time2/1000);
   }
   return 0;
 }
 
+static void test_sieve_row(sieve_ctx_t *ctx, int par, cl_uint *sprimes, int nsp, cl_ulong *k)
+/* one row of the sieve table: the output rate (M/s) of ctx for each SievePrimes value */
+{
+  struct timeval timer;
+  double time1;
+  cl_uint i;
+  int ii;
+
+  for(ii=0; ii<nsp; ii++)
+  {
+    sieve_init_class(ctx, EXP, *k+=1000000, sprimes[ii]);
+    timer_init(&timer);
+    for (i=0; i<(cl_uint)(par*(nsp-ii)); i++)
+    {
+      sieve_candidates(ctx, mystuff.threads_per_grid, mystuff.h_ktab[0], sprimes[ii]);
+    }
+    time1 = (double)timer_diff(&timer);
+    printf(" %7.1f", (double)(par*(mystuff.threads_per_grid *(nsp-ii)))/time1);
+  }
+}
+
 /* Test the core sieving performance.
    This is the main part of the CPU; it's speed directly influences total
    mfakto performance. Achieving the same sieve output at a doubled SievePrimes
@@ -275,7 +329,7 @@ Sieved out:   63.63%  65.94%  67.95%  69.73%  71.31%  72.72%  74.00%  75.16%  76
   double time1;
   cl_ulong k = 0;
   cl_uint i;
-  printf("\n2. CPU-Sieve (output rate M/s)\n");
+  printf("\n2. CPU-Sieve (output rate M/s, SieveWheelPrimes=%u, SieveBucketThreshold=%u)\n", mystuff.sieve_wheel_primes, mystuff.sieve_bucket_threshold);
 
 #define MAX_NUM_SPS 30
 
@@ -320,22 +374,22 @@ Sieved out:   63.63%  65.94%  67.95%  69.73%  71.31%  72.72%  74.00%  75.16%  76
   {
 #ifdef SIEVE_SIZE_LIMIT
     if (j>=3) break; // quit after 3 equal loops if we can't dynamically set the sieve size anyway
-    sieve_init_class(EXP, k+=1000000, 1000000);
     printf("\n%6d kiB  ", SIEVE_SIZE/8192+1);
 #else
-    sieve_free();
     cl_uint tmp=m*ssizes[j];
-    sieve_init(tmp, 1000000);
-    sieve_init_class(EXP, k+=1000000, 1000000);
+    sieve_ctx_free(mystuff.sieve_ctx);
+    mystuff.sieve_ctx = perftest_sieve_ctx(tmp, mystuff.sieve_bucket_threshold, mystuff.sieve_wheel_primes);
     printf("\n%6d kiB  ", tmp/8192+1);
 #endif
 
     for(ii=0; ii<nsp; ii++)
     {
+      // the bucket sieve is set up for the SievePrimes of the class, so init the class for each column
+      sieve_init_class(mystuff.sieve_ctx, EXP, k+=1000000, sprimes[ii]);
       timer_init(&timer);
       for (i=0; i<(cl_uint)(par*(nsp-ii)); i++)
       {
-        sieve_candidates(mystuff.threads_per_grid, mystuff.h_ktab[0], sprimes[ii]);
+        sieve_candidates(mystuff.sieve_ctx, mystuff.threads_per_grid, mystuff.h_ktab[0], sprimes[ii]);
       }
       time1 = (double)timer_diff(&timer);
       last_elem[ii] += mystuff.h_ktab[0][mystuff.threads_per_grid-1]; // sum the last elements to get an average
@@ -355,6 +409,98 @@ Sieved out:   63.63%  65.94%  67.95%  69.73%  71.31%  72.72%  74.00%  75.16%  76
       break;
     }
   }
+
+  if (!mystuff.quit)
+  {
+    // other bucket sieve and wheel settings, using the sieve size of the last row
+#ifdef SIEVE_SIZE_LIMIT
+    cl_uint ssize = SIEVE_SIZE;
+#else
+    cl_uint ssize = m*ssizes[MIN(j,nss)-1];
+#endif
+    sieve_ctx_t *ctx;
+    cl_uint w;
+
+    if (mystuff.sieve_bucket_threshold > 0)
+    {
+      ctx = perftest_sieve_ctx(ssize, 0, mystuff.sieve_wheel_primes);
+      printf("\nno buckets  ");
+      test_sieve_row(ctx, par, sprimes, nsp, &k);
+      sieve_ctx_free(ctx);
+    }
+    for (w = 0; w <= SIEVE_WHEEL_PRIMES_MAX && !mystuff.quit; w += 8)
+    {
+      if (w == mystuff.sieve_wheel_primes) continue; // that's the configured value used above
+      ctx = perftest_sieve_ctx(ssize, mystuff.sieve_bucket_threshold, w);
+      printf("\nwheel %2u    ", w);
+      test_sieve_row(ctx, par, sprimes, nsp, &k);
+      sieve_ctx_free(ctx);
+    }
+  }
+
+  if (!mystuff.quit)
+  {
+    // the bit extraction alone: sieve one segment, then convert the same sieve to candidates again and again
+#ifdef SIEVE_SIZE_LIMIT
+    cl_uint ssize = SIEVE_SIZE;
+#else
+    cl_uint ssize = m*ssizes[MIN(j,nss)-1];
+#endif
+    sieve_ctx_t *ctx = perftest_sieve_ctx(ssize, mystuff.sieve_bucket_threshold, mystuff.sieve_wheel_primes);
+    cl_uint *ktab = (cl_uint *) malloc((ssize + 8) * sizeof(cl_uint));
+    cl_ulong n;
+    int e;
+
+    if (ktab == NULL)
+    {
+      fprintf(stderr, "ERROR: out of memory\n");
+      exit(1);
+    }
+    printf("\n\nBit extraction only (M/s)");
+    for (e = SIEVE_EXTRACT_TABLE; e < SIEVE_EXTRACT_UNKNOWN && !mystuff.quit; e++)
+    {
+      if (!sieve_extractor_supported((enum SIEVE_EXTRACTORS)e)) continue;
+      sieve_ctx_set_extractor(ctx, (enum SIEVE_EXTRACTORS)e);
+      printf("\n%-12s", sieve_extractor_name((enum SIEVE_EXTRACTORS)e));
+      for(ii=0; ii<nsp; ii++)
+      {
+        sieve_init_class(ctx, EXP, k+=1000000, sprimes[ii]);
+        sieve_candidates_segment(ctx, ktab, 0, sprimes[ii]);
+        n = 0;
+        timer_init(&timer);
+        for (i=0; i<(cl_uint)(par*50); i++)
+        {
+          n += sieve_extract(ctx, ktab, 0);
+        }
+        time1 = (double)timer_diff(&timer);
+        printf(" %7.1f", (double)n/time1);
+      }
+    }
+    free(ktab);
+    sieve_ctx_free(ctx);
+  }
+
+  if (mystuff.sieve_threads > 0 && !mystuff.quit)
+  {
+    // the siever threads, using the sieve size of the last row
+#ifndef SIEVE_SIZE_LIMIT
+    mystuff.sieve_size = m*ssizes[MIN(j,nss)-1];
+#endif
+    sievepool_init(&mystuff);
+    printf("\n%3u threads ", mystuff.sieve_threads);
+    for(ii=0; ii<nsp; ii++)
+    {
+      sievepool_init_class(EXP, k+=1000000, sprimes[ii]);
+      timer_init(&timer);
+      for (i=0; i<(cl_uint)(par*(nsp-ii)); i++)
+      {
+        sievepool_candidates(mystuff.threads_per_grid, mystuff.h_ktab[0]);
+      }
+      time1 = (double)timer_diff(&timer);
+      printf(" %7.1f", (double)(par*(mystuff.threads_per_grid *(nsp-ii)))/time1);
+    }
+    sievepool_free();
+  }
   printf("\n\nBest SieveSizeLimit for\nSievePrimes:");
   for(ii=0; ii<nsp; ii++)
   {
@@ -394,6 +540,128 @@ Sieved out:   63.63%  65.94%  67.95%  69.73%  71.31%  72.72%  74.00%  75.16%  76
   return 0;
 }
 
+/* compare the ways to get a ktab to the device, with buffers of its own:
+   - pageable: clEnqueueWriteBuffer() from malloc'd memory
+   - pinned: clEnqueueWriteBuffer() from a mapped CL_MEM_ALLOC_HOST_PTR buffer
+   - zero-copy: the host writes into a mapped CL_MEM_ALLOC_HOST_PTR device
+     buffer and hands it over by unmapping it, nothing is copied. On a discrete
+     GPU the kernel then reads the ktab across the bus.
+   */
+int test_copy_modes(cl_uint par)
+{
+  struct timeval timer;
+  double time_pageable = 0.0, time_pinned = 0.0, time_zero = 0.0;
+  cl_uint i, j;
+  cl_int status;
+  size_t size = mystuff.threads_per_grid * sizeof(cl_uint);
+  cl_uint *pageable[10], *pinned[10], *zero[10];
+  cl_mem   dbuf[10], staging[10], zbuf[10];
+
+  for (i=0; i<10; i++)
+  {
+    if ((pageable[i] = (cl_uint *) malloc(size)) == NULL)
+    {
+      printf("ERROR: malloc(pageable[%d]) failed\n", i);
+      return RET_ERROR;
+    }
+    sieve_candidates(mystuff.sieve_ctx, mystuff.threads_per_grid, pageable[i], 5000);
+
+    dbuf[i] = clCreateBuffer(dev->context, CL_MEM_READ_ONLY, size, NULL, &status);
+    if (status == CL_SUCCESS) staging[i] = clCreateBuffer(dev->context, CL_MEM_READ_WRITE | CL_MEM_ALLOC_HOST_PTR, size, NULL, &status);
+    if (status == CL_SUCCESS) zbuf[i] = clCreateBuffer(dev->context, CL_MEM_READ_ONLY | CL_MEM_ALLOC_HOST_PTR, size, NULL, &status);
+    if (status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clCreateBuffer\n";
+      return RET_ERROR;
+    }
+    pinned[i] = (cl_uint *) clEnqueueMapBuffer(dev->commandQueue, staging[i], CL_TRUE, CL_MAP_WRITE, 0, size, 0, NULL, NULL, &status);
+    if (status == CL_SUCCESS) zero[i] = (cl_uint *) clEnqueueMapBuffer(dev->commandQueue, zbuf[i], CL_TRUE, CL_MAP_WRITE, 0, size, 0, NULL, NULL, &status);
+    if (status != CL_SUCCESS)
+    {
+      std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clEnqueueMapBuffer\n";
+      return RET_ERROR;
+    }
+    memcpy(pinned[i], pageable[i], size);
+  }
+
+  for (j=0; j<par; j++)
+  {
+    timer_init(&timer);
+    for (i=0; i<10; i++)
+    {
+      status = clEnqueueWriteBuffer(dev->commandQueue, dbuf[i], CL_FALSE, 0, size, pageable[i], 0, NULL, NULL);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying pageable buffer (clEnqueueWriteBuffer)\n";
+        return RET_ERROR;
+      }
+    }
+    clFinish(dev->commandQueue);
+    time_pageable += (double)timer_diff(&timer);
+
+    timer_init(&timer);
+    for (i=0; i<10; i++)
+    {
+      status = clEnqueueWriteBuffer(dev->commandQueue, dbuf[i], CL_FALSE, 0, size, pinned[i], 0, NULL, NULL);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying pinned buffer (clEnqueueWriteBuffer)\n";
+        return RET_ERROR;
+      }
+    }
+    clFinish(dev->commandQueue);
+    time_pinned += (double)timer_diff(&timer);
+
+    timer_init(&timer);
+    for (i=0; i<10; i++)
+    {
+      memcpy(zero[i], pageable[i], size); // stands in for the siever writing the ktab
+      status = clEnqueueUnmapMemObject(dev->commandQueue, zbuf[i], zero[i], 0, NULL, NULL);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clEnqueueUnmapMemObject\n";
+        return RET_ERROR;
+      }
+    }
+    clFinish(dev->commandQueue);
+    time_zero += (double)timer_diff(&timer);
+    for (i=0; i<10; i++)
+    {
+      zero[i] = (cl_uint *) clEnqueueMapBuffer(dev->commandQueue, zbuf[i], CL_TRUE, CL_MAP_WRITE, 0, size, 0, NULL, NULL, &status);
+      if(status != CL_SUCCESS)
+      {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): clEnqueueMapBuffer\n";
+        return RET_ERROR;
+      }
+    }
+  }
+
+  printf("\n  Pageable vs. pinned vs. zero-copy (device %s host unified memory):\n", dev->deviceinfo.host_unified_memory ? "has" : "has no");
+  printf("%8d MB in %6.1f ms (%6.1f MB/s) (pageable, copied)\n",
+      (int)(j*10*size/1024/1024), time_pageable/1000.0, (double)(j*10*size)/time_pageable);
+  printf("%8d MB in %6.1f ms (%6.1f MB/s) (pinned, copied)\n",
+      (int)(j*10*size/1024/1024), time_pinned/1000.0, (double)(j*10*size)/time_pinned);
+  printf("%8d MB in %6.1f ms (%6.1f MB/s) (zero-copy, written and unmapped)\n",
+      (int)(j*10*size/1024/1024), time_zero/1000.0, (double)(j*10*size)/time_zero);
+  printf("  Using %s ktab buffers\n", (mystuff.ktab_transfer == KTAB_ZERO_COPY) ? "zero-copy" : (mystuff.ktab_transfer == KTAB_PINNED) ? "pinned" : "pageable");
+
+  for (i=0; i<10; i++)
+  {
+    clEnqueueUnmapMemObject(dev->commandQueue, staging[i], pinned[i], 0, NULL, NULL);
+    clEnqueueUnmapMemObject(dev->commandQueue, zbuf[i], zero[i], 0, NULL, NULL);
+  }
+  clFinish(dev->commandQueue);
+  for (i=0; i<10; i++)
+  {
+    clReleaseMemObject(dbuf[i]);
+    clReleaseMemObject(staging[i]);
+    clReleaseMemObject(zbuf[i]);
+    free(pageable[i]);
+  }
+
+  return 0;
+}
+
 /* test the performance of the memory copy to the device
    necessary for good performance, but not a lot that can be done
    about it, this is rather informational
@@ -411,20 +679,27 @@ int test_copy(cl_uint par)
   cl_int status;
   size_t size = mystuff.threads_per_grid * sizeof(int);
 
+  printf("\n3. Memory copy to GPU (blocks of %d bytes)\n", (int) size);
+
+  if (mystuff.ktab_transfer == KTAB_ZERO_COPY)
+  {
+    // h_ktab is the mapped d_ktab, copying it to itself is undefined
+    printf("\n  Standard copy: skipped, the ktabs are not copied on this device\n");
+    return test_copy_modes(par);
+  }
+
   // fill some data into the arrays (not that it matters what's in there ...)
   for (i=0; i<10; i++)
   {
-    sieve_candidates(mystuff.threads_per_grid, mystuff.h_ktab[i], 5000);
+    sieve_candidates(mystuff.sieve_ctx, mystuff.threads_per_grid, mystuff.h_ktab[i], 5000);
   }
 
-  printf("\n3. Memory copy to GPU (blocks of %d bytes)\n", (int) size);
-
   // first, run a while to warm up the GPU (turn up clocks) without any measurement
   for (j=0; j<2; j++)
   {
     for (i=0; i<10; i++)
     {
-        status = clEnqueueWriteBuffer(commandQueuePrf,
+        status = clEnqueueWriteBuffer(dev->commandQueuePrf,
                   mystuff.d_ktab[i],
                   CL_FALSE,
                   0,
@@ -440,7 +715,7 @@ int test_copy(cl_uint par)
             return RET_ERROR;
         }
     }
-    status = clFinish(commandQueuePrf);
+    status = clFinish(dev->commandQueuePrf);
   }
 
   timer_init(&timer);
@@ -449,7 +724,7 @@ int test_copy(cl_uint par)
   {
     for (i=0; i<10; i++)
     {
-        status = clEnqueueWriteBuffer(commandQueue,
+        status = clEnqueueWriteBuffer(dev->commandQueue,
                   mystuff.d_ktab[i],
                   CL_FALSE,
                   0,
@@ -465,7 +740,7 @@ int test_copy(cl_uint par)
             return RET_ERROR;
         }
     }
-    status = clFinish(commandQueue);
+    status = clFinish(dev->commandQueue);
   }
   time1 = (double)timer_diff(&timer);
   printf("\n  Standard copy, standard queue:\n%8d MB in %6.1f ms (%6.1f MB/s) (real)\n",
@@ -480,7 +755,7 @@ int test_copy(cl_uint par)
     timer_init(&timer);
     for (i=0; i<10; i++)
     {
-        status = clEnqueueWriteBuffer(commandQueuePrf,
+        status = clEnqueueWriteBuffer(dev->commandQueuePrf,
                   mystuff.d_ktab[i],
                   CL_FALSE,
                   0,
@@ -497,7 +772,7 @@ int test_copy(cl_uint par)
         }
 
     }
-    status = clFinish(commandQueuePrf);
+    status = clFinish(dev->commandQueuePrf);
     time1  += (double)timer_diff(&timer);
 
     cl_ulong startTime, endTime;
@@ -551,7 +826,7 @@ int test_copy(cl_uint par)
     {
       if (i&1)
       {
-        status = clEnqueueWriteBuffer(commandQueuePrf,
+        status = clEnqueueWriteBuffer(dev->commandQueuePrf,
                   mystuff.d_ktab[i],
                   CL_FALSE,
                   0,
@@ -563,7 +838,7 @@ int test_copy(cl_uint par)
       }
       else
       {
-        status = clEnqueueWriteBuffer(commandQueue,
+        status = clEnqueueWriteBuffer(dev->commandQueue,
                   mystuff.d_ktab[i],
                   CL_FALSE,
                   0,
@@ -581,15 +856,14 @@ int test_copy(cl_uint par)
       }
 
     }
-    status = clFinish(commandQueuePrf);
-    status = clFinish(commandQueue); // this one does not really finish the job ...
+    status = clFinish(dev->commandQueuePrf);
+    status = clFinish(dev->commandQueue); // this one does not really finish the job ...
     time1  += (double)timer_diff(&timer);
   }
   printf("\n  Standard copy, two queues:\n%8d MB in %6.1f ms (%6.1f MB/s) (real)\n",
       (int)(j*10*size/1024/1024), time1/1000.0, (double)(j*10*size)/time1);
 
-
-  return 0;
+  return test_copy_modes(par);
 }
 
 int test_gpu_sieve(cl_uint par)
@@ -619,9 +893,9 @@ int test_gpu_sieve(cl_uint par)
     gpusieve_init_exponent(&mystuff);
     mystuff.exponent = EXP;
     gpusieve_init_exponent(&mystuff);
-    clFlush(commandQueue);
+    clFlush(dev->commandQueue);
   }
-  clFinish(commandQueue);
+  clFinish(dev->commandQueue);
   time1 = (double)timer_diff(&timer);
 
   printf(" gpusieve_init_exponent: %f ms (CalcModularInverses)\n", time1/2000.0/par);
@@ -632,19 +906,31 @@ int test_gpu_sieve(cl_uint par)
   {
     gpusieve_init_class(&mystuff, k); // does a flush on its own
   }
-  clFinish(commandQueue);
+  clFinish(dev->commandQueue);
   time1 = (double)timer_diff(&timer);
 
   printf(" gpusieve_init_class: %f ms (CalcBitToClear)\n", time1/1000.0/par);
   if (mystuff.quit) exit(1);
 
+  timer_init(&timer);
+  for (i=0; i<par; i++)
+  {
+    gpusieve_advance_class(&mystuff, mystuff.gpu_sieve_size);
+    clFlush(dev->commandQueue);
+  }
+  clFinish(dev->commandQueue);
+  time1 = (double)timer_diff(&timer);
+
+  printf(" gpusieve_advance_class: %f ms (AdvanceBitToClear)\n", time1/1000.0/par);
+  if (mystuff.quit) exit(1);
+
   timer_init(&timer);
   for (i=0; i<par; i++)
   {
     gpusieve(&mystuff, (cl_ulong)mystuff.gpu_sieve_size*256);
-    clFlush(commandQueue);
+    clFlush(dev->commandQueue);
   }
-  clFinish(commandQueue);
+  clFinish(dev->commandQueue);
   time1 = (double)timer_diff(&timer);
 
   printf(" gpusieve: %f ms (SegSieve)\n ", time1/1000.0/par);
@@ -652,18 +938,23 @@ int test_gpu_sieve(cl_uint par)
 
   // now also quickly test a GPU kernel ...
 
-  cl_uint   shared_mem_required = 100;            // no sieving = 100%
-  if (mystuff.sieve_primes < 54) shared_mem_required = 100;  // no sieving = 100%
-  else if (mystuff.sieve_primes < 310) shared_mem_required = 50;  // 54 primes expect 48.30%
-  else if (mystuff.sieve_primes < 1846) shared_mem_required = 38;  // 310 primes expect 35.50%
-  else if (mystuff.sieve_primes < 21814) shared_mem_required = 30;  // 1846 primes expect 28.10%
-  else if (mystuff.sieve_primes < 34101) shared_mem_required = 24;  // 21814 primes expect 21.93%
-  else if (mystuff.sieve_primes < 63797) shared_mem_required = 23;  // 34101 primes expect 20.94%
-  else if (mystuff.sieve_primes < 115253) shared_mem_required = 22;    // 63797 primes expect 19.87%
-  else if (mystuff.sieve_primes < 239157) shared_mem_required = 21;    // 115253 primes expect 18.98%
-  else if (mystuff.sieve_primes < 550453) shared_mem_required = 20;    // 239257 primes expect 17.99%
-  else shared_mem_required = 19;          // 550453 primes expect 16.97%
-  shared_mem_required = mystuff.gpu_sieve_processing_size * sizeof (short) * shared_mem_required / 100;
+  cl_uint   shared_mem_required = mystuff.gpu_sieve_processing_size * sizeof (short) * gpusieve_survival_percent(&mystuff) / 100;
+  cl_uint   sieve_blocks = mystuff.gpu_sieve_size / mystuff.gpu_sieve_processing_size, tf_blocks = sieve_blocks;
+
+  // GPUSieveCompact: the TF kernel reads the compacted candidates of the last sieve run
+  if (mystuff.gpu_sieve_compact)
+  {
+    shared_mem_required = 4;
+    timer_init(&timer);
+    for (i=0; i<par; i++)
+    {
+      if (gpusieve_compact(&mystuff, sieve_blocks, sieve_blocks, &tf_blocks)) return RET_ERROR;
+    }
+    time1 = (double)timer_diff(&timer);
+
+    printf("gpusieve_compact: %f ms (CompactCount, CompactScan, CompactWrite), %u TF blocks\n ", time1/1000.0/par, tf_blocks);
+    if (mystuff.quit) exit(1);
+  }
 
   cl_uint ln2b, shiftcount=10;
     while((1ULL<<shiftcount) < (unsigned long long int)mystuff.exponent)shiftcount++;
@@ -690,6 +981,8 @@ int test_gpu_sieve(cl_uint par)
     else             b_in.s[7]=1<<(ln2b-165);
   }
 
+  if (load_kernel(BARRETT69_MUL15_GS)) return RET_ERROR;
+
   timer_init(&timer);
   for (i=0; i<par; i++, k+=mystuff.gpu_sieve_size)
   {
@@ -699,9 +992,9 @@ int test_gpu_sieve(cl_uint par)
     k_base.d2 = (k >> 30) & 0x7FFF;
     k_base.d3 = (k >> 45) & 0x7FFF;
     k_base.d4 =  k >> 60;
-    run_gs_kernel15(kernel_info[BARRETT69_MUL15_GS].kernel, mystuff.gpu_sieve_size / mystuff.gpu_sieve_processing_size, shared_mem_required, k_base, b_in, shiftcount);
+    run_gs_kernel15(dev->kernel[BARRETT69_MUL15_GS], tf_blocks, sieve_blocks, shared_mem_required, k_base, b_in, shiftcount);
   }
-  clFinish(commandQueue);
+  clFinish(dev->commandQueue);
   time1 = (double)timer_diff(&timer);
 
   printf(" tf: %f ms = %f M/s (raw rate, cl_barrett15_69_gs)\n\n ", time1/1000.0/par, (double)par * mystuff.gpu_sieve_size/time1);
@@ -763,7 +1056,7 @@ int test_gpu_sieve(cl_uint par)
         gpusieve_init_class(&mystuff, k); // does a flush on its own
         gpusieve(&mystuff, (cl_ulong)mystuff.gpu_sieve_size*256);
       }
-      clFinish(commandQueue);
+      clFinish(dev->commandQueue);
 
       time1 = (double)timer_diff(&timer);
       // now get the last sieve to check it out
@@ -876,6 +1169,39 @@ void insert_time(double time1, double time2[], cl_uint num, cl_uint kernel_idxs[
   kernel_idxs[i] = num;
 }
 
+static cl_uint test_ktab_last;  // h_ktab[0][threads_per_grid-1] of the ktabs loaded by load_test_ktabs()
+
+/* sieve the ktabs of all streams and hand them to the device for test_cpu_tf_kernels(). Zero-copy:
+   h_ktab is unmapped while the kernels read d_ktab, until unload_test_ktabs() */
+static void load_test_ktabs(sieve_ctx_t *ctx, size_t size)
+{
+  cl_uint i;
+  cl_int  status;
+
+  for (i=0; i<mystuff.num_streams; i++)
+  {
+    sieve_candidates(ctx, mystuff.threads_per_grid, mystuff.h_ktab[i], mystuff.sieve_primes); // use all blocks alternatingly, but always with the same content
+    if (i == 0) test_ktab_last = mystuff.h_ktab[0][mystuff.threads_per_grid-1];
+    status = ktab_to_device(i, size);  // don't wait here, test_cpu_tf_kernels copies RES in wait mode
+    if(status != CL_SUCCESS)
+    {
+        std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_ktab[" << i << "] (ktab_to_device)\n";
+    }
+  }
+}
+
+static void unload_test_ktabs(void)
+{
+  cl_uint i;
+
+  clFinish(QUEUE);
+  for (i=0; i<mystuff.num_streams; i++)
+  {
+    clReleaseEvent(mystuff.copy_events[i]);
+    if (ktab_to_host(i) != CL_SUCCESS) std::cout<<"Error: mapping h_ktab[" << i << "] again failed\n";
+  }
+}
+
 GPUKernels test_cpu_tf_kernels(cl_uint par)
 {
   static cl_uint num_test=0; // use this counter to cycle through the FC blocks to avoid successive runs blocking each other
@@ -892,14 +1218,14 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
   cl_ulong k = calculate_k(mystuff.exponent,mystuff.bit_min);
   GPUKernels fastest_kernel = UNKNOWN_KERNEL;
 
-  new_class=1; // tell run_kernel to re-submit the one-time kernel arguments
+  dev->new_class=1; // tell run_kernel to re-submit the one-time kernel arguments
   /* set result array to 0 */
-  memset(mystuff.h_RES,0,32 * sizeof(int));
+  memset(mystuff.h_RES,0,RES_SIZE * sizeof(cl_uint));
   status = clEnqueueWriteBuffer(QUEUE,
                 mystuff.d_RES,
                 CL_TRUE,          // Wait for completion
                 0,
-                32 * sizeof(int),
+                RES_SIZE * sizeof(cl_uint),
                 mystuff.h_RES,
                 0,
                 NULL,
@@ -981,7 +1307,7 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
     k_base.d0 =  k & 0xFFFFFF;
     k_base.d1 = (k >> 24) & 0xFFFFFF;
     k_base.d2 =  k >> 48;
-    status = run_kernel24(kernel_info[use_kernel].kernel, mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_preinit, mystuff.d_RES, shiftcount, mystuff.bit_min-63);
+    status = run_kernel24(dev->kernel[use_kernel], mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_preinit, mystuff.d_RES, shiftcount, mystuff.bit_min-63);
   }
   else if (((use_kernel >= BARRETT73_MUL15) && (use_kernel <= BARRETT74_MUL15)) || (use_kernel == MG88))
   {
@@ -991,7 +1317,7 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
     k_base.d2 = (k >> 30) & 0x7FFF;
     k_base.d3 = (k >> 45) & 0x7FFF;
     k_base.d4 =  k >> 60;
-    status = run_kernel15(kernel_info[use_kernel].kernel, mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_in, mystuff.d_RES, shiftcount, mystuff.bit_max_stage-65);
+    status = run_kernel15(dev->kernel[use_kernel], mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_in, mystuff.d_RES, shiftcount, mystuff.bit_max_stage-65);
   }
   else if (((use_kernel >= BARRETT79_MUL32) && (use_kernel <= BARRETT87_MUL32)) || (use_kernel == MG62))
   {
@@ -999,11 +1325,11 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
     k_base.d0 = (cl_uint) k;
     k_base.d1 = k >> 32;
     k_base.d2 = 0;
-    status = run_barrett_kernel32(kernel_info[use_kernel].kernel, mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_192, mystuff.d_RES, shiftcount, mystuff.bit_max_stage-65);
+    status = run_barrett_kernel32(dev->kernel[use_kernel], mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_192, mystuff.d_RES, shiftcount, mystuff.bit_max_stage-65);
   }
   else
   {
-    status = run_kernel64(kernel_info[use_kernel].kernel, mystuff.exponent, k, num_test++ % mystuff.num_streams, b_preinit4, mystuff.d_RES, mystuff.bit_min-63);
+    status = run_kernel64(dev->kernel[use_kernel], mystuff.exponent, k, num_test++ % mystuff.num_streams, b_preinit4, mystuff.d_RES, mystuff.bit_min-63);
   }
   if(status != CL_SUCCESS)
   {
@@ -1014,7 +1340,7 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
   time1 = (double)timer_diff(&timer);
 //  printf("%llu FCs, %f ms\n", num_fcs, time1/1000.0);
   num_loops = 1 + (cl_uint)(200000.0*par/time1); // run for about 2 seconds when par==10
-  num_fcs = (cl_ulong)num_loops*mystuff.h_ktab[0][mystuff.threads_per_grid-1];
+  num_fcs = (cl_ulong)num_loops*test_ktab_last;
   std::cout << "exponent=" << mystuff.exponent << ", " << (num_fcs >> 20)
             << "M FCs (sieved: " << (((cl_ulong)num_loops*mystuff.threads_per_grid)>>20)
             << "M FCs) each, ";
@@ -1024,7 +1350,7 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
             << " GHz-days (per test): " << std::flush;
   for (use_kernel = _71BIT_MUL24; use_kernel < UNKNOWN_KERNEL; use_kernel++)
   {
-    new_class=1; // tell run_kernel to re-submit the one-time kernel arguments
+    dev->new_class=1; // tell run_kernel to re-submit the one-time kernel arguments
     timer_init(&timer);
     for (i=0; i<num_loops; ++i)
     {
@@ -1033,7 +1359,7 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
         k_base.d0 =  k & 0xFFFFFF;
         k_base.d1 = (k >> 24) & 0xFFFFFF;
         k_base.d2 =  k >> 48;
-        status = run_kernel24(kernel_info[use_kernel].kernel, mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_preinit, mystuff.d_RES, shiftcount, mystuff.bit_min-63);
+        status = run_kernel24(dev->kernel[use_kernel], mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_preinit, mystuff.d_RES, shiftcount, mystuff.bit_min-63);
       }
       else if (((use_kernel >= BARRETT73_MUL15) && (use_kernel <= BARRETT74_MUL15)) || (use_kernel == MG88))
       {
@@ -1043,7 +1369,7 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
         k_base.d2 = (k >> 30) & 0x7FFF;
         k_base.d3 = (k >> 45) & 0x7FFF;
         k_base.d4 =  k >> 60;
-        status = run_kernel15(kernel_info[use_kernel].kernel, mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_in, mystuff.d_RES, shiftcount, mystuff.bit_max_stage-65);
+        status = run_kernel15(dev->kernel[use_kernel], mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_in, mystuff.d_RES, shiftcount, mystuff.bit_max_stage-65);
       }
       else if (((use_kernel >= BARRETT79_MUL32) && (use_kernel <= BARRETT87_MUL32)) || (use_kernel == MG62))
       {
@@ -1051,11 +1377,11 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
         k_base.d0 = (cl_uint) k;
         k_base.d1 = k >> 32;
         k_base.d2 = 0;
-        status = run_barrett_kernel32(kernel_info[use_kernel].kernel, mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_192, mystuff.d_RES, shiftcount, mystuff.bit_max_stage-65);
+        status = run_barrett_kernel32(dev->kernel[use_kernel], mystuff.exponent, k_base, num_test++ % mystuff.num_streams, b_192, mystuff.d_RES, shiftcount, mystuff.bit_max_stage-65);
       }
       else
       {
-        status = run_kernel64(kernel_info[use_kernel].kernel, mystuff.exponent, k, num_test++ % mystuff.num_streams, b_preinit4, mystuff.d_RES, mystuff.bit_min-63);
+        status = run_kernel64(dev->kernel[use_kernel], mystuff.exponent, k, num_test++ % mystuff.num_streams, b_preinit4, mystuff.d_RES, mystuff.bit_min-63);
       }
       if(status != CL_SUCCESS)
       {
@@ -1118,6 +1444,94 @@ GPUKernels test_cpu_tf_kernels(cl_uint par)
   return fastest_kernel;
 }
 
+GPUKernels test_host_tf_kernels(cl_uint par, cl_uint *ktab, cl_uint ktab_size)
+/* same as test_cpu_tf_kernels() for the kernels running on the host (-d h), using one thread */
+{
+  timeval  timer;
+  double   time1, time2[3], ghzdt, ghz = 0.0;
+  cl_uint  kernels[] = {CPU_TF, CPU_TF_IFMA}, use_kernel, num_kernels = 0, num_loops, i, idxs[3], res[32];
+  double   ghzd = primenet_ghzdays(mystuff.exponent, mystuff.bit_min, mystuff.bit_min + 1);
+  cl_ulong num_fcs, k = calculate_k(mystuff.exponent,mystuff.bit_min);
+  GPUKernels fastest_kernel = UNKNOWN_KERNEL;
+
+  printf("\nexponent=%u ... calibrating\r", mystuff.exponent); fflush(stdout);
+  // calibrate so we have ~ 2..4 seconds per kernel (at default with par = 10)
+  timer_init(&timer);
+  cpu_tf_candidates(CPU_TF, mystuff.exponent, k, ktab, ktab_size, res);
+  time1 = (double)timer_diff(&timer);
+  num_loops = 1 + (cl_uint)(200000.0*par/time1); // run for about 2 seconds when par==10
+  num_fcs = (cl_ulong)num_loops*ktab[ktab_size-1];
+  std::cout << "exponent=" << mystuff.exponent << ", " << (num_fcs >> 20)
+            << "M FCs (sieved: " << (((cl_ulong)num_loops*ktab_size)>>20)
+            << "M FCs) each, ";
+  // this single test is worth so many GHz-days
+  ghzdt = (double) num_fcs / k * 4620 / 960 * ghzd;
+  std::cout << "k=" << k << ", " << ghzd << " GHz-days (assignment), " << ghzdt
+            << " GHz-days (per test): " << std::flush;
+  for (use_kernel = 0; use_kernel < sizeof(kernels) / sizeof(kernels[0]); use_kernel++)
+  {
+    if (!cpu_tf_kernel_supported((GPUKernels)kernels[use_kernel])) continue;
+    memset(res, 0, sizeof(res));
+    timer_init(&timer);
+    for (i=0; i<num_loops; ++i)
+    {
+      cpu_tf_candidates((GPUKernels)kernels[use_kernel], mystuff.exponent, k, ktab, ktab_size, res);
+    }
+    time1 = (double)timer_diff(&timer);
+    putchar('.'); fflush(stdout);
+    insert_time(time1, time2, kernels[use_kernel], idxs, num_kernels++);
+    if (mystuff.quit) break;
+  }
+
+  for (i=0; i < num_kernels; ++i)
+  {
+    ghz = ghzdt * 86400000000.0 / time2[i];
+    printf("\n%17s [%u-%u]: %8.2f ms ==> %8.2fM (%8.2fM) FCs/s ==> %7.2f GHz-days/day per thread",
+        kernel_info[idxs[i]].kernelname, kernel_info[idxs[i]].bit_min, kernel_info[idxs[i]].bit_max,
+        time2[i]/1000.0, num_fcs/time2[i], (num_loops*ktab_size)/time2[i], ghz);
+  }
+
+  printf("\n\nResulting speed for M%u:\nbit_min - bit_max  GHz-days/day  kernelname\n", mystuff.exponent);
+  cl_uint bitlevels[100];
+
+  cl_uint last_kernel = UNKNOWN_KERNEL;
+  double last_ghz = 0.0;
+  cl_uint bitlevel;
+  cl_uint bit_min = mystuff.bit_min;
+  cl_uint bit_max_stage = mystuff.bit_max_stage;
+
+  for (bitlevel=10; bitlevel<100; ++bitlevel)
+  {
+    bitlevels[bitlevel] = UNKNOWN_KERNEL;
+    for (i=0; i < num_kernels; ++i)
+    {
+      mystuff.bit_min = bitlevel;
+      mystuff.bit_max_stage = bitlevel + 1;
+      if (kernel_possible(idxs[i], &mystuff))
+      {
+        last_ghz = ghz;
+        ghz = ghzdt * 86400000000.0 / time2[i];
+        bitlevels[bitlevel] = idxs[i];
+        break;
+      }
+    }
+    if (bitlevel >= bit_min && bitlevel < bit_max_stage)
+      fastest_kernel = (GPUKernels) bitlevels[bitlevel]; // remember the last one that fits the stage
+
+    if (bitlevels[bitlevel] != last_kernel)
+    {
+      if (last_kernel != UNKNOWN_KERNEL)
+        printf("%7u  %12.3f  %-20s\n", bitlevel, last_ghz, kernel_info[last_kernel].kernelname);
+      last_kernel = bitlevels[bitlevel];
+      if (last_kernel != UNKNOWN_KERNEL)
+        printf("%7u - ", bitlevel);
+    }
+  }
+  mystuff.bit_min = bit_min;
+  mystuff.bit_max_stage = bit_max_stage;
+  return fastest_kernel;
+}
+
 GPUKernels test_gpu_tf_kernels(cl_uint par)
 {
   struct timeval timer;
@@ -1128,7 +1542,7 @@ GPUKernels test_gpu_tf_kernels(cl_uint par)
   cl_ulong num_fcs = mystuff.gpu_sieve_size - 1; //start with one full sieve block
   cl_uint use_kernel;
   double ghzd = primenet_ghzdays(mystuff.exponent, mystuff.bit_min, mystuff.bit_min + 1);
-  GPUKernels fastest_kernel;
+  GPUKernels fastest_kernel = UNKNOWN_KERNEL;
   cl_uint bit_min = mystuff.bit_min;
   cl_uint bit_max_stage = mystuff.bit_max_stage;
 
@@ -1136,7 +1550,7 @@ GPUKernels test_gpu_tf_kernels(cl_uint par)
 
   cl_uint exp_save = mystuff.exponent;
   mystuff.exponent = 0;
-  run_calc_bit_to_clear(0, 0, NULL, 0); // reset the internal static so it will copy the exponent to the device again.
+  run_calc_bit_to_clear(0, 0, NULL, 0, 1); // reset the internal static so it will copy the exponent to the device again.
   mystuff.exponent = exp_save;
   gpusieve_init_exponent(&mystuff);
   while(!class_needed(mystuff.exponent, k, use_class)) use_class++;
@@ -1211,9 +1625,41 @@ GPUKernels test_gpu_tf_kernels(cl_uint par)
   }
   mystuff.bit_min = bit_min;
   mystuff.bit_max_stage = bit_max_stage;
+
+  if (mystuff.specialize_kernels && fastest_kernel != UNKNOWN_KERNEL && !mystuff.quit)
+  {
+    // compare the exponent-specialized build of the kernel used for this bit level with the generic one
+    specialize_kernel(fastest_kernel, mystuff.exponent, mystuff.bit_max_stage);
+    if (use_specialized_kernel(fastest_kernel, 1))
+    {
+      timer_init(&timer);
+      tf_class_opencl (k+use_class, k+use_class+num_fcs*mystuff.num_classes, &mystuff, fastest_kernel);
+      time1 = (double)timer_diff(&timer);
+      for (i=0; i < use_kernel - BARRETT79_MUL32_GS && idxs[i] != (cl_uint)fastest_kernel; ++i);
+      printf("\n%20s specialized for M%u: %8.2f ms, generic: %8.2f ms ==> %+.1f%%\n",
+          kernel_info[fastest_kernel].kernelname, mystuff.exponent, time1/1000.0, time2[i]/1000.0,
+          (time2[i] / time1 - 1.0) * 100.0);
+    }
+    else
+      printf("\n%20s: the specialized build failed\n", kernel_info[fastest_kernel].kernelname);
+    specialize_kernel(UNKNOWN_GS_KERNEL, 0, 0);  // no OpenCL kernel: just put the generic kernel back
+  }
   return fastest_kernel;
 }
 
+/* build all TF kernels of the current sieve mode up front, the kernels are otherwise
+   built on first use and the timings would include the builds */
+static int load_tf_kernels(void)
+{
+  cl_uint kernel;
+  cl_uint first = mystuff.gpu_sieving ? BARRETT79_MUL32_GS : _71BIT_MUL24;
+  cl_uint last  = mystuff.gpu_sieving ? UNKNOWN_GS_KERNEL : UNKNOWN_KERNEL;
+
+  for (kernel = first; kernel < last; kernel++)
+    if (load_kernel(kernel)) return 1;
+  return 0;
+}
+
 int test_tf_kernels(cl_uint par, int devicenumber)
 {
   unsigned int i;
@@ -1243,6 +1689,11 @@ int test_tf_kernels(cl_uint par, int devicenumber)
     printf("ERROR: load_kernels(%d) failed\n", devicenumber);
     return ERR_INIT;
   }
+  if (load_tf_kernels())
+  {
+    printf("ERROR: building the TF kernels failed\n");
+    return ERR_INIT;
+  }
   mystuff.exponent=EXP;
   if (init_CLstreams(0))
   {
@@ -1267,45 +1718,26 @@ int test_tf_kernels(cl_uint par, int devicenumber)
   {
     printf("5. TF kernels (w/ CPU sieve)\n");
     cl_ulong k = calculate_k(mystuff.exponent,mystuff.bit_min);
-    int status;
 
-    sieve_free();
+    // use a separate sieve context, the one in mystuff may be in use
 #ifdef SIEVE_SIZE_LIMIT
-    sieve_init();
-    sieve_init_class(exps[0], k+=1000000, mystuff.sieve_primes);
+    sieve_ctx_t *ctx = perftest_sieve_ctx(SIEVE_SIZE, mystuff.sieve_bucket_threshold, mystuff.sieve_wheel_primes);
 #else
-    cl_uint tmp=3*13*17*19*23;
-    sieve_init(tmp, 1000000);
-    sieve_init_class(exps[0], k+=1000000, mystuff.sieve_primes);
+    sieve_ctx_t *ctx = perftest_sieve_ctx(3*13*17*19*23, mystuff.sieve_bucket_threshold, mystuff.sieve_wheel_primes);
 #endif
+    sieve_init_class(ctx, exps[0], k+=1000000, mystuff.sieve_primes);
     mystuff.threads_per_grid = mystuff.threads_per_grid_max;
-    if(mystuff.threads_per_grid > deviceinfo.maxThreadsPerGrid)
+    if(mystuff.threads_per_grid > dev->deviceinfo.maxThreadsPerGrid)
     {
-      mystuff.threads_per_grid = (cl_uint)deviceinfo.maxThreadsPerGrid;
+      mystuff.threads_per_grid = (cl_uint)dev->deviceinfo.maxThreadsPerGrid;
     }
     size_t size = mystuff.threads_per_grid * sizeof(int);
 
     // use one sieved block for the whole test
-    mystuff.threads_per_grid -= mystuff.threads_per_grid % (mystuff.vectorsize * deviceinfo.maxThreadsPerBlock);
+    mystuff.threads_per_grid -= mystuff.threads_per_grid % (mystuff.vectorsize * dev->deviceinfo.maxThreadsPerBlock);
     mystuff.sieve_primes_upper_limit = mystuff.sieve_primes_max;
-    for (i=0; i<mystuff.num_streams; i++)
-    {
-      sieve_candidates(mystuff.threads_per_grid, mystuff.h_ktab[i], mystuff.sieve_primes); // use all blocks alternatingly, but always with the same content
-      status = clEnqueueWriteBuffer(QUEUE,
-                mystuff.d_ktab[i],
-                CL_FALSE,  // don't wait here, test_cpu_tf_kernels copies RES in wait mode
-                0,
-                size,
-                mystuff.h_ktab[i],
-                0,
-                NULL,
-                &mystuff.copy_events[i]);
-
-      if(status != CL_SUCCESS)
-      {
-          std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_ktab[" << i << "] (clEnqueueWriteBuffer)\n";
-      }
-    }
+    load_test_ktabs(ctx, size);
+    sieve_ctx_free(ctx);
 
     for (i=0; i<nexp; ++i)
     {
@@ -1316,12 +1748,46 @@ int test_tf_kernels(cl_uint par, int devicenumber)
       test_cpu_tf_kernels((cl_uint) par);
       if (mystuff.quit) break;
     }
+    unload_test_ktabs();
     printf("\nNote, the calculated GHz-days/day assume sufficiently fast CPU sieve with SievePrimes=%u.\n", mystuff.sieve_primes);
   }
 
   return 0;
 }
 
+int test_host_tf(cl_uint par)
+/* the TF kernels of -d h */
+{
+  cl_uint i, exps[MAX_NUM_SPS], ktab_size = MIN(65536, mystuff.threads_per_grid);
+  cl_uint nexp=read_array(mystuff.inifile, (char *) "TestExponents", MAX_NUM_SPS, exps);
+  cl_ulong k = calculate_k(EXP, 68);
+
+  if (nexp < 1)
+  {
+    fprintf(stderr, "  Could not read TestExponents from %s - not testing TF kernels\n", mystuff.inifile);
+    return -1;
+  }
+
+  printf("\n5. TF kernels on the host (-d h)\n");
+  cl_uint *ktab = mystuff.h_ktab[0];
+  // use one sieved block for the whole test
+  sieve_init_class(mystuff.sieve_ctx, exps[0], k+=1000000, mystuff.sieve_primes);
+  sieve_candidates(mystuff.sieve_ctx, ktab_size, ktab, mystuff.sieve_primes);
+
+  for (i=0; i<nexp; ++i)
+  {
+    mystuff.bit_min = 68;
+    mystuff.bit_max_assignment = 69;
+    mystuff.bit_max_stage = 69;
+    mystuff.exponent=exps[i];
+    test_host_tf_kernels(par, ktab, ktab_size);
+    if (mystuff.quit) break;
+  }
+  printf("\nNote, the TF threads of -d h scale these numbers with the number of CPU cores, but they share them with the sieve.\n");
+
+  return 0;
+}
+
 int init_gpu_test(int devicenumber)
 {
   cleanup_CL();
@@ -1377,6 +1843,14 @@ int perftest(int par, int devicenumber)
   test_sieve(par);
   if (mystuff.quit) exit(1);
 
+  if (mystuff.host_tf)
+  {
+    // 3. and 4. need OpenCL, 5. TF kernels on the host
+    test_host_tf((cl_uint)par);
+    printf("\nPerformance test finished\n");
+    return 0;
+  }
+
   // 3. memory copy
   test_copy((cl_uint)par);
   if (mystuff.quit) exit(1);
@@ -1403,52 +1877,149 @@ GPUKernels test_fastest_kernel()
   }
   else
   {
-    cl_uint i;
     cl_ulong k = calculate_k(mystuff.exponent,mystuff.bit_min);
-    int status;
 
-    sieve_free();
+    // use a separate sieve context, the one in mystuff may be in use
 #ifdef SIEVE_SIZE_LIMIT
-    sieve_init();
-    sieve_init_class(mystuff.exponent, k+=1000000, mystuff.sieve_primes);
+    sieve_ctx_t *ctx = perftest_sieve_ctx(SIEVE_SIZE, mystuff.sieve_bucket_threshold, mystuff.sieve_wheel_primes);
 #else
-    cl_uint tmp=3*13*17*19*23;
-    sieve_init(tmp, 1000000);
-    sieve_init_class(mystuff.exponent, k+=1000000, mystuff.sieve_primes);
+    sieve_ctx_t *ctx = perftest_sieve_ctx(3*13*17*19*23, mystuff.sieve_bucket_threshold, mystuff.sieve_wheel_primes);
 #endif
+    sieve_init_class(ctx, mystuff.exponent, k+=1000000, mystuff.sieve_primes);
     mystuff.threads_per_grid = mystuff.threads_per_grid_max;
-    if(mystuff.threads_per_grid > deviceinfo.maxThreadsPerGrid)
+    if(mystuff.threads_per_grid > dev->deviceinfo.maxThreadsPerGrid)
     {
-      mystuff.threads_per_grid = (cl_uint)deviceinfo.maxThreadsPerGrid;
+      mystuff.threads_per_grid = (cl_uint)dev->deviceinfo.maxThreadsPerGrid;
     }
     size_t size = mystuff.threads_per_grid * sizeof(int);
 
     // use one sieved block for the whole test
-    mystuff.threads_per_grid -= mystuff.threads_per_grid % (mystuff.vectorsize * deviceinfo.maxThreadsPerBlock);
+    mystuff.threads_per_grid -= mystuff.threads_per_grid % (mystuff.vectorsize * dev->deviceinfo.maxThreadsPerBlock);
     mystuff.sieve_primes_upper_limit = mystuff.sieve_primes_max;
-    for (i=0; i<mystuff.num_streams; i++)
-    {
-      sieve_candidates(mystuff.threads_per_grid, mystuff.h_ktab[i], mystuff.sieve_primes); // use all blocks alternatingly, but always with the same content
-      status = clEnqueueWriteBuffer(QUEUE,
-                mystuff.d_ktab[i],
-                CL_FALSE,  // don't wait here, test_cpu_tf_kernels copies RES in wait mode
-                0,
-                size,
-                mystuff.h_ktab[i],
-                0,
-                NULL,
-                &mystuff.copy_events[i]);
+    load_test_ktabs(ctx, size);
+    sieve_ctx_free(ctx);
+    GPUKernels fastest = test_cpu_tf_kernels(10);
 
-      if(status != CL_SUCCESS)
-      {
-          std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Copying h_ktab[" << i << "] (clEnqueueWriteBuffer)\n";
-      }
-    }
-    return test_cpu_tf_kernels(10);
+    unload_test_ktabs();
+    return fastest;
   }
   return UNKNOWN_KERNEL;
 }
 
+static cl_int read_sieve_buffer(cl_mem buffer, size_t offset, size_t size, void *dest)
+{
+  cl_int status = clEnqueueReadBuffer(dev->commandQueue, buffer, CL_TRUE, offset, size, dest, 0, NULL, NULL);
+
+  if (status != CL_SUCCESS)
+    std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clEnqueueReadBuffer (GPU sieve check)\n";
+  return status;
+}
+
+static cl_uint check_sieved_class(const char *what, unsigned long long k_min, cl_uint slot, cl_uint bit_offset, cl_uint num_bits,
+                                  cl_uchar *ref_pinfo, cl_uchar *dev_pinfo, cl_uint *ref_bits)
+/* compare the bit-to-clear values of the class in d_sieve_info slot <slot> and the bits
+   bit_offset .. bit_offset+num_bits-1 of d_bitarray (already read to h_bitarray) with the reference */
+{
+  cl_uint errors;
+  unsigned long long survivors = 0;
+
+  memcpy(ref_pinfo, mystuff.h_sieve_info, mystuff.gpu_sieve_info_size);
+  gpusieve_ref_bit_to_clear(&mystuff, k_min, ref_pinfo);
+  if (read_sieve_buffer(mystuff.d_sieve_info, (size_t) slot * mystuff.gpu_sieve_info_stride, mystuff.gpu_sieve_info_size, dev_pinfo) != CL_SUCCESS) return 1;
+  errors = gpusieve_ref_compare_bit_to_clear(&mystuff, ref_pinfo, dev_pinfo);
+
+  gpusieve_ref_sieve(&mystuff, ref_pinfo, ref_bits, num_bits);
+  errors += gpusieve_ref_compare_bits(&mystuff, ref_pinfo, ref_bits, mystuff.h_bitarray + bit_offset / 32, num_bits, k_min, &survivors);
+
+  printf("  %-28s k_min=%llu: %s, %llu of %u candidates survived the sloppy sieve only (%.3f%%)\n", what, k_min,
+         errors ? "FAILED" : "ok", survivors, num_bits, 100.0 * survivors / num_bits);
+  return errors;
+}
+
+int gpusieve_test(cl_uint exponent, int devicenumber)
+/* Run the GPU sieve kernels on the selected device and compare bit-to-clear values and sieve bits
+   with the host reference (gpusieve_ref.cpp): one class, the next chunk of it and a multi-class launch.
+   read_config() must have been called. */
+{
+  cl_uint errors = 0, i, c, num_bits, num, bits_per_class, classes[4];
+  unsigned long long k_min;
+  cl_uchar *ref_pinfo, *dev_pinfo;
+  cl_uint *ref_bits;
+
+  mystuff.exponent = exponent ? exponent : EXP;
+  mystuff.gpu_sieving = 1;
+  mystuff.threads_per_grid = 256;
+  if (init_CL(mystuff.num_streams, &devicenumber) != CL_SUCCESS) return 1;
+  set_gpu_type();
+  if (load_kernels(&devicenumber) != CL_SUCCESS) return 1;
+  if (init_CLstreams(0)) return 1;
+  if (mystuff.exponent < mystuff.gpu_sieve_min_exp)
+  {
+    printf("ERROR: exponent %u is too small for GPUSievePrimes=%u, use at least %u\n", mystuff.exponent, mystuff.sieve_primes, mystuff.gpu_sieve_min_exp);
+    return 1;
+  }
+
+  printf("\nComparing the GPU sieve of M%u with the host reference\n", mystuff.exponent);
+  i = gpusieve_ref_check_layout(&mystuff);
+  printf("  %-28s %u primes, %u bytes: %s\n", "prime info layout", mystuff.sieve_primes, mystuff.gpu_sieve_info_size, i ? "FAILED" : "ok");
+  errors += i;
+
+  num_bits  = mystuff.gpu_sieve_size;
+  ref_pinfo = (cl_uchar *) malloc(mystuff.gpu_sieve_info_size);
+  dev_pinfo = (cl_uchar *) malloc(mystuff.gpu_sieve_info_size);
+  ref_bits  = (cl_uint *) malloc(num_bits / 8);
+  if (ref_pinfo == NULL || dev_pinfo == NULL || ref_bits == NULL)
+  {
+    printf("ERROR: out of memory\n");
+    return 1;
+  }
+
+  k_min = calculate_k(mystuff.exponent, 70);
+  k_min -= k_min % mystuff.num_classes;
+  for (c = 0, num = 0; num < 4; c++)
+  {
+    if (class_needed(mystuff.exponent, k_min, c)) classes[num++] = c;
+  }
+  gpusieve_init_exponent(&mystuff);
+
+  // one class in two chunks, as tf_class_opencl() does it
+  gpusieve_init_class(&mystuff, k_min + classes[0]);
+  gpusieve(&mystuff, num_bits);
+  if (read_sieve_buffer(mystuff.d_bitarray, 0, num_bits / 8, mystuff.h_bitarray) != CL_SUCCESS) return 1;
+  errors += check_sieved_class("one class", k_min + classes[0], 0, 0, num_bits, ref_pinfo, dev_pinfo, ref_bits);
+
+  gpusieve_advance_class(&mystuff, num_bits);
+  gpusieve(&mystuff, num_bits);
+  if (read_sieve_buffer(mystuff.d_bitarray, 0, num_bits / 8, mystuff.h_bitarray) != CL_SUCCESS) return 1;
+  errors += check_sieved_class("next chunk of the class", k_min + classes[0] + (unsigned long long) num_bits * mystuff.num_classes,
+                               0, 0, num_bits, ref_pinfo, dev_pinfo, ref_bits);
+
+  // several classes in one launch, as tf_classes_opencl() does it (segments of whole SegSieve blocks)
+  num = MIN(num, mystuff.gpu_sieve_classes);
+  bits_per_class = num_bits / num / 65536 * 65536;
+  if (num > 1 && bits_per_class > 0)
+  {
+    for (i = 0; i < num; i++) mystuff.h_class_delta[i] = classes[i] - classes[0];
+    gpusieve_init_classes(&mystuff, k_min + classes[0], num);
+    gpusieve_classes(&mystuff, num, bits_per_class);
+    if (read_sieve_buffer(mystuff.d_bitarray, 0, num_bits / 8, mystuff.h_bitarray) != CL_SUCCESS) return 1;
+    for (i = 0; i < num; i++)
+    {
+      char what[40];
+      sprintf(what, "class %u of %u in one launch", i + 1, num);
+      errors += check_sieved_class(what, k_min + classes[i], i, i * bits_per_class, bits_per_class, ref_pinfo, dev_pinfo, ref_bits);
+    }
+  }
+
+  free(ref_pinfo);
+  free(dev_pinfo);
+  free(ref_bits);
+
+  if (errors) printf("\nGPU sieve check FAILED: %u errors\n", errors);
+  else        printf("\nGPU sieve check passed\n");
+  return errors ? 1 : 0;
+}
+
 /* copy of the init and test functions for troubleshooting and playing around */
 
 void CL_test(cl_int devnumber)
@@ -1543,12 +2114,12 @@ void CL_test(cl_int devnumber)
   }
 
   cl_context_properties cps[3] = { CL_CONTEXT_PLATFORM, (cl_context_properties)platform, 0 };
-  context = clCreateContextFromType(cps, devtype, NULL, NULL, &status);
+  dev->context = clCreateContextFromType(cps, devtype, NULL, NULL, &status);
   if (status == CL_DEVICE_NOT_FOUND)
   {
-    clReleaseContext(context);
+    clReleaseContext(dev->context);
     std::cout << "GPU not found, fallback to CPU." << std::endl;
-    context = clCreateContextFromType(cps, CL_DEVICE_TYPE_CPU, NULL, NULL, &status);
+    dev->context = clCreateContextFromType(cps, CL_DEVICE_TYPE_CPU, NULL, NULL, &status);
     if(status != CL_SUCCESS)
     {
        std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clCreateContextFromType(CPU)\n";
@@ -1560,14 +2131,14 @@ void CL_test(cl_int devnumber)
   }
 
   cl_uint num_devices;
-  status = clGetContextInfo(context, CL_CONTEXT_NUM_DEVICES, sizeof(num_devices), &num_devices, NULL);
+  status = clGetContextInfo(dev->context, CL_CONTEXT_NUM_DEVICES, sizeof(num_devices), &num_devices, NULL);
   if(status != CL_SUCCESS)
   {
     std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_CONTEXT_NUM_DEVICES) - assuming one device\n";
     num_devices = 1;
   }
 
-  status = clGetContextInfo(context, CL_CONTEXT_DEVICES, 0, NULL, &dev_s);
+  status = clGetContextInfo(dev->context, CL_CONTEXT_DEVICES, 0, NULL, &dev_s);
   if(status != CL_SUCCESS)
   {
     std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(numdevs)\n";
@@ -1578,13 +2149,13 @@ void CL_test(cl_int devnumber)
     std::cerr << "Error: no devices.\n";
   }
 
-  devices = (cl_device_id *)malloc(dev_s*sizeof(cl_device_id));  // *sizeof(...) should not be needed (dev_s is in bytes)
-  if(devices == 0)
+  dev->devices = (cl_device_id *)malloc(dev_s*sizeof(cl_device_id));  // *sizeof(...) should not be needed (dev_s is in bytes)
+  if(dev->devices == 0)
   {
     std::cerr << "Error: Out of memory.\n";
   }
 
-  status = clGetContextInfo(context, CL_CONTEXT_DEVICES, dev_s*sizeof(cl_device_id), devices, NULL);
+  status = clGetContextInfo(dev->context, CL_CONTEXT_DEVICES, dev_s*sizeof(cl_device_id), dev->devices, NULL);
   if(status != CL_SUCCESS)
   {
     std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(devices)\n";
@@ -1608,86 +2179,86 @@ void CL_test(cl_int devnumber)
   for (i=dev_from; i<dev_to; i++)
   {
 
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_NAME, sizeof(deviceinfo.d_name), deviceinfo.d_name, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_NAME, sizeof(dev->deviceinfo.d_name), dev->deviceinfo.d_name, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_NAME)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_VERSION, sizeof(deviceinfo.d_ver), deviceinfo.d_ver, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_VERSION, sizeof(dev->deviceinfo.d_ver), dev->deviceinfo.d_ver, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_VERSION)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_VENDOR, sizeof(deviceinfo.v_name), deviceinfo.v_name, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_VENDOR, sizeof(dev->deviceinfo.v_name), dev->deviceinfo.v_name, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_VENDOR)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DRIVER_VERSION, sizeof(deviceinfo.dr_version), deviceinfo.dr_version, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DRIVER_VERSION, sizeof(dev->deviceinfo.dr_version), dev->deviceinfo.dr_version, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DRIVER_VERSION)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_EXTENSIONS, sizeof(deviceinfo.exts), deviceinfo.exts, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_EXTENSIONS, sizeof(dev->deviceinfo.exts), dev->deviceinfo.exts, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_EXTENSIONS)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, sizeof(deviceinfo.gl_cache), &deviceinfo.gl_cache, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_GLOBAL_MEM_CACHE_SIZE, sizeof(dev->deviceinfo.gl_cache), &dev->deviceinfo.gl_cache, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_GLOBAL_MEM_CACHE_SIZE)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(deviceinfo.gl_mem), &deviceinfo.gl_mem, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(dev->deviceinfo.gl_mem), &dev->deviceinfo.gl_mem, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_GLOBAL_MEM_SIZE)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(deviceinfo.max_clock), &deviceinfo.max_clock, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(dev->deviceinfo.max_clock), &dev->deviceinfo.max_clock, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_CLOCK_FREQUENCY)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(deviceinfo.units), &deviceinfo.units, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(dev->deviceinfo.units), &dev->deviceinfo.units, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_COMPUTE_UNITS)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(deviceinfo.wg_size), &deviceinfo.wg_size, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_WORK_GROUP_SIZE, sizeof(dev->deviceinfo.wg_size), &dev->deviceinfo.wg_size, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_WORK_GROUP_SIZE)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(deviceinfo.w_dim), &deviceinfo.w_dim, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS, sizeof(dev->deviceinfo.w_dim), &dev->deviceinfo.w_dim, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_WORK_ITEM_DIMENSIONS)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(deviceinfo.wi_sizes), deviceinfo.wi_sizes, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_MAX_WORK_ITEM_SIZES, sizeof(dev->deviceinfo.wi_sizes), dev->deviceinfo.wi_sizes, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_MAX_WORK_ITEM_SIZES)\n";
     }
-    status = clGetDeviceInfo(devices[i], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(deviceinfo.l_mem), &deviceinfo.l_mem, NULL);
+    status = clGetDeviceInfo(dev->devices[i], CL_DEVICE_LOCAL_MEM_SIZE, sizeof(dev->deviceinfo.l_mem), &dev->deviceinfo.l_mem, NULL);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clGetContextInfo(CL_DEVICE_LOCAL_MEM_SIZE)\n";
     }
 
-    std::cout << "Device " << i+1  << "/" << num_devices << ": " << deviceinfo.d_name << " (" << deviceinfo.v_name << "),\ndevice version: "
-      << deviceinfo.d_ver << ", driver version: " << deviceinfo.dr_version << "\nExtensions: " << deviceinfo.exts
-      << "\nGlobal memory:" << deviceinfo.gl_mem << ", Global memory cache: " << deviceinfo.gl_cache
-      << ", local memory: " << deviceinfo.l_mem << ", workgroup size: " << deviceinfo.wg_size << ", Work dimensions: " << deviceinfo.w_dim
-      << "[" << deviceinfo.wi_sizes[0] << ", " << deviceinfo.wi_sizes[1] << ", " << deviceinfo.wi_sizes[2] << ", " << deviceinfo.wi_sizes[3] << ", " << deviceinfo.wi_sizes[4]
-      << "] , Max clock speed:" << deviceinfo.max_clock << ", compute units:" << deviceinfo.units << std::endl;
+    std::cout << "Device " << i+1  << "/" << num_devices << ": " << dev->deviceinfo.d_name << " (" << dev->deviceinfo.v_name << "),\ndevice version: "
+      << dev->deviceinfo.d_ver << ", driver version: " << dev->deviceinfo.dr_version << "\nExtensions: " << dev->deviceinfo.exts
+      << "\nGlobal memory:" << dev->deviceinfo.gl_mem << ", Global memory cache: " << dev->deviceinfo.gl_cache
+      << ", local memory: " << dev->deviceinfo.l_mem << ", workgroup size: " << dev->deviceinfo.wg_size << ", Work dimensions: " << dev->deviceinfo.w_dim
+      << "[" << dev->deviceinfo.wi_sizes[0] << ", " << dev->deviceinfo.wi_sizes[1] << ", " << dev->deviceinfo.wi_sizes[2] << ", " << dev->deviceinfo.wi_sizes[3] << ", " << dev->deviceinfo.wi_sizes[4]
+      << "] , Max clock speed:" << dev->deviceinfo.max_clock << ", compute units:" << dev->deviceinfo.units << std::endl;
   }
 
-  deviceinfo.maxThreadsPerBlock = deviceinfo.wi_sizes[0];
-  deviceinfo.maxThreadsPerGrid  = deviceinfo.wi_sizes[0];
-  for (i=1; i<deviceinfo.w_dim && i<5; i++)
+  dev->deviceinfo.maxThreadsPerBlock = dev->deviceinfo.wi_sizes[0];
+  dev->deviceinfo.maxThreadsPerGrid  = dev->deviceinfo.wi_sizes[0];
+  for (i=1; i<dev->deviceinfo.w_dim && i<5; i++)
   {
-    if (deviceinfo.wi_sizes[i])
-      deviceinfo.maxThreadsPerGrid *= deviceinfo.wi_sizes[i];
+    if (dev->deviceinfo.wi_sizes[i])
+      dev->deviceinfo.maxThreadsPerGrid *= dev->deviceinfo.wi_sizes[i];
   }
 
   cl_command_queue_properties props = 0;             // GPU sieve is started without synchronization events
@@ -1695,11 +2266,11 @@ void CL_test(cl_int devnumber)
     props = CL_QUEUE_OUT_OF_ORDER_EXEC_MODE_ENABLE;  // kernels and copy-jobs are queued with event dependencies, so this should work ...
                                                      // but so far the GPU driver does not support that anyway (as of Catalyst 12.9)
 
-  commandQueue = clCreateCommandQueue(context, devices[devnumber], props, &status);
+  dev->commandQueue = clCreateCommandQueue(dev->context, dev->devices[devnumber], props, &status);
   if(status != CL_SUCCESS)
   {
     props = 0; // Intel HD does not support out-of-order
-    commandQueue = clCreateCommandQueue(context, devices[devnumber], props, &status);
+    dev->commandQueue = clCreateCommandQueue(dev->context, dev->devices[devnumber], props, &status);
     if(status != CL_SUCCESS)
     {
       std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clCreateCommandQueue(dev#" << (devnumber+1) << ")\n";
@@ -1710,7 +2281,7 @@ void CL_test(cl_int devnumber)
 
   props |= CL_QUEUE_PROFILING_ENABLE;
 
-  commandQueuePrf = clCreateCommandQueue(context, devices[devnumber], props, &status);
+  dev->commandQueuePrf = clCreateCommandQueue(dev->context, dev->devices[devnumber], props, &status);
   if(status != CL_SUCCESS)
   {
     std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clCreateCommandQueuePrf(dev#" << (devnumber+1) << ")\n";
@@ -1743,7 +2314,7 @@ void CL_test(cl_int devnumber)
     std::cerr << "\nKernel file \"" KERNEL_FILE "\" not found, it needs to be in the same directory as the executable.\n";
   }
 
-  program = clCreateProgramWithSource(context, 1, (const char **)&source, &size, &status);
+  dev->program = clCreateProgramWithSource(dev->context, 1, (const char **)&source, &size, &status);
   if(status != CL_SUCCESS)
   {
     std::cerr << "Error " << status << " (" << ClErrorString(status) << "): clCreateProgramWithSource\n";
@@ -1780,12 +2351,12 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
 
   // program_options can be overridden by setting en environment variable AMD_OCL_BUILD_OPTIONS
 
-  status = clBuildProgram(program, 1, &devices[devnumber], program_options, NULL, NULL);
+  status = clBuildProgram(dev->program, 1, &dev->devices[devnumber], program_options, NULL, NULL);
   {
       cl_int logstatus;
       char *buildLog = NULL;
       size_t buildLogSize = 0;
-      logstatus = clGetProgramBuildInfo (program, devices[devnumber], CL_PROGRAM_BUILD_LOG,
+      logstatus = clGetProgramBuildInfo (dev->program, dev->devices[devnumber], CL_PROGRAM_BUILD_LOG,
                 buildLogSize, buildLog, &buildLogSize);
       if(logstatus != CL_SUCCESS)
       {
@@ -1797,7 +2368,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
         std::cerr << "\noom\n";
       }
 
-      logstatus = clGetProgramBuildInfo (program, devices[devnumber], CL_PROGRAM_BUILD_LOG,
+      logstatus = clGetProgramBuildInfo (dev->program, dev->devices[devnumber], CL_PROGRAM_BUILD_LOG,
                 buildLogSize, buildLog, NULL);
       if(logstatus != CL_SUCCESS)
       {
@@ -1819,7 +2390,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
   for (i=_TEST_MOD_; i<UNKNOWN_KERNEL; i++)
   {
     printf("."); fflush(stdout);
-    kernel_info[i].kernel = clCreateKernel(program, kernel_info[i].kernelname, &status);
+    dev->kernel[i] = clCreateKernel(dev->program, kernel_info[i].kernelname, &status);
     if(status != CL_SUCCESS)
     {
       std::cerr<<"Error " << status << " (" << ClErrorString(status) << "): Creating Kernel " << kernel_info[i].kernelname << " from program. (clCreateKernel)\n";
@@ -1830,11 +2401,12 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
 
   mystuff.threads_per_grid = 1024 * 1024;
 
-  if (context==NULL)
+  if (dev->context==NULL)
   {
     fprintf(stderr, "invalid context.\n");
   }
 
+  mystuff.ktab_transfer = KTAB_PAGEABLE;
   for(i=0;i<(mystuff.num_streams);i++)
   {
     mystuff.stream_status[i] = UNUSED;
@@ -1842,7 +2414,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
     {
       printf("ERROR: malloc(h_ktab[%d]) failed\n", i);
     }
-    mystuff.d_ktab[i] = clCreateBuffer(context,
+    mystuff.d_ktab[i] = clCreateBuffer(dev->context,
                       CL_MEM_READ_ONLY | CL_MEM_COPY_HOST_PTR,
                       mystuff.threads_per_grid * sizeof(cl_uint),
                       mystuff.h_ktab[i],
@@ -1856,7 +2428,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
   {
     printf("ERROR: malloc(h_RES) failed\n");
   }
-  mystuff.d_RES = clCreateBuffer(context,
+  mystuff.d_RES = clCreateBuffer(dev->context,
                     CL_MEM_READ_WRITE | CL_MEM_COPY_HOST_PTR,
                     32 * sizeof(cl_uint),
                     mystuff.h_RES,
@@ -1876,7 +2448,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
 
   cl_event in_evt, mod_evt, res_evt;
 
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     0,
                     sizeof(cl_ulong),
                     (void *)&hi);
@@ -1884,7 +2456,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
   {
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (hi)\n";
   }
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     1,
                     sizeof(cl_ulong),
                     (void *)&lo);
@@ -1892,7 +2464,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
   {
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (lo)\n";
   }
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     2,
                     sizeof(cl_ulong),
                     (void *)&q);
@@ -1900,7 +2472,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
   {
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (q)\n";
   }
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     3,
                     sizeof(cl_float),
                     (void *)&qr);
@@ -1908,7 +2480,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
   {
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (qr)\n";
   }
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     4,
                     sizeof(cl_mem),
                     (void *)&mystuff.d_RES);
@@ -1917,7 +2489,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
     std::cout<<"Error " << status << " (" << ClErrorString(status) << "): Setting kernel argument. (RES)\n";
   }
   // dummy arg if KERNEL_TRACE is enabled: ignore errors if not.
-  status = clSetKernelArg(kernel_info[_TEST_MOD_].kernel,
+  status = clSetKernelArg(dev->kernel[_TEST_MOD_],
                     5,
                     sizeof(cl_uint),
                     (void *)&status);
@@ -1935,7 +2507,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
 
     /* set result array to 0 */
     memset(mystuff.h_RES,0,32 * sizeof(int));
-    status = clEnqueueWriteBuffer(commandQueuePrf,
+    status = clEnqueueWriteBuffer(dev->commandQueuePrf,
                   mystuff.d_RES,
                   CL_FALSE,          // Don't wait for completion; it's fast to copy 128 bytes ;-)
                   0,
@@ -1961,8 +2533,8 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
       g_size[1] = i-255;
     }
 
-    status = clEnqueueNDRangeKernel(commandQueuePrf,
-                 kernel_info[_TEST_MOD_].kernel,
+    status = clEnqueueNDRangeKernel(dev->commandQueuePrf,
+                 dev->kernel[_TEST_MOD_],
                  2,
                  NULL,
                  g_size,
@@ -1988,7 +2560,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
     }
     */
 
-    status = clEnqueueReadBuffer(commandQueuePrf,
+    status = clEnqueueReadBuffer(dev->commandQueuePrf,
                 mystuff.d_RES,
                 CL_FALSE,
                 0,
@@ -2005,7 +2577,7 @@ if (mystuff.more_classes == 1)  strcat(program_options, " -DMORE_CLASSES");
 
     try
     {
-      status = clFinish(commandQueuePrf);
+      status = clFinish(dev->commandQueuePrf);
     }
     catch(...)
     {
@@ -29,6 +29,11 @@ extern "C" {
 int perftest(int par, int devicenumber);
 GPUKernels test_fastest_kernel();
 
+/* --gpusievetest: compare the GPU sieve of the selected device with the host reference (gpusieve_ref.cpp)
+   input: exponent to sieve, 0 for a default
+   returns 0 if the GPU sieve removed no candidate that the reference keeps */
+int gpusieve_test(cl_uint exponent, int devicenumber);
+
 #ifdef __cplusplus
 }
 #endif
@@ -30,6 +30,7 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "params.h"
 #include "my_types.h"
 #include "output.h"
+#include "sieve.h"
 
 extern kernel_info_t   kernel_info[];
 extern GPU_type        gpu_types[];
@@ -143,8 +144,9 @@ int my_read_string(char *inifile, char *name, char *string, unsigned int len)
 
 
 int read_config(mystuff_t *mystuff)
+/* returns 1 if the INI file has a combination of settings mfakto can't run with, 0 otherwise */
 {
-  int i;
+  int i, ret = 0;
   char tmp[51];
   unsigned long long int ul;
 
@@ -176,7 +178,12 @@ int read_config(mystuff_t *mystuff)
     logprintf(mystuff, "Warning: SieveOnGPU must be 0 or 1, set to 0 by default\n");
     i=0;
   }
-  if(mystuff->verbosity >= 1)
+  if(i == 1 && mystuff->host_tf)
+  {
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  SieveOnGPU                no (no GPU with -d h)\n");
+    i=0;
+  }
+  else if(mystuff->verbosity >= 1)
   {
     if(i == 0)logprintf(mystuff, "  SieveOnGPU                no\n");
     else      logprintf(mystuff, "  SieveOnGPU                yes\n");
@@ -353,6 +360,58 @@ int read_config(mystuff_t *mystuff)
     else if(i == 3)  mystuff->threads_per_grid_max = 1048576;
     else             mystuff->threads_per_grid_max = 2097152;
 
+  /*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "GridsPerLaunch", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read GridsPerLaunch from INI file, using default value (1)\n");
+      i = 1;
+    }
+    else
+    {
+      if(i > GRIDS_PER_LAUNCH_MAX)
+      {
+        logprintf(mystuff, "Warning: Read GridsPerLaunch=%d from INI file, using max value (%d)\n", i, GRIDS_PER_LAUNCH_MAX);
+        i = GRIDS_PER_LAUNCH_MAX;
+      }
+      else if(i < 1)
+      {
+        logprintf(mystuff, "Warning: Read GridsPerLaunch=%d from INI file, using min value (1)\n", i);
+        i = 1;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  GridsPerLaunch            %d\n",i);
+    mystuff->grids_per_launch = i;
+
+  /*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "BatchExponents", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read BatchExponents from INI file, using default value (1)\n");
+      i = 1;
+    }
+    else
+    {
+      if(i > BATCH_EXPONENTS_MAX)
+      {
+        logprintf(mystuff, "Warning: Read BatchExponents=%d from INI file, using max value (%d)\n", i, BATCH_EXPONENTS_MAX);
+        i = BATCH_EXPONENTS_MAX;
+      }
+      else if(i < 1)
+      {
+        logprintf(mystuff, "Warning: Read BatchExponents=%d from INI file, using min value (1)\n", i);
+        i = 1;
+      }
+      if(i > 1 && mystuff->grids_per_launch == 1)
+      {
+        logprintf(mystuff, "ERROR: BatchExponents=%d needs GridsPerLaunch > 1, the batch runs on the multi-grid kernels\n", i);
+        i = 1;
+        ret = 1;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  BatchExponents            %d\n",i);
+    mystuff->batch_exponents = i;
+
   /*****************************************************************************/
 
     if(my_read_ulong(mystuff->inifile, "SieveCPUMask", &ul))
@@ -367,11 +426,129 @@ int read_config(mystuff_t *mystuff)
     #endif
 
     mystuff->cpu_mask = ul;
+
+  /*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "SieveThreads", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read SieveThreads from INI file, using default value (%d)\n", SIEVE_THREADS_DEFAULT);
+      i = SIEVE_THREADS_DEFAULT;
+    }
+    else
+    {
+      if(i > SIEVE_THREADS_MAX)
+      {
+        logprintf(mystuff, "Warning: Read SieveThreads=%d from INI file, using max value (%d)\n", i, SIEVE_THREADS_MAX);
+        i = SIEVE_THREADS_MAX;
+      }
+      else if(i < SIEVE_THREADS_MIN)
+      {
+        logprintf(mystuff, "Warning: Read SieveThreads=%d from INI file, using min value (%d)\n", i, SIEVE_THREADS_MIN);
+        i = SIEVE_THREADS_MIN;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  SieveThreads              %d\n",i);
+    mystuff->sieve_threads = i;
+
+  /*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "SieveBucketThreshold", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read SieveBucketThreshold from INI file, using default value (%d)\n", SIEVE_BUCKET_THRESHOLD_DEFAULT);
+      i = SIEVE_BUCKET_THRESHOLD_DEFAULT;
+    }
+    else
+    {
+      if(i > SIEVE_BUCKET_THRESHOLD_MAX)
+      {
+        logprintf(mystuff, "Warning: Read SieveBucketThreshold=%d from INI file, using max value (%d)\n", i, SIEVE_BUCKET_THRESHOLD_MAX);
+        i = SIEVE_BUCKET_THRESHOLD_MAX;
+      }
+      else if(i < SIEVE_BUCKET_THRESHOLD_MIN)
+      {
+        logprintf(mystuff, "Warning: Read SieveBucketThreshold=%d from INI file, using min value (%d)\n", i, SIEVE_BUCKET_THRESHOLD_MIN);
+        i = SIEVE_BUCKET_THRESHOLD_MIN;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  SieveBucketThreshold      %d\n",i);
+    mystuff->sieve_bucket_threshold = i;
+
+  /*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "SieveWheelPrimes", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read SieveWheelPrimes from INI file, using default value (%d)\n", SIEVE_WHEEL_PRIMES_DEFAULT);
+      i = SIEVE_WHEEL_PRIMES_DEFAULT;
+    }
+    else
+    {
+      if(i > SIEVE_WHEEL_PRIMES_MAX)
+      {
+        logprintf(mystuff, "Warning: Read SieveWheelPrimes=%d from INI file, using max value (%d)\n", i, SIEVE_WHEEL_PRIMES_MAX);
+        i = SIEVE_WHEEL_PRIMES_MAX;
+      }
+      else if(i < SIEVE_WHEEL_PRIMES_MIN)
+      {
+        logprintf(mystuff, "Warning: Read SieveWheelPrimes=%d from INI file, using min value (%d)\n", i, SIEVE_WHEEL_PRIMES_MIN);
+        i = SIEVE_WHEEL_PRIMES_MIN;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  SieveWheelPrimes          %d\n",i);
+    mystuff->sieve_wheel_primes = i;
+
+  /*****************************************************************************/
+
+    if(my_read_string(mystuff->inifile, "SieveExtractor", tmp, 50))
+    {
+      logprintf(mystuff, "Warning: Cannot read SieveExtractor from INI file, using default (AUTO)\n");
+      mystuff->sieve_extractor = SIEVE_EXTRACT_AUTO;
+    }
+    else
+    {
+      mystuff->sieve_extractor = sieve_extractor_by_name(tmp);
+      if (mystuff->sieve_extractor == SIEVE_EXTRACT_UNKNOWN)
+      {
+        logprintf(mystuff, "Warning: Unknown setting \"%s\" for SieveExtractor, using default (AUTO)\n", tmp);
+        mystuff->sieve_extractor = SIEVE_EXTRACT_AUTO;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  SieveExtractor            %s\n", sieve_extractor_name(mystuff->sieve_extractor));
+
+  /*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "HostTFThreads", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read HostTFThreads from INI file, using default value (%d)\n", HOST_TF_THREADS_DEFAULT);
+      i = HOST_TF_THREADS_DEFAULT;
+    }
+    else
+    {
+      if(i > HOST_TF_THREADS_MAX)
+      {
+        logprintf(mystuff, "Warning: Read HostTFThreads=%d from INI file, using max value (%d)\n", i, HOST_TF_THREADS_MAX);
+        i = HOST_TF_THREADS_MAX;
+      }
+      else if(i < HOST_TF_THREADS_MIN)
+      {
+        logprintf(mystuff, "Warning: Read HostTFThreads=%d from INI file, using min value (%d)\n", i, HOST_TF_THREADS_MIN);
+        i = HOST_TF_THREADS_MIN;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  HostTFThreads             %d\n",i);
+    mystuff->host_tf_threads = i;
   }
   else // SieveOnGPU
   {
     mystuff->num_streams = 3; // GPU sieve always uses only one stream, but perftest may use more
     mystuff->threads_per_grid_max = 2097152; // not used for the GPU sieve - defined here to satisfy some calculations
+    mystuff->grids_per_launch = 1;
+    mystuff->batch_exponents = 1;
+
+    if(!my_read_int(mystuff->inifile, "BatchExponents", &i) && i > 1)
+    {
+      logprintf(mystuff, "ERROR: BatchExponents=%d works with the CPU sieve only, set SieveOnGPU=0 or BatchExponents=1\n", i);
+      ret = 1;
+    }
 
     if(my_read_int(mystuff->inifile, "MoreClasses", &i))
     {
@@ -474,6 +651,71 @@ int read_config(mystuff_t *mystuff)
     if(mystuff->verbosity >= 1)logprintf(mystuff, "  GPUSieveSize              %d Mib\n",i);
     mystuff->gpu_sieve_size = i * 1024 * 1024;
 
+/*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "GPUSieveClasses", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read GPUSieveClasses from INI file, using default value (%d)\n",GPU_SIEVE_CLASSES_DEFAULT);
+      i = GPU_SIEVE_CLASSES_DEFAULT;
+    }
+    else
+    {
+      if(i > GPU_SIEVE_CLASSES_MAX)
+      {
+        logprintf(mystuff, "Warning: Read GPUSieveClasses=%d from INI file, using max value (%d)\n",i,GPU_SIEVE_CLASSES_MAX);
+        i = GPU_SIEVE_CLASSES_MAX;
+      }
+      else if(i < GPU_SIEVE_CLASSES_MIN)
+      {
+        logprintf(mystuff, "Warning: Read GPUSieveClasses=%d from INI file, using min value (%d)\n",i,GPU_SIEVE_CLASSES_MIN);
+        i = GPU_SIEVE_CLASSES_MIN;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  GPUSieveClasses           %d\n",i);
+    mystuff->gpu_sieve_classes = i;
+
+/*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "GPUSieveBucketThreshold", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read GPUSieveBucketThreshold from INI file, using default value (%d)\n",GPU_SIEVE_BUCKET_THRESHOLD_DEFAULT);
+      i = GPU_SIEVE_BUCKET_THRESHOLD_DEFAULT;
+    }
+    else
+    {
+      if(i > GPU_SIEVE_BUCKET_THRESHOLD_MAX)
+      {
+        logprintf(mystuff, "Warning: Read GPUSieveBucketThreshold=%d from INI file, using max value (%d)\n",i,GPU_SIEVE_BUCKET_THRESHOLD_MAX);
+        i = GPU_SIEVE_BUCKET_THRESHOLD_MAX;
+      }
+      else if(i < GPU_SIEVE_BUCKET_THRESHOLD_MIN)
+      {
+        logprintf(mystuff, "Warning: Read GPUSieveBucketThreshold=%d from INI file, using min value (%d)\n",i,GPU_SIEVE_BUCKET_THRESHOLD_MIN);
+        i = GPU_SIEVE_BUCKET_THRESHOLD_MIN;
+      }
+    }
+    if(mystuff->verbosity >= 1)logprintf(mystuff, "  GPUSieveBucketThreshold   %d\n",i);
+    mystuff->gpu_sieve_bucket_threshold = i;
+
+    /*****************************************************************************/
+
+    if(my_read_int(mystuff->inifile, "GPUSieveCompact", &i))
+    {
+      logprintf(mystuff, "Warning: Cannot read GPUSieveCompact from INI file, set to 0 by default\n");
+      i=0;
+    }
+    else if(i != 0 && i != 1)
+    {
+      logprintf(mystuff, "Warning: GPUSieveCompact must be 0 or 1, set to 0 by default\n");
+      i=0;
+    }
+    if(mystuff->verbosity >= 1)
+    {
+      if(i == 0)logprintf(mystuff, "  GPUSieveCompact           no\n");
+      else      logprintf(mystuff, "  GPUSieveCompact           yes\n");
+    }
+    mystuff->gpu_sieve_compact = i;
+
     /*****************************************************************************/
 
     if(my_read_int(mystuff->inifile, "FlushInterval", &i))
@@ -823,7 +1065,26 @@ int read_config(mystuff_t *mystuff)
   }
 
   /*****************************************************************************/
-  return 0;
+
+  if(my_read_int(mystuff->inifile, "SpecializeKernels", &i))
+  {
+    logprintf(mystuff, "Warning: Cannot read SpecializeKernels from INI file, set to 0 by default\n");
+    i=0;
+  }
+  else if(i != 0 && i != 1)
+  {
+    logprintf(mystuff, "Warning: SpecializeKernels must be 0 or 1, set to 0 by default\n");
+    i=0;
+  }
+  if(mystuff->verbosity >= 1)
+  {
+    if(i == 0)logprintf(mystuff, "  SpecializeKernels         no\n");
+    else      logprintf(mystuff, "  SpecializeKernels         yes\n");
+  }
+  mystuff->specialize_kernels = i;
+
+  /*****************************************************************************/
+  return ret;
 }
 
 /* read a config array of integers from <filename>,
@@ -20,6 +20,9 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#ifdef _WIN32
+#define strcasecmp _stricmp
+#endif
 
 #include "params.h"
 #ifdef VERBOSE_SIEVE_TIMING
@@ -27,25 +30,106 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #endif
 #include "compatibility.h"
 #include "gpusieve.h"
+#include "sieve.h"
+
+#if defined __x86_64__ || defined __i386__ || defined _M_X64 || defined _M_IX86
+  #define SIEVE_X86
+  #include <immintrin.h>
+  #ifdef _MSC_VER
+    #include <intrin.h>
+    #define SIEVE_TARGET(x)
+  #else
+    #define SIEVE_TARGET(x) __attribute__((target(x)))
+  #endif
+#endif
 #ifdef DETAILED_INFO
   #include "output.h"
 #endif
 
-/* yeah, I like global variables :) */
-static unsigned int *sieve, *sieve_base, *primes;
+/* yeah, I like global variables :)
+The prime table and the masks are read-only after sieve_init() and shared by
+all sieve contexts. Everything that changes while sieving a class lives in a
+sieve_ctx_t so that several classes can be sieved at the same time. */
+static unsigned int *primes, max_primes;
 static unsigned int  mask0[32], mask1[32];
-static int *k_init, last_sieve;
 
+/* Bucket sieve for the large primes: a prime p > SIEVE_SIZE hits a segment at
+most once, so instead of looking at every prime for every segment each prime is
+stored in the bucket of the segment which contains its next hit. Sieving a
+segment only walks the entries of its own bucket and moves each of them to
+the bucket of its next hit. The buckets form a ring, one bucket for each
+segment up to the largest prime in the table. */
+typedef struct _sieve_bucket_entry_t
+{
+  unsigned int p;              /* the prime */
+  unsigned int pos;            /* position of the next hit within the segment */
+} sieve_bucket_entry_t;
+
+/* appends the offsets of the bits set in sieve[0 ... words-1] to ktab[k],
+ic is the offset of bit 0 of sieve[0]. Returns the new k, up to 8 entries
+beyond the returned k may be overwritten. */
+typedef unsigned int (*sieve_extract_func)(const unsigned int *sieve, unsigned int words, int ic, unsigned int *ktab, unsigned int k);
+
+typedef struct _sieve_bucket_t
+{
+  sieve_bucket_entry_t *entry;
+  unsigned int count, size;
+} sieve_bucket_t;
+
+/* Wheel for the small primes above the ones in sieve_base: the primes are
+grouped so that the product of each group stays below SIEVE_WHEEL_PERIOD_MAX.
+A group has one pattern with all multiples of its primes cleared. The pattern
+has a period of <period> bits, so <period> words repeat exactly, and a segment
+is sieved by ANDing the pattern (read at bit offset <offset>) into the sieve,
+one pass per group instead of 32 passes per prime. */
+#define SIEVE_WHEEL_PERIOD_MAX 65536
+
+#ifdef MORE_CLASSES
+#define SIEVE_WHEEL_FIRST 8 /* primes[8] = 29, 13 ... 23 are in sieve_base */
+#else
+#define SIEVE_WHEEL_FIRST 7 /* primes[7] = 23, 11 ... 19 are in sieve_base */
+#endif
+
+typedef struct _sieve_wheel_t
+{
+  unsigned int *pattern;       /* period + 1 words, the last one is a copy of the first one */
+  unsigned int period;         /* product of the primes of this group */
+  unsigned int first, last;    /* the group covers primes[first ... last-1] */
+  unsigned int offset;         /* bit of the pattern which corresponds to bit 0 of the segment */
+} sieve_wheel_t;
+
+struct _sieve_ctx_t
+{
+  unsigned int *sieve, *sieve_base;
+  int *k_init, last_sieve;
+#ifndef SIEVE_SIZE_LIMIT
+  unsigned int sieve_size, sieve_bytes, sieve_words, sieve_size_ff;
+#endif
+  sieve_bucket_t *buckets;
+  unsigned int num_buckets, cur_bucket;
+  unsigned int bucket_start;   /* primes[bucket_start] is the first prime handled by the buckets */
+  unsigned int bucket_limit;   /* primes[bucket_start ... bucket_limit-1] are in the buckets */
+  sieve_bucket_entry_t *bucket_tmp; /* scratch space for sieve_skip_segments() */
+  sieve_extract_func extract;  /* converts the bits of the sieve to ktab offsets */
+  enum SIEVE_EXTRACTORS extractor;
+  sieve_wheel_t *wheel;
+  unsigned int num_wheels;
+  unsigned int sieve_start;    /* first prime sieved by sieve_segment(), the ones below are in sieve_base or the wheel */
+  unsigned int *class_add, *class_mul; /* k_init[i] = (class_add[i] + class_mul[i] * k_start) mod primes[i] */
+  unsigned int class_exp;      /* the exponent class_add[] and class_mul[] were computed for */
+  unsigned int class_limit;    /* ... up to primes[class_limit-1] */
+};
+
+/* all functions using these macros have a sieve context named ctx */
 #ifdef SIEVE_SIZE_LIMIT
 #define SIEVE_BYTES (4+((SIEVE_SIZE) >> 3))
 #define SIEVE_WORDS (SIEVE_BYTES >> 2)
 #define SIEVE_SIZE_FF (SIEVE_SIZE&0xFFFFFFE0)
 #else
-  static unsigned int sieve_size, sieve_bytes, sieve_words, sieve_size_ff;
-#define SIEVE_SIZE sieve_size
-#define SIEVE_BYTES sieve_bytes
-#define SIEVE_WORDS sieve_words
-#define SIEVE_SIZE_FF sieve_size_ff
+#define SIEVE_SIZE (ctx->sieve_size)
+#define SIEVE_BYTES (ctx->sieve_bytes)
+#define SIEVE_WORDS (ctx->sieve_words)
+#define SIEVE_SIZE_FF (ctx->sieve_size_ff)
 #endif
 
 /* the sieve_table contains the number of bits set in n (sieve_table[n][8]) and
@@ -82,6 +166,121 @@ static __inline void sieve_clear_bit(unsigned int *array, unsigned int bit)
 //#define sieve_clear_bit(ARRAY,BIT) asm("btrl  %0, %1" : /* no output */ : "r" (BIT), "m" (*ARRAY) : "memory", "cc" )
 //#define sieve_clear_bit(ARRAY,BIT) ARRAY[BIT>>5]&=mask0[BIT&0x1F]
 
+static __inline void sieve_bucket_push(sieve_bucket_t *bucket, unsigned int p, unsigned int pos)
+{
+  if (bucket->count == bucket->size)
+  {
+    bucket->size = bucket->size ? 2 * bucket->size : 1024;
+    bucket->entry = realloc(bucket->entry, bucket->size * sizeof(sieve_bucket_entry_t));
+    if (bucket->entry == NULL)
+    {
+      fprintf(stderr, "ERROR: out of memory\n");
+      exit(1);
+    }
+  }
+  bucket->entry[bucket->count].p   = p;
+  bucket->entry[bucket->count].pos = pos;
+  bucket->count++;
+}
+
+static int sieve_ctx_alloc(sieve_ctx_t *ctx, unsigned int ssize, unsigned int bucket_threshold, unsigned int wheel_primes)
+{
+  unsigned int i, j, t, period;
+
+#ifndef SIEVE_SIZE_LIMIT
+  ctx->sieve_size    = ssize;
+  ctx->sieve_bytes   = 4 + (ssize >> 3);
+  ctx->sieve_words   = ctx->sieve_bytes >> 2;
+  ctx->sieve_size_ff = ssize & 0xFFFFFFE0;
+#else
+  (void)ssize;
+#endif
+  ctx->sieve      = malloc(SIEVE_BYTES);
+  ctx->sieve_base = malloc(SIEVE_BYTES);
+  ctx->k_init     = malloc(max_primes * sizeof(int));
+  ctx->class_add  = malloc(max_primes * sizeof(unsigned int));
+  ctx->class_mul  = malloc(max_primes * sizeof(unsigned int));
+  ctx->last_sieve = SIEVE_SIZE;
+  sieve_ctx_set_extractor(ctx, SIEVE_EXTRACT_AUTO);
+
+/* primes above bucket_threshold * SIEVE_SIZE go into the buckets, they must be
+larger than SIEVE_SIZE so that they never hit the same segment twice */
+  ctx->bucket_start = max_primes;
+  if (bucket_threshold > 0)
+  {
+    for (i = SIEVE_SPLIT; i < max_primes; i++)
+    {
+      if ((unsigned long long int)primes[i] > (unsigned long long int)bucket_threshold * SIEVE_SIZE) break;
+    }
+    ctx->bucket_start = i;
+  }
+  if (ctx->bucket_start < max_primes)
+  {
+    ctx->num_buckets = primes[max_primes-1] / SIEVE_SIZE + 2;
+    ctx->buckets     = calloc(ctx->num_buckets, sizeof(sieve_bucket_t));
+    if (ctx->buckets == NULL) return 1;
+  }
+
+/* primes[SIEVE_WHEEL_FIRST ... SIEVE_WHEEL_FIRST+wheel_primes-1] go into the wheel */
+#ifdef MORE_CLASSES
+  ctx->sieve_start = 7;
+#else
+  ctx->sieve_start = 6;
+#endif
+  if (wheel_primes > 0)
+  {
+    ctx->sieve_start = SIEVE_WHEEL_FIRST + wheel_primes;
+    ctx->wheel = calloc(wheel_primes, sizeof(sieve_wheel_t));
+    if (ctx->wheel == NULL) return 1;
+    for (i = SIEVE_WHEEL_FIRST; i < ctx->sieve_start; ctx->num_wheels++)
+    {
+      sieve_wheel_t *wheel = &ctx->wheel[ctx->num_wheels];
+
+      wheel->first = i;
+      period = primes[i++];
+      while (i < ctx->sieve_start && period * primes[i] <= SIEVE_WHEEL_PERIOD_MAX) period *= primes[i++];
+      wheel->last    = i;
+      wheel->period  = period;
+      wheel->pattern = malloc((period + 1) * sizeof(unsigned int));
+      if (wheel->pattern == NULL) return 1;
+
+      for (t = 0; t <= period; t++) wheel->pattern[t] = 0xFFFFFFFF;
+      for (j = wheel->first; j < wheel->last; j++)
+      {
+        for (t = 0; t < 32 * period; t += primes[j]) sieve_clear_bit(wheel->pattern, t);
+      }
+      wheel->pattern[period] = wheel->pattern[0];
+    }
+  }
+
+  return (ctx->sieve == NULL) || (ctx->sieve_base == NULL) || (ctx->k_init == NULL) ||
+         (ctx->class_add == NULL) || (ctx->class_mul == NULL);
+}
+
+static void sieve_ctx_release(sieve_ctx_t *ctx)
+{
+  unsigned int i;
+
+  if (ctx->sieve)      { free(ctx->sieve);      ctx->sieve=NULL; }
+  if (ctx->sieve_base) { free(ctx->sieve_base); ctx->sieve_base=NULL; }
+  if (ctx->k_init)     { free(ctx->k_init);     ctx->k_init=NULL; }
+  if (ctx->class_add)  { free(ctx->class_add);  ctx->class_add=NULL; }
+  if (ctx->class_mul)  { free(ctx->class_mul);  ctx->class_mul=NULL; }
+  if (ctx->buckets)
+  {
+    for (i = 0; i < ctx->num_buckets; i++) free(ctx->buckets[i].entry);
+    free(ctx->buckets);
+    ctx->buckets=NULL;
+  }
+  if (ctx->bucket_tmp) { free(ctx->bucket_tmp); ctx->bucket_tmp=NULL; }
+  if (ctx->wheel)
+  {
+    for (i = 0; i < ctx->num_wheels; i++) free(ctx->wheel[i].pattern);
+    free(ctx->wheel);
+    ctx->wheel=NULL;
+  }
+}
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -89,17 +288,15 @@ extern "C" {
 #ifdef SIEVE_SIZE_LIMIT
 void sieve_init()
 #else
-void sieve_init(unsigned int ssize, unsigned int max_global)
+void sieve_init(unsigned int max_global)
 #endif
+/* sets up the prime table and the lookup tables shared by all sieve contexts.
+Must be called once before the first sieve_ctx_new(), not while any context is
+in use by another thread. */
 {
   unsigned int i,j;
 #ifdef SIEVE_SIZE_LIMIT
   const unsigned int max_global = SIEVE_PRIMES_MAX;
-#else
-  sieve_size = ssize;
-  sieve_bytes = 4 + (ssize >> 3);
-  sieve_words = sieve_bytes >> 2;
-  sieve_size_ff = ssize & 0xFFFFFFE0;
 #endif
 
   for(i=0;i<32;i++)
@@ -107,12 +304,10 @@ void sieve_init(unsigned int ssize, unsigned int max_global)
     mask1[i]=1<<i;
     mask0[i]=0xFFFFFFFF-mask1[i];
   }
-  sieve      = malloc(SIEVE_BYTES);
-  sieve_base = malloc(SIEVE_BYTES);
+  max_primes = max_global;
   primes     = malloc((1+max_global) * sizeof(unsigned int));
-  k_init     = malloc(max_global * sizeof(int));
 
-  if ((sieve == NULL) || (sieve_base == NULL) || (primes == NULL) || (k_init == NULL))
+  if (primes == NULL)
   {
     fprintf(stderr, "ERROR: out of memory\n");
     exit(1); // TODO: add and evaluate return value for this function
@@ -139,11 +334,37 @@ void sieve_init(unsigned int ssize, unsigned int max_global)
 }
 
 void sieve_free()
+/* frees the shared tables, all sieve contexts must have been freed before */
 {
-  if (sieve)      { free(sieve);      sieve=NULL; }
-  if (sieve_base) { free(sieve_base); sieve_base=NULL; }
   if (primes)     { free(primes);     primes=NULL; }
-  if (k_init)     { free(k_init);     k_init=NULL; }
+}
+
+sieve_ctx_t *sieve_ctx_new(unsigned int ssize, unsigned int bucket_threshold, unsigned int wheel_primes)
+/* allocates a sieve context with a sieve of ssize bits (ignored when
+SIEVE_SIZE_LIMIT is defined), sieve_init() must have been called before.
+Primes above bucket_threshold * ssize are sieved using buckets, 0 disables the
+bucket sieve. The first wheel_primes primes which are not in sieve_base are
+sieved with the wheel patterns.
+Each context holds the complete state of one class, different contexts can be
+used by different threads at the same time. Returns NULL if out of memory. */
+{
+  sieve_ctx_t *ctx = calloc(1, sizeof(sieve_ctx_t));
+
+  if (ctx != NULL && sieve_ctx_alloc(ctx, ssize, bucket_threshold, wheel_primes))
+  {
+    sieve_ctx_free(ctx);
+    ctx = NULL;
+  }
+  return ctx;
+}
+
+void sieve_ctx_free(sieve_ctx_t *ctx)
+{
+  if (ctx)
+  {
+    sieve_ctx_release(ctx);
+    free(ctx);
+  }
 }
 
 int sieve_euclid_modified(int j, int n, int r)
@@ -207,10 +428,40 @@ j, n, r  <=  primes[200000] = 2750161 (22 bits) */
   return (int)tmp;
 }
 
-void sieve_init_class(unsigned int exp, unsigned long long int k_start, unsigned int sieve_limit)
+static void sieve_init_exponent(sieve_ctx_t *ctx, unsigned int exp, unsigned int sieve_limit)
+/* fills class_add[] and class_mul[] of ctx for exp up to primes[sieve_limit-1],
+they stay valid for all classes of the exponent */
+{
+  unsigned int i, p, inv;
+
+  if(exp != ctx->class_exp)
+  {
+    ctx->class_exp = exp;
+#ifdef MORE_CLASSES
+    ctx->class_limit = 4;
+#else
+    ctx->class_limit = 3;
+#endif
+  }
+  for(i=ctx->class_limit;i<sieve_limit;i++)
+  {
+    p = primes[i];
+    inv = sieve_euclid_modified((int)((9240ULL * (unsigned long long int)exp)%p), p, 1); /* (9240*exp)^-1 mod p */
+    ctx->class_add[i] = p - inv;                                                      /* -inv mod p */
+    ctx->class_mul[i] = (unsigned int)(((unsigned long long int)(p - (2ULL * (unsigned long long int)exp)%p) * inv) % p); /* -2*exp*inv mod p */
+  }
+  if(sieve_limit > ctx->class_limit) ctx->class_limit = sieve_limit;
+}
+
+
+void sieve_init_class(sieve_ctx_t *ctx, unsigned int exp, unsigned long long int k_start, unsigned int sieve_limit)
 {
   unsigned int i,j,k,p;
-  unsigned int ii,jj;
+  unsigned int *sieve_base = ctx->sieve_base;
+  unsigned int *class_add = ctx->class_add, *class_mul = ctx->class_mul;
+  int *k_init = ctx->k_init;
+
+  sieve_init_exponent(ctx, exp, sieve_limit);
 
 #ifdef MORE_CLASSES
   for(i=4;i<sieve_limit;i++)
@@ -243,10 +494,16 @@ still a brute force trial&error method */
     // jj=(2ULL * (exp%p) * (NUM_CLASSES%p))%p;     // PERF: skip %p for NUM_CLASSES
 
     // skip 3 modulo's and the error checking: saves 10-20 CPU-ms per class
-    ii = (2ULL * (unsigned long long int)exp * (k_start%p))%p;
+/*    ii = (2ULL * (unsigned long long int)exp * (k_start%p))%p;
     jj = (9240ULL * (unsigned long long int)exp)%p;
 
     k = sieve_euclid_modified(jj, p, p-(1+ii));
+    k_init[i]=k;*/
+
+/* fourth version: k = (p-1-ii) * jj^-1 mod p. jj^-1 and 2*exp depend only on
+the exponent, sieve_init_exponent() caches them in class_add[] and class_mul[],
+so each class needs only k_start%p and one modular multiply-add */
+    k = (unsigned int)((class_add[i] + (unsigned long long int)class_mul[i] * (k_start%p)) % p);
     k_init[i]=k;
 
 // error checking
@@ -289,43 +546,53 @@ still a brute force trial&error method */
     }
 //    k_init[i]=j-SIEVE_SIZE;
   }
-  last_sieve = SIEVE_SIZE;
-}
+  ctx->last_sieve = SIEVE_SIZE;
 
+/* find the pattern offset of each wheel group: bit t of the segment must be
+cleared if t = k_init[i] mod p, the pattern has its cleared bits at 0 mod p, so
+the offset is -k_init[i] mod p for all primes of the group (CRT) */
+  for(i=0;i<ctx->num_wheels;i++)
+  {
+    sieve_wheel_t *wheel = &ctx->wheel[i];
+    unsigned int offset = 0, step = 1, r;
 
-void sieve_candidates(unsigned int ktab_size, unsigned int *ktab, unsigned int sieve_limit)
-{
-  int i=-1,ii,j,p,c=0,ic;
-  unsigned int s,sieve_table_8,*sieve_table_,k=0;
-  unsigned int mask; //, index, index_max;
-  unsigned int *ptr, *ptr_max;
-  unsigned int ktab_size33 = ktab_size - 33;
-#ifdef VERBOSE_SIEVE_TIMING
-  struct timeval timer;
-  timer_init(&timer);
-#endif
-
-#ifdef RAW_GPU_BENCH
-//  quick hack to "speed up the siever", used for GPU-code benchmarks
-  for(i=0;i<ktab_size;i++)ktab[i]=i;
-  return;
-#endif
+    for(j=wheel->first;j<wheel->last;j++)
+    {
+      p = primes[j];
+      r = (p - k_init[j]) % p;
+      while(offset % p != r) offset += step;
+      step *= p;
+    }
+    wheel->offset = offset;
+  }
 
-  if(last_sieve < (int)SIEVE_SIZE)
+/* move the large primes into the buckets of their first hit */
+  if (ctx->buckets)
   {
-    i=last_sieve;
-    c=-i;
-    goto _ugly_goto_in_siever;
+    for(i=0;i<ctx->num_buckets;i++) ctx->buckets[i].count = 0;
+    ctx->cur_bucket = 0;
+    ctx->bucket_limit = (sieve_limit > ctx->bucket_start) ? sieve_limit : ctx->bucket_start;
+    for(i=ctx->bucket_start;i<ctx->bucket_limit;i++)
+    {
+      sieve_bucket_push(&ctx->buckets[k_init[i] / SIEVE_SIZE], primes[i], k_init[i] % SIEVE_SIZE);
+    }
   }
+}
 
+static void sieve_segment(sieve_ctx_t *ctx, unsigned int sieve_limit)
+/* sieves the next SIEVE_SIZE bits of the current class into ctx->sieve */
+{
+  int i,ii,j,p;
+  unsigned int mask;
+  unsigned int *ptr, *ptr_max;
+  unsigned int *sieve = ctx->sieve;
+  int *k_init = ctx->k_init;
 #ifdef VERBOSE_SIEVE_TIMING
-  printf("Sieve start: %llu\n", timer_diff(&timer));
+  struct timeval timer;
+  timer_init(&timer);
 #endif
 
-  while(k<ktab_size)
-  {
-//printf("sieve_candidates(): main loop start\n");
-    memcpy(sieve, sieve_base, SIEVE_BYTES);
+  memcpy(sieve, ctx->sieve_base, SIEVE_BYTES);
 
 /*
 The first few primes in the sieve have their own code. Since they are small
@@ -339,53 +606,402 @@ this behaviour and precompute them. :)
   printf("Sieve base copied: %llu\n", timer_diff(&timer));
 #endif
 
-#ifdef MORE_CLASSES
-    for(i=7;i<SIEVE_SPLIT;i++)
-#else
-    for(i=6;i<SIEVE_SPLIT;i++)
-#endif
+  for(i=0;i<(int)ctx->num_wheels;i++)
+  {
+    sieve_wheel_t *wheel = &ctx->wheel[i];
+    const unsigned int *pattern;
+    unsigned int w = 0, n, x, a = wheel->offset >> 5, sh = wheel->offset & 0x1F;
+
+    while(w < SIEVE_WORDS)
     {
-      j=k_init[i];
-      p=primes[i];
-//printf("sieve: %d\n",p);
-      for(ii=0; ii<32; ii++)
+      n = wheel->period - a; /* words until the pattern wraps around */
+      if(n > SIEVE_WORDS - w) n = SIEVE_WORDS - w;
+      pattern = &(wheel->pattern[a]);
+      if(sh == 0)
       {
-        mask = mask0[j & 0x1F];
-
-        ptr = &(sieve[j>>5]);
-        ptr_max = &(sieve[SIEVE_WORDS]);
-//        ptr_max is now always &(sieve[SIEVE_SIZE>>5])+1
-//        this may result in one more loop than necessary. Advancing ptr by one more p
-//        does not matter as k_init is calculated %p
-//        if( ((unsigned int)j & 0x1F) < (SIEVE_SIZE & 0x1F))ptr_max++;
-        while(ptr < ptr_max) /* inner loop, lets kick out some bits! */
-        {
-          *ptr &= mask;
-          ptr += p;
-        }
-        j+=p;
+        for(x=0;x<n;x++) sieve[w+x] &= pattern[x];
+      }
+      else
+      {
+        for(x=0;x<n;x++) sieve[w+x] &= (pattern[x] >> sh) | (pattern[x+1] << (32 - sh));
       }
-      j = ((int)(ptr - sieve)<<5) + ((j-p) & 0x1F); /* D'oh! Pointer arithmetic... but it is faster! */
-      j -= SIEVE_SIZE;
-      k_init[i] = j % p;
+      w += n;
+      a += n;
+      if(a == wheel->period) a = 0;
     }
+    wheel->offset = (unsigned int)((wheel->offset + (unsigned long long int)SIEVE_SIZE) % wheel->period);
+  }
 
 #ifdef VERBOSE_SIEVE_TIMING
-  printf("Sieve split: %llu\n", timer_diff(&timer));
+  printf("Sieve wheel: %llu\n", timer_diff(&timer));
 #endif
 
-    for(i=SIEVE_SPLIT;i<(int)sieve_limit;i++)
-    {
-      j=k_init[i];
-      p=primes[i];
+  for(i=ctx->sieve_start;i<SIEVE_SPLIT;i++)
+  {
+    j=k_init[i];
+    p=primes[i];
 //printf("sieve: %d\n",p);
-      while((unsigned int)j<SIEVE_SIZE)
+    for(ii=0; ii<32; ii++)
+    {
+      mask = mask0[j & 0x1F];
+
+      ptr = &(sieve[j>>5]);
+      ptr_max = &(sieve[SIEVE_WORDS]);
+//      ptr_max is now always &(sieve[SIEVE_SIZE>>5])+1
+//      this may result in one more loop than necessary. Advancing ptr by one more p
+//      does not matter as k_init is calculated %p
+//      if( ((unsigned int)j & 0x1F) < (SIEVE_SIZE & 0x1F))ptr_max++;
+      while(ptr < ptr_max) /* inner loop, lets kick out some bits! */
       {
-        sieve_clear_bit(sieve,j);
-        j+=p;
+        *ptr &= mask;
+        ptr += p;
       }
-      k_init[i]=j-SIEVE_SIZE;
+      j+=p;
+    }
+    j = ((int)(ptr - sieve)<<5) + ((j-p) & 0x1F); /* D'oh! Pointer arithmetic... but it is faster! */
+    j -= SIEVE_SIZE;
+    k_init[i] = j % p;
+  }
+
+#ifdef VERBOSE_SIEVE_TIMING
+  printf("Sieve split: %llu\n", timer_diff(&timer));
+#endif
+
+  if(sieve_limit > ctx->bucket_start) sieve_limit = ctx->bucket_start; /* the larger primes are in the buckets */
+  for(i=SIEVE_SPLIT;i<(int)sieve_limit;i++)
+  {
+    j=k_init[i];
+    p=primes[i];
+//printf("sieve: %d\n",p);
+    while((unsigned int)j<SIEVE_SIZE)
+    {
+      sieve_clear_bit(sieve,j);
+      j+=p;
+    }
+    k_init[i]=j-SIEVE_SIZE;
+  }
+
+  if (ctx->buckets)
+  {
+    sieve_bucket_t *bucket = &ctx->buckets[ctx->cur_bucket];
+    sieve_bucket_entry_t *entry = bucket->entry;
+    unsigned int n = bucket->count, next, b;
+
+    bucket->count = 0; /* p > SIEVE_SIZE: no entry goes back into this bucket */
+    for(ii=0;ii<(int)n;ii++)
+    {
+      sieve_clear_bit(sieve, entry[ii].pos);
+      next = entry[ii].pos + entry[ii].p;
+      b = ctx->cur_bucket + next / SIEVE_SIZE;
+      if (b >= ctx->num_buckets) b -= ctx->num_buckets;
+      sieve_bucket_push(&ctx->buckets[b], entry[ii].p, next % SIEVE_SIZE);
+    }
+    if (++ctx->cur_bucket == ctx->num_buckets) ctx->cur_bucket = 0;
+  }
+}
+
+
+static __inline unsigned int sieve_extract_word(unsigned int s, int ic, unsigned int *ktab, unsigned int k)
+/* appends the offsets of the bits set in s to ktab[k], ic is the offset of bit 0.
+Up to 8 entries beyond the returned k may be overwritten. */
+{
+  unsigned int *sieve_table_, sieve_table_8;
+#ifdef SIEVER_OLD_METHOD
+  unsigned int p;
+
+  sieve_table_=sieve_table[ s     &0xFF];
+  for(p=0;p<sieve_table_[8];p++) ktab[k++]=ic   +sieve_table_[p];
+
+  sieve_table_=sieve_table[(s>>8 )&0xFF];
+  for(p=0;p<sieve_table_[8];p++) ktab[k++]=ic +8+sieve_table_[p];
+
+  sieve_table_=sieve_table[(s>>16)&0xFF];
+  for(p=0;p<sieve_table_[8];p++) ktab[k++]=ic+16+sieve_table_[p];
+
+  sieve_table_=sieve_table[ s>>24      ];
+  for(p=0;p<sieve_table_[8];p++) ktab[k++]=ic+24+sieve_table_[p];
+
+#else // not SIEVER_OLD_METHOD
+  sieve_table_=sieve_table[ s     &0xFF];
+  sieve_table_8=sieve_table_[8];
+  ktab[k  ]=ic+sieve_table_[0];
+  ktab[k+1]=ic+sieve_table_[1];
+  ktab[k+2]=ic+sieve_table_[2];
+  ktab[k+3]=ic+sieve_table_[3];
+  if(sieve_table_8>4)
+  {
+    ktab[k+4]=ic+sieve_table_[4];
+    ktab[k+5]=ic+sieve_table_[5];
+    ktab[k+6]=ic+sieve_table_[6];
+    ktab[k+7]=ic+sieve_table_[7];
+  }
+  k+=sieve_table_8;
+
+  sieve_table_=sieve_table[(s>>8 )&0xFF];
+  sieve_table_8=sieve_table_[8];
+  ic+=8;
+  ktab[k  ]=ic+sieve_table_[0];
+  ktab[k+1]=ic+sieve_table_[1];
+  ktab[k+2]=ic+sieve_table_[2];
+  ktab[k+3]=ic+sieve_table_[3];
+  if(sieve_table_8>4)
+  {
+    ktab[k+4]=ic+sieve_table_[4];
+    ktab[k+5]=ic+sieve_table_[5];
+    ktab[k+6]=ic+sieve_table_[6];
+    ktab[k+7]=ic+sieve_table_[7];
+  }
+  k+=sieve_table_8;
+
+  sieve_table_=sieve_table[(s>>16)&0xFF];
+  sieve_table_8=sieve_table_[8];
+  ic+=8;
+  ktab[k  ]=ic+sieve_table_[0];
+  ktab[k+1]=ic+sieve_table_[1];
+  ktab[k+2]=ic+sieve_table_[2];
+  ktab[k+3]=ic+sieve_table_[3];
+  if(sieve_table_8>4)
+  {
+    ktab[k+4]=ic+sieve_table_[4];
+    ktab[k+5]=ic+sieve_table_[5];
+    ktab[k+6]=ic+sieve_table_[6];
+    ktab[k+7]=ic+sieve_table_[7];
+  }
+  k+=sieve_table_8;
+
+  sieve_table_=sieve_table[ s>>24      ];
+  sieve_table_8=sieve_table_[8];
+  ic+=8;
+  ktab[k  ]=ic+sieve_table_[0];
+  ktab[k+1]=ic+sieve_table_[1];
+  ktab[k+2]=ic+sieve_table_[2];
+  ktab[k+3]=ic+sieve_table_[3];
+  if(sieve_table_8>4)
+  {
+    ktab[k+4]=ic+sieve_table_[4];
+    ktab[k+5]=ic+sieve_table_[5];
+    ktab[k+6]=ic+sieve_table_[6];
+    ktab[k+7]=ic+sieve_table_[7];
+  }
+  k+=sieve_table_8;
+#endif
+  return k;
+}
+
+
+static unsigned int sieve_extract_table(const unsigned int *sieve, unsigned int words, int ic, unsigned int *ktab, unsigned int k)
+/* the classic way, sieve_table lookup for each byte */
+{
+  unsigned int w;
+
+  for(w=0;w<words;w++,ic+=32)
+  {
+    k = sieve_extract_word(sieve[w], ic, ktab, k);
+  }
+  return k;
+}
+
+
+static __inline unsigned int sieve_ctz(unsigned int s)
+/* index of the lowest set bit, s must not be 0 */
+{
+#ifdef _MSC_VER
+  unsigned long idx;
+  _BitScanForward(&idx, s);
+  return (unsigned int)idx;
+#else
+  return (unsigned int)__builtin_ctz(s);
+#endif
+}
+
+
+static unsigned int sieve_extract_ctz(const unsigned int *sieve, unsigned int words, int ic, unsigned int *ktab, unsigned int k)
+/* one bit at a time, no table lookups and no extra stores, fine for very sparse sieves */
+{
+  unsigned int w, s;
+
+  for(w=0;w<words;w++,ic+=32)
+  {
+    s = sieve[w];
+    while(s)
+    {
+      ktab[k++] = ic + sieve_ctz(s);
+      s &= s - 1;
+    }
+  }
+  return k;
+}
+
+
+#ifdef SIEVE_X86
+SIEVE_TARGET("avx2")
+static unsigned int sieve_extract_avx2(const unsigned int *sieve, unsigned int words, int ic, unsigned int *ktab, unsigned int k)
+/* sieve_table lookup as well, but the (up to) 8 offsets of a byte are written
+with a single store */
+{
+  unsigned int w, b, s;
+  __m256i offset;
+
+  for(w=0;w<words;w++)
+  {
+    s = sieve[w];
+    for(b=0;b<4;b++,ic+=8,s>>=8)
+    {
+      offset = _mm256_set1_epi32(ic);
+      _mm256_storeu_si256((__m256i *)&ktab[k], _mm256_add_epi32(offset, _mm256_loadu_si256((const __m256i *)sieve_table[s&0xFF])));
+      k += sieve_table[s&0xFF][8];
     }
+  }
+  return k;
+}
+
+
+SIEVE_TARGET("avx512f")
+static unsigned int sieve_extract_avx512(const unsigned int *sieve, unsigned int words, int ic, unsigned int *ktab, unsigned int k)
+/* VPCOMPRESSD stores the offsets of the set bits of 16 bits at once */
+{
+  unsigned int w, s;
+  const __m512i idx_lo = _mm512_setr_epi32( 0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15);
+  const __m512i idx_hi = _mm512_setr_epi32(16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+  __m512i offset;
+
+  for(w=0;w<words;w++,ic+=32)
+  {
+    s = sieve[w];
+    offset = _mm512_set1_epi32(ic);
+    _mm512_mask_compressstoreu_epi32(&ktab[k], (__mmask16)(s & 0xFFFF), _mm512_add_epi32(offset, idx_lo));
+    k += sieve_table[s & 0xFF][8] + sieve_table[(s >> 8) & 0xFF][8];
+    _mm512_mask_compressstoreu_epi32(&ktab[k], (__mmask16)(s >> 16), _mm512_add_epi32(offset, idx_hi));
+    k += sieve_table[(s >> 16) & 0xFF][8] + sieve_table[s >> 24][8];
+  }
+  return k;
+}
+
+
+static int sieve_cpu_supports(enum SIEVE_EXTRACTORS extractor)
+{
+#ifdef _MSC_VER
+  int info[4];
+  unsigned long long xcr0;
+
+  __cpuid(info, 0);
+  if (info[0] < 7) return 0;
+  __cpuid(info, 1);
+  if ((info[2] & (1 << 27)) == 0) return 0; /* no OSXSAVE */
+  xcr0 = _xgetbv(0);
+  __cpuidex(info, 7, 0);
+  if (extractor == SIEVE_EXTRACT_AVX2)   return ((info[1] & (1 << 5)) != 0)  && ((xcr0 & 0x06) == 0x06);
+  if (extractor == SIEVE_EXTRACT_AVX512) return ((info[1] & (1 << 16)) != 0) && ((xcr0 & 0xE6) == 0xE6);
+  return 0;
+#else
+  __builtin_cpu_init();
+  if (extractor == SIEVE_EXTRACT_AVX2)   return __builtin_cpu_supports("avx2");
+  if (extractor == SIEVE_EXTRACT_AVX512) return __builtin_cpu_supports("avx512f");
+  return 0;
+#endif
+}
+#endif /* SIEVE_X86 */
+
+
+static const char *sieve_extractor_names[] = {"AUTO", "TABLE", "CTZ", "AVX2", "AVX512", "UNKNOWN"};
+
+const char *sieve_extractor_name(enum SIEVE_EXTRACTORS extractor)
+{
+  if (extractor > SIEVE_EXTRACT_UNKNOWN) extractor = SIEVE_EXTRACT_UNKNOWN;
+  return sieve_extractor_names[extractor];
+}
+
+enum SIEVE_EXTRACTORS sieve_extractor_by_name(const char *name)
+/* returns SIEVE_EXTRACT_UNKNOWN if name is not a valid extractor */
+{
+  int i;
+
+  for (i = 0; i < (int)SIEVE_EXTRACT_UNKNOWN; i++)
+  {
+    if (strcasecmp(name, sieve_extractor_names[i]) == 0) return (enum SIEVE_EXTRACTORS)i;
+  }
+  return SIEVE_EXTRACT_UNKNOWN;
+}
+
+int sieve_extractor_supported(enum SIEVE_EXTRACTORS extractor)
+/* can this CPU (and this build) use the extractor? */
+{
+  switch (extractor)
+  {
+    case SIEVE_EXTRACT_AUTO:
+    case SIEVE_EXTRACT_TABLE:
+    case SIEVE_EXTRACT_CTZ:    return 1;
+#ifdef SIEVE_X86
+    case SIEVE_EXTRACT_AVX2:
+    case SIEVE_EXTRACT_AVX512: return sieve_cpu_supports(extractor);
+#endif
+    default:                   return 0;
+  }
+}
+
+enum SIEVE_EXTRACTORS sieve_ctx_set_extractor(sieve_ctx_t *ctx, enum SIEVE_EXTRACTORS extractor)
+/* selects how ctx converts the sieve bits to ktab offsets. AUTO picks the
+fastest one this CPU supports, an unsupported choice falls back to TABLE.
+Returns the extractor actually used. */
+{
+  if (extractor == SIEVE_EXTRACT_AUTO)
+  {
+    if      (sieve_extractor_supported(SIEVE_EXTRACT_AVX512)) extractor = SIEVE_EXTRACT_AVX512;
+    else if (sieve_extractor_supported(SIEVE_EXTRACT_AVX2))   extractor = SIEVE_EXTRACT_AVX2;
+    else                                                      extractor = SIEVE_EXTRACT_TABLE;
+  }
+  else if (!sieve_extractor_supported(extractor))
+  {
+    extractor = SIEVE_EXTRACT_TABLE;
+  }
+
+  switch (extractor)
+  {
+    case SIEVE_EXTRACT_CTZ:    ctx->extract = sieve_extract_ctz;    break;
+#ifdef SIEVE_X86
+    case SIEVE_EXTRACT_AVX2:   ctx->extract = sieve_extract_avx2;   break;
+    case SIEVE_EXTRACT_AVX512: ctx->extract = sieve_extract_avx512; break;
+#endif
+    default:                   ctx->extract = sieve_extract_table;  break;
+  }
+  ctx->extractor = extractor;
+
+  return extractor;
+}
+
+
+void sieve_candidates(sieve_ctx_t *ctx, unsigned int ktab_size, unsigned int *ktab, unsigned int sieve_limit)
+{
+  int i=-1,c=0;
+  unsigned int k=0, n;
+  unsigned int *sieve = ctx->sieve;
+  unsigned int ktab_size33 = ktab_size - 33;
+#ifdef VERBOSE_SIEVE_TIMING
+  struct timeval timer;
+  timer_init(&timer);
+#endif
+
+#ifdef RAW_GPU_BENCH
+//  quick hack to "speed up the siever", used for GPU-code benchmarks
+  for(i=0;i<ktab_size;i++)ktab[i]=i;
+  return;
+#endif
+
+  if(ctx->last_sieve < (int)SIEVE_SIZE)
+  {
+    i=ctx->last_sieve;
+    c=-i;
+    goto _ugly_goto_in_siever;
+  }
+
+#ifdef VERBOSE_SIEVE_TIMING
+  printf("Sieve start: %llu\n", timer_diff(&timer));
+#endif
+
+  while(k<ktab_size)
+  {
+//printf("sieve_candidates(): main loop start\n");
+    sieve_segment(ctx, sieve_limit);
 
 #ifdef VERBOSE_SIEVE_TIMING
   printf("Sieve done: %llu\n", timer_diff(&timer));
@@ -407,7 +1023,7 @@ _ugly_goto_in_siever:
         ktab[k++]=i+c;
         if(k >= ktab_size)
         {
-          last_sieve=i+1;
+          ctx->last_sieve=i+1;
 #ifdef VERBOSE_SIEVE_TIMING
           printf("Return 1   : %llu\n", timer_diff(&timer));
 #endif
@@ -425,88 +1041,13 @@ Get the bits out of the sieve until
 a) we're close the end of the sieve
 or
 b) ktab is nearly filled up */
-    for(;(unsigned int)i<SIEVE_SIZE_FF && k<ktab_size33;i+=32)	// thirty-three!!!
+    while((unsigned int)i<SIEVE_SIZE_FF && k<ktab_size33)	// thirty-three!!!
     {
-      ic=i+c;
-      s=sieve[i>>5];
-//#define SIEVER_OLD_METHOD
-#ifdef SIEVER_OLD_METHOD
-      sieve_table_=sieve_table[ s     &0xFF];
-      for(p=0;p<sieve_table_[8];p++) ktab[k++]=ic   +sieve_table_[p];
-
-      sieve_table_=sieve_table[(s>>8 )&0xFF];
-      for(p=0;p<sieve_table_[8];p++) ktab[k++]=ic +8+sieve_table_[p];
-
-      sieve_table_=sieve_table[(s>>16)&0xFF];
-      for(p=0;p<sieve_table_[8];p++) ktab[k++]=ic+16+sieve_table_[p];
-
-      sieve_table_=sieve_table[ s>>24      ];
-      for(p=0;p<sieve_table_[8];p++) ktab[k++]=ic+24+sieve_table_[p];
-
-#else // not SIEVER_OLD_METHOD
-      sieve_table_=sieve_table[ s     &0xFF];
-      sieve_table_8=sieve_table_[8];
-      ktab[k  ]=ic+sieve_table_[0];
-      ktab[k+1]=ic+sieve_table_[1];
-      ktab[k+2]=ic+sieve_table_[2];
-      ktab[k+3]=ic+sieve_table_[3];
-      if(sieve_table_8>4)
-      {
-        ktab[k+4]=ic+sieve_table_[4];
-        ktab[k+5]=ic+sieve_table_[5];
-        ktab[k+6]=ic+sieve_table_[6];
-        ktab[k+7]=ic+sieve_table_[7];
-      }
-      k+=sieve_table_8;
-
-      sieve_table_=sieve_table[(s>>8 )&0xFF];
-      sieve_table_8=sieve_table_[8];
-      ic+=8;
-      ktab[k  ]=ic+sieve_table_[0];
-      ktab[k+1]=ic+sieve_table_[1];
-      ktab[k+2]=ic+sieve_table_[2];
-      ktab[k+3]=ic+sieve_table_[3];
-      if(sieve_table_8>4)
-      {
-        ktab[k+4]=ic+sieve_table_[4];
-        ktab[k+5]=ic+sieve_table_[5];
-        ktab[k+6]=ic+sieve_table_[6];
-        ktab[k+7]=ic+sieve_table_[7];
-      }
-      k+=sieve_table_8;
-
-      sieve_table_=sieve_table[(s>>16)&0xFF];
-      sieve_table_8=sieve_table_[8];
-      ic+=8;
-      ktab[k  ]=ic+sieve_table_[0];
-      ktab[k+1]=ic+sieve_table_[1];
-      ktab[k+2]=ic+sieve_table_[2];
-      ktab[k+3]=ic+sieve_table_[3];
-      if(sieve_table_8>4)
-      {
-        ktab[k+4]=ic+sieve_table_[4];
-        ktab[k+5]=ic+sieve_table_[5];
-        ktab[k+6]=ic+sieve_table_[6];
-        ktab[k+7]=ic+sieve_table_[7];
-      }
-      k+=sieve_table_8;
-
-      sieve_table_=sieve_table[ s>>24      ];
-      sieve_table_8=sieve_table_[8];
-      ic+=8;
-      ktab[k  ]=ic+sieve_table_[0];
-      ktab[k+1]=ic+sieve_table_[1];
-      ktab[k+2]=ic+sieve_table_[2];
-      ktab[k+3]=ic+sieve_table_[3];
-      if(sieve_table_8>4)
-      {
-        ktab[k+4]=ic+sieve_table_[4];
-        ktab[k+5]=ic+sieve_table_[5];
-        ktab[k+6]=ic+sieve_table_[6];
-        ktab[k+7]=ic+sieve_table_[7];
-      }
-      k+=sieve_table_8;
-#endif
+/* n words can be extracted without checking k in between */
+      n = (ktab_size33 - k - 1) / 32 + 1;
+      if(n > (SIEVE_SIZE_FF - i) >> 5) n = (SIEVE_SIZE_FF - i) >> 5;
+      k = ctx->extract(&sieve[i>>5], n, i+c, ktab, k);
+      i += n << 5;
     }
 #ifdef VERBOSE_SIEVE_TIMING
   printf("Extract 2  : %llu\n", timer_diff(&timer));
@@ -524,7 +1065,7 @@ b) ktab is full */
         ktab[k++]=i+c;
         if(k >= ktab_size)
         {
-          last_sieve=i+1;
+          ctx->last_sieve=i+1;
 #ifdef VERBOSE_SIEVE_TIMING
           printf("Return 2   : %llu\n", timer_diff(&timer));
 #endif
@@ -539,7 +1080,7 @@ b) ktab is full */
 #endif
 
   }
-  last_sieve=i;
+  ctx->last_sieve=i;
 #ifdef VERBOSE_SIEVE_TIMING
   printf("All done   : %llu\n", timer_diff(&timer));
 #endif
@@ -547,6 +1088,95 @@ b) ktab is full */
 }
 
 
+unsigned int sieve_candidates_segment(sieve_ctx_t *ctx, unsigned int *ktab, unsigned int offset, unsigned int sieve_limit)
+/* sieves the next SIEVE_SIZE bits and writes all remaining candidates to ktab
+(bit position + offset). ktab must have room for SIEVE_SIZE+8 entries.
+Returns the number of candidates. Don't mix this with sieve_candidates()
+within a class, this one always works on complete segments. */
+{
+  sieve_segment(ctx, sieve_limit);
+
+  return sieve_extract(ctx, ktab, offset);
+}
+
+
+unsigned int sieve_extract(sieve_ctx_t *ctx, unsigned int *ktab, unsigned int offset)
+/* writes the candidates of the last sieved segment to ktab (bit position +
+offset) without sieving again. ktab must have room for SIEVE_SIZE+8 entries.
+Returns the number of candidates. perftest uses this to measure the
+extraction alone. */
+{
+  unsigned int i, k;
+  unsigned int *sieve = ctx->sieve;
+
+  k = ctx->extract(sieve, SIEVE_SIZE_FF >> 5, (int)offset, ktab, 0);
+  for(i=SIEVE_SIZE_FF;i<SIEVE_SIZE;i++)
+  {
+    if(sieve_get_bit(sieve,i)) ktab[k++]=i+offset;
+  }
+  return k;
+}
+
+
+void sieve_skip_segments(sieve_ctx_t *ctx, unsigned long long int segments, unsigned int sieve_limit)
+/* advances ctx by <segments> complete segments without sieving them */
+{
+  unsigned long long int bits = segments * SIEVE_SIZE;
+  unsigned int i, j, b, n, p, r, pos;
+
+  for(i=0;i<ctx->num_wheels;i++)
+  {
+    ctx->wheel[i].offset = (unsigned int)((ctx->wheel[i].offset + bits) % ctx->wheel[i].period);
+  }
+
+  if(sieve_limit > ctx->bucket_start) sieve_limit = ctx->bucket_start;
+  for(i=ctx->sieve_start;i<sieve_limit;i++)
+  {
+    p=primes[i];
+    r=(unsigned int)(bits%p);
+    if((unsigned int)ctx->k_init[i] >= r) ctx->k_init[i] -= r;
+    else                                  ctx->k_init[i] += p-r;
+  }
+
+  if (ctx->buckets)
+  {
+/* collect all entries with their next hit relative to the current segment
+(always < p), advance them and distribute them again, starting at bucket 0 */
+    if (ctx->bucket_tmp == NULL)
+    {
+      ctx->bucket_tmp = malloc((max_primes - ctx->bucket_start) * sizeof(sieve_bucket_entry_t));
+      if (ctx->bucket_tmp == NULL)
+      {
+        fprintf(stderr, "ERROR: out of memory\n");
+        exit(1);
+      }
+    }
+    n = 0;
+    for(b=0;b<ctx->num_buckets;b++)
+    {
+      sieve_bucket_t *bucket = &ctx->buckets[(ctx->cur_bucket + b) % ctx->num_buckets];
+
+      for(j=0;j<bucket->count;j++)
+      {
+        p   = bucket->entry[j].p;
+        pos = b * SIEVE_SIZE + bucket->entry[j].pos;
+        r   = (unsigned int)(bits%p);
+        ctx->bucket_tmp[n].p   = p;
+        ctx->bucket_tmp[n].pos = (pos >= r) ? pos - r : pos + p - r;
+        n++;
+      }
+      bucket->count = 0;
+    }
+    ctx->cur_bucket = 0;
+    for(j=0;j<n;j++)
+    {
+      pos = ctx->bucket_tmp[j].pos;
+      sieve_bucket_push(&ctx->buckets[pos / SIEVE_SIZE], ctx->bucket_tmp[j].p, pos % SIEVE_SIZE);
+    }
+  }
+}
+
+
 unsigned int sieve_sieve_primes_max(unsigned int exp, unsigned int sieve_max)
 /* returns min(max_global, number of primes below exp) */
 {
@@ -17,6 +17,10 @@ You should have received a copy of the GNU General Public License
 along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#ifndef SIEVE_H_
+#define SIEVE_H_
+#include "my_types.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -24,15 +28,30 @@ extern "C" {
 #ifdef SIEVE_SIZE_LIMIT
 void sieve_init();
 #else
-void sieve_init(unsigned int ssize, unsigned int max_global);
+void sieve_init(unsigned int max_global);
 #endif
-
 void sieve_free();
-void sieve_init_class(unsigned int exp, unsigned long long int k_start, unsigned int sieve_limit);
-void sieve_candidates(unsigned int ktab_size, unsigned int *ktab, unsigned int sieve_limit);
 unsigned int sieve_sieve_primes_max(unsigned int exp, unsigned int max_global);
 
+/* A sieve context holds the state of one class, the prime table set up by
+sieve_init() is shared between all contexts. sieve_ctx_t is declared in
+my_types.h. */
+sieve_ctx_t *sieve_ctx_new(unsigned int ssize, unsigned int bucket_threshold, unsigned int wheel_primes);
+void sieve_ctx_free(sieve_ctx_t *ctx);
+
+void sieve_init_class(sieve_ctx_t *ctx, unsigned int exp, unsigned long long int k_start, unsigned int sieve_limit);
+void sieve_candidates(sieve_ctx_t *ctx, unsigned int ktab_size, unsigned int *ktab, unsigned int sieve_limit);
+unsigned int sieve_candidates_segment(sieve_ctx_t *ctx, unsigned int *ktab, unsigned int offset, unsigned int sieve_limit);
+void sieve_skip_segments(sieve_ctx_t *ctx, unsigned long long int segments, unsigned int sieve_limit);
+unsigned int sieve_extract(sieve_ctx_t *ctx, unsigned int *ktab, unsigned int offset);
+
+/* bit extraction (sieve -> ktab offsets), runtime selected */
+const char *sieve_extractor_name(enum SIEVE_EXTRACTORS extractor);
+enum SIEVE_EXTRACTORS sieve_extractor_by_name(const char *name);
+int sieve_extractor_supported(enum SIEVE_EXTRACTORS extractor);
+enum SIEVE_EXTRACTORS sieve_ctx_set_extractor(sieve_ctx_t *ctx, enum SIEVE_EXTRACTORS extractor);
+
 #ifdef __cplusplus
 }
 #endif
-
+#endif
@@ -0,0 +1,335 @@
+/*
+This file is part of mfaktc (mfakto).
+Copyright (C) 2009 - 2014  Oliver Weihe (o.weihe@t-online.de)
+                           Bertram Franz (bertramf@gmx.net)
+
+mfaktc (mfakto) is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+mfaktc (mfakto) is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+Multi-threaded CPU siever.
+
+A class is split into chunks of SIEVEPOOL_CHUNK_SEGMENTS sieve segments. The
+siever threads take the chunks in ascending order, each thread sieves its
+chunk with its own sieve context and stores the candidates (relative to the
+start of the chunk) in one of the slots. The slots form a bounded queue: a
+thread may only start chunk n once the consumer has reached chunk
+n - num_slots + 1, so the threads run at most num_slots chunks ahead of the
+GPU.
+sievepool_candidates() runs in the host thread and copies the candidates of
+the chunks in order into the ktab, so the ktabs are exactly the same as the
+single-threaded sieve_candidates() would produce.
+
+A thread jumping from chunk n to chunk n+m only needs to advance its k_init
+values by (m-1) chunks (sieve_skip_segments()), that's one modulo per prime.
+*/
+
+#include <cstdlib>
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#ifndef _MSC_VER
+  #include <sched.h>
+#endif
+#if defined _MSC_VER || defined __MINGW32__ || defined __CYGWIN__
+  #include <windows.h>
+#endif
+#include "my_types.h"
+#include "compatibility.h"
+#include "params.h"
+#include "sieve.h"
+#include "sievepool.h"
+#include "output.h"
+
+#define SIEVEPOOL_CHUNK_SEGMENTS 8  /* sieve segments per chunk */
+
+typedef struct _sievepool_slot_t
+{
+  cl_uint *ktab;              /* candidates, offsets relative to the start of the chunk */
+  cl_uint  count, size;       /* number of candidates, allocated entries */
+  cl_ulong chunk;             /* chunk number within the class */
+  int      ready;             /* 1: chunk completely sieved */
+} sievepool_slot_t;
+
+static std::thread            *threads = NULL;
+static sievepool_slot_t       *slots = NULL;
+static cl_uint                 num_threads = 0, num_slots = 0, sieve_size = 0, bucket_threshold = 0, wheel_primes = 0;
+static cl_ulong                cpu_mask = 0;
+static enum SIEVE_EXTRACTORS   extractor = SIEVE_EXTRACT_AUTO;
+
+static std::mutex              pool_lock;
+static std::condition_variable cv_work;   /* signalled to the siever threads */
+static std::condition_variable cv_done;   /* signalled to the host thread */
+
+/* all of these are protected by pool_lock */
+static int                     shutdown_pool = 0;
+static int                     paused = 1;          /* no class set up yet */
+static cl_uint                 busy = 0;            /* threads working on a chunk or initializing */
+static cl_ulong                next_chunk = 0;      /* next chunk to be sieved */
+static cl_ulong                cur_chunk = 0;       /* chunk currently read by sievepool_candidates() */
+static cl_uint                 class_exp = 0, class_sieve_limit = 0;
+static unsigned long long int  class_k_start = 0;
+
+static std::atomic<cl_uint>    generation(0);       /* incremented for each new class, running chunks abort */
+
+/* owned by the host thread */
+static cl_uint                 cur_index = 0;       /* next candidate of slots[cur_chunk % num_slots] */
+static cl_ulong                grid_base = 0;       /* bit position (within the class) of ktab offset 0 */
+
+
+static void sievepool_set_affinity(cl_uint thread_id)
+/* pin siever thread <thread_id> to one of the CPUs of SieveCPUMask, round robin */
+{
+#if !defined __APPLE__
+  cl_uint cpu, n = 0, cpus = 0;
+
+  if (cpu_mask == 0) return;
+
+  for (cpu = 0; cpu < 64; cpu++) if (cpu_mask & (1ULL << cpu)) cpus++;
+  thread_id %= cpus;
+  for (cpu = 0; cpu < 64; cpu++)
+  {
+    if (cpu_mask & (1ULL << cpu))
+    {
+      if (n++ == thread_id) break;
+    }
+  }
+  #if defined _MSC_VER || defined __MINGW32__ || defined __CYGWIN__
+  SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu);
+  #else
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  sched_setaffinity(0, sizeof(set), &set);
+  #endif
+#else
+  (void)thread_id;
+#endif
+}
+
+
+static void sievepool_thread(cl_uint thread_id)
+{
+  sieve_ctx_t *ctx;
+  cl_uint my_generation = 0, exp = 0, sieve_limit = 0, count, s, gen;
+  unsigned long long int k_start = 0;
+  cl_ulong chunk, pos = 0;     /* pos: the chunk ctx is positioned at */
+  int initialized = 0;
+  sievepool_slot_t *slot;
+
+  sievepool_set_affinity(thread_id);
+  ctx = sieve_ctx_new(sieve_size, bucket_threshold, wheel_primes);
+  if (ctx == NULL)
+  {
+    fprintf(stderr, "ERROR: out of memory\n");
+    exit(1);
+  }
+  sieve_ctx_set_extractor(ctx, extractor);
+
+  std::unique_lock<std::mutex> lock(pool_lock);
+  while (!shutdown_pool)
+  {
+    gen = generation.load();
+    if (paused || (initialized && my_generation == gen && next_chunk >= cur_chunk + num_slots))
+    {
+      cv_work.wait(lock);
+      continue;
+    }
+
+    if (!initialized || my_generation != gen)
+    {
+      my_generation = gen;
+      exp = class_exp;
+      k_start = class_k_start;
+      sieve_limit = class_sieve_limit;
+      busy++;
+      lock.unlock();
+
+      sieve_init_class(ctx, exp, k_start, sieve_limit);
+      pos = 0;
+      initialized = 1;
+
+      lock.lock();
+      busy--;
+      cv_done.notify_all();
+      continue;
+    }
+
+    chunk = next_chunk++;
+    slot = &slots[chunk % num_slots];
+    busy++;
+    lock.unlock();
+
+    if (chunk > pos) sieve_skip_segments(ctx, (chunk - pos) * SIEVEPOOL_CHUNK_SEGMENTS, sieve_limit);
+    count = 0;
+    for (s = 0; s < SIEVEPOOL_CHUNK_SEGMENTS && generation.load() == my_generation; s++)
+    {
+      if (slot->size < count + sieve_size + 8)
+      {
+        slot->size = count + sieve_size + 8;
+        slot->ktab = (cl_uint *) realloc(slot->ktab, slot->size * sizeof(cl_uint));
+        if (slot->ktab == NULL)
+        {
+          fprintf(stderr, "ERROR: out of memory\n");
+          exit(1);
+        }
+      }
+      count += sieve_candidates_segment(ctx, slot->ktab + count, s * sieve_size, sieve_limit);
+    }
+    pos = chunk + 1;
+
+    lock.lock();
+    busy--;
+    if (my_generation == generation.load())
+    {
+      slot->count = count;
+      slot->chunk = chunk;
+      slot->ready = 1;
+    }
+    cv_done.notify_all();
+  }
+  lock.unlock();
+
+  sieve_ctx_free(ctx);
+}
+
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int sievepool_init(mystuff_t *mystuff)
+/* start mystuff->sieve_threads siever threads, sieve_init() must have been called before */
+{
+  cl_uint i;
+
+  if (threads) sievepool_free();
+  if (mystuff->sieve_threads == 0) return 0;
+
+  num_threads = mystuff->sieve_threads;
+  num_slots   = 2 * num_threads + 1;
+  sieve_size  = mystuff->sieve_size;
+  bucket_threshold = mystuff->sieve_bucket_threshold;
+  extractor   = mystuff->sieve_extractor;
+  wheel_primes = mystuff->sieve_wheel_primes;
+  cpu_mask    = mystuff->cpu_mask;
+
+  slots = (sievepool_slot_t *) calloc(num_slots, sizeof(sievepool_slot_t));
+  if (slots == NULL) return 1;
+
+  shutdown_pool = 0;
+  paused = 1;
+  busy = 0;
+  threads = new std::thread[num_threads];
+  for (i = 0; i < num_threads; i++)
+  {
+    threads[i] = std::thread(sievepool_thread, i);
+  }
+  if (mystuff->verbosity >= 2) logprintf(mystuff, "Started %u siever threads\n", num_threads);
+
+  return 0;
+}
+
+
+void sievepool_free()
+{
+  cl_uint i;
+
+  if (threads == NULL) return;
+
+  {
+    std::lock_guard<std::mutex> lock(pool_lock);
+    shutdown_pool = 1;
+    generation++;
+  }
+  cv_work.notify_all();
+  for (i = 0; i < num_threads; i++) threads[i].join();
+  delete[] threads;
+  threads = NULL;
+
+  for (i = 0; i < num_slots; i++) free(slots[i].ktab);
+  free(slots);
+  slots = NULL;
+  num_threads = 0;
+}
+
+
+void sievepool_init_class(unsigned int exp, unsigned long long int k_start, unsigned int sieve_limit)
+{
+  cl_uint i;
+  std::unique_lock<std::mutex> lock(pool_lock);
+
+  /* stop the threads from taking new chunks and abort the running ones */
+  paused = 1;
+  generation++;
+  while (busy > 0) cv_done.wait(lock);
+
+  for (i = 0; i < num_slots; i++) slots[i].ready = 0;
+  class_exp = exp;
+  class_k_start = k_start;
+  class_sieve_limit = sieve_limit;
+  next_chunk = 0;
+  cur_chunk = 0;
+  cur_index = 0;
+  grid_base = 0;
+  paused = 0;
+  lock.unlock();
+  cv_work.notify_all();
+}
+
+
+void sievepool_candidates(unsigned int ktab_size, unsigned int *ktab)
+/* same as sieve_candidates(), but the candidates come from the siever threads */
+{
+  cl_uint k = 0, n, i, offset;
+  sievepool_slot_t *slot;
+
+  while (k < ktab_size)
+  {
+    slot = &slots[cur_chunk % num_slots];
+    if (cur_index == 0)
+    {
+      std::unique_lock<std::mutex> lock(pool_lock);
+      while (!(slot->ready && slot->chunk == cur_chunk)) cv_done.wait(lock);
+    }
+
+    n = MIN(ktab_size - k, slot->count - cur_index);
+    /* the offset of chunk cur_chunk relative to this grid fits into 32 bits
+       as long as a grid doesn't span more than 2^32 bits */
+    offset = (cl_uint)(cur_chunk * SIEVEPOOL_CHUNK_SEGMENTS * sieve_size - grid_base);
+    for (i = 0; i < n; i++) ktab[k + i] = slot->ktab[cur_index + i] + offset;
+    k += n;
+    cur_index += n;
+
+    if (cur_index >= slot->count) /* chunk used up, hand out the slot to the next chunk */
+    {
+      {
+        std::lock_guard<std::mutex> lock(pool_lock);
+        slot->ready = 0;
+        cur_chunk++;
+        cur_index = 0;
+      }
+      cv_work.notify_all();
+    }
+  }
+  grid_base += (cl_ulong)ktab[ktab_size - 1] + 1;
+}
+
+#ifdef __cplusplus
+}
+#endif
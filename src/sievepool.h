@@ -0,0 +1,41 @@
+/*
+This file is part of mfaktc (mfakto).
+Copyright (C) 2009 - 2014  Oliver Weihe (o.weihe@t-online.de)
+                           Bertram Franz (bertramf@gmx.net)
+
+mfaktc (mfakto) is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+mfaktc (mfakto) is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef SIEVEPOOL_H_
+#define SIEVEPOOL_H_
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "my_types.h"
+
+/* Pool of CPU siever threads. Each thread has its own sieve context and works
+on consecutive chunks of the current class, sievepool_candidates() hands out
+the results in order. The ktabs are identical to what sieve_candidates()
+produces for the same class. */
+
+int  sievepool_init(mystuff_t *mystuff);
+void sievepool_free();
+void sievepool_init_class(unsigned int exp, unsigned long long int k_start, unsigned int sieve_limit);
+void sievepool_candidates(unsigned int ktab_size, unsigned int *ktab);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
@@ -25,21 +25,25 @@ along with mfaktc (mfakto).  If not, see <http://www.gnu.org/licenses/>.
 #include "my_types.h"
 #include "compatibility.h"
 
-static mystuff_t *signal_handler_mystuff;
+/* the mystuff of each device, ^C quits all of them */
+static mystuff_t *signal_handler_mystuff[MAX_DEVICES];
+static int        signal_handler_num;
 
 void my_signal_handler(int signum)
 {
+    int i;
+
 #ifdef _MSC_VER
     /* Windows resets the signal handler to the default action once it is invoked so we just register it again. */
     signal(signum, &my_signal_handler);
 #endif
 
-    signal_handler_mystuff->quit++;
-    if (signal_handler_mystuff->quit == 1) {
-        printf("\nmfakto will exit once the current %s is finished.\n", signal_handler_mystuff->mode == MODE_NORMAL ? "class" : "test");
+    for (i = 0; i < signal_handler_num; i++) signal_handler_mystuff[i]->quit++;
+    if (signal_handler_mystuff[0]->quit == 1) {
+        printf("\nmfakto will exit once the current %s is finished.\n", signal_handler_mystuff[0]->mode == MODE_NORMAL ? "class" : "test");
         printf("press ^C again to exit immediately\n");
     }
-    if (signal_handler_mystuff->quit > 1) {
+    if (signal_handler_mystuff[0]->quit > 1) {
         printf("mfakto will exit NOW!\n");
         exit(1);
     }
@@ -48,7 +52,10 @@ void my_signal_handler(int signum)
 
 void register_signal_handler(mystuff_t *mystuff)
 {
-    signal_handler_mystuff = mystuff;
+    int i;
+
+    for (i = 0; i < signal_handler_num && signal_handler_mystuff[i] != mystuff; i++);
+    if (i == signal_handler_num && signal_handler_num < MAX_DEVICES) signal_handler_mystuff[signal_handler_num++] = mystuff;
     signal(SIGINT, &my_signal_handler);
     signal(SIGTERM, &my_signal_handler);
 }